@@ -0,0 +1,102 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICABADPIXELS_H
+#define PROSILICABADPIXELS_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "Prosilica.h"
+#include "lima/Debug.h"
+#include "lima/SizeUtils.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class Camera;
+    class FlatFieldCorrection;
+
+    /** @brief replacement of the defective pixels by the mean of their
+	valid neighbours (same Bayer colour for raw frames).
+
+	The defects are kept in sensor coordinates. At each prepare they
+	are remapped to the current roi and binning into a sorted list of
+	frame indexes, each with the indexes of its valid neighbours, so
+	the cost of a frame only depends on the number of defects.
+     */
+    class BadPixelCorrection : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"BadPixelCorrection","Prosilica");
+    public:
+      BadPixelCorrection(Camera*);
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+
+      // sensor coordinates, unbinned
+      void addDefect(int x,int y);
+      void clearDefects();
+      int getNbDefects();
+      void getDefects(std::vector<int>& x,std::vector<int>& y);
+
+      // hot pixels: dark above mean + hot_sigma * rms,
+      // dead pixels: flat - dark below dead_ratio * mean
+      int detect(FlatFieldCorrection&,double hot_sigma = 5.,
+		 double dead_ratio = 0.5);
+
+      virtual void prepare();
+      virtual void process(FrameData&);
+      virtual bool isParallel() const {return true;}
+    private:
+      struct Defect
+      {
+	uint32_t	index;
+	uint32_t	first_neighbour;
+	uint32_t	nb_neighbours;
+      };
+
+      void _buildMap();
+      template<class T> void _correct(T* data);
+
+      Camera*			m_cam;
+      Mutex			m_lock;
+      volatile bool		m_active;
+      std::vector<uint32_t>	m_sensor_defects;	///< sorted y * max_width + x
+      tPvUint32			m_max_width;
+      tPvUint32			m_max_height;
+      bool			m_bayer;
+      int			m_map_width;
+      int			m_map_height;
+      std::vector<Defect>	m_defects;
+      std::vector<uint32_t>	m_neighbours;
+    };
+  }
+}
+#endif
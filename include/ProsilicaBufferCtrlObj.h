@@ -25,9 +25,16 @@
 #ifndef PROSILICABUFFERCTRLOBJ_H
 #define PROSILICABUFFERCTRLOBJ_H
 
+#include <map>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
 #include "Prosilica.h"
+#include "ProsilicaFrameProcessor.h"
 
 #include "lima/HwBufferMgr.h"
+#include "lima/ThreadUtils.h"
 
 namespace lima
 {
@@ -37,23 +44,246 @@ namespace lima
     class SyncCtrlObj;
     class Interface;
 
+    /** @brief what to do when no Lima buffer is free for a new frame,
+	the consumer (processing or saving) being too late
+     */
+    enum OverrunPolicy
+      {
+	OverrunStop,		///< acquisition fault
+	OverrunDrop,		///< newest frames are dropped and counted
+	OverrunDecimate,	///< 1 frame out of n above half occupancy
+      };
+
+    struct OverrunStatus
+    {
+      OverrunStatus();
+
+      int	capacity;		///< frames the Lima buffers can hold
+      int	high_water_mark;	///< max frames waiting for the consumer
+      int	nb_overruns;		///< frames which found no free buffer
+      int	nb_dropped;
+      int	nb_decimated;
+      int	nb_incomplete;		///< frames given to Lima with missing data
+      double	first_overrun_time;	///< since acquisition start, -1 if none
+      double	last_overrun_time;
+    };
+
+    /** @brief what fires a history capture
+     */
+    enum HistoryTrigger
+      {
+	HistorySoftware,	///< BufferCtrlObj::triggerHistory only
+	HistorySyncIn1,		///< rising edge of SyncIn1 (or software)
+	HistorySyncIn2,		///< rising edge of SyncIn2 (or software)
+      };
+
+    struct AccumulationStatus
+    {
+      AccumulationStatus();
+
+      int	nb_saturated_frames;	///< camera frames with saturated pixels
+      long long	nb_saturated_pixels;
+      int	last_saturated_frame;	///< Lima frame nb, -1 if none
+    };
+
+    /** @brief how the software part of the binning combines the pixels
+     */
+    enum SoftwareBinMode
+      {
+	SoftwareBinSum,		///< saturated to the output depth
+	SoftwareBinMean,
+      };
+
     class BufferCtrlObj : public SoftBufferCtrlObj
     {
       friend class Interface;
       DEB_CLASS_NAMESPC(DebModCamera,"BufferCtrlObj","Prosilica");
     public:
       BufferCtrlObj(Camera *cam);
+      ~BufferCtrlObj();
       void prepareAcq();
       void startAcq();
+      void flushFrames();
       void getStatus(tPvErr &err,bool& exposing) {err = m_status,exposing = m_exposing;}
+
+      // number of PvAPI frames queued ahead, 1 keeps a single frame in flight
+      void setNbQueuedFrames(int nb_frames);
+      int getNbQueuedFrames() const {return m_nb_queued_frames;}
+      // newFrameReady is called by batches of up to max size frames,
+      // the batch size adapts to the frame rate to stay within max latency
+      void setMaxBatchSize(int size);
+      int getMaxBatchSize() const {return m_max_batch_size;}
+      void setMaxBatchLatency(double latency);
+      double getMaxBatchLatency() const {return m_max_batch_latency;}
+      int getBatchSize() const {return m_batch_size;}
+
+      // overrun detection needs the last frame consumed downstream,
+      // see ImageStatusTracker
+      void setConsumerTracking(bool);
+      void setLastConsumedFrame(int frame_nb);
+      void setOverrunPolicy(OverrunPolicy);
+      OverrunPolicy getOverrunPolicy() const {return m_overrun_policy;}
+      void setOverrunDecimation(int);
+      int getOverrunDecimation() const {return m_overrun_decimation;}
+      void getOverrunStatus(OverrunStatus&);
+
+      // pre/post-trigger history: the camera streams in a ring of pre
+      // frames until the trigger, Lima then gets the pre frames before
+      // the trigger followed by the post frames (nb_frames = pre + post).
+      // pre = post = 0 disables the history mode
+      void setHistory(int pre_frames,int post_frames);
+      void getHistory(int& pre_frames,int& post_frames) const
+      {pre_frames = m_history_pre,post_frames = m_history_post;}
+      void setHistoryTrigger(HistoryTrigger);
+      HistoryTrigger getHistoryTrigger() const {return m_history_trigger;}
+      void triggerHistory();
+      bool isHistoryTriggered();
+
+      // each Lima frame is the 32 bit sum of nb camera frames,
+      // the output depth must be 32 bits
+      void setAccumulation(int nb_frames);
+      int getAccumulation() const {return m_accumulation;}
+      // camera frames with pixels >= level are counted, 0 disables
+      void setSaturationLevel(int level);
+      int getSaturationLevel() const {return m_saturation_level;}
+      void getAccumulationStatus(AccumulationStatus&);
+
+      // zero-copy access of the application to the Lima buffers: the
+      // buffer of a leased frame is not given back to PvAPI, the camera
+      // frames which would need it follow the overrun policy until
+      // releaseFrame. Leases end with the acquisition (generation)
+      void* leaseFrame(int frame_nb,FrameDim& dim,int& generation);
+      void releaseFrame(int frame_nb,int generation);
+      int getNbLeases();
+      // @return the last frame ready after after_frame_nb, -1 on timeout
+      // (negative: none) or at the end of the acquisition
+      int waitNextFrame(int after_frame_nb,double timeout = -1.);
     private:
+      class _BatchThread;
+      friend class _BatchThread;
+
+      struct HistoryFrame
+      {
+	HistoryFrame(int s,unsigned long long t,double h) :
+	  slot(s),timestamp(t),host_time(h) {}
+	int			slot;
+	unsigned long long	timestamp;
+	double			host_time;
+      };
+
+      static void _cameraEvent(void* context,tPvHandle,
+			       const tPvCameraEvent* events,
+			       unsigned long nb_events);
+      void _prepareHistory(int nb_queued);
+      void _disableTriggerEvent();
+      void _setHistoryTrigger(unsigned long long timestamp);
+      void _freezeHistory(std::vector<HistoryFrame>& pre_frames);
+      bool _historyFrame(tPvFrame*,unsigned long long timestamp,double host_time,
+			 int& frame_nb,std::vector<HistoryFrame>& pre_frames);
+      Timestamp _cameraTime(unsigned long long timestamp) const;
+      void _setFrameTime(HwFrameInfoType&,unsigned long long timestamp,double host_time);
+      static unsigned long long _frameTimestamp(const tPvFrame*);
+
+      void _prepareSoftwareBinning(const FrameDim&,int nb_queued);
+      void _copyFrame(void* dst,const void* raw);
+      void* _limaBuffer(int frame_nb);
+      bool _accumulate(tPvFrame*,int frame_nb);
+      bool _moreFrames() const
+      {return !m_nb_frames || m_next_frame_nb < m_nb_frames || m_next_subframe;}
+
       static void _newFrame(tPvFrame*);
-      
+      void _processFrame(tPvFrame*);
+      bool _processLimaFrame(void* lima_buffer,int frame_nb,const tPvFrame&,
+			     unsigned long long timestamp,double host_time,double now);
+      void _pipelineFrame(FrameData&);
+      void _readyFrame(int frame_nb,HwFrameInfoType&,double now,AutoMutex&);
+      bool _queueFrame(tPvFrame*);
+      int _checkOverrun(int frame_nb);
+      void _updateBatchSize(double now);
+      void _flushBatch();
+      void _batchTimer();
+
+      Camera*		m_cam;
       tPvHandle&      	m_handle;
-      tPvFrame        	m_frame[2];
+      std::vector<tPvFrame> m_frame;
       SyncCtrlObj* 	m_sync;
       tPvErr		m_status;
       bool		m_exposing;
+      int		m_nb_frames;
+      int		m_nb_queued_frames;
+      int		m_next_frame_nb;
+      int		m_next_ready_nb;
+
+      Mutex		m_lock;
+      std::map<int,HwFrameInfoType> m_pending;
+      std::vector<HwFrameInfoType> m_batch;
+      bool		m_batching;
+      int		m_batch_size;
+      int		m_max_batch_size;
+      double		m_max_batch_latency;
+      double		m_batch_start;
+      double		m_last_frame_time;
+      double		m_frame_interval;
+      // the batch thread flushes a batch due while no frame comes
+      Cond		m_batch_cond;
+      _BatchThread*	m_batch_thread;
+      double		m_batch_deadline;	///< -1 without batch
+      bool		m_batch_quit;
+      bool		m_batch_thread_running;
+
+      Mutex		m_consumer_lock;
+      bool		m_consumer_tracking;
+      int		m_last_consumed;
+      OverrunPolicy	m_overrun_policy;
+      int		m_overrun_decimation;
+      OverrunStatus	m_overrun_status;
+      int		m_nb_hw_frames;
+      double		m_start_time;
+      std::vector<char>	m_scratch;
+      std::map<int,int>	m_leases;	///< frame nb -> nb of leases
+      int		m_lease_generation;
+
+      Cond		m_ready_cond;
+      int		m_last_ready;
+      bool		m_running;
+
+      int		m_history_pre;
+      int		m_history_post;
+      HistoryTrigger	m_history_trigger;
+      bool		m_history_active;
+      bool		m_event_registered;
+      unsigned long	m_trigger_event_id;
+      std::vector<char>	m_ring;
+      size_t		m_frame_size;
+      FrameDim		m_frame_dim;
+      // software binning, the camera frames are received in m_raw
+      bool		m_sw_binning;
+      Bin		m_sw_bin;
+      bool		m_sw_bin_mean;
+      int		m_raw_width;
+      int		m_raw_depth;
+      size_t		m_raw_size;
+      std::vector<char>	m_raw;
+      int		m_nb_bin_bands;
+      std::vector<uint32_t> m_bin_rows;
+      Kernels::BinFunction m_bin_function;
+      Kernels::BinFunction m_accumulation_bin;
+
+      int		m_accumulation;
+      int		m_saturation_level;
+      int		m_next_subframe;
+      int		m_queued_frame_nb;
+      std::map<int,int>	m_nb_subframes;
+      std::vector<uint32_t> m_accumulation_tmp;
+      AccumulationStatus m_accumulation_status;
+      std::vector<int>	m_free_slots;
+      std::deque<HistoryFrame> m_history;
+      bool		m_triggered;
+      unsigned long long m_trigger_timestamp;
+      bool		m_frozen;
+      int		m_slot_post_nb;
+      unsigned long long m_start_timestamp;
+      double		m_timestamp_frequency;
     };
   }
 }
@@ -24,7 +24,29 @@
 
 #ifndef PROSILICACAMERA_H
 #define PROSILICACAMERA_H
+#include <pthread.h>
+#include <vector>
+
 #include "Prosilica.h"
+#include "ProsilicaStreamTuning.h"
+#include "ProsilicaBufferCtrlObj.h"
+#include "ProsilicaFrameLease.h"
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaFramePipeline.h"
+#include "ProsilicaPixelFormat.h"
+#include "ProsilicaRoiStatistics.h"
+#include "ProsilicaProjectionProfiles.h"
+#include "ProsilicaWorkerPool.h"
+#include "ProsilicaFlatField.h"
+#include "ProsilicaBadPixels.h"
+#include "ProsilicaLivePreview.h"
+#include "ProsilicaPreviewPyramid.h"
+#include "ProsilicaFrameCompressor.h"
+#include "ProsilicaShmPublisher.h"
+#include "ProsilicaStreamWriter.h"
+#include "ProsilicaFrameRecording.h"
+#include "ProsilicaThreadPolicy.h"
+#include "ProsilicaClockSync.h"
 #include "lima/Debug.h"
 #include "lima/Constants.h"
 #include "lima/HwMaxImageSizeCallback.h"
@@ -35,6 +57,9 @@ namespace lima
   {
     class SyncCtrlObj;
     class VideoCtrlObj;
+    class BufferCtrlObj;
+    struct AcqPlan;
+    struct AcqPrediction;
     class Camera : public HwMaxImageSizeCallbackGen
     {
       friend class Interface;
@@ -53,13 +78,24 @@ namespace lima
       VideoMode getVideoMode() const;
       void 	setVideoMode(VideoMode);
       
+      // the binning reported to Lima, the camera bins what it can and
+      // the remaining factor is done in software
       void checkBin(Bin&);
       void setBin(const Bin&);
       void getBin(Bin&);
+      void getCameraBin(Bin&);
+      void getSoftwareBin(Bin&);
+      void setSoftwareBinMode(SoftwareBinMode);
+      void getSoftwareBinMode(SoftwareBinMode&);
+      // output pixel depth in bits (8, 16 or 32), 0 is the camera one
+      void setOutputDepth(int bits);
+      void getOutputDepth(int& bits);
 
       void checkRoi(const Roi& set_roi, Roi& hw_roi);
       void setRoi(const Roi&);
       void getRoi(Roi&);
+      // roi in camera binned pixels
+      void getCameraRoi(Roi&);
       
       void setGain(double);
       void getGain(double&) const;
@@ -68,16 +104,129 @@ namespace lima
       void getPvGainRange(unsigned long&, unsigned long&) const;
 
       void	getCameraName(std::string& name);
+
+      void	setStreamParameters(const StreamParameters&);
+      void	getStreamParameters(StreamParameters&) const;
+      void	setPacketSize(unsigned long);
+      void	getPacketSize(unsigned long&) const;
+      void	autoTuneStream(int nb_frames,StreamParameters& best,
+			       std::vector<StreamTestResult>* results = NULL);
+      void	saveStreamParameters();
+
+      void	getAcqPlan(AcqPlan&);
+      void	predictAcq(const AcqPlan&,AcqPrediction&);
+      void	setStrictPlanCheck(bool);
+      void	getStrictPlanCheck(bool&);
+      void	setLinkSpeed(double bytes_per_second);
+      void	getLinkSpeed(double&);
+      void	getStopLatency(double& last,double& max);
+
+      void	calibrateTimingModel();
+      void	getTimingModel(double& offset,double& row_time,double& shift_time,
+			       double& byte_time);
+
+      void	setNbQueuedFrames(int);
+      void	getNbQueuedFrames(int&);
+      void	setMaxBatchSize(int);
+      void	getMaxBatchSize(int&);
+      void	setMaxBatchLatency(double);
+      void	getMaxBatchLatency(double&);
+
+      void	setOverrunPolicy(OverrunPolicy);
+      void	getOverrunPolicy(OverrunPolicy&);
+      void	setOverrunDecimation(int);
+      void	getOverrunDecimation(int&);
+      void	getOverrunStatus(OverrunStatus&);
+
+      void	setHistory(int pre_frames,int post_frames);
+      void	getHistory(int& pre_frames,int& post_frames);
+      void	setHistoryTrigger(HistoryTrigger);
+      void	getHistoryTrigger(HistoryTrigger&);
+      void	triggerHistory();
+      bool	isHistoryTriggered();
+
+      void	setAccumulation(int nb_frames);
+      void	getAccumulation(int& nb_frames);
+      void	setSaturationLevel(int level);
+      void	getSaturationLevel(int& level);
+      void	getAccumulationStatus(AccumulationStatus&);
+
+      // zero-copy read of a ready frame, the caller owns the lease
+      FrameLease* leaseFrame(int frame_nb);
+      // @return the last frame ready after after_frame_nb, -1 on timeout
+      // or at the end of the acquisition
+      int	waitNextFrame(int after_frame_nb,double timeout = -1.);
+
+      // live video frames given to Lima per second, 0: all of them
+      void	setVideoMaxRate(double rate);
+      void	getVideoMaxRate(double& rate);
+
+      // in-plugin processing of the frames, before Lima gets them
+      FrameProcessorChain& getFrameProcessors() {return m_processors;}
+      // the processors out of the callback thread when active
+      FramePipeline& getFramePipeline() {return m_pipeline;}
+      RoiStatistics& getRoiStatistics() {return m_roi_statistics;}
+      ProjectionProfiles& getProjectionProfiles() {return *m_profiles;}
+      FlatFieldCorrection& getFlatFieldCorrection() {return *m_flat_field;}
+      BadPixelCorrection& getBadPixelCorrection() {return *m_bad_pixels;}
+      FrameCompressor& getFrameCompressor() {return *m_compressor;}
+      ShmPublisher& getShmPublisher() {return *m_shm_publisher;}
+      StreamWriter& getStreamWriter() {return *m_stream_writer;}
+      LivePreview& getLivePreview() {return m_preview;}
+      PreviewPyramid& getPreviewPyramid() {return m_pyramid;}
+      WorkerPool& getWorkerPool() {return m_workers;}
+      // NULL in video mode
+      BufferCtrlObj* getBufferCtrlObj() {return m_buffer;}
+
+      // the PvAPI frames of the acquisitions, recorded or replayed
+      FrameRecorder& getFrameRecorder() {return m_recorder;}
+      FrameReplayer& getFrameReplayer() {return m_replayer;}
+      tPvErr	queueFrame(tPvFrame*,tPvFrameCallback);
+      tPvErr	clearFrameQueue();
+
+      // camera time stamps on the host clock
+      ClockSync& getClockSync() {return *m_clock_sync;}
+      // @return the wall clock time of the frame time stamp, 0 if unknown
+      double	frameHostTime(const tPvFrame*);
+      // kernels of the pixel format, chosen with the video mode.
+      // a frame of another format (or Bayer order) changes them
+      const FormatKernels& frameFormatKernels(const tPvFrame& frame)
+      {return m_format_kernels->matches(frame) ?
+	  *m_format_kernels : _frameFormatChanged(frame);}
+
+      // cpu affinity and SCHED_FIFO priority of the thread running the
+      // frame callbacks and of the plugin threads (workers, stream writing)
+      void	setCallbackThreadPolicy(const ThreadPolicy&);
+      void	getCallbackThreadPolicy(ThreadPolicy&);
+      void	setWorkerThreadPolicy(const ThreadPolicy&);
+      void	getWorkerThreadPolicy(ThreadPolicy&);
+      // applied by the plugin threads to themselves
+      ThreadPolicyControl& getWorkerThreadControl() {return m_worker_threads;}
+      void	getThreadStates(std::vector<ThreadState>&);
+      void	getCallbackStatus(CallbackStatus&);
+      void	resetCallbackStatus();
+      // around the frame callbacks
+      double	beginCallback();
+      void	endCallback(double start);
 	
       void 	startAcq();
       void	reset();
+      // throws while acquiring
+      void	checkNotRunning();
 
       bool		m_as_master;
 
     private:
       void 		_allocBuffer();
+      int		_cameraBinFactor(const char* attr,int factor);
+      ImageType		_getImageType();
+      SyncCtrlObj*	_getSync();
+      BufferCtrlObj*	_getBuffer();
       static void 	_newFrameCBK(tPvFrame*);
       void		_newFrame(tPvFrame*);
+      void*		_binVideoFrame(const void* raw,int depth,int& width,int& height);
+      void		_updateFormatKernels();
+      const FormatKernels& _frameFormatChanged(const tPvFrame&);
 
       bool 		m_cam_connected;
       tPvHandle		m_handle;
@@ -91,14 +240,46 @@ namespace lima
       tPvUint32		m_uid;
       tPvFrame		m_frame[2];
       Bin         m_bin;
+      Bin         m_sw_bin;
+      SoftwareBinMode m_sw_bin_mode;
+      std::vector<char> m_video_binned;
+      std::vector<uint32_t> m_video_bin_rows;
+      int         m_output_depth;
       Roi         m_roi;
       
       SyncCtrlObj*	m_sync;
       VideoCtrlObj*	m_video;
+      BufferCtrlObj*	m_buffer;
       VideoMode		m_video_mode;
+      const FormatKernels* m_format_kernels;
+      tPvBayerPattern	m_bayer_pattern;	///< only known from the frames
       int		m_acq_frame_nb;
       bool		m_continue_acq;
       bool              m_mono_forced;
+      StreamTuning*	m_stream_tuning;
+      FrameProcessorChain m_processors;
+      RoiStatistics	m_roi_statistics;
+      ProjectionProfiles* m_profiles;
+      ThreadPolicyControl m_callback_threads;
+      ThreadPolicyControl m_worker_threads;
+      WorkerPool	m_workers;
+      FramePipeline	m_pipeline;
+      FlatFieldCorrection* m_flat_field;
+      BadPixelCorrection* m_bad_pixels;
+      FrameCompressor*	m_compressor;
+      ShmPublisher*	m_shm_publisher;
+      StreamWriter*	m_stream_writer;
+      LivePreview	m_preview;
+      PreviewPyramid	m_pyramid;
+      FrameRecorder	m_recorder;
+      FrameReplayer	m_replayer;
+      ClockSync*	m_clock_sync;
+      double		m_video_max_rate;
+      double		m_last_video_time;
+      pthread_t		m_callback_thread;
+      int		m_callback_generation;
+      Mutex		m_callback_lock;
+      CallbackStatus	m_callback_status;
     };
   }
 }
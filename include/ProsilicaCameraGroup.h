@@ -0,0 +1,167 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICACAMERAGROUP_H
+#define PROSILICACAMERAGROUP_H
+
+#include <deque>
+#include <vector>
+#include <atomic>
+
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+#include "lima/CtControl.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaSpscQueue.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class Camera;
+
+    /** @brief a camera frame of a frame set
+     */
+    struct GroupFrame
+    {
+      GroupFrame();
+
+      int		frame_nb;	///< -1 if the camera has no frame in the set
+      unsigned long long camera_timestamp;
+      double		host_timestamp;	///< from the camera clock model, or 0
+      double		timestamp;	///< host time of arrival
+    };
+
+    /** @brief the frames of the cameras of a group taken by the same trigger
+     */
+    struct FrameSet
+    {
+      FrameSet();
+
+      long long		set_nb;
+      bool		complete;	///< a frame of each camera
+      double		time;		///< on the group time base (s)
+      double		skew;		///< max time difference of the frames (s)
+      std::vector<GroupFrame> frames;	///< one per camera, in the order added
+    };
+
+    struct GroupStatus
+    {
+      GroupStatus();
+
+      long long	nb_sets;
+      long long	nb_incomplete;		///< sets missing a camera frame
+      long long	nb_frame_nb_mismatches;	///< complete sets of different frame numbers
+      long long	nb_overflows;		///< frames lost, a camera queue was full
+      long long	nb_lost_sets;		///< sets not taken in time by nextFrameSet
+      double	last_skew;
+      double	max_skew;
+    };
+
+    /** @brief acquisition of several cameras triggered by the same
+	hardware line, with their frames matched in frame sets.
+
+	startAcq() puts every camera in ExtTrigMult trigger mode, prepares
+	them all, then starts them all, so that they are armed before the
+	first trigger. Each camera hands its frames over to the matching
+	thread in a lock-free queue, from its frame callback or pipeline.
+	The frame times of each camera are counted from its first frame
+	(or taken from its clock model when all the cameras have one) and
+	the frames whose times are within the tolerance of the earliest
+	pending one make a set. A camera frame still missing after the
+	timeout makes an incomplete set. The time offset of each camera is
+	corrected with every set to follow the drift of the camera clocks.
+	The frame numbers of a complete set are checked against each other.
+     */
+    class CameraGroup
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"CameraGroup","Prosilica");
+    public:
+      CameraGroup();
+      ~CameraGroup();
+
+      // the camera and the control of its interface, they must outlive the group
+      void add(Camera*,CtControl*);
+      int getNbCameras() const {return int(m_members.size());}
+
+      // max time difference of the frames of a set (default 1 ms)
+      void setTolerance(double tolerance);
+      double getTolerance() const {return m_tolerance;}
+      // wait for a missing camera frame (default 1 s)
+      void setTimeout(double timeout);
+      double getTimeout() const {return m_timeout;}
+      // frames pending per camera (default 64), next acquisition
+      void setQueueSize(int nb_frames);
+      int getQueueSize() const {return m_queue_size;}
+      // sets not yet taken by nextFrameSet (default 1000), older are lost
+      void setMaxSets(int nb_sets);
+      int getMaxSets() const {return m_max_sets;}
+
+      void startAcq();
+      void stopAcq();
+      bool isRunning() const {return m_running;}
+
+      // @return false if no set came within timeout seconds
+      bool nextFrameSet(FrameSet&,double timeout = 0.);
+      void getStatus(GroupStatus&);
+      long long getNbMissing(int camera);
+    private:
+      class _Member;
+      class _MatchThread;
+      friend class _Member;
+      friend class _MatchThread;
+
+      void _wake();
+      bool _match(bool flush,double& wait_time);
+      void _deliver(FrameSet&,bool frame_nb_mismatch);
+      void _run();
+
+      std::vector<_Member*>	m_members;
+      double			m_tolerance;
+      double			m_timeout;
+      int			m_queue_size;
+      int			m_max_sets;
+      volatile bool		m_running;
+      bool			m_host_time;
+
+      Cond			m_cond;
+      _MatchThread*		m_thread;
+      bool			m_flush;
+      bool			m_matching;
+      std::atomic<bool>		m_waiting;
+      std::atomic<long long>	m_nb_pushed;
+      // matching thread
+      std::vector<double>	m_times;
+      std::vector<char>		m_heads;
+
+      Cond			m_sets_cond;
+      std::deque<FrameSet>	m_sets;
+      long long			m_next_set_nb;
+      GroupStatus		m_status;
+    };
+  }
+}
+#endif
@@ -0,0 +1,138 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICACLOCKSYNC_H
+#define PROSILICACLOCKSYNC_H
+
+#include <deque>
+#include <vector>
+
+#include "Prosilica.h"
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief a camera time stamp latched between two host clock reads
+     */
+    struct ClockSample
+    {
+      ClockSample();
+
+      unsigned long long ticks;
+      double	monotonic;	///< CLOCK_MONOTONIC in the middle of the latch (s)
+      double	realtime;	///< CLOCK_REALTIME at the same time (s)
+      double	round_trip;	///< duration of the latch (s)
+    };
+
+    struct ClockSyncStatus
+    {
+      ClockSyncStatus();
+
+      bool	valid;
+      int	nb_samples;		///< in the fit window
+      long long	nb_rejected;		///< round-trip too long
+      double	frequency;		///< fitted tick frequency (Hz)
+      double	drift;			///< against the nominal frequency (ppm)
+      double	rms_residual;		///< of the fit (s)
+      double	max_residual;
+      double	prediction_error;	///< of the last sample by the previous fit (s)
+      double	round_trip;		///< of the last sample (s)
+    };
+
+    /** @brief linear model of the camera time stamp clock on the host clock.
+
+	The sampling thread latches TimeStampValue every period: the camera
+	time is taken in the middle of the two CLOCK_MONOTONIC reads around
+	the latch, the latch with the shortest round-trip of a short burst
+	is kept and the samples slower than 3 times the best one of the
+	window are rejected. A least-squares line through the samples of
+	the window gives the host time of any tick, the last
+	REALTIME - MONOTONIC offset puts it on the wall clock.
+     */
+    class ClockSync
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"ClockSync","Prosilica");
+    public:
+      ClockSync(tPvHandle& handle);
+      ~ClockSync();
+
+      // start or stop the sampling thread
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+      // seconds between two samples (default 1)
+      void setPeriod(double period);
+      double getPeriod() const {return m_period;}
+      // samples of the fit (default 60)
+      void setWindow(int nb_samples);
+      int getWindow() const {return m_window;}
+
+      // forget the samples and the model
+      void reset();
+      // take a sample now
+      void sample();
+      // latch the camera time stamp, serialised with the sampling
+      bool latch(unsigned long long& ticks);
+
+      // O(1), in the frame callbacks
+      // @return false without a model
+      bool toHostTime(unsigned long long ticks,double& realtime);
+      void getStatus(ClockSyncStatus&);
+      void getSamples(std::vector<ClockSample>&);
+    private:
+      class _SampleThread;
+      friend class _SampleThread;
+
+      bool _latch(ClockSample&);
+      void _fit();
+      void _run();
+
+      tPvHandle&	m_handle;
+      volatile bool	m_active;
+      double		m_period;
+      int		m_window;
+
+      Cond		m_cond;
+      _SampleThread*	m_thread;
+      bool		m_quit;
+      bool		m_running;
+
+      Mutex		m_latch_lock;
+      Mutex		m_lock;
+      double		m_nominal_frequency;
+      std::deque<ClockSample> m_samples;
+      // monotonic = m_host_ref + (ticks - m_ticks_ref) * m_tick_period
+      bool		m_valid;
+      unsigned long long m_ticks_ref;
+      double		m_host_ref;
+      double		m_tick_period;
+      double		m_realtime_offset;
+      ClockSyncStatus	m_status;
+    };
+  }
+}
+#endif
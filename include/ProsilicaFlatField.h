@@ -0,0 +1,112 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAFLATFIELD_H
+#define PROSILICAFLATFIELD_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "Prosilica.h"
+#include "lima/Debug.h"
+#include "lima/SizeUtils.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaWorkerPool.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class Camera;
+
+    /** @brief dark subtraction and flat-field normalisation of the
+	Mono8/Mono16 frames, in place.
+
+	The references are averaged acquisitions taken with the camera at
+	the roi and binning of the time. At each prepare they are cut to
+	the current roi and summed to the current binning (a multiple of
+	the reference one) into per-pixel offset and gain maps:
+	corrected = (raw - dark) * mean(flat - dark) / (flat - dark).
+	Frames are corrected by row bands on the worker pool.
+     */
+    class FlatFieldCorrection : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FlatFieldCorrection","Prosilica");
+      friend class BadPixelCorrection;
+    public:
+      FlatFieldCorrection(Camera*,WorkerPool&);
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+
+      // the camera must not be acquiring
+      void acquireDark(int nb_frames);
+      void acquireFlat(int nb_frames);
+      void clearReferences();
+      bool hasDark();
+      bool hasFlat();
+
+      virtual void prepare();
+      virtual void process(FrameData&);
+      virtual bool isParallel() const {return true;}
+    private:
+      struct Reference
+      {
+	Reference() : width(0),height(0) {}
+
+	Roi			roi;
+	Bin			bin;
+	int			width;
+	int			height;
+	std::vector<float>	image;
+      };
+
+      void _getGeometry(Roi&,Bin&,bool camera);
+      void _grabAverage(int nb_frames,Reference&);
+      bool _binReference(const Reference&,const Roi&,const Bin&,
+			 std::vector<float>&);
+      void _buildMaps();
+
+      Camera*			m_cam;
+      tPvHandle&		m_handle;
+      WorkerPool&		m_pool;
+      Mutex			m_lock;
+      volatile bool		m_active;
+      Reference			m_dark;
+      Reference			m_flat;
+      bool			m_maps_valid;
+      bool			m_use_gain;
+      int			m_map_width;
+      int			m_map_height;
+      std::vector<uint8_t>	m_offset8;
+      std::vector<uint16_t>	m_offset16;
+      std::vector<float>	m_offset;
+      std::vector<float>	m_gain;
+    };
+  }
+}
+#endif
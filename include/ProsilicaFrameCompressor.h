@@ -0,0 +1,148 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAFRAMECOMPRESSOR_H
+#define PROSILICAFRAMECOMPRESSOR_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaTripleBuffer.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class WorkerPool;
+
+    /** @brief a frame compressed by chunks of rows.
+
+	data holds the chunk table, nb_chunks then rows_per_chunk then
+	the size of each chunk (uint32), followed by the chunks. Each chunk
+	is the bitshuffled rows (see Kernels::bitshuffle) compressed by the
+	codec, or stored as they are when its size is the size of the rows.
+     */
+    struct CompressedFrame
+    {
+      CompressedFrame();
+
+      long long		index;		///< number of frames compressed before
+      int		frame_nb;
+      double		timestamp;
+      unsigned long long camera_timestamp;
+      int		width;
+      int		height;
+      int		depth;		///< bytes per pixel
+      VideoMode		mode;
+      int		codec;		///< FrameCompressor::Codec
+      size_t		size;		///< bytes used in data
+      std::vector<char>	data;
+    };
+
+    struct CompressionStatus
+    {
+      CompressionStatus();
+
+      long long	nb_frames;
+      long long	raw_bytes;
+      long long	compressed_bytes;
+      double	ratio;			///< raw / compressed bytes
+      double	last_ratio;
+      double	cpu_time;		///< s summed over the chunks
+      double	throughput_per_core;	///< raw bytes per cpu s
+      double	last_duration;		///< s to compress the last frame
+    };
+
+    /** @brief lossless compression of the frames, in parallel on the
+	worker pool by chunks of rows.
+
+	The compressed frame is given to the processors of the Output stage
+	added after it (FrameData::compressed) and kept for getLatest.
+	BitshuffleLz4 and BitshuffleZstd need the plugin built with
+	PROSILICA_ENABLE_LZ4 and PROSILICA_ENABLE_ZSTD; BitshuffleRle,
+	zero runs only, is always there.
+     */
+    class FrameCompressor : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FrameCompressor","Prosilica");
+    public:
+      enum Codec {BitshuffleRle,BitshuffleLz4,BitshuffleZstd};
+
+      FrameCompressor(WorkerPool&);
+      ~FrameCompressor();
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+      static bool isAvailable(Codec);
+      void setCodec(Codec);
+      Codec getCodec() const {return m_codec;}
+      // higher is smaller and slower (default 1): zstd level, LZ4 HC above 1
+      void setLevel(int level);
+      int getLevel() const {return m_level;}
+      // 0: split the frame for the worker pool
+      void setRowsPerChunk(int nb_rows);
+      int getRowsPerChunk() const {return m_rows_per_chunk;}
+
+      void getStatus(CompressionStatus&);
+      void resetStatus();
+      // @return false if no frame was compressed after after_index
+      bool getLatest(CompressedFrame&,long long after_index = -1);
+      // dst holds width * height * depth bytes
+      static void decompress(const CompressedFrame&,void* dst);
+
+      virtual void process(FrameData&);
+    private:
+      struct _Chunk
+      {
+	std::vector<char>	shuffled;
+	std::vector<char>	compressed;
+	size_t			size;
+	double			duration;
+	void*			context;	///< zstd
+	std::vector<char>	lz4_state;	///< LZ4 HC
+      };
+
+      void _compress(_Chunk&,Codec,int level,const char* rows,int nb_pixels,int depth);
+
+      WorkerPool&		m_pool;
+      volatile bool		m_active;
+      Codec			m_codec;
+      int			m_level;
+      int			m_rows_per_chunk;
+      Mutex			m_lock;
+      std::vector<_Chunk>	m_chunks;
+      long long			m_nb_compressed;
+      TripleBuffer<CompressedFrame> m_frames;
+      Mutex			m_read_lock;
+      Mutex			m_status_lock;
+      CompressionStatus		m_status;
+    };
+  }
+}
+#endif
@@ -0,0 +1,73 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAFRAMELEASE_H
+#define PROSILICAFRAMELEASE_H
+
+#include "lima/Debug.h"
+#include "lima/SizeUtils.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class BufferCtrlObj;
+
+    /** @brief a ready frame held in the Lima buffers, read in place.
+	The camera does not overwrite it until release() or destruction.
+     */
+    class FrameLease
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FrameLease","Prosilica");
+    public:
+      FrameLease(BufferCtrlObj&,int frame_nb);
+      ~FrameLease();
+
+      void release();
+      bool isHeld() const {return m_data != NULL;}
+
+      int getFrameNb() const {return m_frame_nb;}
+      const FrameDim& getFrameDim() const {return m_dim;}
+      void* getData() const {return m_data;}
+
+      // views of the frame exported to Python, release() is refused
+      // while one is open
+      void addExport() {++m_nb_exports;}
+      void removeExport() {--m_nb_exports;}
+      int getNbExports() const {return m_nb_exports;}
+    private:
+      FrameLease(const FrameLease&);
+      FrameLease& operator=(const FrameLease&);
+
+      BufferCtrlObj&	m_buffer;
+      int		m_frame_nb;
+      int		m_generation;
+      FrameDim		m_dim;
+      void*		m_data;
+      int		m_nb_exports;
+    };
+  }
+}
+#endif
@@ -0,0 +1,179 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAFRAMEPIPELINE_H
+#define PROSILICAFRAMEPIPELINE_H
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaThreadPolicy.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    struct PipelineStageStatus
+    {
+      PipelineStageStatus();
+
+      std::string	name;
+      bool		parallel;
+      long long		nb_frames;
+      double		last_duration;
+      double		mean_duration;
+      double		max_duration;
+    };
+
+    struct PipelineStatus
+    {
+      PipelineStatus();
+
+      long long	nb_frames;		///< delivered
+      int	in_flight;
+      int	max_in_flight;
+      long long	nb_stalls;		///< submit waited for a free slot
+      double	stall_time;		///< s the callback thread waited
+      double	last_latency;		///< s from submit to delivery
+      double	mean_latency;
+      double	max_latency;
+    };
+
+    /** @brief the frame processors run out of the PvAPI callback thread.
+
+	Each processor stage (Correction, Analysis, Output) is a pipeline
+	stage. A stage whose processors are all parallel
+	(FrameProcessor::isParallel) takes several frames at once, in any
+	order, the others take one frame at a time in submit order. The
+	frames are delivered in submit order after the last stage.
+
+	The stages of the frames are run by a pool of threads, each with
+	its own deque of ready stages: a thread takes its newest one and
+	steals the oldest one of another thread when it runs out.
+	submit() blocks the callback thread while depth frames are in
+	flight (back-pressure), the Lima buffers of the frames in flight
+	must not be reused meanwhile.
+     */
+    class FramePipeline
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FramePipeline","Prosilica");
+    public:
+      typedef std::pair<FrameProcessor::Stage,FrameProcessor*> StageProcessor;
+      typedef std::function<void(FrameData&)> Delivery;
+
+      FramePipeline(ThreadPolicyControl* policy = NULL);
+      ~FramePipeline();
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+      // 0: half the cpus
+      void setNbThreads(int nb_threads);
+      int getNbThreads() const {return m_nb_threads;}
+      void setDepth(int nb_frames);
+      int getDepth() const {return m_depth;}
+
+      // the max frames in flight of an acquisition, <= depth
+      void prepare(int max_in_flight);
+      void submit(const FrameData&,const Delivery&);
+      // wait for the frames in flight
+      void drain();
+
+      void getStatus(PipelineStatus&);
+      void getStageStatus(std::vector<PipelineStageStatus>&);
+      void resetStatus();
+
+      // by FrameProcessorChain, waits for the frames in flight
+      void setProcessors(const std::vector<StageProcessor>&);
+    private:
+      class _Worker;
+      friend class _Worker;
+
+      struct _Job
+      {
+	FrameData	frame;
+	Delivery	delivery;
+	long long	seq;
+	int		stage;
+	double		submit_time;
+      };
+
+      struct _Stage
+      {
+	std::string			name;
+	bool				parallel;
+	std::vector<FrameProcessor*>	processors;
+	long long			next_seq;	///< serial stages
+	std::map<long long,_Job*>	waiting;
+	PipelineStageStatus		status;
+      };
+
+      struct _Queue
+      {
+	Mutex			lock;
+	std::deque<_Job*>	jobs;
+      };
+
+      void _startThreads();
+      void _stopThreads();
+      void _run(int worker);
+      _Job* _take(int worker);
+      void _runStage(_Job*);
+      void _enter(_Job*,int worker);
+      void _push(_Job*,int worker);
+      void _deliver(_Job*);
+      void _waitIdle(AutoMutex&);
+
+      ThreadPolicyControl*	m_policy;
+      volatile bool		m_active;
+      int			m_nb_threads;
+      int			m_depth;
+      int			m_max_in_flight;
+
+      Cond			m_cond;		///< threads, tasks, in flight
+      std::vector<_Worker*>	m_workers;
+      std::vector<_Queue*>	m_queues;
+      int			m_nb_tasks;	///< ready, not taken yet
+      long long			m_nb_pushed;	///< jobs pushed in the queues
+      int			m_nb_running;
+      bool			m_quit;
+      long long			m_next_seq;
+      int			m_in_flight;
+      int			m_next_queue;
+      bool			m_rebuilding;
+
+      Mutex			m_stage_lock;
+      std::vector<_Stage>	m_stages;	///< the last one delivers
+      PipelineStatus		m_status;
+    };
+  }
+}
+#endif
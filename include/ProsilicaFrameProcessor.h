@@ -0,0 +1,107 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAFRAMEPROCESSOR_H
+#define PROSILICAFRAMEPROCESSOR_H
+
+#include <vector>
+
+#include "lima/Debug.h"
+#include "lima/Constants.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaPixelFormat.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    struct CompressedFrame;
+    class FramePipeline;
+
+    /** @brief a frame as received from PvAPI, before Lima gets it
+     */
+    struct FrameData
+    {
+      void*	data;
+      int	width;
+      int	height;
+      int	depth;		///< bytes per pixel
+      VideoMode	mode;
+      PixelLayout layout;	///< with the actual Bayer order
+      int	frame_nb;
+      double	timestamp;	///< host time of arrival
+      unsigned long long camera_timestamp; ///< camera clock ticks
+      double	host_timestamp;	///< camera time stamp on the host clock, or 0
+      const CompressedFrame* compressed; ///< by the FrameCompressor, or NULL
+    };
+
+    /** @brief in-plugin processing of the frames, in the PvAPI callback
+	thread or in the FramePipeline threads. Correction stages may
+	modify the frame in place.
+     */
+    class FrameProcessor
+    {
+    public:
+      enum Stage {Correction,Analysis,Output};
+
+      virtual ~FrameProcessor() {}
+      // before each acquisition, out of the callback thread
+      virtual void prepare() {}
+      virtual void process(FrameData&) = 0;
+      // process may run for several frames at once, in any order
+      virtual bool isParallel() const {return false;}
+      // after each acquisition, once the capture is stopped
+      virtual void finish() {}
+    };
+
+    /** @brief the processors of a camera, run by stage order
+     */
+    class FrameProcessorChain
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FrameProcessorChain","Prosilica");
+    public:
+      FrameProcessorChain();
+
+      // the processors given to the pipeline as they change
+      void setPipeline(FramePipeline*);
+
+      void add(FrameProcessor*,FrameProcessor::Stage);
+      void remove(FrameProcessor*);
+      bool empty() const {return m_empty;}
+      void prepare();
+      void process(FrameData&);
+      void finish();
+    private:
+      typedef std::pair<FrameProcessor::Stage,FrameProcessor*> StageProcessor;
+
+      Mutex			m_lock;
+      std::vector<StageProcessor> m_processors;
+      FramePipeline*		m_pipeline;
+      volatile bool		m_empty;
+    };
+  }
+}
+#endif
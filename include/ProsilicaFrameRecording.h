@@ -0,0 +1,187 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAFRAMERECORDING_H
+#define PROSILICAFRAMERECORDING_H
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "Prosilica.h"
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief recording file of the PvAPI frames.
+
+	A FileHeader block then, for each frame in arrival order, a
+	FrameHeader (the tPvFrame fields and the arrival time in s from
+	the first frame) followed by the ImageSize bytes of the image,
+	padded to 8 bytes. nb_frames and data_size are updated with each
+	frame. All the fields are little endian.
+     */
+    namespace Recording
+    {
+      enum
+	{
+	  MAGIC		= 0x4352504c,	// "LPRC"
+	  VERSION	= 1,
+	  HEADER_SIZE	= 4096,
+	};
+
+      struct FileHeader
+      {
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	nb_frames;
+	uint64_t	data_size;		// after the header
+	double		start_time;		// host time of the first frame
+      };
+
+      struct FrameHeader
+      {
+	uint32_t	size;			// of the record
+	int32_t		status;			// tPvErr
+	int32_t		format;			// tPvImageFormat
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	region_x;
+	uint32_t	region_y;
+	uint32_t	bit_depth;
+	uint32_t	bayer_pattern;
+	uint32_t	frame_count;
+	uint32_t	timestamp_lo;
+	uint32_t	timestamp_hi;
+	uint32_t	image_size;
+	uint32_t	reserved;
+	double		arrival;
+      };
+    }
+
+    /** @brief the PvAPI frames of the acquisitions written, as received,
+	in a memory mapped file of a fixed max size.
+     */
+    class FrameRecorder
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FrameRecorder","Prosilica");
+    public:
+      FrameRecorder();
+      ~FrameRecorder();
+
+      void start(const std::string& path,long long max_size = 1LL << 30);
+      void stop();
+      bool isActive() const {return m_active;}
+      // frames recorded, and not recorded once the file was full
+      long long getNbRecorded();
+      long long getNbDropped();
+
+      // in the PvAPI callback, before the frame is processed
+      void record(const tPvFrame*);
+    private:
+      volatile bool	m_active;
+      Mutex		m_lock;
+      std::string	m_path;
+      int		m_fd;
+      char*		m_map;
+      size_t		m_map_size;
+      size_t		m_offset;
+      double		m_start_time;
+      long long		m_nb_recorded;
+      long long		m_nb_dropped;
+    };
+
+    /** @brief a recording played back instead of the camera frames.
+
+	The frames queued by the plugin are filled, in queue order, with
+	the recorded frames and given to their callback from the replay
+	thread, at the recorded pace divided by speed or, at speed 0, as
+	soon as queued. The roi, binning and pixel format must be the ones
+	of the recording.
+     */
+    class FrameReplayer
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FrameReplayer","Prosilica");
+    public:
+      FrameReplayer();
+      ~FrameReplayer();
+
+      void open(const std::string& path);
+      void close();
+      bool isActive() const {return m_active;}
+      long long getNbFrames() const {return (long long)m_offsets.size();}
+      // 1: recorded pace, 0: as fast as the plugin takes the frames
+      void setSpeed(double speed);
+      double getSpeed() const {return m_speed;}
+      // at the end of the recording start again, or wait
+      void setLoop(bool);
+      bool getLoop() const {return m_loop;}
+      long long getNbReplayed();
+
+      // PvCaptureQueueFrame and PvCaptureQueueClear
+      tPvErr queueFrame(tPvFrame*,tPvFrameCallback);
+      void clear();
+      // the next frame is the first of the recording
+      void rewind();
+    private:
+      class _ReplayThread;
+      friend class _ReplayThread;
+
+      struct Queued
+      {
+	tPvFrame*		frame;
+	tPvFrameCallback	callback;
+      };
+
+      void _run();
+      void _fill(tPvFrame*,const Recording::FrameHeader*);
+
+      volatile bool	m_active;
+      int		m_fd;
+      char*		m_map;
+      size_t		m_map_size;
+      std::vector<size_t> m_offsets;
+
+      Cond		m_cond;
+      _ReplayThread*	m_thread;
+      bool		m_quit;
+      bool		m_running;
+      bool		m_in_callback;		///< clear waits for it
+      pthread_t		m_callback_thread;
+      double		m_speed;
+      bool		m_loop;
+      std::deque<Queued> m_queue;
+      size_t		m_next;
+      double		m_time_base;	///< host time of the recording time 0
+      long long		m_nb_replayed;
+    };
+  }
+}
+#endif
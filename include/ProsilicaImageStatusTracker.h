@@ -0,0 +1,63 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAIMAGESTATUSTRACKER_H
+#define PROSILICAIMAGESTATUSTRACKER_H
+
+#include "lima/Debug.h"
+#include "lima/CtControl.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class Camera;
+
+    /** @brief feeds the buffer overrun detection with the frames
+	consumed downstream.
+
+	Register it on the CtControl of the camera interface
+	(CtControl::registerImageStatusCallback). The last consumed frame
+	is the last image ready or, when tracking saving, the last image
+	saved if behind.
+     */
+    class ImageStatusTracker : public CtControl::ImageStatusCallback
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"ImageStatusTracker","Prosilica");
+    public:
+      ImageStatusTracker(Camera*,bool track_saving = false);
+      virtual ~ImageStatusTracker();
+
+      void setTrackSaving(bool track_saving) {m_track_saving = track_saving;}
+      bool getTrackSaving() const {return m_track_saving;}
+    protected:
+      virtual void imageStatusChanged(const CtControl::ImageStatus&);
+    private:
+      Camera*	m_cam;
+      bool	m_track_saving;
+    };
+  }
+}
+#endif
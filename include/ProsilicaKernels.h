@@ -0,0 +1,87 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAKERNELS_H
+#define PROSILICAKERNELS_H
+
+#include <stdint.h>
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief pixel kernels of the frame processors, SSE2 when the
+	compiler targets it, scalar otherwise.
+	Strides are in pixels.
+     */
+    namespace Kernels
+    {
+      // row and column sums of a width x height window, the rows are
+      // traversed by blocks of columns so that the column sums stay in cache.
+      // @return the max pixel value
+      uint32_t project8(const uint8_t* data,int stride,int width,int height,
+			uint32_t* col_sums,uint32_t* row_sums);
+      uint32_t project16(const uint16_t* data,int stride,int width,int height,
+			 uint32_t* col_sums,uint32_t* row_sums);
+
+      // data = max(data - offset,0)
+      void subtract8(uint8_t* data,const uint8_t* offset,int nb);
+      void subtract16(uint16_t* data,const uint16_t* offset,int nb);
+      // data = (data - offset) * gain, rounded and clamped to the pixel range
+      void correct8(uint8_t* data,const float* offset,const float* gain,int nb);
+      void correct16(uint16_t* data,const float* offset,const float* gain,int nb);
+
+      // acc += data, 32-bit sums
+      void add8(uint32_t* acc,const uint8_t* data,int nb);
+      void add16(uint32_t* acc,const uint16_t* data,int nb);
+      void add32(uint32_t* acc,const uint32_t* data,int nb);
+      // number of pixels >= level
+      int countSaturated8(const uint8_t* data,int nb,uint8_t level);
+      int countSaturated16(const uint16_t* data,int nb,uint16_t level);
+      // bin_x x bin_y binning of the output rows [first_row,last_row) of a
+      // frame of width pixels. Depths are in bytes, the sums are saturated
+      // to the output depth or divided by the bin area (mean).
+      // row is a scratch of width sums
+      void bin(const void* src,int src_depth,int width,int bin_x,int bin_y,
+	       bool mean,void* dst,int dst_depth,int first_row,int last_row,
+	       uint32_t* row);
+
+      // dst = lut[src], lut has an entry for every source value
+      void toneMap16(const uint16_t* src,const uint8_t* lut,uint8_t* dst,int nb);
+
+      // bit planes of nb pixels of depth bytes: plane p (bit p % 8 of
+      // byte p / 8) holds bit i % 8 of pixel i in its byte i / 8, the
+      // nb % 8 last pixels are copied as they are. The unused high bits
+      // of 10 or 12-bit pixels become runs of zero bytes.
+      void bitshuffle(const void* src,void* dst,int nb,int depth);
+      void bitunshuffle(const void* src,void* dst,int nb,int depth);
+
+      // first and second moments of a projection
+      void moments(const uint32_t* sums,int nb,double& total,
+		   double& mean,double& rms);
+    }
+  }
+}
+#endif
@@ -0,0 +1,96 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICALIVEPREVIEW_H
+#define PROSILICALIVEPREVIEW_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaTripleBuffer.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    struct PreviewFrame
+    {
+      PreviewFrame();
+
+      long long		index;		///< number of previews published before
+      int		frame_nb;
+      double		timestamp;
+      int		width;
+      int		height;
+      int		depth;		///< bytes per pixel
+      VideoMode		mode;
+      std::vector<char>	data;
+    };
+
+    /** @brief latest frame, downscaled, at a limited rate.
+
+	The frames (acquisition or live video, after the corrections) are
+	published at most max_rate times per second in a triple buffer:
+	a slow viewer only misses frames, it never delays the acquisition.
+     */
+    class LivePreview : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"LivePreview","Prosilica");
+    public:
+      LivePreview();
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+      // 0: every frame
+      void setMaxRate(double rate);
+      double getMaxRate() const {return m_max_rate;}
+      // mean over factor x factor pixels: 1, 2, 4 or 8 (Mono and Bayer)
+      void setDownscale(int factor);
+      int getDownscale() const {return m_downscale;}
+
+      // @return false if no preview was published after after_index
+      bool getLatest(PreviewFrame&,long long after_index = -1);
+
+      virtual void process(FrameData&);
+    private:
+      volatile bool		m_active;
+      double			m_max_rate;
+      volatile int		m_downscale;
+      double			m_last_publish;
+      long long			m_nb_published;
+      TripleBuffer<PreviewFrame> m_frames;
+      Mutex			m_read_lock;
+      std::vector<uint32_t>	m_row;
+      Kernels::BinFunction	m_bin;
+      int			m_bin_depth;
+      int			m_bin_factor;
+    };
+  }
+}
+#endif
@@ -0,0 +1,112 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAPIXELFORMAT_H
+#define PROSILICAPIXELFORMAT_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "Prosilica.h"
+#include "lima/Constants.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief arrangement of the pixels of a frame
+     */
+    enum PixelLayout
+      {
+	LayoutMono,
+	LayoutBayerRGGB,	///< first row R G, second row G B
+	LayoutBayerGBRG,
+	LayoutBayerGRBG,
+	LayoutBayerBGGR,
+	LayoutRgb,		///< 3 bytes per pixel
+	LayoutBgr,
+      };
+
+    inline bool isBayer(PixelLayout layout)
+    {return layout >= LayoutBayerRGGB && layout <= LayoutBayerBGGR;}
+
+    namespace Kernels
+    {
+      // Kernels::bin of the output rows [first_row,last_row)
+      typedef void (*BinFunction)(const void* src,int width,int bin_x,int bin_y,
+				  void* dst,int first_row,int last_row,uint32_t* row);
+      // 16-bit luminance of the output rows [first_row,last_row): one value
+      // per pixel, or per 2x2 cell of a Bayer mosaic (width / 2 per row)
+      typedef void (*LuminanceFunction)(const void* src,int width,
+					int first_row,int last_row,uint16_t* dst);
+
+      // the instantiation for the depths, bin factors (1, 2 or 4 each)
+      // and mean, Kernels::bin for the other factors or if generic
+      BinFunction selectBin(int src_depth,int dst_depth,int bin_x,int bin_y,
+			    bool mean,bool generic = false);
+      // NULL if the layout and depth have no luminance
+      LuminanceFunction selectLuminance(PixelLayout,int depth);
+      // same result, with the layout and depth tested for each pixel
+      void luminance(PixelLayout,int depth,const void* src,int width,
+		     int first_row,int last_row,uint16_t* dst);
+    }
+
+    /** @brief a PvAPI pixel format, looked up once per format rather
+	than switched on for each frame
+     */
+    struct FormatKernels
+    {
+      tPvImageFormat	format;
+      tPvBayerPattern	pattern;
+      bool		supported;
+      VideoMode		mode;		///< the Bayer orders are all BAYER_RG
+      PixelLayout	layout;
+      int		depth;		///< bytes per pixel
+      Kernels::LuminanceFunction luminance;
+
+      bool matches(const tPvFrame& frame) const
+      {return frame.Format == format &&
+	  (!isBayer(layout) || frame.BayerPattern == pattern);}
+
+      static const FormatKernels& get(tPvImageFormat,tPvBayerPattern = ePvBayerRGGB);
+    };
+
+    /** @brief seconds per frame of a kernel, generic and specialised
+     */
+    struct KernelBenchmark
+    {
+      KernelBenchmark();
+
+      std::string	name;
+      double		generic_time;
+      double		specialised_time;
+    };
+
+    void benchmarkKernels(int width,int height,int nb_iterations,
+			  std::vector<KernelBenchmark>& results);
+  }
+}
+#endif
@@ -0,0 +1,101 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAPREVIEWPYRAMID_H
+#define PROSILICAPREVIEWPYRAMID_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaLivePreview.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief 8-bit previews at 1/2, 1/4 and 1/8 scale of the Mono,
+	Bayer and RGB frames.
+
+	The first level is the luminance of the Bayer cells (in the frame
+	Bayer order) or the 2x2 mean of the mono or RGB luminance, each
+	next level is the 2x2 mean of the previous one, then
+	tone mapped to 8 bits through a lookup table, and published in its
+	own triple buffer: a remote viewer fetches only the level it shows.
+     */
+    class PreviewPyramid : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"PreviewPyramid","Prosilica");
+    public:
+      enum {NB_LEVELS = 3};
+
+      PreviewPyramid();
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+      // 0: every frame
+      void setMaxRate(double rate);
+      double getMaxRate() const {return m_max_rate;}
+      // pixel values from black to white are mapped on 0-255 with a gamma,
+      // white = 0 follows the brightest pixel of the 1/8 level
+      void setToneMapping(int black,int white,double gamma);
+      void getToneMapping(int& black,int& white,double& gamma);
+
+      // level 1, 2 or 3 is the 1/2, 1/4 or 1/8 scale
+      // @return false if no level was published after after_index
+      bool getLevel(int level,PreviewFrame&,long long after_index = -1);
+
+      virtual void process(FrameData&);
+    private:
+      void _updateLut(int depth,int max_value);
+
+      volatile bool		m_active;
+      double			m_max_rate;
+      double			m_last_publish;
+      long long			m_nb_published;
+
+      Mutex			m_lock;
+      int			m_black;
+      int			m_white;
+      double			m_gamma;
+      bool			m_lut_dirty;
+      int			m_lut_depth;
+      int			m_lut_white;
+      std::vector<uint8_t>	m_lut;
+
+      Kernels::BinFunction	m_mean8;
+      Kernels::BinFunction	m_mean16;
+      std::vector<uint16_t>	m_luminance;
+      std::vector<uint16_t>	m_levels16[NB_LEVELS];
+      std::vector<uint32_t>	m_row;
+      TripleBuffer<PreviewFrame> m_levels[NB_LEVELS];
+      Mutex			m_read_lock;
+    };
+  }
+}
+#endif
@@ -0,0 +1,102 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAPROJECTIONPROFILES_H
+#define PROSILICAPROJECTIONPROFILES_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "lima/Debug.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaSeqLock.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief row and column sums of a frame
+     */
+    struct ProfileRecord
+    {
+      ProfileRecord();
+
+      long long			index;	///< position in the stream of profiles
+      int			frame_nb;
+      double			timestamp;
+      std::vector<uint32_t>	cols;	///< sum of each column
+      std::vector<uint32_t>	rows;	///< sum of each row
+    };
+
+    /** @brief horizontal and vertical projections of the Mono and Bayer
+	(raw) frames, kept in a ring of compact records.
+
+	The writer never waits: a slow reader of readProfiles gets the
+	oldest profile still in the ring and the number of lost ones.
+     */
+    class ProjectionProfiles : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"ProjectionProfiles","Prosilica");
+    public:
+      ProjectionProfiles(int max_width,int max_height,int ring_size = 256);
+      virtual ~ProjectionProfiles();
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+
+      // index of the next profile to come
+      long long getNextIndex() const {return m_ring.count();}
+      bool getLastProfile(ProfileRecord&) const;
+      // up to max_nb profiles from next_index, which is updated.
+      // @return the number of profiles lost, overwritten before being read
+      long long readProfiles(long long& next_index,int max_nb,
+			     std::vector<ProfileRecord>&) const;
+
+      virtual void process(FrameData&);
+    private:
+      // the profiles are the payload: columns then rows
+      struct Header
+      {
+	Header() : frame_nb(-1),timestamp(0.),width(0),height(0) {}
+
+	int			frame_nb;
+	double			timestamp;
+	int			width;
+	int			height;
+      };
+
+      bool _read(long long index,ProfileRecord&) const;
+
+      volatile bool		m_active;
+      int			m_max_width;
+      int			m_max_height;
+      SeqLockRing<Header,uint32_t> m_ring;
+      std::vector<uint32_t>	m_cols;
+      std::vector<uint32_t>	m_rows;
+    };
+  }
+}
+#endif
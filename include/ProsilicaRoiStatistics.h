@@ -0,0 +1,104 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAROISTATISTICS_H
+#define PROSILICAROISTATISTICS_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "lima/Debug.h"
+#include "lima/SizeUtils.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaSeqLock.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    struct RoiStatisticsResult
+    {
+      RoiStatisticsResult();
+
+      int	roi_id;
+      int	frame_nb;
+      double	timestamp;
+      double	sum;
+      double	max;
+      double	centroid_x;	///< in frame pixels
+      double	centroid_y;
+      double	rms_x;		///< rms width
+      double	rms_y;
+    };
+
+    /** @brief sum, max, centroid and rms width of Mono8/Mono16 frames
+	over a set of rois, computed from row and column projections.
+
+	The results are read without lock: the latest one or the
+	history_size last ones of each roi.
+     */
+    class RoiStatistics : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"RoiStatistics","Prosilica");
+    public:
+      enum {MAX_ROIS = 16};
+
+      RoiStatistics(int history_size = 4096);
+      virtual ~RoiStatistics();
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+
+      // an empty roi is the full frame. @return the roi id
+      int addRoi(const Roi&);
+      void clearRois();
+      int getNbRois();
+      void getRoi(int roi_id,Roi&);
+
+      bool getLastResult(int roi_id,RoiStatisticsResult&) const;
+      // the last nb results, older first
+      void getHistory(int roi_id,int nb,std::vector<RoiStatisticsResult>&) const;
+
+      virtual void process(FrameData&);
+    private:
+      typedef SeqLockRing<RoiStatisticsResult> ResultRing;
+
+      void _checkRoiId(int roi_id) const;
+      const ResultRing& _getRing(int roi_id) const;
+
+      Mutex			m_lock;
+      volatile bool		m_active;
+      int			m_history_size;
+      std::vector<Roi>		m_rois;
+      ResultRing*		m_rings[MAX_ROIS];
+      std::atomic<long long>	m_first_index[MAX_ROIS];
+      std::vector<uint32_t>	m_col_sums;
+      std::vector<uint32_t>	m_row_sums;
+    };
+  }
+}
+#endif
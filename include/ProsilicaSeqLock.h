@@ -0,0 +1,137 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICASEQLOCK_H
+#define PROSILICASEQLOCK_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief ring of the last results, one writer and lock-free readers.
+
+	Each slot is protected by a sequence number, odd while the writer
+	fills it: a reader copies the slot and retries if the sequence
+	changed meanwhile, the writer never waits.
+	A slot may also hold a payload of up to payload_size elements of
+	type P (profiles, histograms...), filled by the writer and copied
+	out by the reader under the same sequence.
+     */
+    template<class T,class P = char>
+    class SeqLockRing
+    {
+    public:
+      explicit SeqLockRing(int size,int payload_size = 0) :
+	m_size(size),
+	m_slots(new Slot[size]),
+	m_payload_size(payload_size),
+	m_payload(new P[size_t(size) * payload_size]),
+	m_count(0)
+      {}
+      ~SeqLockRing() {delete [] m_slots;delete [] m_payload;}
+
+      int size() const {return m_size;}
+      int payloadSize() const {return m_payload_size;}
+      // number of values pushed so far
+      long long count() const {return m_count.load(std::memory_order_acquire);}
+
+      void push(const T& value) {push(value,_NoPayload());}
+      // fill(P* payload) writes the payload of the value
+      template<class Fill>
+      void push(const T& value,Fill fill)
+      {
+	long long index = m_count.load(std::memory_order_relaxed);
+	Slot& slot = m_slots[index % m_size];
+	unsigned seq = slot.seq.load(std::memory_order_relaxed);
+	slot.seq.store(seq + 1,std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.index = index;
+	slot.value = value;
+	fill(_payload(index));
+	slot.seq.store(seq + 2,std::memory_order_release);
+	m_count.store(index + 1,std::memory_order_release);
+      }
+
+      // @return false if the value was not pushed yet or overwritten
+      bool read(long long index,T& value) const
+      {return read(index,value,_NoPayload());}
+      // copy(const T& value,const P* payload) reads the payload, the
+      // value may be torn: copy must not trust it beyond payload_size
+      template<class Copy>
+      bool read(long long index,T& value,Copy copy) const
+      {
+	if(index < 0 || index >= count())
+	  return false;
+	const Slot& slot = m_slots[index % m_size];
+	for(;;)
+	  {
+	    unsigned seq = slot.seq.load(std::memory_order_acquire);
+	    if(seq & 1)
+	      continue;
+	    long long slot_index = slot.index;
+	    value = slot.value;
+	    copy(value,_payload(index));
+	    std::atomic_thread_fence(std::memory_order_acquire);
+	    if(slot.seq.load(std::memory_order_relaxed) == seq)
+	      return slot_index == index;
+	  }
+      }
+
+      bool latest(T& value) const {return read(count() - 1,value);}
+
+    private:
+      struct Slot
+      {
+	Slot() : seq(0),index(-1) {}
+
+	std::atomic<unsigned>	seq;
+	long long		index;
+	T			value;
+      };
+
+      struct _NoPayload
+      {
+	void operator()(P*) const {}
+	void operator()(const T&,const P*) const {}
+      };
+
+      P* _payload(long long index) const
+      {return m_payload + size_t(index % m_size) * m_payload_size;}
+
+      SeqLockRing(const SeqLockRing&);
+      SeqLockRing& operator=(const SeqLockRing&);
+
+      int			m_size;
+      Slot*			m_slots;
+      int			m_payload_size;
+      P*			m_payload;
+      std::atomic<long long>	m_count;
+    };
+  }
+}
+#endif
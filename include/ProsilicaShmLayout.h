@@ -0,0 +1,89 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICASHMLAYOUT_H
+#define PROSILICASHMLAYOUT_H
+
+#include <stdint.h>
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief layout of the shared memory frame ring (POSIX shm segment),
+	shared with the readers, which don't depend on Lima.
+
+	The segment holds a RingHeader page followed by nb_slots slots of
+	slot_size bytes, each a SlotHeader followed by the pixels at
+	SLOT_DATA_OFFSET. Publication n goes to slot n % nb_slots.
+	Every slot is a seqlock: seq is odd while the writer fills it, a
+	reader copies the slot and keeps the copy only if seq was even and
+	did not change meanwhile. The writer never waits for the readers.
+	All the fields are little endian, the offsets are fixed.
+     */
+    namespace Shm
+    {
+      enum
+	{
+	  MAGIC			= 0x4853504c,	// "LPSH"
+	  VERSION		= 1,
+	  HEADER_SIZE		= 4096,
+	  SLOT_DATA_OFFSET	= 64,
+	};
+
+      struct RingHeader
+      {
+	uint32_t	magic;			// written last
+	uint32_t	version;
+	uint32_t	nb_slots;
+	uint32_t	closed;			// the writer removed the segment
+	uint64_t	slot_size;		// page aligned
+	uint64_t	max_data_size;
+	uint64_t	timestamp_frequency;	// camera ticks per second, 0 if unknown
+	uint64_t	nb_published;		// frames published so far
+      };
+
+      struct SlotHeader
+      {
+	uint64_t	seq;			// odd while written
+	uint64_t	index;			// publication number
+	int32_t		frame_nb;
+	int32_t		width;
+	int32_t		height;
+	int32_t		depth;			// bytes per pixel
+	int32_t		mode;			// lima::VideoMode
+	uint32_t	data_size;
+	uint64_t	camera_timestamp;	// camera clock ticks
+	double		timestamp;		// host time of arrival
+      };
+
+      inline uint64_t load(const uint64_t* p)
+      {return __atomic_load_n(p,__ATOMIC_ACQUIRE);}
+      inline void store(uint64_t* p,uint64_t v)
+      {__atomic_store_n(p,v,__ATOMIC_RELEASE);}
+    }
+  }
+}
+#endif
@@ -0,0 +1,89 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICASHMPUBLISHER_H
+#define PROSILICASHMPUBLISHER_H
+
+#include <string>
+
+#include "Prosilica.h"
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaShmLayout.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class Camera;
+
+    /** @brief every frame, with its metadata, in a shared memory ring
+	that any number of local processes read without blocking the
+	acquisition (see ProsilicaShmLayout.h and ProsilicaShmReader.h).
+     */
+    class ShmPublisher : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"ShmPublisher","Prosilica");
+    public:
+      ShmPublisher(Camera*);
+      ~ShmPublisher();
+
+      // creates or removes the segment
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+      // POSIX shm name, default /lima_prosilica_<camera unique id>
+      void setName(const std::string&);
+      void getName(std::string&);
+      void setNbSlots(int nb_slots);
+      int getNbSlots() const {return m_nb_slots;}
+
+      long long getNbPublished();
+      int getNbDropped() const {return m_nb_dropped;}
+
+      virtual void prepare();
+      virtual void process(FrameData&);
+    private:
+      size_t _expectedFrameSize();
+      void _open(size_t max_data_size);
+      void _close();
+
+      Camera*		m_cam;
+      tPvHandle&	m_handle;
+      Mutex		m_lock;
+      volatile bool	m_active;
+      std::string	m_name;
+      int		m_nb_slots;
+      int		m_fd;
+      char*		m_base;
+      size_t		m_map_size;
+      Shm::RingHeader*	m_header;
+      unsigned long long m_nb_published;
+      int		m_nb_dropped;
+    };
+  }
+}
+#endif
@@ -0,0 +1,217 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICASHMREADER_H
+#define PROSILICASHMREADER_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ProsilicaShmLayout.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    namespace Shm
+    {
+      struct Frame
+      {
+	uint64_t		index;
+	int			frame_nb;
+	int			width;
+	int			height;
+	int			depth;
+	int			mode;
+	uint64_t		camera_timestamp;
+	double			timestamp;
+	std::vector<char>	data;
+      };
+
+      /** @brief reader of the frame ring of a ShmPublisher, header only,
+	  without Lima or PvAPI dependency. Readers never block the writer:
+	  a reader too slow for the ring size loses the overwritten frames.
+
+	  Reader reader("/lima_prosilica_123456");
+	  Frame frame;
+	  for(uint64_t next = reader.nbPublished();;next = frame.index + 1)
+	    if(reader.waitFrame(next,frame,1.) == Reader::Overwritten)
+	      ...
+       */
+      class Reader
+      {
+      public:
+	enum Status {Ok,NotYet,Overwritten,Closed};
+
+	explicit Reader(const std::string& name) :
+	  m_name(name),m_base(NULL),m_map_size(0),m_header(NULL)
+	{_open();}
+	~Reader() {_close();}
+
+	bool isOpen() {return _check();}
+	uint64_t nbPublished()
+	{return _check() ? load(&m_header->nb_published) : 0;}
+	uint64_t timestampFrequency()
+	{return _check() ? m_header->timestamp_frequency : 0;}
+
+	// copy publication index out of the ring
+	Status read(uint64_t index,Frame& frame)
+	{
+	  if(!_check())
+	    return Closed;
+	  uint64_t nb_published = load(&m_header->nb_published);
+	  if(index >= nb_published)
+	    return NotYet;
+	  if(nb_published - index > m_header->nb_slots)
+	    return Overwritten;
+
+	  const char* slot = (const char*)m_base + HEADER_SIZE +
+	    (index % m_header->nb_slots) * m_header->slot_size;
+	  const SlotHeader* header = (const SlotHeader*)slot;
+	  for(;;)
+	    {
+	      uint64_t seq = load(&header->seq);
+	      if(seq & 1)
+		{
+		  sched_yield();
+		  continue;
+		}
+	      SlotHeader copy;
+	      memcpy(&copy,header,sizeof(copy));
+	      size_t data_size = std::min<size_t>(copy.data_size,m_header->max_data_size);
+	      frame.data.resize(data_size);
+	      if(data_size)
+		memcpy(&frame.data[0],slot + SLOT_DATA_OFFSET,data_size);
+	      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+	      if(__atomic_load_n(&header->seq,__ATOMIC_RELAXED) != seq)
+		continue;
+	      if(copy.index != index)
+		return Overwritten;
+	      frame.index = copy.index;
+	      frame.frame_nb = copy.frame_nb;
+	      frame.width = copy.width;
+	      frame.height = copy.height;
+	      frame.depth = copy.depth;
+	      frame.mode = copy.mode;
+	      frame.camera_timestamp = copy.camera_timestamp;
+	      frame.timestamp = copy.timestamp;
+	      return Ok;
+	    }
+	}
+
+	// the last frame published
+	Status readLatest(Frame& frame)
+	{
+	  uint64_t nb_published = nbPublished();
+	  return nb_published ? read(nb_published - 1,frame) : NotYet;
+	}
+
+	// poll until index is published, timeout < 0 waits forever
+	Status waitFrame(uint64_t index,Frame& frame,double timeout = -1.)
+	{
+	  double end = _now() + timeout;
+	  for(;;)
+	    {
+	      Status status = read(index,frame);
+	      if(status != NotYet && status != Closed)
+		return status;
+	      if(timeout >= 0. && _now() >= end)
+		return status;
+	      struct timespec pause = {0,100000};
+	      nanosleep(&pause,NULL);
+	    }
+	}
+
+      private:
+	Reader(const Reader&);
+	Reader& operator=(const Reader&);
+
+	static double _now()
+	{
+	  struct timespec t;
+	  clock_gettime(CLOCK_MONOTONIC,&t);
+	  return t.tv_sec + t.tv_nsec * 1e-9;
+	}
+
+	void _open()
+	{
+	  int fd = shm_open(m_name.c_str(),O_RDONLY,0);
+	  if(fd < 0)
+	    return;
+	  struct stat st;
+	  void* base = MAP_FAILED;
+	  if(!fstat(fd,&st) && size_t(st.st_size) >= HEADER_SIZE)
+	    base = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	  close(fd);
+	  if(base == MAP_FAILED)
+	    return;
+	  const RingHeader* header = (const RingHeader*)base;
+	  if(__atomic_load_n(&header->magic,__ATOMIC_ACQUIRE) != MAGIC ||
+	     header->version != VERSION ||
+	     HEADER_SIZE + header->slot_size * header->nb_slots > size_t(st.st_size))
+	    {
+	      munmap(base,st.st_size);
+	      return;
+	    }
+	  m_base = base;
+	  m_map_size = st.st_size;
+	  m_header = header;
+	}
+
+	void _close()
+	{
+	  if(m_base)
+	    munmap(m_base,m_map_size);
+	  m_base = NULL;
+	  m_header = NULL;
+	}
+
+	// follow the writer to a new segment
+	bool _check()
+	{
+	  if(m_header && __atomic_load_n(&m_header->closed,__ATOMIC_ACQUIRE))
+	    _close();
+	  if(!m_header)
+	    _open();
+	  return m_header != NULL;
+	}
+
+	std::string		m_name;
+	void*			m_base;
+	size_t			m_map_size;
+	const RingHeader*	m_header;
+      };
+    }
+  }
+}
+#endif
@@ -0,0 +1,94 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICASPSCQUEUE_H
+#define PROSILICASPSCQUEUE_H
+
+#include <atomic>
+#include <vector>
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief bounded FIFO between one producer and one consumer thread,
+	neither of them ever waits or takes a lock.
+
+	The producer push()es, a full queue refuses the value. The consumer
+	reads front() and pop()s it once used.
+     */
+    template<class T>
+    class SpscQueue
+    {
+    public:
+      explicit SpscQueue(size_t capacity = 0) : m_head(0),m_tail(0) {resize(capacity);}
+
+      // both sides idle
+      void resize(size_t capacity)
+      {
+	m_slots.assign(capacity + 1,T());
+	m_head.store(0,std::memory_order_relaxed);
+	m_tail.store(0,std::memory_order_relaxed);
+      }
+      size_t capacity() const {return m_slots.size() - 1;}
+
+      // producer side
+      // @return false if the queue is full
+      bool push(const T& value)
+      {
+	size_t tail = m_tail.load(std::memory_order_relaxed);
+	size_t next = tail + 1 == m_slots.size() ? 0 : tail + 1;
+	if(next == m_head.load(std::memory_order_acquire))
+	  return false;
+	m_slots[tail] = value;
+	m_tail.store(next,std::memory_order_release);
+	return true;
+      }
+
+      // consumer side
+      bool empty() const
+      {return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);}
+      T& front() {return m_slots[m_head.load(std::memory_order_relaxed)];}
+      void pop()
+      {
+	size_t head = m_head.load(std::memory_order_relaxed);
+	m_head.store(head + 1 == m_slots.size() ? 0 : head + 1,std::memory_order_release);
+      }
+
+    private:
+      SpscQueue(const SpscQueue&);
+      SpscQueue& operator=(const SpscQueue&);
+
+      std::vector<T>		m_slots;
+      // padded apart, each side writes only one of them
+      char			m_pad0[64];
+      std::atomic<size_t>	m_head;
+      char			m_pad1[64 - sizeof(std::atomic<size_t>)];
+      std::atomic<size_t>	m_tail;
+      char			m_pad2[64 - sizeof(std::atomic<size_t>)];
+    };
+  }
+}
+#endif
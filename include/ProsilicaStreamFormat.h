@@ -0,0 +1,99 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICASTREAMFORMAT_H
+#define PROSILICASTREAMFORMAT_H
+
+#include <stdint.h>
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief container files of the StreamWriter.
+
+	A file is a FileHeader block followed by the records, each a
+	RecordHeader and the frame data at RECORD_DATA_OFFSET, padded to a
+	multiple of BLOCK_SIZE and at most record_size bytes: the pixels, or
+	the CompressedFrame data when codec is not 0. Then comes the index,
+	one IndexEntry per record,
+	frame_nb = -1 for a record which failed. nb_records and
+	index_offset are only set when the file is closed, records are
+	self-describing (RECORD_MAGIC) for the files of an interrupted
+	acquisition. All the fields are little endian.
+     */
+    namespace Stream
+    {
+      enum
+	{
+	  MAGIC			= 0x4653504c,	// "LPSF"
+	  RECORD_MAGIC		= 0x5253504c,	// "LPSR"
+	  VERSION		= 1,
+	  BLOCK_SIZE		= 4096,
+	  HEADER_SIZE		= 4096,
+	  RECORD_DATA_OFFSET	= 64,
+	};
+
+      struct FileHeader
+      {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	file_nb;
+	uint32_t	max_records;
+	uint64_t	record_size;		// max
+	uint64_t	nb_records;		// 0 until closed
+	uint64_t	index_offset;		// 0 until closed
+	uint64_t	timestamp_frequency;	// camera ticks per second
+	int32_t		width;
+	int32_t		height;
+	int32_t		depth;			// bytes per pixel
+	int32_t		mode;			// lima::VideoMode
+      };
+
+      struct RecordHeader
+      {
+	uint32_t	magic;
+	int32_t		frame_nb;
+	int32_t		width;
+	int32_t		height;
+	int32_t		depth;
+	int32_t		mode;
+	uint32_t	data_size;
+	uint32_t	codec;			// 0: raw, FrameCompressor::Codec + 1
+	uint64_t	camera_timestamp;	// camera clock ticks
+	double		timestamp;		// host time of arrival
+      };
+
+      struct IndexEntry
+      {
+	int64_t		frame_nb;
+	uint64_t	offset;			// of the record
+	uint64_t	camera_timestamp;
+	double		timestamp;
+      };
+    }
+  }
+}
+#endif
@@ -0,0 +1,105 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#ifndef PROSILICASTREAMTUNING_H
+#define PROSILICASTREAMTUNING_H
+
+#include <string>
+#include <vector>
+
+#include "Prosilica.h"
+#include "lima/Debug.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief GigE streaming parameters of a camera.
+	A zero value (or a negative resend percent) means "driver default",
+	the parameter is then left untouched by StreamTuning::apply.
+     */
+    struct StreamParameters
+    {
+      StreamParameters();
+
+      unsigned long	packet_size;
+      bool		stream_hold;
+      float		resend_percent;
+      unsigned long	lookback_window;
+      unsigned long	retries;
+      unsigned long	timeout;
+    };
+
+    /** @brief result of a short test acquisition
+     */
+    struct StreamTestResult
+    {
+      StreamTestResult();
+
+      StreamParameters	params;
+      int		nb_frames;
+      int		nb_completed;
+      int		nb_dropped;
+      unsigned long	packets_received;
+      unsigned long	packets_missed;
+      unsigned long	packets_resent;
+      double		frame_rate;
+      double		throughput;	// bytes per second
+      double		loss_ratio;
+    };
+
+    /** @brief packet-size and resend tuning of the GigE stream.
+
+	The best set found by autoTune is stored per camera unique id and
+	host interface in the directory given by the environment variable
+	LIMA_PROSILICA_TUNING_DIR (default $HOME/.lima/prosilica).
+     */
+    class StreamTuning
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"StreamTuning","Prosilica");
+    public:
+      StreamTuning(tPvHandle& handle,tPvUint32 uid);
+
+      void getHostInterface(std::string&) const;
+
+      void apply(const StreamParameters&);
+      void read(StreamParameters&) const;
+
+      bool load(StreamParameters&) const;
+      void save(const StreamParameters&) const;
+
+      void test(const StreamParameters&,int nb_frames,StreamTestResult&);
+      void autoTune(int nb_frames,StreamParameters& best,
+		    std::vector<StreamTestResult>* results = NULL);
+    private:
+      std::string _storePath() const;
+      void _grab(int nb_frames,StreamTestResult&);
+      static bool _better(const StreamTestResult&,const StreamTestResult&);
+
+      tPvHandle&	m_handle;
+      tPvUint32		m_uid;
+    };
+  }
+}
+#endif
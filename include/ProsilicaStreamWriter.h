@@ -0,0 +1,176 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICASTREAMWRITER_H
+#define PROSILICASTREAMWRITER_H
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Prosilica.h"
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaStreamFormat.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class Camera;
+
+    struct StreamWriterStatus
+    {
+      StreamWriterStatus();
+
+      long long	nb_written;
+      long long	nb_bytes;
+      int	nb_dropped;		///< no free buffer
+      int	nb_errors;		///< failed writes
+      int	nb_files;
+      int	queue_depth;		///< frames waiting or being written
+      int	max_queue_depth;
+      double	last_latency;		///< s from the frame arrival to its write
+      double	mean_latency;
+      double	max_latency;
+    };
+
+    /** @brief the frames of the acquisitions streamed to disk, bypassing
+	the Lima saving and the page cache.
+
+	Each frame is copied in one of nb_buffers aligned buffers (the
+	memory bound, a frame finding none is dropped) and written by
+	io_uring (built with PROSILICA_ENABLE_IO_URING) or by a pool of
+	threads, with O_DIRECT when the file system allows it, into
+	preallocated files of frames_per_file records (see
+	ProsilicaStreamFormat.h) named <directory>/<prefix><file nb>.lpsf.
+	When the FrameCompressor is active, its compressed frames are
+	written instead of the pixels.
+     */
+    class StreamWriter : public FrameProcessor
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"StreamWriter","Prosilica");
+    public:
+      StreamWriter(Camera*);
+      ~StreamWriter();
+
+      void setActive(bool);
+      bool isActive() const {return m_active;}
+      void setDirectory(const std::string&);
+      void getDirectory(std::string&) const;
+      // the file numbers restart at 0 when the prefix or directory changes
+      void setPrefix(const std::string&);
+      void getPrefix(std::string&) const;
+      void setFramesPerFile(int nb_frames);
+      int getFramesPerFile() const {return m_frames_per_file;}
+      void setNbBuffers(int nb_buffers);
+      int getNbBuffers() const {return m_nb_buffers;}
+      // writing threads without io_uring
+      void setNbThreads(int nb_threads);
+      int getNbThreads() const {return m_nb_threads;}
+      static bool hasIoUring();
+
+      void getStatus(StreamWriterStatus&);
+
+      virtual void prepare();
+      virtual void process(FrameData&);
+      virtual void finish();
+    private:
+      class _IoThread;
+      friend class _IoThread;
+
+      struct File
+      {
+	int		nb;
+	int		fd;		///< -1: not open yet, -2: failed
+	size_t		record_size;	///< max
+	uint64_t	next_offset;
+	int		width;
+	int		height;
+	int		depth;
+	int		mode;
+	int		nb_records;	///< assigned to frames
+	int		nb_pending;
+	bool		full;
+	std::vector<Stream::IndexEntry> index;
+      };
+
+      struct Request
+      {
+	int		buffer;		///< -1: close the file
+	File*		file;
+	int		record;
+	uint64_t	offset;
+	size_t		size;
+	int		frame_nb;
+	unsigned long long camera_timestamp;
+	double		timestamp;
+	double		submit_time;
+      };
+
+      void _checkIdle();
+      void _start();
+      void _run();
+      void _runThreads(AutoMutex&);
+#ifdef PROSILICA_WITH_IO_URING
+      void _runIoUring(AutoMutex&);
+#endif
+      void _push(const Request&);
+      int _fileFd(File*);
+      bool _write(const Request&);
+      File* _complete(const Request&,bool ok);
+      void _close(File*);
+
+      Camera*		m_cam;
+      volatile bool	m_active;
+      std::string	m_directory;
+      std::string	m_prefix;
+      int		m_frames_per_file;
+      int		m_nb_buffers;
+      int		m_nb_threads;
+      int		m_next_file_nb;
+      unsigned long long m_timestamp_frequency;
+
+      Cond		m_cond;
+      bool		m_running;
+      bool		m_quit;
+      int		m_nb_io_threads;
+      std::vector<_IoThread*> m_io_threads;
+      std::vector<char*> m_buffers;
+      std::vector<size_t> m_buffer_sizes;
+      std::vector<int>	m_free_buffers;
+      std::deque<Request> m_queue;
+      File*		m_file;		///< receiving the frames
+      std::set<File*>	m_files;	///< created and not closed
+      Mutex		m_file_lock;
+      StreamWriterStatus m_status;
+      int		m_nb_latencies;
+    };
+  }
+}
+#endif
@@ -26,9 +26,13 @@
 #define PROSILICASYNCCTRLOBJ_H
 
 #include "Prosilica.h"
+#include "ProsilicaTimingModel.h"
 
 #include "lima/HwSyncCtrlObj.h"
 #include "lima/HwInterface.h"
+#include "lima/SizeUtils.h"
+#include "lima/Constants.h"
+#include "lima/ThreadUtils.h"
 
 namespace lima
 {
@@ -37,6 +41,48 @@ namespace lima
     class Camera;
     class BufferCtrlObj;
 
+    /** @brief a planned acquisition, as it would be prepared.
+	exp_time and lat_time are the ones of each camera frame, a Lima
+	frame is the sum of accumulation camera frames.
+     */
+    struct AcqPlan
+    {
+      AcqPlan();
+
+      Roi	roi;
+      Bin	bin;
+      VideoMode	video_mode;
+      double	exp_time;
+      double	lat_time;
+      int	nb_frames;
+      TrigMode	trig_mode;
+      int	accumulation;
+    };
+
+    /** @brief what the camera and the link can sustain for an AcqPlan
+	requested_frame_rate is 0 when the rate is given by the triggers.
+	frame_rate and requested_frame_rate count Lima frames, the other
+	rates camera frames (accumulation times more).
+     */
+    struct AcqPrediction
+    {
+      enum LimitingFactor {Requested,Exposure,Readout,Bandwidth};
+
+      AcqPrediction();
+
+      double		frame_rate;
+      double		requested_frame_rate;
+      double		camera_frame_rate;
+      double		effective_exp_time;	// of a Lima frame
+      double		max_readout_rate;
+      double		max_bandwidth_rate;
+      double		link_utilisation;
+      double		data_rate;	// bytes per second
+      long long		frame_size;	// camera frame
+      long long		buffer_memory;	// Lima frames
+      LimitingFactor	limiting_factor;
+    };
+
     class SyncCtrlObj : public HwSyncCtrlObj
     {
       DEB_CLASS_NAMESPC(DebModCamera,"SyncCtrlObj","Prosilica");
@@ -64,13 +110,36 @@ namespace lima
 
       void startAcq();
       void stopAcq(bool clearQueue = true);
+      // from the PvAPI callbacks: the capture is ended by the stop thread
+      void requestStop(bool clearQueue = false);
+      // last frame to ready for the next acquisition, in s
+      void getStopLatency(double& last,double& max);
       
       void getStatus(HwInterface::StatusType&);
 
       void updateValidRanges(bool force_init=false);
       void adjustFrameRate();
 
+      void getAcqPlan(AcqPlan&);
+      void predictAcq(const AcqPlan&,AcqPrediction&);
+      void checkAcqPlan();
+
+      void setStrictPlanCheck(bool strict) {m_strict_plan_check = strict;}
+      bool getStrictPlanCheck() const {return m_strict_plan_check;}
+      void setLinkSpeed(double bytes_per_second);
+      double getLinkSpeed() const {return m_link_speed;}
+
+      TimingModel& getTimingModel() {return m_timing;}
+
     private:
+      class _StopThread;
+      friend class _StopThread;
+
+      void _stopCapture(bool clearQueue);
+      void _waitStopDone(AutoMutex&);
+      void _getPlanImageSize(const AcqPlan&,int& width,int& height);
+      double _maxReadoutRate(const AcqPlan&);
+
       Camera*		m_cam;
       tPvHandle&	m_handle;
       TrigMode		m_trig_mode;
@@ -85,6 +154,21 @@ namespace lima
       tPvFloat32	m_latency;
       ValidRangesType m_valid_ranges;
       double m_max_acq_period;
+      bool		m_strict_plan_check;
+      double		m_link_speed;
+      TimingModel	m_timing;
+      int		m_nb_range_updates;
+
+      Cond		m_cond;
+      _StopThread*	m_stop_thread;
+      bool		m_stopping;
+      bool		m_stop_requested;
+      bool		m_stop_clear_queue;
+      bool		m_quit;
+      bool		m_thread_running;
+      double		m_last_frame_time;
+      double		m_stop_latency;
+      double		m_max_stop_latency;
     };
 
   } // namespace Prosilica
@@ -0,0 +1,118 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICATHREADPOLICY_H
+#define PROSILICATHREADPOLICY_H
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    struct ThreadPolicy
+    {
+      ThreadPolicy();
+
+      std::vector<int>	cpus;		///< empty: any cpu
+      int		priority;	///< SCHED_FIFO priority, 0: normal scheduling
+    };
+
+    /** @brief effective scheduling of a thread, read back from the system
+     */
+    struct ThreadState
+    {
+      ThreadState();
+
+      std::string	name;
+      int		tid;
+      std::vector<int>	cpus;
+      bool		fifo;
+      int		priority;
+      bool		degraded;	///< the policy could not be fully applied
+    };
+
+    /** @brief time the frame callbacks hold the callback thread, the
+	PvAPI can't hand over the next frames meanwhile
+     */
+    struct CallbackStatus
+    {
+      CallbackStatus();
+
+      long long	nb_frames;
+      double	last_duration;
+      double	mean_duration;
+      double	max_duration;
+    };
+
+    // "0,2-3" <-> {0,2,3}
+    void parseCpuList(const std::string&,std::vector<int>&);
+    std::string formatCpuList(const std::vector<int>&);
+
+    /** @brief cpu affinity and real-time priority of a group of threads.
+
+	The threads apply the policy themselves, from update(), so that
+	threads the plugin does not create (the PvAPI callback thread)
+	can be handled too. Until a policy is set, the threads are left
+	untouched. SCHED_FIFO needs CAP_SYS_NICE or an RLIMIT_RTPRIO
+	large enough, without them the thread stays in normal scheduling
+	and its state is reported degraded.
+     */
+    class ThreadPolicyControl
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"ThreadPolicyControl","Prosilica");
+    public:
+      ThreadPolicyControl(const std::string& name);
+
+      void set(const ThreadPolicy&);
+      void get(ThreadPolicy&) const;
+
+      // from the thread itself, applied_generation starts at -1
+      bool changed(int applied_generation) const
+      {return applied_generation != m_generation;}
+      void update(int& applied_generation);
+      // from the thread itself, before it exits
+      void release();
+
+      void getStates(std::vector<ThreadState>&) const;
+    private:
+      void _apply(const ThreadPolicy&,ThreadState&);
+      void _read(ThreadState&);
+
+      std::string		m_name;
+      mutable Mutex		m_lock;
+      ThreadPolicy		m_policy;
+      std::atomic<int>		m_generation;
+      std::map<int,ThreadState>	m_states;
+    };
+  }
+}
+#endif
@@ -0,0 +1,92 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#ifndef PROSILICATIMINGMODEL_H
+#define PROSILICATIMINGMODEL_H
+
+#include "Prosilica.h"
+#include "lima/Debug.h"
+#include "lima/SizeUtils.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    class Camera;
+
+    /** @brief local model of the sensor timing.
+
+	The readout period of a frame of width x height pixels (binned)
+	and bytes_per_pixel is
+	offset + row_time * height + shift_time * height * bin_y
+	+ byte_time * width * height * (bytes_per_pixel - 1).
+	The terms are calibrated once from the camera FrameRate range at
+	the min exposure, full frame, half height, vertical binning 2 and
+	half height in a 16 bit format, so that roi, binning and pixel
+	format changes do not need any network round-trip. The stream
+	bandwidth is not part of the model. check() compares the model
+	with the camera and corrects the offset.
+     */
+    class TimingModel
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"TimingModel","Prosilica");
+    public:
+      TimingModel(Camera*);
+
+      void calibrate();
+      bool isCalibrated() const {return m_calibrated;}
+      bool check(int width,int height,const Bin&,int bytes_per_pixel);
+
+      double readoutTime(int width,int height,const Bin&,int bytes_per_pixel) const;
+      double maxFrameRate(int width,int height,const Bin& bin,int bytes_per_pixel) const
+      {return 1. / readoutTime(width,height,bin,bytes_per_pixel);}
+      double getMinFrameRate() const {return m_min_frame_rate;}
+      void getExposureRange(double& min_exp,double& max_exp) const
+      {min_exp = m_min_exposure,max_exp = m_max_exposure;}
+      void getParameters(double& offset,double& row_time,double& shift_time,
+			 double& byte_time) const
+      {offset = m_offset,row_time = m_row_time,shift_time = m_shift_time,
+	  byte_time = m_byte_time;}
+
+    private:
+      double _cameraPeriod();
+      void _restoreSettings(tPvUint32 region_x,tPvUint32 region_y,
+			    tPvUint32 width,tPvUint32 height,
+			    tPvUint32 bin_x,tPvUint32 bin_y,const char* format,
+			    tPvUint32 exposure,tPvUint32 stream_bandwidth);
+
+      Camera*		m_cam;
+      tPvHandle&	m_handle;
+      bool		m_calibrated;
+      double		m_offset;
+      double		m_row_time;
+      double		m_shift_time;
+      double		m_byte_time;
+      double		m_min_frame_rate;
+      double		m_min_exposure;
+      double		m_max_exposure;
+    };
+  }
+}
+#endif
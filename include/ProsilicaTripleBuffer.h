@@ -0,0 +1,91 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICATRIPLEBUFFER_H
+#define PROSILICATRIPLEBUFFER_H
+
+#include <atomic>
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief "latest value wins" exchange between one writer and one
+	reader, neither of them ever waits.
+
+	The writer fills back() and publishes it, the published value
+	replaces the one not yet taken by the reader. update() gives the
+	reader the last published value in front().
+     */
+    template<class T>
+    class TripleBuffer
+    {
+    public:
+      TripleBuffer() : m_state(BACK_INIT | MIDDLE_INIT | FRONT_INIT) {}
+
+      // writer side
+      T& back() {return m_slots[m_state.load(std::memory_order_relaxed) & 3];}
+      void publish()
+      {
+	unsigned state = m_state.load(std::memory_order_relaxed);
+	unsigned next;
+	do
+	  next = (state & FRONT_MASK) | FRESH |
+	    ((state >> 2) & 3) | ((state & 3) << 2);
+	while(!m_state.compare_exchange_weak(state,next,std::memory_order_acq_rel));
+      }
+
+      // reader side
+      // @return false if nothing was published since the last update
+      bool update()
+      {
+	unsigned state = m_state.load(std::memory_order_relaxed);
+	unsigned next;
+	do
+	  {
+	    if(!(state & FRESH))
+	      return false;
+	    next = (state & 3) | (((state >> 2) & 3) << 4) | (((state >> 4) & 3) << 2);
+	  }
+	while(!m_state.compare_exchange_weak(state,next,std::memory_order_acq_rel));
+	return true;
+      }
+      const T& front() const
+      {return m_slots[(m_state.load(std::memory_order_acquire) >> 4) & 3];}
+
+    private:
+      // slot indexes of back, middle and front, 2 bits each
+      enum {BACK_INIT = 0,MIDDLE_INIT = 1 << 2,FRONT_INIT = 2 << 4,
+	    FRONT_MASK = 3 << 4,FRESH = 1 << 6};
+
+      TripleBuffer(const TripleBuffer&);
+      TripleBuffer& operator=(const TripleBuffer&);
+
+      T				m_slots[3];
+      std::atomic<unsigned>	m_state;
+    };
+  }
+}
+#endif
@@ -54,7 +54,7 @@ namespace lima
       virtual void checkBin(Bin& bin);
       virtual void checkRoi(const Roi& set_roi, Roi& hw_roi);
 
-      virtual void setBin(const Bin&){};
+      virtual void setBin(const Bin&);
       virtual void setRoi(const Roi&){};
 
     private:
@@ -0,0 +1,82 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#ifndef PROSILICAWORKERPOOL_H
+#define PROSILICAWORKERPOOL_H
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+#include "ProsilicaThreadPolicy.h"
+
+namespace lima
+{
+  namespace Prosilica
+  {
+    /** @brief threads sharing the work of the frame processors.
+	The threads are started as the calls need them, and a call only
+	wakes the threads it can keep busy.
+     */
+    class WorkerPool
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"WorkerPool","Prosilica");
+    public:
+      // 0 threads: at most one less than the number of cpus
+      WorkerPool(int nb_threads = 0,ThreadPolicyControl* policy = NULL);
+      ~WorkerPool();
+
+      int getNbThreads() const {return m_nb_threads;}
+
+      // func(i) for i in [0,nb), the calling thread takes part
+      void parallelFor(int nb,const std::function<void(int)>& func);
+      // the idle workers take the new policy at once
+      void applyThreadPolicy();
+    private:
+      class _Worker;
+      friend class _Worker;
+
+      void _run();
+      void _work();
+
+      ThreadPolicyControl*		m_policy;
+      Mutex				m_call_lock;
+      Cond				m_cond;
+      int				m_nb_threads;
+      std::vector<_Worker*>		m_workers;
+      const std::function<void(int)>*	m_func;
+      int				m_nb;
+      std::atomic<int>			m_next;
+      int				m_nb_tickets;	///< workers still to join the call
+      int				m_nb_busy;
+      int				m_nb_running;
+      bool				m_quit;
+    };
+  }
+}
+#endif
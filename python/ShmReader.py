@@ -0,0 +1,215 @@
+############################################################################
+# This file is part of LImA, a Library for Image Acquisition
+#
+# Copyright (C) : 2009-2023
+# European Synchrotron Radiation Facility
+# CS40220 38043 Grenoble Cedex 9
+# FRANCE
+#
+# Contact: lima@esrf.fr
+#
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, see <http://www.gnu.org/licenses/>.
+############################################################################
+"""Reader of the shared memory frame ring of a Prosilica ShmPublisher.
+
+It has no Lima dependency (numpy for Frame.image), see ProsilicaShmLayout.h for the layout.
+Out of a Lima process, import it as the standalone lima_prosilica_shm_reader
+module: importing Lima.Prosilica loads Lima.Core and the camera library.
+Readers never block the writer: a reader too slow for the ring size
+loses the overwritten frames.
+
+    reader = ShmReader('/lima_prosilica_123456')
+    index = reader.nb_published()
+    while True:
+        status, frame = reader.wait_frame(index, timeout=1.)
+        if status == OK:
+            process(frame.image)
+            index = frame.index + 1
+        elif status == OVERWRITTEN:
+            index = reader.nb_published()
+
+python -m lima_prosilica_shm_reader /lima_prosilica_123456 [seconds]
+measures the throughput of a reader.
+"""
+import mmap
+import os
+import struct
+import sys
+import time
+
+MAGIC = 0x4853504c
+VERSION = 1
+HEADER_SIZE = 4096
+SLOT_DATA_OFFSET = 64
+
+# RingHeader and SlotHeader of ProsilicaShmLayout.h
+_RING_HEADER = struct.Struct('<IIIIQQQQ')
+_SLOT_HEADER = struct.Struct('<QQiiiiiIQd')
+_U32 = struct.Struct('<I')
+_U64 = struct.Struct('<Q')
+_CLOSED_OFFSET = 12
+_NB_PUBLISHED_OFFSET = 40
+
+OK, NOT_YET, OVERWRITTEN, CLOSED = range(4)
+
+_DTYPES = {1: 'u1', 2: '<u2', 3: 'u1', 4: '<u4'}
+
+
+class Frame(object):
+    __slots__ = ('index', 'frame_nb', 'width', 'height', 'depth', 'mode',
+                 'camera_timestamp', 'timestamp', 'data')
+
+    @property
+    def image(self):
+        """height x width array (x 3 for RGB24/BGR24)"""
+        import numpy
+        image = numpy.frombuffer(self.data, _DTYPES[self.depth])
+        if self.depth == 3:
+            return image.reshape(self.height, self.width, 3)
+        return image.reshape(self.height, self.width)
+
+
+class ShmReader(object):
+
+    def __init__(self, name):
+        self.__path = '/dev/shm/' + name.lstrip('/')
+        self.__map = None
+        self._open()
+
+    def close(self):
+        if self.__map is not None:
+            self.__map.close()
+            self.__map = None
+
+    def is_open(self):
+        return self._check()
+
+    def nb_published(self):
+        if not self._check():
+            return 0
+        return _U64.unpack_from(self.__map, _NB_PUBLISHED_OFFSET)[0]
+
+    def timestamp_frequency(self):
+        return self.__timestamp_frequency if self._check() else 0
+
+    def read(self, index):
+        """copy publication index out of the ring
+        @return (status, Frame or None)"""
+        if not self._check():
+            return CLOSED, None
+        nb_published = _U64.unpack_from(self.__map, _NB_PUBLISHED_OFFSET)[0]
+        if index >= nb_published:
+            return NOT_YET, None
+        if nb_published - index > self.__nb_slots:
+            return OVERWRITTEN, None
+
+        slot = HEADER_SIZE + (index % self.__nb_slots) * self.__slot_size
+        data_offset = slot + SLOT_DATA_OFFSET
+        while True:
+            header = _SLOT_HEADER.unpack_from(self.__map, slot)
+            seq = header[0]
+            if seq & 1:
+                time.sleep(0)
+                continue
+            data_size = min(header[7], self.__max_data_size)
+            data = self.__map[data_offset:data_offset + data_size]
+            if _U64.unpack_from(self.__map, slot)[0] != seq:
+                continue
+            if header[1] != index:
+                return OVERWRITTEN, None
+            frame = Frame()
+            (frame.index, frame.frame_nb, frame.width, frame.height,
+             frame.depth, frame.mode) = header[1:7]
+            frame.camera_timestamp, frame.timestamp = header[8:10]
+            frame.data = data
+            return OK, frame
+
+    def read_latest(self):
+        nb_published = self.nb_published()
+        if not nb_published:
+            return NOT_YET, None
+        return self.read(nb_published - 1)
+
+    def wait_frame(self, index, timeout=None):
+        """poll until index is published"""
+        end = None if timeout is None else time.monotonic() + timeout
+        while True:
+            status, frame = self.read(index)
+            if status not in (NOT_YET, CLOSED):
+                return status, frame
+            if end is not None and time.monotonic() >= end:
+                return status, None
+            time.sleep(1e-4)
+
+    def _open(self):
+        try:
+            with open(self.__path, 'rb') as f:
+                size = os.fstat(f.fileno()).st_size
+                if size < HEADER_SIZE:
+                    return
+                shm = mmap.mmap(f.fileno(), size, mmap.MAP_SHARED, mmap.PROT_READ)
+        except (OSError, ValueError):
+            return
+        (magic, version, nb_slots, closed, slot_size, max_data_size,
+         frequency, nb_published) = _RING_HEADER.unpack_from(shm, 0)
+        if (magic != MAGIC or version != VERSION or
+                HEADER_SIZE + slot_size * nb_slots > size):
+            shm.close()
+            return
+        self.__map = shm
+        self.__nb_slots = nb_slots
+        self.__slot_size = slot_size
+        self.__max_data_size = max_data_size
+        self.__timestamp_frequency = frequency
+
+    def _check(self):
+        # follow the writer to a new segment
+        if self.__map is not None and _U32.unpack_from(self.__map, _CLOSED_OFFSET)[0]:
+            self.close()
+        if self.__map is None:
+            self._open()
+        return self.__map is not None
+
+
+def main(argv):
+    if len(argv) < 2:
+        print('usage: %s shm_name [seconds]' % argv[0])
+        return 1
+    duration = float(argv[2]) if len(argv) > 2 else 10.
+    reader = ShmReader(argv[1])
+    if not reader.is_open():
+        print('%s: no frame ring' % argv[1])
+        return 1
+
+    nb_frames = nb_lost = nb_bytes = 0
+    index = reader.nb_published()
+    start = time.monotonic()
+    while time.monotonic() - start < duration:
+        status, frame = reader.wait_frame(index, timeout=0.1)
+        if status == OK:
+            nb_frames += 1
+            nb_bytes += len(frame.data)
+            index = frame.index + 1
+        elif status == OVERWRITTEN:
+            next_index = reader.nb_published()
+            nb_lost += next_index - index
+            index = next_index
+    elapsed = time.monotonic() - start
+    print('%d frames in %.1f s: %.1f frames/s, %.1f MB/s, %d lost' %
+          (nb_frames, elapsed, nb_frames / elapsed, nb_bytes / elapsed / 1e6, nb_lost))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,298 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <cmath>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaBadPixels.h"
+#include "ProsilicaFlatField.h"
+#include "ProsilicaCamera.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+BadPixelCorrection::BadPixelCorrection(Camera* cam) :
+  m_cam(cam),
+  m_active(false),
+  m_bayer(false),
+  m_map_width(0),
+  m_map_height(0)
+{
+  DEB_CONSTRUCTOR();
+  m_cam->getMaxWidthHeight(m_max_width,m_max_height);
+}
+
+void BadPixelCorrection::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  AutoMutex lock(m_lock);
+  if(active)
+    _buildMap();
+  m_active = active;
+}
+
+void BadPixelCorrection::addDefect(int x,int y)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(x,y);
+
+  if(x < 0 || y < 0 || x >= int(m_max_width) || y >= int(m_max_height))
+    throw LIMA_HW_EXC(InvalidValue,"Defect out of the sensor");
+
+  uint32_t index = uint32_t(y) * m_max_width + x;
+  AutoMutex lock(m_lock);
+  std::vector<uint32_t>::iterator i = std::lower_bound(m_sensor_defects.begin(),
+						       m_sensor_defects.end(),index);
+  if(i != m_sensor_defects.end() && *i == index)
+    return;
+  m_sensor_defects.insert(i,index);
+  if(m_active)
+    _buildMap();
+}
+
+void BadPixelCorrection::clearDefects()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  m_sensor_defects.clear();
+  _buildMap();
+}
+
+int BadPixelCorrection::getNbDefects()
+{
+  AutoMutex lock(m_lock);
+  return int(m_sensor_defects.size());
+}
+
+void BadPixelCorrection::getDefects(std::vector<int>& x,std::vector<int>& y)
+{
+  AutoMutex lock(m_lock);
+  x.clear(),y.clear();
+  for(std::vector<uint32_t>::const_iterator i = m_sensor_defects.begin();
+      i != m_sensor_defects.end();++i)
+    {
+      x.push_back(*i % m_max_width);
+      y.push_back(*i / m_max_width);
+    }
+}
+
+//-----------------------------------------------------
+// @brief add the hot and dead pixels of the flat-field references.
+// a defective reference pixel marks its whole binning block
+// @return the number of defects found
+//-----------------------------------------------------
+int BadPixelCorrection::detect(FlatFieldCorrection& flat_field,
+			       double hot_sigma,double dead_ratio)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(hot_sigma,dead_ratio);
+
+  std::vector<bool> defective;
+  FlatFieldCorrection::Reference reference;
+  {
+    AutoMutex flat_lock(flat_field.m_lock);
+    const FlatFieldCorrection::Reference& dark = flat_field.m_dark;
+    const FlatFieldCorrection::Reference& flat = flat_field.m_flat;
+    if(dark.image.empty() && flat.image.empty())
+      throw LIMA_HW_EXC(Error,"No dark or flat reference acquired");
+    if(!dark.image.empty() && !flat.image.empty() &&
+       (dark.width != flat.width || dark.height != flat.height))
+      throw LIMA_HW_EXC(Error,"Dark and flat references don't match");
+
+    reference = dark.image.empty() ? flat : dark;
+    size_t nb_pixels = reference.image.size();
+    defective.assign(nb_pixels,false);
+
+    if(!dark.image.empty())
+      {
+	double sum = 0.,sum2 = 0.;
+	for(size_t i = 0;i < nb_pixels;++i)
+	  sum += dark.image[i],sum2 += double(dark.image[i]) * dark.image[i];
+	double mean = sum / nb_pixels;
+	double rms = sqrt(std::max(0.,sum2 / nb_pixels - mean * mean));
+	double threshold = mean + hot_sigma * rms;
+	for(size_t i = 0;i < nb_pixels;++i)
+	  if(dark.image[i] > threshold)
+	    defective[i] = true;
+      }
+    if(!flat.image.empty())
+      {
+	double sum = 0.;
+	for(size_t i = 0;i < nb_pixels;++i)
+	  sum += flat.image[i] - (dark.image.empty() ? 0.f : dark.image[i]);
+	double threshold = dead_ratio * sum / nb_pixels;
+	for(size_t i = 0;i < nb_pixels;++i)
+	  if(flat.image[i] - (dark.image.empty() ? 0.f : dark.image[i]) < threshold)
+	    defective[i] = true;
+      }
+  }
+
+  int bin_x = reference.bin.getX(),bin_y = reference.bin.getY();
+  Point top_left = reference.roi.getTopLeft();
+  std::vector<uint32_t> found;
+  for(int y = 0;y < reference.height;++y)
+    for(int x = 0;x < reference.width;++x)
+      {
+	if(!defective[size_t(y) * reference.width + x])
+	  continue;
+	for(int dy = 0;dy < bin_y;++dy)
+	  for(int dx = 0;dx < bin_x;++dx)
+	    {
+	      tPvUint32 sx = (top_left.x + x) * bin_x + dx;
+	      tPvUint32 sy = (top_left.y + y) * bin_y + dy;
+	      if(sx < m_max_width && sy < m_max_height)
+		found.push_back(sy * m_max_width + sx);
+	    }
+      }
+
+  AutoMutex lock(m_lock);
+  found.insert(found.end(),m_sensor_defects.begin(),m_sensor_defects.end());
+  std::sort(found.begin(),found.end());
+  found.erase(std::unique(found.begin(),found.end()),found.end());
+  int nb_found = int(found.size() - m_sensor_defects.size());
+  m_sensor_defects.swap(found);
+  if(m_active)
+    _buildMap();
+
+  DEB_RETURN() << DEB_VAR1(nb_found);
+  return nb_found;
+}
+
+void BadPixelCorrection::prepare()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  if(m_active)
+    _buildMap();
+}
+
+//-----------------------------------------------------
+// @brief remap the sensor defects to the current roi and binning
+//-----------------------------------------------------
+void BadPixelCorrection::_buildMap()
+{
+  DEB_MEMBER_FUNCT();
+
+  Bin bin;
+  Roi roi;
+  m_cam->getBin(bin);
+  m_cam->getRoi(roi);
+  if(!roi.isActive())
+    roi = Roi(0,0,m_max_width / bin.getX(),m_max_height / bin.getY());
+  VideoMode mode = m_cam->getVideoMode();
+  m_bayer = mode == BAYER_RG8 || mode == BAYER_RG16;
+
+  Point top_left = roi.getTopLeft();
+  int width = roi.getSize().getWidth();
+  int height = roi.getSize().getHeight();
+
+  std::vector<uint32_t> indexes;
+  for(std::vector<uint32_t>::const_iterator i = m_sensor_defects.begin();
+      i != m_sensor_defects.end();++i)
+    {
+      int x = int(*i % m_max_width) / bin.getX() - top_left.x;
+      int y = int(*i / m_max_width) / bin.getY() - top_left.y;
+      if(x >= 0 && y >= 0 && x < width && y < height)
+	indexes.push_back(uint32_t(y) * width + x);
+    }
+  std::sort(indexes.begin(),indexes.end());
+  indexes.erase(std::unique(indexes.begin(),indexes.end()),indexes.end());
+
+  int step = m_bayer ? 2 : 1;
+  m_defects.clear();
+  m_neighbours.clear();
+  for(std::vector<uint32_t>::const_iterator i = indexes.begin();
+      i != indexes.end();++i)
+    {
+      int x = *i % width,y = *i / width;
+      Defect defect;
+      defect.index = *i;
+      defect.first_neighbour = uint32_t(m_neighbours.size());
+      for(int dy = -step;dy <= step;dy += step)
+	for(int dx = -step;dx <= step;dx += step)
+	  {
+	    int nx = x + dx,ny = y + dy;
+	    if((!dx && !dy) || nx < 0 || ny < 0 || nx >= width || ny >= height)
+	      continue;
+	    uint32_t neighbour = uint32_t(ny) * width + nx;
+	    if(!std::binary_search(indexes.begin(),indexes.end(),neighbour))
+	      m_neighbours.push_back(neighbour);
+	  }
+      defect.nb_neighbours = uint32_t(m_neighbours.size()) - defect.first_neighbour;
+      if(defect.nb_neighbours)
+	m_defects.push_back(defect);
+    }
+  m_map_width = width;
+  m_map_height = height;
+
+  DEB_TRACE() << DEB_VAR4(roi,bin,m_sensor_defects.size(),m_defects.size());
+}
+
+template<class T>
+void BadPixelCorrection::_correct(T* data)
+{
+  const uint32_t* neighbours = m_neighbours.empty() ? NULL : &m_neighbours[0];
+  for(std::vector<Defect>::const_iterator i = m_defects.begin();
+      i != m_defects.end();++i)
+    {
+      uint32_t sum = 0;
+      const uint32_t* n = neighbours + i->first_neighbour;
+      for(uint32_t j = 0;j < i->nb_neighbours;++j)
+	sum += data[n[j]];
+      data[i->index] = T((sum + i->nb_neighbours / 2) / i->nb_neighbours);
+    }
+}
+
+void BadPixelCorrection::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active)
+    return;
+
+  bool bayer;
+  switch(frame.mode)
+    {
+    case Y8: case Y16: bayer = false; break;
+    case BAYER_RG8: case BAYER_RG16: bayer = true; break;
+    default: return;
+    }
+
+  AutoMutex lock(m_lock);
+  if(bayer != m_bayer || m_defects.empty() ||
+     frame.width != m_map_width || frame.height != m_map_height)
+    return;
+
+  if(frame.depth == 1)
+    _correct((uint8_t*)frame.data);
+  else
+    _correct((uint16_t*)frame.data);
+}
@@ -22,51 +22,556 @@
 // along with this program; if not, see <http://www.gnu.org/licenses/>.
 //###########################################################################
 
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
+
 #include "ProsilicaBufferCtrlObj.h"
 #include "ProsilicaSyncCtrlObj.h"
 #include "ProsilicaCamera.h"
+#include "ProsilicaKernels.h"
 
 using namespace lima;
 using namespace lima::Prosilica;
 
+static const int MAX_QUEUED_FRAMES = 64;
+// scratch frames, not delivered to Lima
+static const int DROPPED_FRAME = -1;
+static const int DECIMATED_FRAME = -2;
+// history ring frame, the slot is in Context[2]
+static const int HISTORY_FRAME = -3;
+// camera event ids are 40000 + their bit in EventsEnable1
+static const unsigned long EVENT_ID_BASE = 40000;
+
+OverrunStatus::OverrunStatus() :
+  capacity(0),
+  high_water_mark(0),
+  nb_overruns(0),
+  nb_dropped(0),
+  nb_decimated(0),
+  nb_incomplete(0),
+  first_overrun_time(-1.),
+  last_overrun_time(-1.)
+{
+}
+
+AccumulationStatus::AccumulationStatus() :
+  nb_saturated_frames(0),
+  nb_saturated_pixels(0),
+  last_saturated_frame(-1)
+{
+}
+
+class BufferCtrlObj::_BatchThread : public Thread
+{
+public:
+  _BatchThread(BufferCtrlObj& buffer) : m_buffer(buffer) {}
+protected:
+  virtual void threadFunction() {m_buffer._batchTimer();}
+private:
+  BufferCtrlObj&	m_buffer;
+};
+
 BufferCtrlObj::BufferCtrlObj(Camera *cam) :
+  m_cam(cam),
   m_handle(cam->getHandle()),
+  m_sync(NULL),
   m_status(ePvErrSuccess),
-  m_exposing(false)
+  m_exposing(false),
+  m_nb_frames(1),
+  m_nb_queued_frames(1),
+  m_next_frame_nb(0),
+  m_next_ready_nb(0),
+  m_batching(false),
+  m_batch_size(1),
+  m_max_batch_size(1),
+  m_max_batch_latency(0.01),
+  m_batch_start(-1.),
+  m_last_frame_time(-1.),
+  m_frame_interval(0.),
+  m_batch_thread(NULL),
+  m_batch_deadline(-1.),
+  m_batch_quit(false),
+  m_batch_thread_running(false),
+  m_consumer_tracking(false),
+  m_last_consumed(-1),
+  m_overrun_policy(OverrunStop),
+  m_overrun_decimation(2),
+  m_nb_hw_frames(0),
+  m_start_time(0.),
+  m_lease_generation(0),
+  m_last_ready(-1),
+  m_running(false),
+  m_history_pre(0),
+  m_history_post(0),
+  m_history_trigger(HistorySoftware),
+  m_history_active(false),
+  m_event_registered(false),
+  m_trigger_event_id(0),
+  m_frame_size(0),
+  m_sw_binning(false),
+  m_sw_bin_mean(false),
+  m_raw_width(0),
+  m_raw_depth(0),
+  m_raw_size(0),
+  m_nb_bin_bands(1),
+  m_bin_function(NULL),
+  m_accumulation_bin(NULL),
+  m_accumulation(1),
+  m_saturation_level(0),
+  m_next_subframe(0),
+  m_queued_frame_nb(0),
+  m_triggered(false),
+  m_trigger_timestamp(0),
+  m_frozen(false),
+  m_slot_post_nb(0),
+  m_start_timestamp(0),
+  m_timestamp_frequency(0.)
 {
   DEB_CONSTRUCTOR();
 
-  //IMPORTANT: Initialize camera structure. See tPvFrame in PvApi.h for more info.
-  memset(&(m_frame[0]),0,sizeof(tPvFrame));
-  memset(&(m_frame[1]),0,sizeof(tPvFrame));
-  m_frame[0].Context[0] = this;
-  m_frame[1].Context[0] = this;
+  m_batch_thread = new _BatchThread(*this);
+  m_batch_thread_running = true;
+  m_batch_thread->start();
+}
+
+BufferCtrlObj::~BufferCtrlObj()
+{
+  DEB_DESTRUCTOR();
+
+  AutoMutex lock(m_batch_cond.mutex());
+  m_batch_quit = true;
+  m_batch_cond.broadcast();
+  while(m_batch_thread_running)
+    m_batch_cond.wait();
+  lock.unlock();
+  delete m_batch_thread;
+
+  _disableTriggerEvent();
+  if(m_event_registered)
+    PvCameraEventCallbackUnRegister(m_handle,_cameraEvent);
+}
+
+void BufferCtrlObj::setConsumerTracking(bool tracking)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(tracking);
+
+  AutoMutex lock(m_consumer_lock);
+  m_consumer_tracking = tracking;
+}
+
+void BufferCtrlObj::setLastConsumedFrame(int frame_nb)
+{
+  AutoMutex lock(m_consumer_lock);
+  m_last_consumed = frame_nb;
+}
+
+void BufferCtrlObj::setOverrunPolicy(OverrunPolicy policy)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(policy);
+
+  m_overrun_policy = policy;
+}
+
+void BufferCtrlObj::setOverrunDecimation(int decimation)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(decimation);
+
+  if(decimation < 2)
+    throw LIMA_HW_EXC(InvalidValue,"Decimation must be at least 2");
+  m_overrun_decimation = decimation;
+}
+
+void BufferCtrlObj::getOverrunStatus(OverrunStatus& status)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  status = m_overrun_status;
+}
+
+void BufferCtrlObj::setHistory(int pre_frames,int post_frames)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(pre_frames,post_frames);
+
+  if(pre_frames < 0 || post_frames < 0)
+    throw LIMA_HW_EXC(InvalidValue,"History frames can't be negative");
+  m_history_pre = pre_frames;
+  m_history_post = post_frames;
+}
+
+void BufferCtrlObj::setHistoryTrigger(HistoryTrigger trigger)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(trigger);
+
+  m_history_trigger = trigger;
+}
+
+//-----------------------------------------------------
+// @brief software trigger of the history capture,
+// frames exposed before the camera time latched now are pre-trigger
+//-----------------------------------------------------
+void BufferCtrlObj::triggerHistory()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_history_active)
+    throw LIMA_HW_EXC(Error,"History capture is not prepared");
+
+  unsigned long long timestamp;
+  if(!m_cam->getClockSync().latch(timestamp))
+    throw LIMA_HW_EXC(Error,"Can't latch camera time stamp");
+  _setHistoryTrigger(timestamp);
+}
+
+bool BufferCtrlObj::isHistoryTriggered()
+{
+  AutoMutex lock(m_lock);
+  return m_triggered;
+}
+
+void BufferCtrlObj::_setHistoryTrigger(unsigned long long timestamp)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(timestamp);
+
+  AutoMutex lock(m_lock);
+  if(!m_history_active || m_triggered)
+    return;
+  m_triggered = true;
+  m_trigger_timestamp = timestamp;
+}
+
+void BufferCtrlObj::_cameraEvent(void* context,tPvHandle,
+				 const tPvCameraEvent* events,
+				 unsigned long nb_events)
+{
+  BufferCtrlObj* bufferPt = (BufferCtrlObj*)context;
+  for(unsigned long i = 0;i < nb_events;++i)
+    if(events[i].EventId == bufferPt->m_trigger_event_id)
+      {
+	bufferPt->_setHistoryTrigger((unsigned long long)events[i].TimestampHi << 32 |
+				     events[i].TimestampLo);
+	break;
+      }
+}
+
+//-----------------------------------------------------
+// @brief allocate the ring and arm the hardware trigger
+//-----------------------------------------------------
+void BufferCtrlObj::_prepareHistory(int nb_queued)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_nb_frames != m_history_pre + m_history_post)
+    throw LIMA_HW_EXC(InvalidValue,"History mode needs nb frames = pre + post frames");
+  TrigMode trig_mode;
+  m_sync->getTrigMode(trig_mode);
+  if(trig_mode != IntTrig)
+    throw LIMA_HW_EXC(InvalidValue,"History mode needs the internal trigger");
+
+  tPvUint32 frequency;
+  if(PvAttrUint32Get(m_handle,"TimeStampFrequency",&frequency) || !frequency)
+    throw LIMA_HW_EXC(Error,"Can't get camera time stamp frequency");
+  m_timestamp_frequency = frequency;
+
+  _disableTriggerEvent();
+  if(m_history_trigger != HistorySoftware)
+    {
+      const char* event_name = m_history_trigger == HistorySyncIn1 ?
+	"EventSyncIn1Rise" : "EventSyncIn2Rise";
+      tPvUint32 event_id,events_enable;
+      if(PvAttrUint32Get(m_handle,event_name,&event_id) ||
+	 event_id < EVENT_ID_BASE || event_id >= EVENT_ID_BASE + 32 ||
+	 PvAttrUint32Get(m_handle,"EventsEnable1",&events_enable) ||
+	 PvAttrUint32Set(m_handle,"EventsEnable1",
+			 events_enable | 1UL << (event_id - EVENT_ID_BASE)))
+	throw LIMA_HW_EXC(Error,"Can't enable SyncIn camera event");
+      m_trigger_event_id = event_id;
+      if(!m_event_registered)
+	{
+	  if(PvCameraEventCallbackRegister(m_handle,_cameraEvent,this))
+	    throw LIMA_HW_EXC(Error,"Can't register camera event callback");
+	  m_event_registered = true;
+	}
+    }
+
+  // the last pre frames are kept while nb_queued are in flight
+  int nb_slots = m_history_pre + nb_queued;
+  m_ring.resize(size_t(nb_slots) * m_raw_size);
+  m_free_slots.clear();
+  for(int slot = nb_slots - 1;slot >= 0;--slot)
+    m_free_slots.push_back(slot);
+  m_history.clear();
+  m_triggered = m_frozen = false;
+  m_slot_post_nb = 0;
 }
+
+//-----------------------------------------------------
+// @brief clear the bit of the SyncIn event in EventsEnable1, the
+// camera must not keep sending events nobody waits for
+//-----------------------------------------------------
+void BufferCtrlObj::_disableTriggerEvent()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_trigger_event_id)
+    return;
+  tPvUint32 events_enable;
+  if(PvAttrUint32Get(m_handle,"EventsEnable1",&events_enable) ||
+     PvAttrUint32Set(m_handle,"EventsEnable1",
+		     events_enable & ~(1UL << (m_trigger_event_id - EVENT_ID_BASE))))
+    DEB_WARNING() << "Can't disable SyncIn camera event";
+  m_trigger_event_id = 0;
+}
+
+void BufferCtrlObj::setAccumulation(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if(nb_frames < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Accumulation needs at least one frame");
+  m_accumulation = nb_frames;
+}
+
+void BufferCtrlObj::setSaturationLevel(int level)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(level);
+
+  if(level < 0 || level > 0xffff)
+    throw LIMA_HW_EXC(InvalidValue,"Saturation level out of range");
+  m_saturation_level = level;
+}
+
+void BufferCtrlObj::getAccumulationStatus(AccumulationStatus& status)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  status = m_accumulation_status;
+}
+
+//-----------------------------------------------------
+// @brief hold the Lima buffer of a ready frame
+// @return the frame data, valid until releaseFrame
+//-----------------------------------------------------
+void* BufferCtrlObj::leaseFrame(int frame_nb,FrameDim& dim,int& generation)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(frame_nb);
+
+  AutoMutex lock(m_lock);
+  if(m_history_active)
+    throw LIMA_HW_EXC(NotSupported,"Frames can't be leased in history mode");
+  if(frame_nb < 0 || frame_nb >= m_next_ready_nb)
+    throw LIMA_HW_EXC(InvalidValue,"Frame is not ready");
+  // the buffer is reused by frame_nb + capacity
+  if(m_next_frame_nb - frame_nb > m_overrun_status.capacity)
+    throw LIMA_HW_EXC(Error,"Frame was overwritten");
+
+  AutoMutex consumer_lock(m_consumer_lock);
+  ++m_leases[frame_nb];
+  dim = m_frame_dim;
+  generation = m_lease_generation;
+  return _limaBuffer(frame_nb);
+}
+
+void BufferCtrlObj::releaseFrame(int frame_nb,int generation)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(frame_nb,generation);
+
+  AutoMutex lock(m_consumer_lock);
+  if(generation != m_lease_generation)
+    return;
+  std::map<int,int>::iterator i = m_leases.find(frame_nb);
+  if(i != m_leases.end() && !--i->second)
+    m_leases.erase(i);
+}
+
+int BufferCtrlObj::getNbLeases()
+{
+  AutoMutex lock(m_consumer_lock);
+  int nb_leases = 0;
+  for(std::map<int,int>::iterator i = m_leases.begin();i != m_leases.end();++i)
+    nb_leases += i->second;
+  return nb_leases;
+}
+
+int BufferCtrlObj::waitNextFrame(int after_frame_nb,double timeout)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(after_frame_nb,timeout);
+
+  AutoMutex lock(m_ready_cond.mutex());
+  double end = timeout >= 0. ? double(Timestamp::now()) + timeout : 0.;
+  while(m_last_ready <= after_frame_nb && m_running)
+    {
+      if(timeout < 0.)
+	m_ready_cond.wait();
+      else
+	{
+	  double remaining = end - double(Timestamp::now());
+	  if(remaining <= 0. || !m_ready_cond.wait(remaining))
+	    break;
+	}
+    }
+  int frame_nb = m_last_ready > after_frame_nb ? m_last_ready : -1;
+  DEB_RETURN() << DEB_VAR1(frame_nb);
+  return frame_nb;
+}
+
+void BufferCtrlObj::setNbQueuedFrames(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if(nb_frames < 1 || nb_frames > MAX_QUEUED_FRAMES)
+    throw LIMA_HW_EXC(InvalidValue,"Nb queued frames out of range");
+  m_nb_queued_frames = nb_frames;
+}
+
+void BufferCtrlObj::setMaxBatchSize(int size)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(size);
+
+  if(size < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Batch size must be at least 1");
+  m_max_batch_size = size;
+}
+
+void BufferCtrlObj::setMaxBatchLatency(double latency)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(latency);
+
+  if(latency < 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Batch latency can't be negative");
+  m_max_batch_latency = latency;
+}
+
 void BufferCtrlObj::prepareAcq()
 {
   DEB_MEMBER_FUNCT();
   FrameDim dim;
   getFrameDim(dim);
-  m_frame[0].ImageBufferSize = m_frame[1].ImageBufferSize = dim.getMemSize();
-  
+  m_sync->getNbFrames(m_nb_frames);
+
+  int nb_buffers,nb_concat_frames;
+  getNbBuffers(nb_buffers);
+  getNbConcatFrames(nb_concat_frames);
+
+  if(m_accumulation > 1)
+    {
+      if(dim.getDepth() != 4)
+	throw LIMA_HW_EXC(InvalidValue,"Frame accumulation needs a 32 bit output");
+      if(m_history_pre + m_history_post)
+	throw LIMA_HW_EXC(InvalidValue,"Frame accumulation and history mode are exclusive");
+    }
+
+  // batches only make sense at a steady internal rate
+  TrigMode trig_mode;
+  m_sync->getTrigMode(trig_mode);
+  m_batching = trig_mode == IntTrig && m_max_batch_size > 1;
+  int max_batch_size = m_batching ? m_max_batch_size : 1;
+
+  // frames in flight, in the processing pipeline and waiting in the
+  // batch must not wrap over the Lima buffers
+  int capacity = nb_buffers * nb_concat_frames;
+  FramePipeline& pipeline = m_cam->getFramePipeline();
+  int nb_processing = 0;
+  if(pipeline.isActive())
+    nb_processing = std::max(1,std::min(pipeline.getDepth(),
+					capacity - max_batch_size - 1));
+  int nb_queued = std::min(m_nb_queued_frames,
+			   capacity - max_batch_size - nb_processing);
+  if(m_nb_frames)
+    nb_queued = std::min(nb_queued,m_nb_frames * m_accumulation);
+  nb_queued = std::max(nb_queued,1);
+  if(pipeline.isActive())
+    pipeline.prepare(capacity - max_batch_size - nb_queued);
+
+  //IMPORTANT: Initialize camera structure. See tPvFrame in PvApi.h for more info.
+  tPvFrame empty_frame;
+  memset(&empty_frame,0,sizeof(tPvFrame));
+  m_frame.assign(nb_queued,empty_frame);
+  m_frame_size = dim.getMemSize();
+  m_frame_dim = dim;
+  _prepareSoftwareBinning(dim,nb_queued);
+  for(int i = 0;i < nb_queued;++i)
+    {
+      m_frame[i].Context[0] = this;
+      m_frame[i].ImageBufferSize = m_raw_size;
+    }
+
   m_acq_frame_nb = -1;
-  tPvFrame& frame0 = m_frame[0];
-  frame0.ImageBuffer = (char*) m_buffer_cb_mgr.getFrameBufferPtr(0);
-  
-  int requested_nb_frames;
-  m_sync->getNbFrames(requested_nb_frames);
-  if(!requested_nb_frames || requested_nb_frames > 1)
+  m_next_frame_nb = m_next_ready_nb = 0;
+  m_next_subframe = 0;
+  m_nb_subframes.clear();
+  m_accumulation_status = AccumulationStatus();
+  m_status = ePvErrSuccess;
+  m_pending.clear();
+  m_batch.clear();
+  m_batch_size = 1;
+  m_batch_start = m_last_frame_time = -1.;
+  {
+    AutoMutex batch_lock(m_batch_cond.mutex());
+    m_batch_deadline = -1.;
+  }
+  m_frame_interval = 0.;
+
+  m_last_consumed = -1;
+  m_nb_hw_frames = 0;
+  m_overrun_status = OverrunStatus();
+  m_overrun_status.capacity = nb_buffers * nb_concat_frames;
+  {
+    AutoMutex lock(m_consumer_lock);
+    if(!m_leases.empty())
+      DEB_WARNING() << "Leases of the previous acquisition dropped";
+    m_leases.clear();
+    ++m_lease_generation;
+  }
   {
-    tPvFrame& frame1 = m_frame[1];
-    frame1.ImageBuffer = (char*) m_buffer_cb_mgr.getFrameBufferPtr(1);
+    AutoMutex lock(m_ready_cond.mutex());
+    m_last_ready = -1;
   }
+  // frames which can't go to Lima are received in scratch buffers,
+  // leases may start at any time
+  if(m_overrun_policy != OverrunStop)
+    m_scratch.resize(size_t(nb_queued) * m_raw_size);
+  else
+    m_scratch.clear();
+
+  {
+    AutoMutex lock(m_lock);
+    m_history_active = false;
+  }
+  if(m_history_pre + m_history_post)
+    {
+      _prepareHistory(nb_queued);
+      AutoMutex lock(m_lock);
+      m_history_active = true;
+    }
+  else
+    _disableTriggerEvent();
+
   unsigned long FrameSize = 0;
   if((PvAttrUint32Get(m_handle,"TotalBytesPerFrame",&FrameSize)) == ePvErrSuccess)
     {
       DEB_TRACE() << "Camera TotalBytesPerFrame: "<< FrameSize;
       DEB_TRACE() << "Lima Frame size: " << dim.getMemSize();
-      DEB_TRACE() << "Lima buffer 0 ptr address: " << frame0.ImageBuffer;
-      DEB_TRACE() << "m_frame[0] ptr address: " << &frame0;
+      DEB_TRACE() << DEB_VAR3(nb_queued,nb_concat_frames,m_batching);
     }
 }
 
@@ -74,36 +579,163 @@ void BufferCtrlObj::startAcq()
 {
   DEB_MEMBER_FUNCT();
 
+  {
+    AutoMutex lock(m_ready_cond.mutex());
+    m_running = true;
+  }
+  AutoMutex lock(m_lock);
   m_exposing = true;
-  tPvFrame& frame = m_frame[0];
-  
-  m_status = PvCaptureQueueFrame(m_handle,&frame,_newFrame);
+  m_start_time = Timestamp::now();
+  if(m_history_active)
+    {
+      // frame time stamps are given relative to the acquisition start
+      m_start_timestamp = 0;
+      m_cam->getClockSync().latch(m_start_timestamp);
+    }
+  for(unsigned int i = 0;i < m_frame.size();++i)
+    _queueFrame(&m_frame[i]);
+}
+
+//-----------------------------------------------------
+// @brief check the Lima buffer of frame_nb is free
+// @return frame_nb, or the scratch tag if it can't be written
+//-----------------------------------------------------
+int BufferCtrlObj::_checkOverrun(int frame_nb)
+{
+  DEB_MEMBER_FUNCT();
+
+  int last_consumed;
+  {
+    AutoMutex lock(m_consumer_lock);
+    if(!m_consumer_tracking && m_leases.empty())
+      return frame_nb;
+    last_consumed = m_consumer_tracking ? m_last_consumed : frame_nb;
+    // a leased frame counts as not consumed
+    if(!m_leases.empty())
+      last_consumed = std::min(last_consumed,m_leases.begin()->first - 1);
+  }
+
+  // writing frame_nb overwrites frame_nb - capacity
+  int capacity = m_overrun_status.capacity;
+  int lag = frame_nb - last_consumed;
+  int target = frame_nb;
+  if(lag > capacity)
+    target = DROPPED_FRAME;
+  else if(m_overrun_policy == OverrunDecimate && lag > capacity / 2 &&
+	  m_nb_hw_frames % m_overrun_decimation)
+    target = DECIMATED_FRAME;
+
+  if(target == DROPPED_FRAME)
+    {
+      double overrun_time = double(Timestamp::now()) - m_start_time;
+      if(!m_overrun_status.nb_overruns++)
+	{
+	  DEB_WARNING() << "Buffer overrun: " << DEB_VAR3(frame_nb,last_consumed,capacity);
+	  m_overrun_status.first_overrun_time = overrun_time;
+	}
+      m_overrun_status.last_overrun_time = overrun_time;
+    }
+  return target;
+}
+
+//-----------------------------------------------------
+// @brief queue a PvAPI frame on the Lima buffer of the next frame
+// @return false if the acquisition must stop on overrun
+//-----------------------------------------------------
+bool BufferCtrlObj::_queueFrame(tPvFrame* aFrame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_history_active && !m_frozen)
+    {
+      // free-running in the ring until the trigger
+      int slot = m_free_slots.back();
+      m_free_slots.pop_back();
+      aFrame->ImageBuffer = &m_ring[slot * m_raw_size];
+      aFrame->Context[1] = (void*)(intptr_t)HISTORY_FRAME;
+      aFrame->Context[2] = (void*)(intptr_t)slot;
+      ++m_nb_hw_frames;
+      tPvErr error = m_cam->queueFrame(aFrame,_newFrame);
+      if(error)
+	m_status = error;
+      return !error;
+    }
+
+  int frame_nb;
+  if(m_next_subframe)
+    frame_nb = m_queued_frame_nb;	// next camera frame of the same sum
+  else
+    {
+      frame_nb = _checkOverrun(m_next_frame_nb);
+      if(frame_nb >= 0)
+	{
+	  ++m_next_frame_nb;
+	  // camera frames may complete out of order, start from zero
+	  if(m_accumulation > 1)
+	    memset(_limaBuffer(frame_nb),0,m_frame_size);
+	}
+      else if(m_overrun_policy == OverrunStop)
+	{
+	  DEB_ERROR() << "Buffer overrun, acquisition stopped";
+	  m_status = ePvErrResources;
+	  return false;
+	}
+      m_queued_frame_nb = frame_nb;
+    }
+  m_next_subframe = (m_next_subframe + 1) % m_accumulation;
+
+  if(frame_nb >= 0)
+    {
+      if(m_sw_binning)
+	aFrame->ImageBuffer = &m_raw[(aFrame - &m_frame[0]) * m_raw_size];
+      else
+	aFrame->ImageBuffer = _limaBuffer(frame_nb);
+    }
+  else
+    aFrame->ImageBuffer = &m_scratch[(aFrame - &m_frame[0]) * aFrame->ImageBufferSize];
+  ++m_nb_hw_frames;
+  aFrame->Context[1] = (void*)(intptr_t)frame_nb;
+
+  tPvErr error = m_cam->queueFrame(aFrame,_newFrame);
+  if(error)
+    m_status = error;
+  return !error;
 }
 
 void BufferCtrlObj::_newFrame(tPvFrame* aFrame)
 {
   DEB_STATIC_FUNCT();
   BufferCtrlObj *bufferPt = (BufferCtrlObj*)aFrame->Context[0];
+  double start = bufferPt->m_cam->beginCallback();
+  bufferPt->m_cam->getFrameRecorder().record(aFrame);
+  bufferPt->_processFrame(aFrame);
+  bufferPt->m_cam->endCallback(start);
+}
+
+void BufferCtrlObj::_processFrame(tPvFrame* aFrame)
+{
+  DEB_MEMBER_FUNCT();
 
-  int requested_nb_frames;
-  bufferPt->m_sync->getNbFrames(requested_nb_frames);
+  int frame_nb = (int)(intptr_t)aFrame->Context[1];
 
-  bufferPt->m_exposing = false;
-  if(bufferPt->m_status || aFrame->Status != ePvErrSuccess) // error
+  m_exposing = false;
+  if(!m_status && aFrame->Status == ePvErrDataMissing)
     {
-      // it's not really an error,continue
-      if(aFrame->Status == ePvErrDataMissing)
-	{
-	  DEB_WARNING() << DEB_VAR1(aFrame->Status);
-          PvCaptureQueueFrame(bufferPt->m_handle,aFrame,_newFrame);
-	  return;
-	}
-      else if(aFrame->Status == ePvErrCancelled) // we stopped the acqusition so not an error
+      // it's not really an error. The next frames are already queued,
+      // acquired again this one would go to Lima after them: it goes
+      // as received
+      DEB_WARNING() << DEB_VAR2(frame_nb,aFrame->Status);
+      AutoMutex lock(m_lock);
+      ++m_overrun_status.nb_incomplete;
+    }
+  else if(m_status || aFrame->Status != ePvErrSuccess) // error
+    {
+      if(aFrame->Status == ePvErrCancelled) // we stopped the acqusition so not an error
 	return;
       else 
 	{
-	  if(!bufferPt->m_status) // Keep error status
-	    bufferPt->m_status = aFrame->Status;
+	  if(!m_status) // Keep error status
+	    m_status = aFrame->Status;
 
 	  if(aFrame->Status)
 	    DEB_ERROR() << DEB_VAR1(aFrame->Status);
@@ -111,37 +743,510 @@ void BufferCtrlObj::_newFrame(tPvFrame* aFrame)
 	  return;
 	}
     }
-  
-  ++bufferPt->m_acq_frame_nb;
 
-  int next_frame_nb = bufferPt->m_acq_frame_nb  + 1;
+  double now = Timestamp::now();
+
+  void* lima_buffer = aFrame->ImageBuffer;
+  if(frame_nb >= 0 && m_accumulation > 1)
+    {
+      if(!_accumulate(aFrame,frame_nb))
+	{
+	  AutoMutex lock(m_lock);
+	  if(_moreFrames())
+	    m_exposing = _queueFrame(aFrame);
+	  return;
+	}
+      lima_buffer = _limaBuffer(frame_nb);
+    }
+  else if(frame_nb >= 0 && m_sw_binning)
+    {
+      lima_buffer = _limaBuffer(frame_nb);
+      _copyFrame(lima_buffer,aFrame->ImageBuffer);
+    }
+
+  double host_time = m_cam->frameHostTime(aFrame);
+  unsigned long long timestamp = _frameTimestamp(aFrame);
+
+  if(frame_nb == HISTORY_FRAME)
+    {
+      // the pre-trigger frames go to Lima with the first post-trigger one
+      std::vector<HistoryFrame> pre_frames;
+      bool post_trigger;
+      {
+	AutoMutex lock(m_lock);
+	post_trigger = _historyFrame(aFrame,timestamp,host_time,frame_nb,pre_frames);
+      }
+      for(int pre_nb = 0;pre_nb < int(pre_frames.size());++pre_nb)
+	{
+	  const HistoryFrame& pre_frame = pre_frames[pre_nb];
+	  if(_processLimaFrame(_limaBuffer(pre_nb),pre_nb,*aFrame,
+			       pre_frame.timestamp,pre_frame.host_time,now))
+	    continue;
+	  AutoMutex lock(m_lock);
+	  HwFrameInfoType frame_info;
+	  _setFrameTime(frame_info,pre_frame.timestamp,pre_frame.host_time);
+	  _readyFrame(pre_nb,frame_info,now,lock);
+	}
+      if(!post_trigger)
+	return;
+      lima_buffer = _limaBuffer(frame_nb);
+    }
+
+  if(frame_nb >= 0 && _processLimaFrame(lima_buffer,frame_nb,*aFrame,
+					timestamp,host_time,now))
+    {
+      // Lima gets the frame from the pipeline, in frame order
+      AutoMutex lock(m_lock);
+      if(_moreFrames())
+	_queueFrame(aFrame);
+      int nb_completed = m_next_ready_nb + int(m_pending.size());
+      m_exposing = m_next_frame_nb > nb_completed;
+      return;
+    }
+
+  AutoMutex lock(m_lock);
+  HwFrameInfoType frame_info;
+  _setFrameTime(frame_info,timestamp,host_time);
+  if(frame_nb < 0)
+    {
+      if(frame_nb == DECIMATED_FRAME)
+	++m_overrun_status.nb_decimated;
+      else
+	++m_overrun_status.nb_dropped;
+      m_exposing = _queueFrame(aFrame);
+      return;
+    }
+  if(_moreFrames())
+    _queueFrame(aFrame);
+  _readyFrame(frame_nb,frame_info,now,lock);
+}
 
-  tPvFrame* next_frame = &(bufferPt->m_frame[next_frame_nb % 2]);
+//-----------------------------------------------------
+// @brief run the processors on a frame complete in its Lima buffer
+// @return true if the pipeline delivers it to Lima
+//-----------------------------------------------------
+bool BufferCtrlObj::_processLimaFrame(void* lima_buffer,int frame_nb,const tPvFrame& aFrame,
+				      unsigned long long timestamp,double host_time,double now)
+{
+  FrameProcessorChain& processors = m_cam->getFrameProcessors();
+  if(processors.empty())
+    return false;
 
-  bool stopAcq = false;
-  if(!requested_nb_frames || 
-     bufferPt->m_acq_frame_nb < (requested_nb_frames - 1))
+  FrameData frame;
+  frame.data = lima_buffer;
+  frame.width = m_frame_dim.getSize().getWidth();
+  frame.height = m_frame_dim.getSize().getHeight();
+  frame.depth = m_frame_dim.getDepth();
+  frame.mode = frame.depth == 1 ? Y8 : (frame.depth == 2 ? Y16 : Y32);
+  // a binned frame is no longer a Bayer mosaic
+  const FormatKernels& kernels = m_cam->frameFormatKernels(aFrame);
+  frame.layout = m_sw_bin.isOne() && isBayer(kernels.layout) ?
+    kernels.layout : LayoutMono;
+  frame.frame_nb = frame_nb;
+  frame.timestamp = now;
+  frame.camera_timestamp = timestamp;
+  frame.host_timestamp = host_time;
+  frame.compressed = NULL;
+  FramePipeline& pipeline = m_cam->getFramePipeline();
+  if(pipeline.isActive())
     {
-      int buffer_nb, concat_frame_nb;
-      bufferPt->m_buffer_cb_mgr.acqFrameNb2BufferNb(
-                            next_frame_nb,
-						    buffer_nb,
-						    concat_frame_nb);
-      next_frame->ImageBuffer = (char*)bufferPt->m_buffer_cb_mgr.getBufferPtr(
-                                      buffer_nb,
-									  concat_frame_nb);
-      bufferPt->m_exposing = true;
-      bufferPt->m_status = PvCaptureQueueFrame(bufferPt->m_handle,
-                                               next_frame,
-                                               _newFrame);
+      pipeline.submit(frame,[this](FrameData& processed) {_pipelineFrame(processed);});
+      return true;
     }
-  else
-    stopAcq = true;
-  
+  processors.process(frame);
+  return false;
+}
+
+//-----------------------------------------------------
+// @brief delivery of the frames processed by the pipeline
+//-----------------------------------------------------
+void BufferCtrlObj::_pipelineFrame(FrameData& frame)
+{
+  double now = Timestamp::now();
+  AutoMutex lock(m_lock);
   HwFrameInfoType frame_info;
-  frame_info.acq_frame_nb = bufferPt->m_acq_frame_nb;
-  bufferPt->m_buffer_cb_mgr.newFrameReady(frame_info);
-  
+  _setFrameTime(frame_info,frame.camera_timestamp,frame.host_timestamp);
+  _readyFrame(frame.frame_nb,frame_info,now,lock);
+}
+
+//-----------------------------------------------------
+// @brief a frame is complete in its Lima buffer, m_lock is released
+//-----------------------------------------------------
+void BufferCtrlObj::_readyFrame(int frame_nb,HwFrameInfoType& frame_info,
+				double now,AutoMutex& lock)
+{
+  _updateBatchSize(now);
+
+  // keep the notifications in frame order
+  frame_info.acq_frame_nb = frame_nb;
+  m_pending[frame_nb] = frame_info;
+  int next_ready_nb = m_next_ready_nb;
+  while(!m_pending.empty() && m_pending.begin()->first == m_next_ready_nb)
+    {
+      if(m_batch.empty())
+	{
+	  m_batch_start = now;
+	  if(m_batching)
+	    {
+	      AutoMutex batch_lock(m_batch_cond.mutex());
+	      m_batch_deadline = now + m_max_batch_latency;
+	      m_batch_cond.broadcast();
+	    }
+	}
+      m_batch.push_back(m_pending.begin()->second);
+      m_pending.erase(m_pending.begin());
+      ++m_next_ready_nb;
+    }
+  if(m_next_ready_nb != next_ready_nb)
+    {
+      AutoMutex ready_lock(m_ready_cond.mutex());
+      m_last_ready = m_next_ready_nb - 1;
+      m_ready_cond.broadcast();
+    }
+
+  int nb_completed = m_next_ready_nb + int(m_pending.size());
+  m_exposing = m_next_frame_nb > nb_completed;
+
+  bool stopAcq = m_nb_frames && m_next_ready_nb == m_nb_frames;
+  if(stopAcq || int(m_batch.size()) >= m_batch_size ||
+     now - m_batch_start >= m_max_batch_latency)
+    _flushBatch();
+  lock.unlock();
+
   if(stopAcq)
-    bufferPt->m_sync->stopAcq(false);
+    m_sync->requestStop();
+}
+
+void* BufferCtrlObj::_limaBuffer(int frame_nb)
+{
+  int buffer_nb,concat_frame_nb;
+  m_buffer_cb_mgr.acqFrameNb2BufferNb(frame_nb,buffer_nb,concat_frame_nb);
+  return m_buffer_cb_mgr.getBufferPtr(buffer_nb,concat_frame_nb);
+}
+
+//-----------------------------------------------------
+// @brief check the camera frames against the Lima ones, a software
+// binning or depth conversion needs the raw frames in m_raw
+//-----------------------------------------------------
+void BufferCtrlObj::_prepareSoftwareBinning(const FrameDim& dim,int nb_queued)
+{
+  DEB_MEMBER_FUNCT();
+
+  m_cam->getSoftwareBin(m_sw_bin);
+  SoftwareBinMode mode;
+  m_cam->getSoftwareBinMode(mode);
+  m_sw_bin_mean = mode == SoftwareBinMean;
+
+  tPvUint32 width,height,frame_size;
+  if(PvAttrUint32Get(m_handle,"Width",&width) ||
+     PvAttrUint32Get(m_handle,"Height",&height) ||
+     PvAttrUint32Get(m_handle,"TotalBytesPerFrame",&frame_size))
+    throw LIMA_HW_EXC(Error,"Can't get camera image size");
+  m_raw_width = width;
+  m_raw_depth = width && height ? frame_size / (width * height) : 0;
+
+  m_sw_binning = !m_sw_bin.isOne() || m_raw_depth != dim.getDepth();
+  if(!m_sw_binning)
+    {
+      m_raw_size = m_frame_size;
+      m_raw.clear();
+      m_bin_rows.clear();
+      return;
+    }
+
+  if(m_raw_depth != 1 && m_raw_depth != 2)
+    throw LIMA_HW_EXC(NotSupported,"Software binning needs a Mono or Bayer pixel format");
+  const Size& size = dim.getSize();
+  if(int(width) / m_sw_bin.getX() != size.getWidth() ||
+     int(height) / m_sw_bin.getY() != size.getHeight())
+    throw LIMA_HW_EXC(Error,"Camera image doesn't match the binned Lima frame");
+
+  m_raw_size = size_t(frame_size);
+  m_raw.resize(size_t(nb_queued) * m_raw_size);
+  m_nb_bin_bands = std::max(1,std::min(size.getHeight(),
+				       m_cam->getWorkerPool().getNbThreads() + 1));
+  m_bin_rows.resize(size_t(m_nb_bin_bands) * width);
+  m_bin_function = Kernels::selectBin(m_raw_depth,dim.getDepth(),
+				      m_sw_bin.getX(),m_sw_bin.getY(),m_sw_bin_mean);
+  m_accumulation_bin = Kernels::selectBin(m_raw_depth,4,m_sw_bin.getX(),m_sw_bin.getY(),
+					  m_sw_bin_mean);
+  if(m_accumulation > 1 && !m_sw_bin.isOne())
+    m_accumulation_tmp.resize(size_t(size.getWidth()) * size.getHeight());
+  else
+    m_accumulation_tmp.clear();
+
+  DEB_TRACE() << DEB_VAR4(m_sw_bin,m_sw_bin_mean,m_raw_depth,dim.getDepth());
+}
+
+//-----------------------------------------------------
+// @brief a camera frame to a Lima buffer, binned by row bands
+//-----------------------------------------------------
+void BufferCtrlObj::_copyFrame(void* dst,const void* raw)
+{
+  if(!m_sw_binning)
+    {
+      memcpy(dst,raw,m_frame_size);
+      return;
+    }
+
+  int height = m_frame_dim.getSize().getHeight();
+  int band_height = (height + m_nb_bin_bands - 1) / m_nb_bin_bands;
+  m_cam->getWorkerPool().parallelFor(m_nb_bin_bands,[&](int band)
+    {
+      int first_row = band * band_height;
+      int last_row = std::min(height,first_row + band_height);
+      if(first_row < last_row)
+	m_bin_function(raw,m_raw_width,m_sw_bin.getX(),m_sw_bin.getY(),
+		       dst,first_row,last_row,&m_bin_rows[size_t(band) * m_raw_width]);
+    });
+}
+
+//-----------------------------------------------------
+// @brief add a camera frame to the 32 bit sum of its Lima frame
+// @return true when the sum is complete
+//-----------------------------------------------------
+bool BufferCtrlObj::_accumulate(tPvFrame* aFrame,int frame_nb)
+{
+  DEB_MEMBER_FUNCT();
+
+  const void* raw = aFrame->ImageBuffer;
+  if(m_saturation_level)
+    {
+      int nb_pixels = int(m_raw_size / m_raw_depth);
+      int nb_saturated = m_raw_depth == 1 ?
+	Kernels::countSaturated8((const uint8_t*)raw,nb_pixels,
+				 uint8_t(std::min(m_saturation_level,0xff))) :
+	Kernels::countSaturated16((const uint16_t*)raw,nb_pixels,
+				  uint16_t(m_saturation_level));
+      if(nb_saturated)
+	{
+	  AutoMutex lock(m_lock);
+	  ++m_accumulation_status.nb_saturated_frames;
+	  m_accumulation_status.nb_saturated_pixels += nb_saturated;
+	  m_accumulation_status.last_saturated_frame = frame_nb;
+	}
+    }
+
+  uint32_t* sum = (uint32_t*)_limaBuffer(frame_nb);
+  int width = m_frame_dim.getSize().getWidth();
+  int height = m_frame_dim.getSize().getHeight();
+  int band_height = (height + m_nb_bin_bands - 1) / m_nb_bin_bands;
+  m_cam->getWorkerPool().parallelFor(m_nb_bin_bands,[&](int band)
+    {
+      int first_row = band * band_height;
+      int last_row = std::min(height,first_row + band_height);
+      if(first_row >= last_row)
+	return;
+      size_t offset = size_t(first_row) * width;
+      int nb = (last_row - first_row) * width;
+      if(!m_sw_bin.isOne())
+	{
+	  uint32_t* binned = &m_accumulation_tmp[0];
+	  m_accumulation_bin(raw,m_raw_width,m_sw_bin.getX(),m_sw_bin.getY(),
+			     binned,first_row,last_row,
+			     &m_bin_rows[size_t(band) * m_raw_width]);
+	  Kernels::add32(sum + offset,binned + offset,nb);
+	}
+      else if(m_raw_depth == 1)
+	Kernels::add8(sum + offset,(const uint8_t*)raw + offset,nb);
+      else
+	Kernels::add16(sum + offset,(const uint16_t*)raw + offset,nb);
+    });
+
+  std::map<int,int>::iterator i = m_nb_subframes.insert(std::make_pair(frame_nb,0)).first;
+  if(++i->second < m_accumulation)
+    return false;
+  m_nb_subframes.erase(i);
+  return true;
+}
+
+unsigned long long BufferCtrlObj::_frameTimestamp(const tPvFrame* aFrame)
+{
+  return (unsigned long long)aFrame->TimestampHi << 32 | aFrame->TimestampLo;
+}
+
+Timestamp BufferCtrlObj::_cameraTime(unsigned long long timestamp) const
+{
+  return Timestamp(double((long long)(timestamp - m_start_timestamp)) /
+		   m_timestamp_frequency);
+}
+
+//-----------------------------------------------------
+// @brief the history frames are timed from the camera start time stamp,
+// the others from the clock model if any (else Lima takes the arrival)
+//-----------------------------------------------------
+void BufferCtrlObj::_setFrameTime(HwFrameInfoType& frame_info,
+				  unsigned long long timestamp,double host_time)
+{
+  if(m_history_active)
+    frame_info.frame_timestamp = _cameraTime(timestamp);
+  else if(host_time > 0.)
+    frame_info.frame_timestamp = Timestamp(host_time - m_start_time);
+}
+
+//-----------------------------------------------------
+// @brief handle a frame received in the history ring
+// @return true with frame_nb set if it goes to Lima as a post-trigger frame
+//-----------------------------------------------------
+bool BufferCtrlObj::_historyFrame(tPvFrame* aFrame,unsigned long long timestamp,
+				  double host_time,int& frame_nb,
+				  std::vector<HistoryFrame>& pre_frames)
+{
+  int slot = (int)(intptr_t)aFrame->Context[2];
+  if(!m_frozen && !(m_triggered && timestamp > m_trigger_timestamp))
+    {
+      // pre-trigger, only the last frames are kept
+      m_history.push_back(HistoryFrame(slot,timestamp,host_time));
+      if(int(m_history.size()) > m_history_pre)
+	{
+	  m_free_slots.push_back(m_history.front().slot);
+	  m_history.pop_front();
+	}
+      m_exposing = _queueFrame(aFrame);
+      return false;
+    }
+
+  if(!m_frozen)
+    _freezeHistory(pre_frames);
+
+  // post-trigger frame exposed before the PvAPI frames were
+  // requeued on the Lima buffers
+  frame_nb = m_slot_post_nb++;
+  m_free_slots.push_back(slot);
+  if(frame_nb >= m_nb_frames)
+    return false;
+
+  _copyFrame(_limaBuffer(frame_nb),&m_ring[slot * m_raw_size]);
+  return true;
+}
+
+//-----------------------------------------------------
+// @brief copy the pre-trigger frames to the first Lima buffers, they
+// are returned in pre_frames to be processed and made ready.
+// The next PvAPI frames go to the Lima buffers of the post-trigger frames
+//-----------------------------------------------------
+void BufferCtrlObj::_freezeHistory(std::vector<HistoryFrame>& pre_frames)
+{
+  DEB_MEMBER_FUNCT();
+
+  int nb_pre = int(m_history.size());
+  for(int frame_nb = 0;frame_nb < nb_pre;++frame_nb)
+    {
+      const HistoryFrame& history_frame = m_history[frame_nb];
+      _copyFrame(_limaBuffer(frame_nb),&m_ring[history_frame.slot * m_raw_size]);
+      m_free_slots.push_back(history_frame.slot);
+    }
+  pre_frames.assign(m_history.begin(),m_history.end());
+  m_history.clear();
+
+  // all the PvAPI frames are in flight on ring slots, the current one included
+  m_slot_post_nb = nb_pre;
+  m_next_frame_nb = nb_pre + int(m_frame.size());
+  m_frozen = true;
+  DEB_TRACE() << "History frozen: " << DEB_VAR2(nb_pre,m_trigger_timestamp);
+}
+
+//-----------------------------------------------------
+// @brief adapt the batch size to the measured frame interval
+//-----------------------------------------------------
+void BufferCtrlObj::_updateBatchSize(double now)
+{
+  if(!m_batching)
+    return;
+
+  if(m_last_frame_time >= 0.)
+    {
+      double interval = now - m_last_frame_time;
+      // follow a rate drop at once, smooth the increases
+      if(m_frame_interval <= 0. || interval > m_frame_interval)
+	m_frame_interval = interval;
+      else
+	m_frame_interval = 0.9 * m_frame_interval + 0.1 * interval;
+    }
+  m_last_frame_time = now;
+
+  int size = 1;
+  if(m_frame_interval > 0.)
+    size = int(m_max_batch_latency / m_frame_interval);
+  m_batch_size = std::max(1,std::min(size,m_max_batch_size));
+}
+
+void BufferCtrlObj::_flushBatch()
+{
+  int last_consumed;
+  {
+    AutoMutex lock(m_consumer_lock);
+    last_consumed = m_consumer_tracking ? m_last_consumed : -2;
+  }
+
+  for(std::vector<HwFrameInfoType>::iterator i = m_batch.begin();
+      i != m_batch.end();++i)
+    {
+      m_acq_frame_nb = i->acq_frame_nb;
+      m_buffer_cb_mgr.newFrameReady(*i);
+    }
+  m_batch.clear();
+  if(m_batching)
+    {
+      AutoMutex batch_lock(m_batch_cond.mutex());
+      m_batch_deadline = -1.;
+    }
+
+  if(last_consumed >= -1)
+    m_overrun_status.high_water_mark = std::max(m_overrun_status.high_water_mark,
+						m_acq_frame_nb - last_consumed);
+}
+
+//-----------------------------------------------------
+// @brief flush a batch once its latency is over, even if no frame
+// comes anymore (rate drop, trigger gap). m_lock is taken before
+// m_batch_cond, never while holding it
+//-----------------------------------------------------
+void BufferCtrlObj::_batchTimer()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_batch_cond.mutex());
+  while(!m_batch_quit)
+    {
+      if(m_batch_deadline < 0.)
+	{
+	  m_batch_cond.wait();
+	  continue;
+	}
+      double wait_time = m_batch_deadline - double(Timestamp::now());
+      if(wait_time > 0.)
+	{
+	  m_batch_cond.wait(wait_time);
+	  continue;
+	}
+
+      lock.unlock();
+      {
+	AutoMutex buffer_lock(m_lock);
+	if(!m_batch.empty() &&
+	   double(Timestamp::now()) - m_batch_start >= m_max_batch_latency)
+	  _flushBatch();
+      }
+      lock.lock();
+    }
+  m_batch_thread_running = false;
+  m_batch_cond.broadcast();
+}
+
+//-----------------------------------------------------
+// @brief deliver the frames still waiting in the batch
+//-----------------------------------------------------
+void BufferCtrlObj::flushFrames()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  _flushBatch();
+  lock.unlock();
+
+  // the acquisition is over, wake up waitNextFrame
+  AutoMutex ready_lock(m_ready_cond.mutex());
+  m_running = false;
+  m_ready_cond.broadcast();
 }
@@ -27,12 +27,17 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sstream>
+#include <algorithm>
 
 #include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
 
 #include "ProsilicaCamera.h"
 #include "ProsilicaSyncCtrlObj.h"
 #include "ProsilicaVideoCtrlObj.h"
+#include "ProsilicaBufferCtrlObj.h"
+#include "ProsilicaKernels.h"
 
 using namespace lima;
 using namespace lima::Prosilica;
@@ -42,9 +47,31 @@ Camera::Camera(const std::string& ip_addr,bool master,
   m_cam_connected(false),
   m_sync(NULL),
   m_video(NULL),
+  m_buffer(NULL),
   m_bin(1,1),
+  m_sw_bin(1,1),
+  m_sw_bin_mode(SoftwareBinSum),
+  m_output_depth(0),
   m_roi(0,0,0,0),
-  m_mono_forced(mono_forced)
+  m_format_kernels(NULL),
+  m_bayer_pattern(ePvBayerRGGB),
+  m_mono_forced(mono_forced),
+  m_stream_tuning(NULL),
+  m_profiles(NULL),
+  m_callback_threads("callback"),
+  m_worker_threads("worker"),
+  m_workers(0,&m_worker_threads),
+  m_pipeline(&m_worker_threads),
+  m_flat_field(NULL),
+  m_bad_pixels(NULL),
+  m_compressor(NULL),
+  m_shm_publisher(NULL),
+  m_stream_writer(NULL),
+  m_clock_sync(NULL),
+  m_video_max_rate(0.),
+  m_last_video_time(-1.),
+  m_callback_thread(pthread_self()),
+  m_callback_generation(-1)
 {
   DEB_CONSTRUCTOR();
   //Tango signal management is a real shit (workaround)
@@ -52,6 +79,11 @@ Camera::Camera(const std::string& ip_addr,bool master,
   sigfillset(&signals);
   sigprocmask(SIG_UNBLOCK,&signals,NULL);
 
+  m_processors.setPipeline(&m_pipeline);
+  m_processors.add(&m_roi_statistics,FrameProcessor::Analysis);
+  m_processors.add(&m_preview,FrameProcessor::Output);
+  m_processors.add(&m_pyramid,FrameProcessor::Output);
+
   // Init Frames
   m_frame[0].ImageBuffer = NULL;
   m_frame[0].Context[0] = this;
@@ -86,6 +118,20 @@ Camera::Camera(const std::string& ip_addr,bool master,
 
   DEB_TRACE() << DEB_VAR2(m_maxwidth,m_maxheight);
 
+  m_profiles = new ProjectionProfiles(m_maxwidth,m_maxheight);
+  m_processors.add(m_profiles,FrameProcessor::Analysis);
+  m_flat_field = new FlatFieldCorrection(this,m_workers);
+  m_processors.add(m_flat_field,FrameProcessor::Correction);
+  m_bad_pixels = new BadPixelCorrection(this);
+  m_processors.add(m_bad_pixels,FrameProcessor::Correction);
+  // before the outputs which take the compressed frames
+  m_compressor = new FrameCompressor(m_workers);
+  m_processors.add(m_compressor,FrameProcessor::Output);
+  m_shm_publisher = new ShmPublisher(this);
+  m_processors.add(m_shm_publisher,FrameProcessor::Output);
+  m_stream_writer = new StreamWriter(this);
+  m_processors.add(m_stream_writer,FrameProcessor::Output);
+
   if(master)
     {
       Bin tmp_bin(1, 1);
@@ -128,25 +174,91 @@ Camera::Camera(const std::string& ip_addr,bool master,
     m_video_mode = Y8;
   
   m_as_master = master;
+  _updateFormatKernels();
+
+  m_stream_tuning = new StreamTuning(m_handle,m_uid);
+  m_clock_sync = new ClockSync(m_handle);
 
+  // Use the stream parameters stored by a previous auto-tune for this
+  // camera and host interface, if any. The network path may have
+  // changed since: the stored packet size is negotiated again
+  StreamParameters stream_params;
+  bool tuned = false;
+  if(master && m_stream_tuning->load(stream_params))
+    {
+      try
+	{
+	  m_stream_tuning->apply(stream_params);
+	  tuned = !stream_params.packet_size ||
+	    PvCaptureAdjustPacketSize(m_handle,stream_params.packet_size) == ePvErrSuccess;
+	}
+      catch(Exception& e)
+	{
+	  DEB_WARNING() << "Can't apply stored stream parameters: " << e.getErrMsg();
+	}
+      if(!tuned)
+	DEB_WARNING() << "Stored packet size " << stream_params.packet_size
+		      << " failed, adjusting it again";
+    }
   // NOTE: This call sets camera PacketSize to largest sized test packet, up to 8228, that doesn't fail
   // on network card. Some MS VISTA network card drivers become unresponsive if test packet fails. 
   // Use PvUint32Set(handle, "PacketSize", MaxAllowablePacketSize) instead. See network card properties
   // for max allowable PacketSize/MTU/JumboFrameSize. 
-  if((error = PvCaptureAdjustPacketSize(m_handle,8228)) != ePvErrSuccess)
-	throw LIMA_HW_EXC(Error,"PvCaptureAdjustPacketSize failed and error code  = "+ error);
+  if(!tuned && (error = PvCaptureAdjustPacketSize(m_handle,8228)) != ePvErrSuccess)
+    {
+      std::ostringstream message;
+      message << "PvCaptureAdjustPacketSize failed and error code  = " << error;
+      throw LIMA_HW_EXC(Error,message.str());
+    }
 }
 
 Camera::~Camera()
 {
   DEB_DESTRUCTOR();
 
+  // no replayed frame after the processors are gone
+  m_replayer.close();
+  m_recorder.stop();
+  if(m_clock_sync)
+    m_clock_sync->setActive(false);
   if(m_cam_connected)
     {
       PvCommandRun(m_handle,"AcquisitionStop");
       PvCaptureEnd(m_handle);
       PvCameraClose(m_handle);
     }
+  delete m_stream_tuning;
+  delete m_clock_sync;
+  if(m_profiles)
+    {
+      m_processors.remove(m_profiles);
+      delete m_profiles;
+    }
+  if(m_flat_field)
+    {
+      m_processors.remove(m_flat_field);
+      delete m_flat_field;
+    }
+  if(m_bad_pixels)
+    {
+      m_processors.remove(m_bad_pixels);
+      delete m_bad_pixels;
+    }
+  if(m_compressor)
+    {
+      m_processors.remove(m_compressor);
+      delete m_compressor;
+    }
+  if(m_shm_publisher)
+    {
+      m_processors.remove(m_shm_publisher);
+      delete m_shm_publisher;
+    }
+  if(m_stream_writer)
+    {
+      m_processors.remove(m_stream_writer);
+      delete m_stream_writer;
+    }
   PvUnInitialize();
   if(m_frame[0].ImageBuffer)
     free(m_frame[0].ImageBuffer);
@@ -178,6 +290,286 @@ void Camera::getCameraName(std::string& name)
 
   name = m_camera_name;
 }
+//-----------------------------------------------------
+// @brief the stream can only be changed while not acquiring
+//-----------------------------------------------------
+void Camera::checkNotRunning()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_sync)
+    {
+      HwInterface::StatusType status;
+      m_sync->getStatus(status);
+      if(status.acq == AcqRunning)
+	throw LIMA_HW_EXC(Error,"Can't do that while acquiring");
+    }
+}
+
+void Camera::setStreamParameters(const StreamParameters& params)
+{
+  DEB_MEMBER_FUNCT();
+
+  checkNotRunning();
+  m_stream_tuning->apply(params);
+}
+
+void Camera::getStreamParameters(StreamParameters& params) const
+{
+  DEB_MEMBER_FUNCT();
+
+  m_stream_tuning->read(params);
+}
+
+void Camera::setPacketSize(unsigned long packet_size)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(packet_size);
+
+  checkNotRunning();
+  tPvErr error = PvAttrUint32Set(m_handle,"PacketSize",packet_size);
+  if(error)
+    throw LIMA_HW_EXC(Error,"Can't set PacketSize");
+}
+
+void Camera::getPacketSize(unsigned long& packet_size) const
+{
+  DEB_MEMBER_FUNCT();
+
+  tPvErr error = PvAttrUint32Get(m_handle,"PacketSize",&packet_size);
+  if(error)
+    throw LIMA_HW_EXC(Error,"Can't get PacketSize");
+
+  DEB_RETURN() << DEB_VAR1(packet_size);
+}
+
+//-----------------------------------------------------
+// @brief one-shot tuning of packet size, stream hold and resend windows.
+// the best set is applied and stored for this camera and host interface
+//-----------------------------------------------------
+void Camera::autoTuneStream(int nb_frames,StreamParameters& best,
+			    std::vector<StreamTestResult>* results)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if(!m_as_master)
+    throw LIMA_HW_EXC(Error,"Stream auto-tune needs master access");
+  checkNotRunning();
+
+  m_stream_tuning->autoTune(nb_frames,best,results);
+  m_stream_tuning->save(best);
+}
+
+void Camera::saveStreamParameters()
+{
+  DEB_MEMBER_FUNCT();
+
+  StreamParameters params;
+  m_stream_tuning->read(params);
+  m_stream_tuning->save(params);
+}
+
+SyncCtrlObj* Camera::_getSync()
+{
+  if(!m_sync)
+    throw LIMA_HW_EXC(Error,"No interface created for this camera");
+  return m_sync;
+}
+
+BufferCtrlObj* Camera::_getBuffer()
+{
+  if(!m_buffer)
+    throw LIMA_HW_EXC(NotSupported,"Not available in video mode");
+  return m_buffer;
+}
+
+void Camera::getAcqPlan(AcqPlan& plan)
+{
+  _getSync()->getAcqPlan(plan);
+}
+
+void Camera::predictAcq(const AcqPlan& plan,AcqPrediction& prediction)
+{
+  _getSync()->predictAcq(plan,prediction);
+}
+
+void Camera::setStrictPlanCheck(bool strict)
+{
+  _getSync()->setStrictPlanCheck(strict);
+}
+
+void Camera::getStrictPlanCheck(bool& strict)
+{
+  strict = _getSync()->getStrictPlanCheck();
+}
+
+void Camera::setLinkSpeed(double bytes_per_second)
+{
+  _getSync()->setLinkSpeed(bytes_per_second);
+}
+
+void Camera::getLinkSpeed(double& bytes_per_second)
+{
+  bytes_per_second = _getSync()->getLinkSpeed();
+}
+
+void Camera::getStopLatency(double& last,double& max)
+{
+  _getSync()->getStopLatency(last,max);
+}
+
+void Camera::calibrateTimingModel()
+{
+  DEB_MEMBER_FUNCT();
+
+  checkNotRunning();
+  SyncCtrlObj* sync = _getSync();
+  sync->getTimingModel().calibrate();
+  sync->updateValidRanges();
+}
+
+void Camera::getTimingModel(double& offset,double& row_time,double& shift_time,
+			    double& byte_time)
+{
+  _getSync()->getTimingModel().getParameters(offset,row_time,shift_time,byte_time);
+}
+
+void Camera::setNbQueuedFrames(int nb_frames)
+{
+  _getBuffer()->setNbQueuedFrames(nb_frames);
+}
+
+void Camera::getNbQueuedFrames(int& nb_frames)
+{
+  nb_frames = _getBuffer()->getNbQueuedFrames();
+}
+
+void Camera::setMaxBatchSize(int size)
+{
+  _getBuffer()->setMaxBatchSize(size);
+}
+
+void Camera::getMaxBatchSize(int& size)
+{
+  size = _getBuffer()->getMaxBatchSize();
+}
+
+void Camera::setMaxBatchLatency(double latency)
+{
+  _getBuffer()->setMaxBatchLatency(latency);
+}
+
+void Camera::getMaxBatchLatency(double& latency)
+{
+  latency = _getBuffer()->getMaxBatchLatency();
+}
+
+void Camera::setOverrunPolicy(OverrunPolicy policy)
+{
+  _getBuffer()->setOverrunPolicy(policy);
+}
+
+void Camera::getOverrunPolicy(OverrunPolicy& policy)
+{
+  policy = _getBuffer()->getOverrunPolicy();
+}
+
+void Camera::setOverrunDecimation(int decimation)
+{
+  _getBuffer()->setOverrunDecimation(decimation);
+}
+
+void Camera::getOverrunDecimation(int& decimation)
+{
+  decimation = _getBuffer()->getOverrunDecimation();
+}
+
+void Camera::getOverrunStatus(OverrunStatus& status)
+{
+  _getBuffer()->getOverrunStatus(status);
+}
+
+void Camera::setHistory(int pre_frames,int post_frames)
+{
+  _getBuffer()->setHistory(pre_frames,post_frames);
+}
+
+void Camera::getHistory(int& pre_frames,int& post_frames)
+{
+  _getBuffer()->getHistory(pre_frames,post_frames);
+}
+
+void Camera::setHistoryTrigger(HistoryTrigger trigger)
+{
+  _getBuffer()->setHistoryTrigger(trigger);
+}
+
+void Camera::getHistoryTrigger(HistoryTrigger& trigger)
+{
+  trigger = _getBuffer()->getHistoryTrigger();
+}
+
+void Camera::triggerHistory()
+{
+  _getBuffer()->triggerHistory();
+}
+
+bool Camera::isHistoryTriggered()
+{
+  return _getBuffer()->isHistoryTriggered();
+}
+
+void Camera::setAccumulation(int nb_frames)
+{
+  _getBuffer()->setAccumulation(nb_frames);
+}
+
+void Camera::getAccumulation(int& nb_frames)
+{
+  nb_frames = _getBuffer()->getAccumulation();
+}
+
+void Camera::setSaturationLevel(int level)
+{
+  _getBuffer()->setSaturationLevel(level);
+}
+
+void Camera::getSaturationLevel(int& level)
+{
+  level = _getBuffer()->getSaturationLevel();
+}
+
+void Camera::getAccumulationStatus(AccumulationStatus& status)
+{
+  _getBuffer()->getAccumulationStatus(status);
+}
+
+FrameLease* Camera::leaseFrame(int frame_nb)
+{
+  return new FrameLease(*_getBuffer(),frame_nb);
+}
+
+int Camera::waitNextFrame(int after_frame_nb,double timeout)
+{
+  return _getBuffer()->waitNextFrame(after_frame_nb,timeout);
+}
+
+void Camera::setVideoMaxRate(double rate)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(rate);
+
+  if(rate < 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Video rate can't be negative");
+  m_video_max_rate = rate;
+}
+
+void Camera::getVideoMaxRate(double& rate)
+{
+  rate = m_video_max_rate;
+}
+
 void Camera::setVideoMode(VideoMode aMode)
 {
   DEB_MEMBER_FUNCT();
@@ -219,6 +611,12 @@ void Camera::setVideoMode(VideoMode aMode)
     throw LIMA_HW_EXC(Error,"Can't change video mode");
   
   m_video_mode = aMode;
+  _updateFormatKernels();
+  // the readout time depends on the bytes per pixel
+  if(m_sync)
+    m_sync->updateValidRanges();
+  if(m_output_depth)
+    anImageType = _getImageType();
   maxImageSizeChanged(Size(m_maxwidth,m_maxheight),anImageType);
 }
 
@@ -256,7 +654,8 @@ void Camera::startAcq()
 
   m_continue_acq = true;
   m_acq_frame_nb = 0;
-  tPvErr error = PvCaptureQueueFrame(m_handle,&m_frame[0],_newFrameCBK);
+  m_last_video_time = -1.;
+  tPvErr error = queueFrame(&m_frame[0],_newFrameCBK);
 
   int requested_nb_frames;
   m_sync->getNbFrames(requested_nb_frames);
@@ -264,7 +663,7 @@ void Camera::startAcq()
   m_video->getLive(isLive);
 
   if(!requested_nb_frames || requested_nb_frames > 1 || isLive)
-    error = PvCaptureQueueFrame(m_handle,&m_frame[1],_newFrameCBK);
+    error = queueFrame(&m_frame[1],_newFrameCBK);
 }
 
 void Camera::reset()
@@ -277,7 +676,114 @@ void Camera::_newFrameCBK(tPvFrame* aFrame)
 {
   DEB_STATIC_FUNCT();
   Camera *aCamera = (Camera*)aFrame->Context[0];
+  double start = aCamera->beginCallback();
+  aCamera->m_recorder.record(aFrame);
   aCamera->_newFrame(aFrame);
+  aCamera->endCallback(start);
+}
+
+void Camera::setCallbackThreadPolicy(const ThreadPolicy& policy)
+{
+  DEB_MEMBER_FUNCT();
+  // taken by the callback thread with its next frame
+  m_callback_threads.set(policy);
+}
+
+void Camera::getCallbackThreadPolicy(ThreadPolicy& policy)
+{
+  m_callback_threads.get(policy);
+}
+
+void Camera::setWorkerThreadPolicy(const ThreadPolicy& policy)
+{
+  DEB_MEMBER_FUNCT();
+  // the stream writing threads take it with the next acquisition
+  m_worker_threads.set(policy);
+  m_workers.applyThreadPolicy();
+}
+
+void Camera::getWorkerThreadPolicy(ThreadPolicy& policy)
+{
+  m_worker_threads.get(policy);
+}
+
+void Camera::getThreadStates(std::vector<ThreadState>& states)
+{
+  states.clear();
+  m_callback_threads.getStates(states);
+  m_worker_threads.getStates(states);
+}
+
+void Camera::getCallbackStatus(CallbackStatus& status)
+{
+  AutoMutex lock(m_callback_lock);
+  status = m_callback_status;
+}
+
+void Camera::resetCallbackStatus()
+{
+  AutoMutex lock(m_callback_lock);
+  m_callback_status = CallbackStatus();
+}
+
+//-----------------------------------------------------
+// @brief the replayed time stamps are not from this camera clock
+//-----------------------------------------------------
+double Camera::frameHostTime(const tPvFrame* aFrame)
+{
+  double host_time = 0.;
+  if(!m_replayer.isActive())
+    m_clock_sync->toHostTime((unsigned long long)aFrame->TimestampHi << 32 |
+			     aFrame->TimestampLo,host_time);
+  return host_time;
+}
+
+//-----------------------------------------------------
+// @brief the callback thread may change (replay), the policy is
+// applied to each new one
+//-----------------------------------------------------
+double Camera::beginCallback()
+{
+  pthread_t self = pthread_self();
+  if(!pthread_equal(self,m_callback_thread))
+    {
+      m_callback_thread = self;
+      m_callback_generation = -1;
+    }
+  m_callback_threads.update(m_callback_generation);
+  return Timestamp::now();
+}
+
+void Camera::endCallback(double start)
+{
+  double duration = double(Timestamp::now()) - start;
+  AutoMutex lock(m_callback_lock);
+  CallbackStatus& status = m_callback_status;
+  ++status.nb_frames;
+  status.last_duration = duration;
+  status.mean_duration += (duration - status.mean_duration) / status.nb_frames;
+  if(duration > status.max_duration)
+    status.max_duration = duration;
+}
+
+//-----------------------------------------------------
+// @brief PvCaptureQueueFrame, unless a recording is replayed
+//-----------------------------------------------------
+tPvErr Camera::queueFrame(tPvFrame* aFrame,tPvFrameCallback callback)
+{
+  if(m_replayer.isActive())
+    return m_replayer.queueFrame(aFrame,callback);
+  return PvCaptureQueueFrame(m_handle,aFrame,callback);
+}
+
+tPvErr Camera::clearFrameQueue()
+{
+  if(m_replayer.isActive())
+    {
+      m_replayer.clear();
+      return ePvErrSuccess;
+    }
+  return PvCaptureQueueClear(m_handle);
 }
 
 void Camera::_newFrame(tPvFrame* aFrame)
@@ -291,7 +797,7 @@ void Camera::_newFrame(tPvFrame* aFrame)
       if(aFrame->Status != ePvErrCancelled)
 	{
 	  DEB_WARNING() << DEB_VAR1(aFrame->Status);
-	  PvCaptureQueueFrame(m_handle,aFrame,_newFrameCBK);
+	  queueFrame(aFrame,_newFrameCBK);
 	}
       return;
     }
@@ -303,36 +809,139 @@ void Camera::_newFrame(tPvFrame* aFrame)
   ++m_acq_frame_nb;
 
   bool stopAcq = false;
+  bool requeue = false;
   if(isLive || !requested_nb_frames || m_acq_frame_nb < (requested_nb_frames - 1))
-    {
-      if(isLive || !requested_nb_frames ||
-	 m_acq_frame_nb < (requested_nb_frames - 2))
-	tPvErr error = PvCaptureQueueFrame(m_handle,aFrame,_newFrameCBK);
-    }
+    requeue = isLive || !requested_nb_frames ||
+      m_acq_frame_nb < (requested_nb_frames - 2);
   else
     stopAcq = true;
-  
-  VideoMode mode;
-  switch(aFrame->Format)
+
+  const FormatKernels& kernels = frameFormatKernels(*aFrame);
+  if(!kernels.supported)
     {
-    case ePvFmtMono8: 	mode = Y8;		break;
-    case ePvFmtMono16: 	mode = Y16;		break;
-    case ePvFmtBayer8: 	mode = BAYER_RG8;	break;
-    case ePvFmtBayer16: mode = BAYER_RG16;	break;
-    case ePvFmtRgb24:   mode = RGB24;           break;
-    case ePvFmtBgr24:   mode = BGR24;           break;
-    default:
       DEB_ERROR() << "Format not supported: " << DEB_VAR1(aFrame->Format);
-      m_sync->stopAcq();
+      m_sync->requestStop(true);
       return;
     }
+  VideoMode mode = kernels.mode;
+
+  // the binning the camera can't do, in the Mono modes only
+  void* image = aFrame->ImageBuffer;
+  int width = aFrame->Width,height = aFrame->Height;
+  int depth = aFrame->ImageSize / (aFrame->Width * aFrame->Height);
+  if(!m_sw_bin.isOne())
+    {
+      if(kernels.layout != LayoutMono)
+	{
+	  DEB_ERROR() << "Software binning needs a Mono video mode";
+	  m_sync->requestStop(true);
+	  return;
+	}
+      image = _binVideoFrame(aFrame->ImageBuffer,depth,width,height);
+    }
+
+  double now = Timestamp::now();
+  if(!m_processors.empty())
+    {
+      FrameData frame;
+      frame.data = image;
+      frame.width = width;
+      frame.height = height;
+      frame.depth = depth;
+      frame.mode = mode;
+      frame.layout = kernels.layout;
+      frame.frame_nb = m_acq_frame_nb;
+      frame.timestamp = now;
+      frame.camera_timestamp = (unsigned long long)aFrame->TimestampHi << 32 |
+	aFrame->TimestampLo;
+      frame.host_timestamp = frameHostTime(aFrame);
+      frame.compressed = NULL;
+      m_processors.process(frame);
+    }
 
-  m_continue_acq =  m_video->callNewImage((char*)aFrame->ImageBuffer,
-					  aFrame->Width,
-					  aFrame->Height,
-					  mode);
+  // in live mode, the Lima video chain only gets the frames due at
+  // the max rate. the last frame of an acquisition is always given
+  double max_rate = m_video_max_rate;
+  if(!isLive || stopAcq || max_rate <= 0. || m_last_video_time < 0. ||
+     now - m_last_video_time >= 1. / max_rate)
+    {
+      m_last_video_time = now;
+      m_continue_acq =  m_video->callNewImage((char*)image,
+					      width,
+					      height,
+					      mode);
+    }
+  // the buffer goes back to PvAPI once the processors and Lima are done with it
+  if(requeue)
+    queueFrame(aFrame,_newFrameCBK);
   if(stopAcq || !m_continue_acq)
-    m_sync->stopAcq(false);
+    m_sync->requestStop();
+}
+
+//-----------------------------------------------------
+// @brief software binning of a video frame by row bands
+// @return the binned frame, width and height are updated
+//-----------------------------------------------------
+void* Camera::_binVideoFrame(const void* raw,int depth,int& width,int& height)
+{
+  int raw_width = width;
+  int bin_x = m_sw_bin.getX(),bin_y = m_sw_bin.getY();
+  width /= bin_x;
+  height /= bin_y;
+  m_video_binned.resize(size_t(width) * height * depth);
+  int nb_bands = std::max(1,std::min(height,m_workers.getNbThreads() + 1));
+  m_video_bin_rows.resize(size_t(nb_bands) * raw_width);
+
+  bool mean = m_sw_bin_mode == SoftwareBinMean;
+  void* binned = &m_video_binned[0];
+  int band_height = (height + nb_bands - 1) / nb_bands;
+  m_workers.parallelFor(nb_bands,[&](int band)
+    {
+      int first_row = band * band_height;
+      int last_row = std::min(height,first_row + band_height);
+      if(first_row < last_row)
+	Kernels::bin(raw,depth,raw_width,bin_x,bin_y,mean,binned,depth,
+		     first_row,last_row,&m_video_bin_rows[size_t(band) * raw_width]);
+    });
+  return binned;
+}
+
+//-----------------------------------------------------
+// @brief the kernels of the video mode, out of the frame callbacks
+//-----------------------------------------------------
+void Camera::_updateFormatKernels()
+{
+  DEB_MEMBER_FUNCT();
+
+  tPvImageFormat format;
+  switch(m_video_mode)
+    {
+    case Y16:		format = ePvFmtMono16;	break;
+    case BAYER_RG8:	format = ePvFmtBayer8;	break;
+    case BAYER_RG16:	format = ePvFmtBayer16;	break;
+    case RGB24:		format = ePvFmtRgb24;	break;
+    case BGR24:		format = ePvFmtBgr24;	break;
+    default:		format = ePvFmtMono8;	break;
+    }
+  m_format_kernels = &FormatKernels::get(format,m_bayer_pattern);
+}
+
+//-----------------------------------------------------
+// @brief a frame does not match the kernels of the video mode: the
+// Bayer order of the sensor, learnt once, or a format set behind us
+//-----------------------------------------------------
+const FormatKernels& Camera::_frameFormatChanged(const tPvFrame& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(frame.Format != m_format_kernels->format)
+    DEB_WARNING() << "Frame format differs from the video mode: "
+		  << DEB_VAR2(frame.Format,m_video_mode);
+  else
+    DEB_TRACE() << "Bayer order: " << DEB_VAR1(frame.BayerPattern);
+  m_bayer_pattern = frame.BayerPattern;
+  m_format_kernels = &FormatKernels::get(frame.Format,frame.BayerPattern);
+  return *m_format_kernels;
 }
 
 //-----------------------------------------------------
@@ -354,6 +963,20 @@ void Camera::checkBin(Bin &hw_bin)
     DEB_RETURN() << DEB_VAR1(hw_bin);
 }
 
+//-----------------------------------------------------
+// @brief the largest divisor of factor the camera can bin
+//-----------------------------------------------------
+int Camera::_cameraBinFactor(const char* attr,int factor)
+{
+  tPvUint32 min_bin,max_bin;
+  if(PvAttrRangeUint32(m_handle,attr,&min_bin,&max_bin))
+    return 1;
+  int camera_factor = std::min(factor,int(max_bin));
+  while(factor % camera_factor)
+    --camera_factor;
+  return camera_factor;
+}
+
 //-----------------------------------------------------
 // @brief set the new binning mode
 //-----------------------------------------------------
@@ -361,12 +984,15 @@ void Camera::setBin(const Bin &set_bin)
 {
     DEB_MEMBER_FUNCT();
 
-    PvAttrUint32Set(m_handle, "BinningX", set_bin.getX());
-    PvAttrUint32Set(m_handle, "BinningY", set_bin.getY());
+    int x = _cameraBinFactor("BinningX",set_bin.getX());
+    int y = _cameraBinFactor("BinningY",set_bin.getY());
+    PvAttrUint32Set(m_handle, "BinningX", x);
+    PvAttrUint32Set(m_handle, "BinningY", y);
 
-    m_bin = set_bin;
+    m_bin = Bin(x,y);
+    m_sw_bin = Bin(set_bin.getX() / x,set_bin.getY() / y);
     
-    DEB_RETURN() << DEB_VAR1(set_bin);
+    DEB_RETURN() << DEB_VAR3(set_bin,m_bin,m_sw_bin);
 }
 
 //-----------------------------------------------------
@@ -382,14 +1008,67 @@ void Camera::getBin(Bin &hw_bin)
     PvAttrUint32Get(m_handle,"BinningX",&xValue); 
     PvAttrUint32Get(m_handle,"BinningY",&yValue);
 
-    Bin tmp_bin(xValue, yValue);
-    
-    hw_bin = tmp_bin;
-    m_bin = tmp_bin;
+    m_bin = Bin(xValue, yValue);
+    hw_bin = Bin(xValue * m_sw_bin.getX(), yValue * m_sw_bin.getY());
     
     DEB_RETURN() << DEB_VAR1(hw_bin);
 }
 
+void Camera::getCameraBin(Bin& camera_bin)
+{
+  camera_bin = m_bin;
+}
+
+void Camera::getSoftwareBin(Bin& sw_bin)
+{
+  sw_bin = m_sw_bin;
+}
+
+void Camera::setSoftwareBinMode(SoftwareBinMode mode)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(mode);
+
+  checkNotRunning();
+  m_sw_bin_mode = mode;
+}
+
+void Camera::getSoftwareBinMode(SoftwareBinMode& mode)
+{
+  mode = m_sw_bin_mode;
+}
+
+void Camera::setOutputDepth(int bits)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(bits);
+
+  if(bits && bits != 8 && bits != 16 && bits != 32)
+    throw LIMA_HW_EXC(InvalidValue,"Output depth must be 0, 8, 16 or 32 bits");
+  checkNotRunning();
+  m_output_depth = bits;
+  maxImageSizeChanged(Size(m_maxwidth,m_maxheight),_getImageType());
+}
+
+void Camera::getOutputDepth(int& bits)
+{
+  bits = m_output_depth;
+}
+
+//-----------------------------------------------------
+// @brief image type of the frames given to Lima
+//-----------------------------------------------------
+ImageType Camera::_getImageType()
+{
+  switch(m_output_depth)
+    {
+    case 8:	return Bpp8;
+    case 16:	return Bpp16;
+    case 32:	return Bpp32;
+    default:
+      return (m_video_mode == Y16 || m_video_mode == BAYER_RG16) ? Bpp16 : Bpp8;
+    }
+}
 
 //-----------------------------------------------------
 // @brief range the Region-Of-Interest to the maximum allowed
@@ -413,6 +1092,11 @@ void Camera::getRoi(Roi &hw_roi)
   hw_roi = m_roi;
 }
 
+void Camera::getCameraRoi(Roi& camera_roi)
+{
+  camera_roi = m_roi.isActive() ? m_roi.getUnbinned(m_sw_bin) : m_roi;
+}
+
 //-----------------------------------------------------
 // @brief set the new Roi
 //-----------------------------------------------------
@@ -434,10 +1118,12 @@ void Camera::setRoi(const Roi& set_roi)
   } 
   else
   {
-    x = set_roi.getTopLeft().x;
-    y = set_roi.getTopLeft().y;
-    width = set_roi.getSize().getWidth();
-    height = set_roi.getSize().getHeight();
+    // the camera sends the pixels of the software binning
+    Roi camera_roi = set_roi.getUnbinned(m_sw_bin);
+    x = camera_roi.getTopLeft().x;
+    y = camera_roi.getTopLeft().y;
+    width = camera_roi.getSize().getWidth();
+    height = camera_roi.getSize().getHeight();
   }
 
   PvAttrUint32Set(m_handle,"RegionX",x); 
@@ -446,13 +1132,6 @@ void Camera::setRoi(const Roi& set_roi)
   PvAttrUint32Set(m_handle,"Height",height); 
 
   m_roi = set_roi;
-
-  tPvFloat32 min_framerate, max_framerate;
-  tPvErr error = PvAttrRangeFloat32(m_handle, "FrameRate", &min_framerate, &max_framerate);
-  if(error)
-    throw LIMA_HW_EXC(Error,"Can't get  FramRate range");
-  DEB_TRACE() << "Frame Rate Range :" << min_framerate << " - " << max_framerate << " Hz";
-
 }
 
 
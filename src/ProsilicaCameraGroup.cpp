@@ -0,0 +1,529 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <cmath>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+#include "lima/CtAcquisition.h"
+
+#include "ProsilicaCameraGroup.h"
+#include "ProsilicaCamera.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+GroupFrame::GroupFrame() :
+  frame_nb(-1),
+  camera_timestamp(0),
+  host_timestamp(0.),
+  timestamp(0.)
+{
+}
+
+FrameSet::FrameSet() :
+  set_nb(-1),
+  complete(false),
+  time(0.),
+  skew(0.)
+{
+}
+
+GroupStatus::GroupStatus() :
+  nb_sets(0),
+  nb_incomplete(0),
+  nb_frame_nb_mismatches(0),
+  nb_overflows(0),
+  nb_lost_sets(0),
+  last_skew(0.),
+  max_skew(0.)
+{
+}
+
+//-----------------------------------------------------
+// @brief a camera of the group: the last processor of its frames,
+// they are pushed in its queue for the matching thread
+//-----------------------------------------------------
+class CameraGroup::_Member : public FrameProcessor
+{
+public:
+  _Member(CameraGroup& group,Camera* cam,CtControl* control) :
+    cam(cam),
+    control(control),
+    active(false),
+    nb_overflows(0),
+    frequency(1.),
+    anchored(false),
+    first_timestamp(0),
+    first_frame_nb(0),
+    base(0.),
+    offset(0.),
+    nb_missing(0),
+    m_group(group)
+  {}
+
+  virtual void process(FrameData& frame)
+  {
+    if(!active)
+      return;
+    GroupFrame group_frame;
+    group_frame.frame_nb = frame.frame_nb;
+    group_frame.camera_timestamp = frame.camera_timestamp;
+    group_frame.host_timestamp = frame.host_timestamp;
+    group_frame.timestamp = frame.timestamp;
+    if(queue.push(group_frame))
+      m_group._wake();
+    else
+      ++nb_overflows;
+  }
+
+  // the first frame is time 0, or its host time with a clock model
+  void anchor(const GroupFrame& frame,bool host_time)
+  {
+    anchored = true;
+    first_timestamp = frame.camera_timestamp;
+    first_frame_nb = frame.frame_nb;
+    base = host_time ? frame.host_timestamp : 0.;
+    offset = 0.;
+  }
+  double time(const GroupFrame& frame) const
+  {
+    return base + offset +
+      double((long long)(frame.camera_timestamp - first_timestamp)) / frequency;
+  }
+
+  Camera*		cam;
+  CtControl*		control;
+  volatile bool		active;
+  SpscQueue<GroupFrame>	queue;
+  std::atomic<long long> nb_overflows;
+
+  // matching thread
+  double		frequency;
+  bool			anchored;
+  unsigned long long	first_timestamp;
+  int			first_frame_nb;
+  double		base;
+  double		offset;
+  long long		nb_missing;
+private:
+  CameraGroup&		m_group;
+};
+
+class CameraGroup::_MatchThread : public Thread
+{
+public:
+  _MatchThread(CameraGroup& group) : m_group(group) {}
+protected:
+  virtual void threadFunction() {m_group._run();}
+private:
+  CameraGroup&	m_group;
+};
+
+CameraGroup::CameraGroup() :
+  m_tolerance(1e-3),
+  m_timeout(1.),
+  m_queue_size(64),
+  m_max_sets(1000),
+  m_running(false),
+  m_host_time(false),
+  m_thread(NULL),
+  m_flush(false),
+  m_matching(false),
+  m_waiting(false),
+  m_nb_pushed(0),
+  m_next_set_nb(0)
+{
+  DEB_CONSTRUCTOR();
+}
+
+CameraGroup::~CameraGroup()
+{
+  DEB_DESTRUCTOR();
+
+  stopAcq();
+  for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+    {
+      (*i)->cam->getFrameProcessors().remove(*i);
+      delete *i;
+    }
+}
+
+void CameraGroup::add(Camera* cam,CtControl* control)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!cam || !control)
+    throw LIMA_HW_EXC(InvalidValue,"A group camera needs its control");
+  if(m_running)
+    throw LIMA_HW_EXC(Error,"Can't add a camera to a running group");
+  for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+    if((*i)->cam == cam)
+      throw LIMA_HW_EXC(InvalidValue,"Camera already in the group");
+
+  _Member* member = new _Member(*this,cam,control);
+  m_members.push_back(member);
+  cam->getFrameProcessors().add(member,FrameProcessor::Output);
+}
+
+void CameraGroup::setTolerance(double tolerance)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(tolerance);
+
+  if(tolerance <= 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Tolerance must be positive");
+  m_tolerance = tolerance;
+}
+
+void CameraGroup::setTimeout(double timeout)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(timeout);
+
+  if(timeout <= 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Timeout must be positive");
+  m_timeout = timeout;
+}
+
+void CameraGroup::setQueueSize(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if(nb_frames < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Queue size must be at least 1");
+  m_queue_size = nb_frames;
+}
+
+void CameraGroup::setMaxSets(int nb_sets)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_sets);
+
+  if(nb_sets < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Max sets must be at least 1");
+  AutoMutex lock(m_sets_cond.mutex());
+  m_max_sets = nb_sets;
+}
+
+//-----------------------------------------------------
+// @brief arm all the cameras on the external trigger, then start them
+//-----------------------------------------------------
+void CameraGroup::startAcq()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_members.empty())
+    throw LIMA_HW_EXC(InvalidValue,"No camera in the group");
+  if(m_running)
+    throw LIMA_HW_EXC(Error,"Group acquisition already running");
+
+  // the host times of the first frames are comparable if all the
+  // cameras have a clock model
+  m_host_time = true;
+  for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+    {
+      _Member& member = **i;
+      tPvUint32 frequency;
+      if(PvAttrUint32Get(member.cam->getHandle(),"TimeStampFrequency",&frequency) ||
+	 !frequency)
+	throw LIMA_HW_EXC(Error,"Can't get camera time stamp frequency");
+      member.frequency = frequency;
+      ClockSyncStatus clock_status;
+      member.cam->getClockSync().getStatus(clock_status);
+      m_host_time = m_host_time && member.cam->getClockSync().isActive() &&
+	clock_status.valid;
+
+      member.control->acquisition()->setTriggerMode(ExtTrigMult);
+    }
+  for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+    (*i)->control->prepareAcq();
+
+  for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+    {
+      _Member& member = **i;
+      member.queue.resize(m_queue_size);
+      member.nb_overflows = 0;
+      member.anchored = false;
+      member.nb_missing = 0;
+    }
+  m_times.resize(m_members.size());
+  m_heads.resize(m_members.size());
+  {
+    AutoMutex lock(m_sets_cond.mutex());
+    m_sets.clear();
+    m_next_set_nb = 0;
+    m_status = GroupStatus();
+  }
+  {
+    AutoMutex lock(m_cond.mutex());
+    m_flush = false;
+    m_matching = true;
+    m_nb_pushed = 0;
+    m_thread = new _MatchThread(*this);
+    m_thread->start();
+  }
+  for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+    (*i)->active = true;
+  m_running = true;
+
+  DEB_TRACE() << DEB_VAR2(m_members.size(),m_host_time);
+
+  try
+    {
+      for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+	(*i)->control->startAcq();
+    }
+  catch(Exception&)
+    {
+      stopAcq();
+      throw;
+    }
+}
+
+void CameraGroup::stopAcq()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_running)
+    return;
+  for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+    {
+      try
+	{
+	  (*i)->control->stopAcq();
+	}
+      catch(Exception& e)
+	{
+	  DEB_ERROR() << "Camera stop failed: " << e.getErrMsg();
+	}
+      (*i)->active = false;
+    }
+
+  // the frames received are matched before the thread ends
+  AutoMutex lock(m_cond.mutex());
+  m_flush = true;
+  m_cond.broadcast();
+  while(m_matching)
+    m_cond.wait();
+  lock.unlock();
+
+  delete m_thread;
+  m_thread = NULL;
+  m_running = false;
+}
+
+bool CameraGroup::nextFrameSet(FrameSet& set,double timeout)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_sets_cond.mutex());
+  if(m_sets.empty() && timeout > 0.)
+    {
+      double deadline = double(Timestamp::now()) + timeout;
+      while(m_sets.empty())
+	{
+	  double remaining = deadline - double(Timestamp::now());
+	  if(remaining <= 0. || !m_sets_cond.wait(remaining))
+	    break;
+	}
+    }
+  if(m_sets.empty())
+    return false;
+  set = m_sets.front();
+  m_sets.pop_front();
+  return true;
+}
+
+void CameraGroup::getStatus(GroupStatus& status)
+{
+  AutoMutex lock(m_sets_cond.mutex());
+  status = m_status;
+  status.nb_overflows = 0;
+  for(std::vector<_Member*>::iterator i = m_members.begin();i != m_members.end();++i)
+    status.nb_overflows += (*i)->nb_overflows;
+}
+
+long long CameraGroup::getNbMissing(int camera)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(camera < 0 || camera >= int(m_members.size()))
+    throw LIMA_HW_EXC(InvalidValue,"No such camera in the group");
+  AutoMutex lock(m_sets_cond.mutex());
+  return m_members[camera]->nb_missing;
+}
+
+//-----------------------------------------------------
+// @brief a producer pushed a frame: the matching thread is woken if
+// it sleeps, m_nb_pushed closes the race with its going to sleep
+//-----------------------------------------------------
+void CameraGroup::_wake()
+{
+  ++m_nb_pushed;
+  if(m_waiting)
+    {
+      AutoMutex lock(m_cond.mutex());
+      m_cond.broadcast();
+    }
+}
+
+//-----------------------------------------------------
+// @brief one set out of the frames at the head of the camera queues
+// @return true if a set was delivered, else wait_time is the time
+// until the oldest pending frame times out (-1 if none)
+//-----------------------------------------------------
+bool CameraGroup::_match(bool flush,double& wait_time)
+{
+  int nb = int(m_members.size());
+  int nb_heads = 0;
+  double earliest = 0.,oldest_arrival = 0.;
+  for(int c = 0;c < nb;++c)
+    {
+      _Member& member = *m_members[c];
+      m_heads[c] = !member.queue.empty();
+      if(!m_heads[c])
+	continue;
+      const GroupFrame& frame = member.queue.front();
+      if(!member.anchored)
+	member.anchor(frame,m_host_time);
+      m_times[c] = member.time(frame);
+      if(!nb_heads || m_times[c] < earliest)
+	earliest = m_times[c];
+      if(!nb_heads || frame.timestamp < oldest_arrival)
+	oldest_arrival = frame.timestamp;
+      ++nb_heads;
+    }
+  wait_time = -1.;
+  if(!nb_heads)
+    return false;
+  if(nb_heads < nb && !flush)
+    {
+      // a camera frame may still come
+      wait_time = oldest_arrival + m_timeout - double(Timestamp::now());
+      if(wait_time > 0.)
+	return false;
+    }
+
+  // the earliest frame and the ones within tolerance of it
+  FrameSet set;
+  set.frames.resize(nb);
+  set.complete = true;
+  int ref = -1;
+  for(int c = 0;c < nb;++c)
+    {
+      _Member& member = *m_members[c];
+      if(m_heads[c] && m_times[c] - earliest <= m_tolerance)
+	{
+	  set.frames[c] = member.queue.front();
+	  member.queue.pop();
+	  if(ref < 0)
+	    ref = c;
+	}
+      else
+	{
+	  m_heads[c] = false;
+	  set.complete = false;
+	}
+    }
+
+  // the offsets follow the drift of the camera clocks
+  set.time = m_times[ref];
+  bool frame_nb_mismatch = false;
+  int ref_frame_nb = set.frames[ref].frame_nb - m_members[ref]->first_frame_nb;
+  for(int c = 0;c < nb;++c)
+    if(m_heads[c])
+      {
+	_Member& member = *m_members[c];
+	set.skew = std::max(set.skew,fabs(m_times[c] - set.time));
+	member.offset += set.time - m_times[c];
+	frame_nb_mismatch = frame_nb_mismatch ||
+	  set.frames[c].frame_nb - member.first_frame_nb != ref_frame_nb;
+      }
+  _deliver(set,set.complete && frame_nb_mismatch);
+  return true;
+}
+
+void CameraGroup::_deliver(FrameSet& set,bool frame_nb_mismatch)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_sets_cond.mutex());
+  set.set_nb = m_next_set_nb++;
+  ++m_status.nb_sets;
+  if(!set.complete)
+    {
+      ++m_status.nb_incomplete;
+      for(unsigned int c = 0;c < m_members.size();++c)
+	if(!m_heads[c])
+	  ++m_members[c]->nb_missing;
+      DEB_TRACE() << "Incomplete frame set " << set.set_nb;
+    }
+  if(frame_nb_mismatch)
+    ++m_status.nb_frame_nb_mismatches;
+  m_status.last_skew = set.skew;
+  m_status.max_skew = std::max(m_status.max_skew,set.skew);
+
+  m_sets.push_back(set);
+  if(int(m_sets.size()) > m_max_sets)
+    {
+      m_sets.pop_front();
+      ++m_status.nb_lost_sets;
+    }
+  m_sets_cond.broadcast();
+}
+
+void CameraGroup::_run()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  while(true)
+    {
+      bool flush = m_flush;
+      long long nb_pushed = m_nb_pushed;
+      lock.unlock();
+      double wait_time;
+      bool matched = _match(flush,wait_time);
+      lock.lock();
+      if(matched)
+	continue;
+      if(flush)
+	break;
+
+      m_waiting = true;
+      if(m_nb_pushed == nb_pushed && !m_flush)
+	{
+	  if(wait_time < 0.)
+	    m_cond.wait();
+	  else
+	    m_cond.wait(wait_time);
+	}
+      m_waiting = false;
+    }
+  m_matching = false;
+  m_cond.broadcast();
+}
@@ -0,0 +1,366 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <time.h>
+#include <cmath>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaClockSync.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+// latches per sample, the shortest round-trip is kept
+static const int NB_BURST = 3;
+// a sample is rejected when its round-trip is longer than 3 times
+// the best one of the window, and than 200 us
+static const double MAX_ROUND_TRIP_RATIO = 3.;
+static const double MIN_REJECTED_ROUND_TRIP = 200e-6;
+static const int MIN_REJECT_SAMPLES = 4;
+
+static inline double _clock(clockid_t id)
+{
+  struct timespec t;
+  clock_gettime(id,&t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+ClockSample::ClockSample() :
+  ticks(0),
+  monotonic(0.),
+  realtime(0.),
+  round_trip(0.)
+{
+}
+
+ClockSyncStatus::ClockSyncStatus() :
+  valid(false),
+  nb_samples(0),
+  nb_rejected(0),
+  frequency(0.),
+  drift(0.),
+  rms_residual(0.),
+  max_residual(0.),
+  prediction_error(0.),
+  round_trip(0.)
+{
+}
+
+class ClockSync::_SampleThread : public Thread
+{
+public:
+  _SampleThread(ClockSync& sync) : m_sync(sync) {}
+protected:
+  virtual void threadFunction() {m_sync._run();}
+private:
+  ClockSync&	m_sync;
+};
+
+ClockSync::ClockSync(tPvHandle& handle) :
+  m_handle(handle),
+  m_active(false),
+  m_period(1.),
+  m_window(60),
+  m_thread(NULL),
+  m_quit(false),
+  m_running(false),
+  m_nominal_frequency(0.),
+  m_valid(false),
+  m_ticks_ref(0),
+  m_host_ref(0.),
+  m_tick_period(0.),
+  m_realtime_offset(0.)
+{
+  DEB_CONSTRUCTOR();
+}
+
+ClockSync::~ClockSync()
+{
+  DEB_DESTRUCTOR();
+
+  setActive(false);
+}
+
+void ClockSync::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  AutoMutex lock(m_cond.mutex());
+  if(active == m_active)
+    return;
+  if(active)
+    {
+      m_quit = false;
+      m_running = true;
+      m_thread = new _SampleThread(*this);
+      m_thread->start();
+      m_active = true;
+      return;
+    }
+
+  m_active = false;
+  m_quit = true;
+  m_cond.broadcast();
+  while(m_running)
+    m_cond.wait();
+  lock.unlock();
+
+  delete m_thread;
+  m_thread = NULL;
+}
+
+void ClockSync::setPeriod(double period)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(period);
+
+  if(period < 0.01)
+    throw LIMA_HW_EXC(InvalidValue,"Clock sampling period must be at least 10 ms");
+  AutoMutex lock(m_cond.mutex());
+  m_period = period;
+  m_cond.broadcast();
+}
+
+void ClockSync::setWindow(int nb_samples)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_samples);
+
+  if(nb_samples < 2)
+    throw LIMA_HW_EXC(InvalidValue,"Clock fit window must hold 2 samples or more");
+  AutoMutex lock(m_lock);
+  m_window = nb_samples;
+  if(int(m_samples.size()) > m_window)
+    {
+      m_samples.erase(m_samples.begin(),m_samples.end() - m_window);
+      _fit();
+    }
+}
+
+void ClockSync::reset()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  m_samples.clear();
+  m_valid = false;
+  m_status = ClockSyncStatus();
+}
+
+bool ClockSync::latch(unsigned long long& ticks)
+{
+  ClockSample sample;
+  if(!_latch(sample))
+    return false;
+  ticks = sample.ticks;
+  return true;
+}
+
+bool ClockSync::_latch(ClockSample& sample)
+{
+  AutoMutex lock(m_latch_lock);
+  double before = _clock(CLOCK_MONOTONIC);
+  tPvErr error = PvCommandRun(m_handle,"TimeStampValueLatch");
+  double after = _clock(CLOCK_MONOTONIC);
+  double realtime = _clock(CLOCK_REALTIME);
+
+  tPvUint32 hi,lo;
+  if(error ||
+     PvAttrUint32Get(m_handle,"TimeStampValueHi",&hi) ||
+     PvAttrUint32Get(m_handle,"TimeStampValueLo",&lo))
+    return false;
+  sample.ticks = (unsigned long long)hi << 32 | lo;
+  sample.monotonic = (before + after) / 2.;
+  sample.realtime = realtime - (after - sample.monotonic);
+  sample.round_trip = after - before;
+  return true;
+}
+
+//-----------------------------------------------------
+// @brief add the best latch of a burst to the window and fit again
+//-----------------------------------------------------
+void ClockSync::sample()
+{
+  DEB_MEMBER_FUNCT();
+
+  {
+    AutoMutex lock(m_latch_lock);
+    if(!m_nominal_frequency)
+      {
+	tPvUint32 frequency;
+	if(PvAttrUint32Get(m_handle,"TimeStampFrequency",&frequency) || !frequency)
+	  throw LIMA_HW_EXC(Error,"Can't get camera time stamp frequency");
+	m_nominal_frequency = frequency;
+      }
+  }
+
+  ClockSample best;
+  bool latched = false;
+  for(int i = 0;i < NB_BURST;++i)
+    {
+      ClockSample sample;
+      if(_latch(sample) && (!latched || sample.round_trip < best.round_trip))
+	best = sample,latched = true;
+    }
+  if(!latched)
+    throw LIMA_HW_EXC(Error,"Can't latch camera time stamp");
+
+  AutoMutex lock(m_lock);
+  // the time stamps were reset
+  if(!m_samples.empty() && best.ticks <= m_samples.back().ticks)
+    {
+      DEB_WARNING() << "Camera time stamp went back, clock model reset";
+      m_samples.clear();
+      m_valid = false;
+    }
+  if(int(m_samples.size()) >= MIN_REJECT_SAMPLES)
+    {
+      double best_round_trip = m_samples.front().round_trip;
+      for(std::deque<ClockSample>::iterator i = m_samples.begin();i != m_samples.end();++i)
+	best_round_trip = std::min(best_round_trip,i->round_trip);
+      if(best.round_trip > MIN_REJECTED_ROUND_TRIP &&
+	 best.round_trip > MAX_ROUND_TRIP_RATIO * best_round_trip)
+	{
+	  ++m_status.nb_rejected;
+	  DEB_TRACE() << "Sample rejected: " << DEB_VAR2(best.round_trip,best_round_trip);
+	  return;
+	}
+    }
+
+  m_status.prediction_error = m_valid ?
+    best.monotonic - (m_host_ref + double((long long)(best.ticks - m_ticks_ref)) *
+		      m_tick_period) : 0.;
+  m_status.round_trip = best.round_trip;
+  m_realtime_offset = best.realtime - best.monotonic;
+  m_samples.push_back(best);
+  if(int(m_samples.size()) > m_window)
+    m_samples.pop_front();
+  _fit();
+
+  DEB_TRACE() << DEB_VAR3(m_status.drift,m_status.rms_residual,m_status.prediction_error);
+}
+
+//-----------------------------------------------------
+// @brief least-squares line of the host time against the ticks,
+// the ticks are counted from the first sample in nominal seconds
+//-----------------------------------------------------
+void ClockSync::_fit()
+{
+  int nb = int(m_samples.size());
+  m_status.nb_samples = nb;
+  if(!nb)
+    {
+      m_valid = false;
+      return;
+    }
+
+  const ClockSample& first = m_samples.front();
+  double x_mean = 0.,y_mean = 0.;
+  for(std::deque<ClockSample>::iterator i = m_samples.begin();i != m_samples.end();++i)
+    {
+      x_mean += double((long long)(i->ticks - first.ticks)) / m_nominal_frequency;
+      y_mean += i->monotonic - first.monotonic;
+    }
+  x_mean /= nb,y_mean /= nb;
+  double sxx = 0.,sxy = 0.;
+  for(std::deque<ClockSample>::iterator i = m_samples.begin();i != m_samples.end();++i)
+    {
+      double dx = double((long long)(i->ticks - first.ticks)) / m_nominal_frequency - x_mean;
+      sxx += dx * dx;
+      sxy += dx * (i->monotonic - first.monotonic - y_mean);
+    }
+  // host seconds per nominal camera second
+  double slope = sxx > 0. ? sxy / sxx : 1.;
+  double offset = y_mean - slope * x_mean;
+
+  double sum2 = 0.,max_residual = 0.;
+  for(std::deque<ClockSample>::iterator i = m_samples.begin();i != m_samples.end();++i)
+    {
+      double x = double((long long)(i->ticks - first.ticks)) / m_nominal_frequency;
+      double residual = i->monotonic - first.monotonic - (offset + slope * x);
+      sum2 += residual * residual;
+      max_residual = std::max(max_residual,fabs(residual));
+    }
+
+  m_ticks_ref = first.ticks;
+  m_host_ref = first.monotonic + offset;
+  m_tick_period = slope / m_nominal_frequency;
+  m_valid = true;
+
+  m_status.valid = true;
+  m_status.frequency = 1. / m_tick_period;
+  m_status.drift = (1. / slope - 1.) * 1e6;
+  m_status.rms_residual = sqrt(sum2 / nb);
+  m_status.max_residual = max_residual;
+}
+
+bool ClockSync::toHostTime(unsigned long long ticks,double& realtime)
+{
+  AutoMutex lock(m_lock);
+  if(!m_valid)
+    return false;
+  realtime = m_host_ref + double((long long)(ticks - m_ticks_ref)) * m_tick_period +
+    m_realtime_offset;
+  return true;
+}
+
+void ClockSync::getStatus(ClockSyncStatus& status)
+{
+  AutoMutex lock(m_lock);
+  status = m_status;
+}
+
+void ClockSync::getSamples(std::vector<ClockSample>& samples)
+{
+  AutoMutex lock(m_lock);
+  samples.assign(m_samples.begin(),m_samples.end());
+}
+
+void ClockSync::_run()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  while(!m_quit)
+    {
+      lock.unlock();
+      try
+	{
+	  sample();
+	}
+      catch(Exception& e)
+	{
+	  DEB_WARNING() << "Clock sampling failed: " << e.getErrMsg();
+	}
+      lock.lock();
+      if(!m_quit)
+	m_cond.wait(m_period);
+    }
+  m_running = false;
+  m_cond.broadcast();
+}
@@ -58,6 +58,14 @@ void DetInfoCtrlObj::getDefImageType(ImageType& def_image_type)
 
 void DetInfoCtrlObj::getCurrImageType(ImageType& curr_image_type)
 {
+  int output_depth;
+  m_cam->getOutputDepth(output_depth);
+  if(output_depth)
+    {
+      curr_image_type = output_depth == 32 ? Bpp32 : (output_depth == 16 ? Bpp16 : Bpp8);
+      return;
+    }
+
   char modeStr[64];
   tPvUint32 psize;
   tPvErr error = PvAttrEnumGet(m_handle,"PixelFormat",modeStr,
@@ -85,10 +93,18 @@ void DetInfoCtrlObj::setCurrImageType(ImageType curr_image_type)
       else
 	aNextMode = BAYER_RG8;
       break;
+    case Bpp32:
+      // 32 bit sums of the software binning
+      m_cam->setOutputDepth(32);
+      return;
     default:
       throw LIMA_HW_EXC(InvalidValue,"This image type is not Managed");
     }
 
+  int output_depth;
+  m_cam->getOutputDepth(output_depth);
+  if(output_depth)
+    m_cam->setOutputDepth(0);
   m_cam->setVideoMode(aNextMode);
 }
 
@@ -0,0 +1,413 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaFlatField.h"
+#include "ProsilicaCamera.h"
+#include "ProsilicaKernels.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+static const int GRAB_NB_BUFFERS = 4;
+static const unsigned long GRAB_FRAME_TIMEOUT = 5000; // ms
+
+FlatFieldCorrection::FlatFieldCorrection(Camera* cam,WorkerPool& pool) :
+  m_cam(cam),
+  m_handle(cam->getHandle()),
+  m_pool(pool),
+  m_active(false),
+  m_maps_valid(false),
+  m_use_gain(false),
+  m_map_width(0),
+  m_map_height(0)
+{
+  DEB_CONSTRUCTOR();
+}
+
+void FlatFieldCorrection::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  AutoMutex lock(m_lock);
+  if(active && !m_maps_valid)
+    _buildMaps();
+  m_active = active;
+}
+
+void FlatFieldCorrection::acquireDark(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+
+  Reference dark;
+  _grabAverage(nb_frames,dark);
+  AutoMutex lock(m_lock);
+  m_dark = dark;
+  _buildMaps();
+}
+
+void FlatFieldCorrection::acquireFlat(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+
+  Reference flat;
+  _grabAverage(nb_frames,flat);
+  AutoMutex lock(m_lock);
+  m_flat = flat;
+  _buildMaps();
+}
+
+void FlatFieldCorrection::clearReferences()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  m_dark = Reference();
+  m_flat = Reference();
+  _buildMaps();
+}
+
+bool FlatFieldCorrection::hasDark()
+{
+  AutoMutex lock(m_lock);
+  return !m_dark.image.empty();
+}
+
+bool FlatFieldCorrection::hasFlat()
+{
+  AutoMutex lock(m_lock);
+  return !m_flat.image.empty();
+}
+
+void FlatFieldCorrection::prepare()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  if(m_active)
+    _buildMaps();
+}
+
+//-----------------------------------------------------
+// @brief current roi, in binned pixels, and binning of the camera
+// frames or of the frames given to Lima (software binning included)
+//-----------------------------------------------------
+void FlatFieldCorrection::_getGeometry(Roi& roi,Bin& bin,bool camera)
+{
+  if(camera)
+    {
+      m_cam->getCameraBin(bin);
+      m_cam->getCameraRoi(roi);
+    }
+  else
+    {
+      m_cam->getBin(bin);
+      m_cam->getRoi(roi);
+    }
+  if(!roi.isActive())
+    {
+      tPvUint32 max_width,max_height;
+      m_cam->getMaxWidthHeight(max_width,max_height);
+      roi = Roi(0,0,max_width / bin.getX(),max_height / bin.getY());
+    }
+}
+
+//-----------------------------------------------------
+// @brief average of a free-running acquisition at the current settings
+//-----------------------------------------------------
+void FlatFieldCorrection::_grabAverage(int nb_frames,Reference& reference)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if(nb_frames < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Need at least one reference frame");
+  m_cam->checkNotRunning();
+
+  char format[32];
+  unsigned long psize;
+  tPvUint32 width,height,frame_size;
+  if(PvAttrEnumGet(m_handle,"PixelFormat",format,sizeof(format),&psize) ||
+     PvAttrUint32Get(m_handle,"Width",&width) ||
+     PvAttrUint32Get(m_handle,"Height",&height) ||
+     PvAttrUint32Get(m_handle,"TotalBytesPerFrame",&frame_size))
+    throw LIMA_HW_EXC(Error,"Can't get camera image format");
+  int depth;
+  if(!strcmp(format,"Mono8"))
+    depth = 1;
+  else if(!strcmp(format,"Mono16"))
+    depth = 2;
+  else
+    throw LIMA_HW_EXC(NotSupported,"Flat-field references need Mono8 or Mono16");
+
+  _getGeometry(reference.roi,reference.bin,true);
+  reference.width = width;
+  reference.height = height;
+  int nb_pixels = width * height;
+  std::vector<double> sum(nb_pixels,0.);
+
+  std::vector<char> memory(GRAB_NB_BUFFERS * frame_size);
+  tPvFrame frames[GRAB_NB_BUFFERS];
+  memset(frames,0,sizeof(frames));
+  for(int i = 0;i < GRAB_NB_BUFFERS;++i)
+    {
+      frames[i].ImageBuffer = &memory[i * frame_size];
+      frames[i].ImageBufferSize = frame_size;
+    }
+
+  char trigger_mode[32];
+  PvAttrEnumGet(m_handle,"FrameStartTriggerMode",trigger_mode,
+		sizeof(trigger_mode),&psize);
+  PvAttrEnumSet(m_handle,"FrameStartTriggerMode","Freerun");
+
+  tPvErr error = PvCaptureStart(m_handle);
+  if(error)
+    {
+      PvAttrEnumSet(m_handle,"FrameStartTriggerMode",trigger_mode);
+      throw LIMA_HW_EXC(Error,"Can't start reference capture");
+    }
+  for(int i = 0;i < GRAB_NB_BUFFERS && i < nb_frames;++i)
+    PvCaptureQueueFrame(m_handle,&frames[i],NULL);
+
+  int nb_averaged = 0;
+  error = PvCommandRun(m_handle,"AcquisitionStart");
+  for(int i = 0;!error && i < nb_frames;++i)
+    {
+      tPvFrame& frame = frames[i % GRAB_NB_BUFFERS];
+      if(PvCaptureWaitForFrameDone(m_handle,&frame,GRAB_FRAME_TIMEOUT))
+	{
+	  error = ePvErrTimeout;
+	  break;
+	}
+      if(frame.Status == ePvErrSuccess)
+	{
+	  if(depth == 1)
+	    {
+	      const uint8_t* p = (const uint8_t*)frame.ImageBuffer;
+	      for(int j = 0;j < nb_pixels;++j)
+		sum[j] += p[j];
+	    }
+	  else
+	    {
+	      const uint16_t* p = (const uint16_t*)frame.ImageBuffer;
+	      for(int j = 0;j < nb_pixels;++j)
+		sum[j] += p[j];
+	    }
+	  ++nb_averaged;
+	}
+      else
+	DEB_WARNING() << "Reference frame " << i << " lost: " << DEB_VAR1(frame.Status);
+      if(i + GRAB_NB_BUFFERS < nb_frames)
+	PvCaptureQueueFrame(m_handle,&frame,NULL);
+    }
+
+  PvCommandRun(m_handle,"AcquisitionStop");
+  PvCaptureQueueClear(m_handle);
+  PvCaptureEnd(m_handle);
+  PvAttrEnumSet(m_handle,"FrameStartTriggerMode",trigger_mode);
+
+  if(error || !nb_averaged)
+    throw LIMA_HW_EXC(Error,"Reference acquisition failed");
+
+  reference.image.resize(nb_pixels);
+  for(int j = 0;j < nb_pixels;++j)
+    reference.image[j] = float(sum[j] / nb_averaged);
+
+  DEB_TRACE() << DEB_VAR4(reference.roi,reference.bin,nb_averaged,depth);
+}
+
+//-----------------------------------------------------
+// @brief cut and bin a reference to the given roi and binning
+// @return false if the reference doesn't cover it
+//-----------------------------------------------------
+bool FlatFieldCorrection::_binReference(const Reference& reference,
+					const Roi& roi,const Bin& bin,
+					std::vector<float>& binned)
+{
+  DEB_MEMBER_FUNCT();
+
+  const Bin& ref_bin = reference.bin;
+  if(bin.getX() % ref_bin.getX() || bin.getY() % ref_bin.getY())
+    return false;
+  int kx = bin.getX() / ref_bin.getX();
+  int ky = bin.getY() / ref_bin.getY();
+
+  Point top_left = roi.getTopLeft();
+  Point ref_top_left = reference.roi.getTopLeft();
+  int x0 = top_left.x * kx - ref_top_left.x;
+  int y0 = top_left.y * ky - ref_top_left.y;
+  int width = roi.getSize().getWidth();
+  int height = roi.getSize().getHeight();
+  if(x0 < 0 || y0 < 0 ||
+     x0 + width * kx > reference.width || y0 + height * ky > reference.height)
+    return false;
+
+  binned.assign(size_t(width) * height,0.f);
+  for(int y = 0;y < height;++y)
+    for(int dy = 0;dy < ky;++dy)
+      {
+	const float* src = &reference.image[size_t(y0 + y * ky + dy) * reference.width + x0];
+	float* dst = &binned[size_t(y) * width];
+	for(int x = 0;x < width;++x)
+	  for(int dx = 0;dx < kx;++dx)
+	    dst[x] += src[x * kx + dx];
+      }
+  return true;
+}
+
+void FlatFieldCorrection::_buildMaps()
+{
+  DEB_MEMBER_FUNCT();
+
+  m_maps_valid = false;
+  Roi roi;
+  Bin bin;
+  _getGeometry(roi,bin,false);
+  int width = roi.getSize().getWidth();
+  int height = roi.getSize().getHeight();
+  size_t nb_pixels = size_t(width) * height;
+
+  std::vector<float> dark,flat;
+  bool has_dark = !m_dark.image.empty();
+  bool has_flat = !m_flat.image.empty();
+  if(has_dark && !_binReference(m_dark,roi,bin,dark))
+    {
+      DEB_WARNING() << "Dark reference doesn't match " << DEB_VAR2(roi,bin);
+      return;
+    }
+  if(has_flat && !_binReference(m_flat,roi,bin,flat))
+    {
+      DEB_WARNING() << "Flat reference doesn't match " << DEB_VAR2(roi,bin);
+      return;
+    }
+  if(!has_dark && !has_flat)
+    return;
+
+  SoftwareBinMode sw_bin_mode;
+  m_cam->getSoftwareBinMode(sw_bin_mode);
+  if(sw_bin_mode == SoftwareBinMean)
+    {
+      Bin sw_bin;
+      m_cam->getSoftwareBin(sw_bin);
+      float scale = 1.f / (sw_bin.getX() * sw_bin.getY());
+      for(size_t i = 0;i < dark.size();++i)
+	dark[i] *= scale;
+      for(size_t i = 0;i < flat.size();++i)
+	flat[i] *= scale;
+    }
+  if(!has_dark)
+    dark.assign(nb_pixels,0.f);
+
+  m_use_gain = has_flat;
+  m_offset.swap(dark);
+  if(m_use_gain)
+    {
+      double signal_sum = 0.;
+      size_t nb_signal = 0;
+      for(size_t i = 0;i < nb_pixels;++i)
+	{
+	  float signal = flat[i] - m_offset[i];
+	  if(signal > 0.f)
+	    signal_sum += signal,++nb_signal;
+	}
+      float mean = nb_signal ? float(signal_sum / nb_signal) : 1.f;
+      m_gain.resize(nb_pixels);
+      for(size_t i = 0;i < nb_pixels;++i)
+	{
+	  float signal = flat[i] - m_offset[i];
+	  m_gain[i] = signal > 0.f ? mean / signal : 1.f;
+	}
+      m_offset8.clear();
+      m_offset16.clear();
+    }
+  else
+    {
+      // dark only: integer kernels
+      m_offset8.resize(nb_pixels);
+      m_offset16.resize(nb_pixels);
+      for(size_t i = 0;i < nb_pixels;++i)
+	{
+	  float offset = floorf(m_offset[i] + 0.5f);
+	  m_offset8[i] = uint8_t(std::min(offset,255.f));
+	  m_offset16[i] = uint16_t(std::min(offset,65535.f));
+	}
+      m_gain.clear();
+    }
+  m_map_width = width;
+  m_map_height = height;
+  m_maps_valid = true;
+
+  DEB_TRACE() << DEB_VAR4(roi,bin,has_dark,has_flat);
+}
+
+void FlatFieldCorrection::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active || (frame.mode != Y8 && frame.mode != Y16))
+    return;
+
+  AutoMutex lock(m_lock);
+  if(!m_maps_valid || frame.width != m_map_width || frame.height != m_map_height)
+    return;
+
+  int width = frame.width;
+  int height = frame.height;
+  int nb_bands = std::min(height,2 * (m_pool.getNbThreads() + 1));
+  int band_height = (height + nb_bands - 1) / nb_bands;
+  void* data = frame.data;
+  int depth = frame.depth;
+  m_pool.parallelFor(nb_bands,[&](int band)
+    {
+      int y0 = band * band_height;
+      int nb_rows = std::min(band_height,height - y0);
+      if(nb_rows <= 0)
+	return;
+      size_t offset = size_t(y0) * width;
+      int nb = nb_rows * width;
+      if(depth == 1)
+	{
+	  uint8_t* p = (uint8_t*)data + offset;
+	  if(m_use_gain)
+	    Kernels::correct8(p,&m_offset[offset],&m_gain[offset],nb);
+	  else
+	    Kernels::subtract8(p,&m_offset8[offset],nb);
+	}
+      else
+	{
+	  uint16_t* p = (uint16_t*)data + offset;
+	  if(m_use_gain)
+	    Kernels::correct16(p,&m_offset[offset],&m_gain[offset],nb);
+	  else
+	    Kernels::subtract16(p,&m_offset16[offset],nb);
+	}
+    });
+}
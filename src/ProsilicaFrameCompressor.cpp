@@ -0,0 +1,489 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef PROSILICA_WITH_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef PROSILICA_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
+
+#include "ProsilicaFrameCompressor.h"
+#include "ProsilicaWorkerPool.h"
+#include "ProsilicaKernels.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+// zero runs and literal runs of up to 128 bytes, one token byte each
+static const uint8_t RLE_ZEROS = 0x80;
+static const size_t RLE_MAX_RUN = 128;
+
+static size_t _rleBound(size_t size)
+{
+  return size + size / RLE_MAX_RUN + 1;
+}
+
+static size_t _rleEncode(const uint8_t* src,size_t size,uint8_t* dst)
+{
+  uint8_t* d = dst;
+  size_t i = 0;
+  while(i < size)
+    {
+      size_t run = 0;
+      while(i + run < size && run < RLE_MAX_RUN && !src[i + run])
+	++run;
+      if(run > 1 || (run && i + 1 == size))
+	{
+	  *d++ = uint8_t(RLE_ZEROS | (run - 1));
+	  i += run;
+	  continue;
+	}
+      // literals up to the next pair of zeros
+      size_t nb = 0;
+      while(i + nb < size && nb < RLE_MAX_RUN &&
+	    (src[i + nb] || (i + nb + 1 < size && src[i + nb + 1])))
+	++nb;
+      if(!nb)
+	nb = 1;
+      *d++ = uint8_t(nb - 1);
+      memcpy(d,src + i,nb);
+      d += nb,i += nb;
+    }
+  return d - dst;
+}
+
+static bool _rleDecode(const uint8_t* src,size_t size,uint8_t* dst,size_t raw_size)
+{
+  const uint8_t* end = src + size;
+  size_t j = 0;
+  while(src < end)
+    {
+      uint8_t token = *src++;
+      size_t nb = (token & ~RLE_ZEROS) + 1;
+      if(j + nb > raw_size)
+	return false;
+      if(token & RLE_ZEROS)
+	memset(dst + j,0,nb);
+      else
+	{
+	  if(src + nb > end)
+	    return false;
+	  memcpy(dst + j,src,nb);
+	  src += nb;
+	}
+      j += nb;
+    }
+  return j == raw_size;
+}
+
+// round trip of the token boundaries: single and trailing zeros, runs of
+// 128 bytes and one more, zeros and literals alternating
+static bool _rleCheck()
+{
+  static const size_t sizes[] = {1,2,127,128,129,256,257};
+  std::vector<uint8_t> raw,encoded,decoded;
+  for(size_t s = 0;s < sizeof(sizes) / sizeof(sizes[0]);++s)
+    for(int pattern = 0;pattern < 4;++pattern)
+      {
+	size_t size = sizes[s];
+	raw.assign(size,0);
+	for(size_t i = 0;i < size;++i)
+	  switch(pattern)
+	    {
+	    case 1: raw[i] = 0xa5;break;			// literals
+	    case 2: raw[i] = i + 1 < size ? 0xa5 : 0;break; // trailing zero
+	    case 3: raw[i] = i & 1;break;			// alternating
+	    default: break;					// zeros
+	    }
+	encoded.assign(_rleBound(size),0);
+	decoded.assign(size,0xff);
+	size_t nb = _rleEncode(&raw[0],size,&encoded[0]);
+	if(nb > encoded.size() ||
+	   !_rleDecode(&encoded[0],nb,&decoded[0],size) || decoded != raw)
+	  return false;
+      }
+  return true;
+}
+
+CompressedFrame::CompressedFrame() :
+  index(-1),
+  frame_nb(-1),
+  timestamp(0.),
+  camera_timestamp(0),
+  width(0),
+  height(0),
+  depth(0),
+  mode(Y8),
+  codec(FrameCompressor::BitshuffleRle),
+  size(0)
+{
+}
+
+CompressionStatus::CompressionStatus() :
+  nb_frames(0),
+  raw_bytes(0),
+  compressed_bytes(0),
+  ratio(0.),
+  last_ratio(0.),
+  cpu_time(0.),
+  throughput_per_core(0.),
+  last_duration(0.)
+{
+}
+
+FrameCompressor::FrameCompressor(WorkerPool& pool) :
+  m_pool(pool),
+  m_active(false),
+  m_codec(isAvailable(BitshuffleLz4) ? BitshuffleLz4 : BitshuffleRle),
+  m_level(1),
+  m_rows_per_chunk(0),
+  m_nb_compressed(0)
+{
+  DEB_CONSTRUCTOR();
+
+  static const bool rle_ok = _rleCheck();
+  if(!rle_ok)
+    throw LIMA_HW_EXC(Error,"Bitshuffle RLE round trip failed");
+}
+
+FrameCompressor::~FrameCompressor()
+{
+  DEB_DESTRUCTOR();
+
+#ifdef PROSILICA_WITH_ZSTD
+  for(std::vector<_Chunk>::iterator i = m_chunks.begin();i != m_chunks.end();++i)
+    ZSTD_freeCCtx((ZSTD_CCtx*)i->context);
+#endif
+}
+
+bool FrameCompressor::isAvailable(Codec codec)
+{
+  switch(codec)
+    {
+    case BitshuffleRle:
+      return true;
+#ifdef PROSILICA_WITH_LZ4
+    case BitshuffleLz4:
+      return true;
+#endif
+#ifdef PROSILICA_WITH_ZSTD
+    case BitshuffleZstd:
+      return true;
+#endif
+    default:
+      return false;
+    }
+}
+
+void FrameCompressor::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  m_active = active;
+}
+
+void FrameCompressor::setCodec(Codec codec)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(codec);
+
+  if(!isAvailable(codec))
+    throw LIMA_HW_EXC(NotSupported,"Compression codec not built in the plugin");
+  AutoMutex lock(m_lock);
+  m_codec = codec;
+}
+
+void FrameCompressor::setLevel(int level)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(level);
+
+  if(level < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Compression level must be at least 1");
+  AutoMutex lock(m_lock);
+  m_level = level;
+}
+
+void FrameCompressor::setRowsPerChunk(int nb_rows)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_rows);
+
+  if(nb_rows < 0)
+    throw LIMA_HW_EXC(InvalidValue,"Rows per chunk can't be negative");
+  AutoMutex lock(m_lock);
+  m_rows_per_chunk = nb_rows;
+}
+
+void FrameCompressor::getStatus(CompressionStatus& status)
+{
+  AutoMutex lock(m_status_lock);
+  status = m_status;
+}
+
+void FrameCompressor::resetStatus()
+{
+  AutoMutex lock(m_status_lock);
+  m_status = CompressionStatus();
+}
+
+bool FrameCompressor::getLatest(CompressedFrame& frame,long long after_index)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_read_lock);
+  m_frames.update();
+  const CompressedFrame& latest = m_frames.front();
+  if(latest.index < 0 || latest.index <= after_index)
+    return false;
+  frame = latest;
+  return true;
+}
+
+void FrameCompressor::_compress(_Chunk& chunk,Codec codec,int level,
+				const char* rows,int nb_pixels,int depth)
+{
+  (void)level;		// only used by the optional codecs
+  size_t raw_size = size_t(nb_pixels) * depth;
+  if(chunk.shuffled.size() < raw_size)
+    chunk.shuffled.resize(raw_size);
+  Kernels::bitshuffle(rows,&chunk.shuffled[0],nb_pixels,depth);
+  const char* src = &chunk.shuffled[0];
+
+  size_t bound = _rleBound(raw_size);
+#ifdef PROSILICA_WITH_LZ4
+  bound = std::max(bound,size_t(LZ4_compressBound(int(raw_size))));
+#endif
+#ifdef PROSILICA_WITH_ZSTD
+  bound = std::max(bound,ZSTD_compressBound(raw_size));
+#endif
+  if(chunk.compressed.size() < bound)
+    chunk.compressed.resize(bound);
+  char* dst = &chunk.compressed[0];
+
+  size_t size = raw_size;
+  switch(codec)
+    {
+    case BitshuffleRle:
+      size = _rleEncode((const uint8_t*)src,raw_size,(uint8_t*)dst);
+      break;
+#ifdef PROSILICA_WITH_LZ4
+    case BitshuffleLz4:
+      {
+	// level 1 is plain LZ4, higher levels LZ4 HC (up to 12): slower,
+	// smaller, decoded the same way
+	int nb;
+	if(level <= 1)
+	  nb = LZ4_compress_default(src,dst,int(raw_size),int(bound));
+	else
+	  {
+	    if(chunk.lz4_state.size() < size_t(LZ4_sizeofStateHC()))
+	      chunk.lz4_state.resize(LZ4_sizeofStateHC());
+	    nb = LZ4_compress_HC_extStateHC(&chunk.lz4_state[0],src,dst,
+					    int(raw_size),int(bound),
+					    std::min(level,LZ4HC_CLEVEL_MAX));
+	  }
+	if(nb > 0)
+	  size = nb;
+      }
+      break;
+#endif
+#ifdef PROSILICA_WITH_ZSTD
+    case BitshuffleZstd:
+      {
+	if(!chunk.context)
+	  chunk.context = ZSTD_createCCtx();
+	size_t nb = ZSTD_compressCCtx((ZSTD_CCtx*)chunk.context,dst,bound,
+				      src,raw_size,level);
+	if(!ZSTD_isError(nb))
+	  size = nb;
+      }
+      break;
+#endif
+    default:
+      break;
+    }
+  // incompressible, stored bitshuffled
+  if(size >= raw_size)
+    {
+      memcpy(dst,src,raw_size);
+      size = raw_size;
+    }
+  chunk.size = size;
+}
+
+void FrameCompressor::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active || (frame.depth != 1 && frame.depth != 2 && frame.depth != 4) ||
+     frame.width <= 0 || frame.height <= 0)
+    return;
+
+  AutoMutex lock(m_lock);
+  Codec codec = m_codec;
+  int level = m_level;
+  int width = frame.width;
+  int height = frame.height;
+  int depth = frame.depth;
+  int nb_rows = m_rows_per_chunk;
+  if(nb_rows <= 0)
+    {
+      int nb_bands = std::min(height,2 * (m_pool.getNbThreads() + 1));
+      nb_rows = (height + nb_bands - 1) / nb_bands;
+    }
+  nb_rows = std::min(nb_rows,height);
+  int nb_chunks = (height + nb_rows - 1) / nb_rows;
+  if(int(m_chunks.size()) < nb_chunks)
+    {
+      _Chunk empty;
+      empty.size = 0;
+      empty.duration = 0.;
+      empty.context = NULL;
+      m_chunks.resize(nb_chunks,empty);
+    }
+
+  size_t row_size = size_t(width) * depth;
+  const char* data = (const char*)frame.data;
+  double start = Timestamp::now();
+  m_pool.parallelFor(nb_chunks,[&](int c)
+    {
+      double chunk_start = Timestamp::now();
+      int y0 = c * nb_rows;
+      int rows = std::min(nb_rows,height - y0);
+      _compress(m_chunks[c],codec,level,data + y0 * row_size,rows * width,depth);
+      m_chunks[c].duration = Timestamp::now() - chunk_start;
+    });
+  double duration = Timestamp::now() - start;
+
+  CompressedFrame& compressed = m_frames.back();
+  size_t table_size = (2 + nb_chunks) * sizeof(uint32_t);
+  size_t total = table_size;
+  double cpu_time = 0.;
+  for(int c = 0;c < nb_chunks;++c)
+    total += m_chunks[c].size,cpu_time += m_chunks[c].duration;
+  if(compressed.data.size() < total)
+    compressed.data.resize(total);
+  uint32_t* table = (uint32_t*)&compressed.data[0];
+  table[0] = nb_chunks;
+  table[1] = nb_rows;
+  char* p = &compressed.data[table_size];
+  for(int c = 0;c < nb_chunks;++c)
+    {
+      table[2 + c] = uint32_t(m_chunks[c].size);
+      memcpy(p,&m_chunks[c].compressed[0],m_chunks[c].size);
+      p += m_chunks[c].size;
+    }
+  compressed.index = m_nb_compressed++;
+  compressed.frame_nb = frame.frame_nb;
+  compressed.timestamp = frame.timestamp;
+  compressed.camera_timestamp = frame.camera_timestamp;
+  compressed.width = width;
+  compressed.height = height;
+  compressed.depth = depth;
+  compressed.mode = frame.mode;
+  compressed.codec = codec;
+  compressed.size = total;
+  // the slot is not written again before the next frame
+  frame.compressed = &compressed;
+  m_frames.publish();
+  lock.unlock();
+
+  AutoMutex status_lock(m_status_lock);
+  size_t raw_size = row_size * height;
+  ++m_status.nb_frames;
+  m_status.raw_bytes += raw_size;
+  m_status.compressed_bytes += total;
+  m_status.ratio = double(m_status.raw_bytes) / m_status.compressed_bytes;
+  m_status.last_ratio = double(raw_size) / total;
+  m_status.cpu_time += cpu_time;
+  if(m_status.cpu_time > 0.)
+    m_status.throughput_per_core = m_status.raw_bytes / m_status.cpu_time;
+  m_status.last_duration = duration;
+}
+
+void FrameCompressor::decompress(const CompressedFrame& frame,void* dst)
+{
+  DEB_STATIC_FUNCT();
+
+  const char* data = frame.data.empty() ? NULL : &frame.data[0];
+  const uint32_t* table = (const uint32_t*)data;
+  size_t row_size = size_t(frame.width) * frame.depth;
+  if(frame.size < 2 * sizeof(uint32_t) || frame.size > frame.data.size() ||
+     !table[1] || table[0] != (frame.height + table[1] - 1) / table[1] ||
+     frame.size < (2 + table[0]) * sizeof(uint32_t))
+    throw LIMA_HW_EXC(InvalidValue,"Corrupted compressed frame");
+  int nb_chunks = table[0];
+  int nb_rows = table[1];
+
+  std::vector<char> shuffled(nb_rows * row_size);
+  size_t offset = (2 + nb_chunks) * sizeof(uint32_t);
+  for(int c = 0;c < nb_chunks;++c)
+    {
+      int y0 = c * nb_rows;
+      int rows = std::min(nb_rows,frame.height - y0);
+      size_t raw_size = rows * row_size;
+      size_t size = table[2 + c];
+      if(offset + size > frame.size)
+	throw LIMA_HW_EXC(InvalidValue,"Corrupted compressed frame");
+      const char* src = data + offset;
+      offset += size;
+      if(size != raw_size)
+	{
+	  bool ok = false;
+	  switch(frame.codec)
+	    {
+	    case BitshuffleRle:
+	      ok = _rleDecode((const uint8_t*)src,size,(uint8_t*)&shuffled[0],raw_size);
+	      break;
+#ifdef PROSILICA_WITH_LZ4
+	    case BitshuffleLz4:
+	      ok = LZ4_decompress_safe(src,&shuffled[0],int(size),int(raw_size)) == int(raw_size);
+	      break;
+#endif
+#ifdef PROSILICA_WITH_ZSTD
+	    case BitshuffleZstd:
+	      ok = ZSTD_decompress(&shuffled[0],raw_size,src,size) == raw_size;
+	      break;
+#endif
+	    default:
+	      throw LIMA_HW_EXC(NotSupported,"Compression codec not built in the plugin");
+	    }
+	  if(!ok)
+	    throw LIMA_HW_EXC(InvalidValue,"Corrupted compressed frame");
+	  src = &shuffled[0];
+	}
+      Kernels::bitunshuffle(src,(char*)dst + y0 * row_size,rows * frame.width,frame.depth);
+    }
+}
@@ -0,0 +1,59 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include "ProsilicaFrameLease.h"
+#include "ProsilicaBufferCtrlObj.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+FrameLease::FrameLease(BufferCtrlObj& buffer,int frame_nb) :
+  m_buffer(buffer),
+  m_frame_nb(frame_nb),
+  m_generation(0),
+  m_data(NULL),
+  m_nb_exports(0)
+{
+  DEB_CONSTRUCTOR();
+  DEB_PARAM() << DEB_VAR1(frame_nb);
+
+  m_data = m_buffer.leaseFrame(frame_nb,m_dim,m_generation);
+}
+
+FrameLease::~FrameLease()
+{
+  DEB_DESTRUCTOR();
+  release();
+}
+
+void FrameLease::release()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_data)
+    return;
+  m_buffer.releaseFrame(m_frame_nb,m_generation);
+  m_data = NULL;
+}
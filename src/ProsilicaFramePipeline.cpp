@@ -0,0 +1,511 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <unistd.h>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
+
+#include "ProsilicaFramePipeline.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+static const char* STAGE_NAMES[] = {"correction","analysis","output"};
+
+class FramePipeline::_Worker : public Thread
+{
+public:
+  _Worker(FramePipeline& pipeline,int nb) : m_pipeline(pipeline),m_nb(nb) {}
+protected:
+  virtual void threadFunction() {m_pipeline._run(m_nb);}
+private:
+  FramePipeline&	m_pipeline;
+  int			m_nb;
+};
+
+PipelineStageStatus::PipelineStageStatus() :
+  parallel(false),
+  nb_frames(0),
+  last_duration(0.),
+  mean_duration(0.),
+  max_duration(0.)
+{
+}
+
+PipelineStatus::PipelineStatus() :
+  nb_frames(0),
+  in_flight(0),
+  max_in_flight(0),
+  nb_stalls(0),
+  stall_time(0.),
+  last_latency(0.),
+  mean_latency(0.),
+  max_latency(0.)
+{
+}
+
+FramePipeline::FramePipeline(ThreadPolicyControl* policy) :
+  m_policy(policy),
+  m_active(false),
+  m_nb_threads(0),
+  m_depth(4),
+  m_max_in_flight(4),
+  m_nb_tasks(0),
+  m_nb_pushed(0),
+  m_nb_running(0),
+  m_quit(false),
+  m_next_seq(0),
+  m_in_flight(0),
+  m_next_queue(0),
+  m_rebuilding(false)
+{
+  DEB_CONSTRUCTOR();
+  setProcessors(std::vector<StageProcessor>());
+}
+
+FramePipeline::~FramePipeline()
+{
+  DEB_DESTRUCTOR();
+  drain();
+  _stopThreads();
+}
+
+void FramePipeline::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  if(active == m_active)
+    return;
+  if(active)
+    {
+      _startThreads();
+      m_active = true;
+    }
+  else
+    {
+      m_active = false;
+      _stopThreads();
+    }
+}
+
+void FramePipeline::setNbThreads(int nb_threads)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_threads);
+
+  if(nb_threads < 0)
+    throw LIMA_HW_EXC(InvalidValue,"Bad number of pipeline threads");
+  m_nb_threads = nb_threads;
+  if(m_active)
+    {
+      _stopThreads();
+      _startThreads();
+    }
+}
+
+void FramePipeline::setDepth(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if(nb_frames < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Pipeline depth must be >= 1");
+  AutoMutex lock(m_cond.mutex());
+  m_depth = m_max_in_flight = nb_frames;
+}
+
+void FramePipeline::prepare(int max_in_flight)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  m_max_in_flight = std::max(1,std::min(m_depth,max_in_flight));
+  DEB_TRACE() << DEB_VAR2(m_depth,m_max_in_flight);
+}
+
+void FramePipeline::_startThreads()
+{
+  DEB_MEMBER_FUNCT();
+
+  int nb_threads = m_nb_threads;
+  if(!nb_threads)
+    nb_threads = std::max(1L,sysconf(_SC_NPROCESSORS_ONLN) / 2);
+  DEB_TRACE() << DEB_VAR1(nb_threads);
+
+  AutoMutex lock(m_cond.mutex());
+  // the frames in flight are processed in the callback thread
+  _waitIdle(lock);
+  m_quit = false;
+  for(int i = 0;i < nb_threads;++i)
+    m_queues.push_back(new _Queue);
+  for(int i = 0;i < nb_threads;++i)
+    {
+      _Worker* worker = new _Worker(*this,i);
+      m_workers.push_back(worker);
+      ++m_nb_running;
+      worker->start();
+    }
+}
+
+void FramePipeline::_stopThreads()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  _waitIdle(lock);
+  // from now on, the frames are processed in the callback thread
+  std::vector<_Worker*> workers;
+  workers.swap(m_workers);
+  std::vector<_Queue*> queues;
+  queues.swap(m_queues);
+  m_quit = true;
+  m_cond.broadcast();
+  while(m_nb_running)
+    m_cond.wait();
+  lock.unlock();
+
+  for(std::vector<_Worker*>::iterator i = workers.begin();i != workers.end();++i)
+    delete *i;
+  for(std::vector<_Queue*>::iterator i = queues.begin();i != queues.end();++i)
+    delete *i;
+}
+
+//-----------------------------------------------------
+// @brief hand a frame over to the pipeline threads,
+// waits while the pipeline is full
+//-----------------------------------------------------
+void FramePipeline::submit(const FrameData& frame,const Delivery& delivery)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  if(m_in_flight >= m_max_in_flight || m_rebuilding)
+    {
+      double start = Timestamp::now();
+      ++m_status.nb_stalls;
+      while(m_in_flight >= m_max_in_flight || m_rebuilding)
+	m_cond.wait();
+      m_status.stall_time += double(Timestamp::now()) - start;
+    }
+
+  _Job* job = new _Job;
+  job->frame = frame;
+  job->frame.compressed = NULL;
+  job->delivery = delivery;
+  job->seq = m_next_seq++;
+  job->stage = 0;
+  job->submit_time = Timestamp::now();
+  ++m_in_flight;
+  m_status.max_in_flight = std::max(m_status.max_in_flight,m_in_flight);
+
+  if(m_workers.empty())
+    {
+      // not active: all the stages in the calling thread, alone in flight
+      lock.unlock();
+      for(;job->stage < int(m_stages.size());++job->stage)
+	_runStage(job);
+      AutoMutex stage_lock(m_stage_lock);
+      for(std::vector<_Stage>::iterator i = m_stages.begin();i != m_stages.end();++i)
+	++i->next_seq;
+      stage_lock.unlock();
+      _deliver(job);
+      return;
+    }
+  int worker = m_next_queue++ % int(m_queues.size());
+  lock.unlock();
+  _enter(job,worker);
+}
+
+void FramePipeline::drain()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  _waitIdle(lock);
+}
+
+void FramePipeline::_waitIdle(AutoMutex&)
+{
+  while(m_in_flight)
+    m_cond.wait();
+}
+
+void FramePipeline::setProcessors(const std::vector<StageProcessor>& processors)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  while(m_rebuilding)
+    m_cond.wait();
+  m_rebuilding = true;
+  _waitIdle(lock);
+
+  AutoMutex stage_lock(m_stage_lock);
+  m_stages.clear();
+  for(std::vector<StageProcessor>::const_iterator i = processors.begin();
+      i != processors.end();++i)
+    {
+      if(m_stages.empty() || m_stages.back().name != STAGE_NAMES[i->first])
+	{
+	  m_stages.push_back(_Stage());
+	  _Stage& stage = m_stages.back();
+	  stage.name = STAGE_NAMES[i->first];
+	  stage.parallel = true;
+	}
+      _Stage& stage = m_stages.back();
+      stage.processors.push_back(i->second);
+      stage.parallel = stage.parallel && i->second->isParallel();
+    }
+  // frames are delivered in submit order
+  m_stages.push_back(_Stage());
+  m_stages.back().name = "delivery";
+  m_stages.back().parallel = false;
+  for(std::vector<_Stage>::iterator i = m_stages.begin();i != m_stages.end();++i)
+    {
+      i->next_seq = m_next_seq;
+      i->status.name = i->name;
+      i->status.parallel = i->parallel;
+    }
+  stage_lock.unlock();
+
+  m_rebuilding = false;
+  m_cond.broadcast();
+}
+
+void FramePipeline::_run(int worker)
+{
+  DEB_MEMBER_FUNCT();
+
+  int policy_generation = -1;
+  while(true)
+    {
+      if(m_policy)
+	m_policy->update(policy_generation);
+      _Job* job = _take(worker);
+      if(!job)
+	break;
+
+      _runStage(job);
+
+      _Job* next = NULL;
+      AutoMutex stage_lock(m_stage_lock);
+      _Stage& stage = m_stages[job->stage];
+      if(!stage.parallel)
+	{
+	  // the next frame of a serial stage may be waiting for it
+	  std::map<long long,_Job*>::iterator i = stage.waiting.find(++stage.next_seq);
+	  if(i != stage.waiting.end())
+	    {
+	      next = i->second;
+	      stage.waiting.erase(i);
+	    }
+	}
+      stage_lock.unlock();
+      if(next)
+	_push(next,worker);
+
+      if(++job->stage < int(m_stages.size()))
+	_enter(job,worker);
+      else
+	_deliver(job);
+    }
+  if(m_policy)
+    m_policy->release();
+
+  AutoMutex lock(m_cond.mutex());
+  --m_nb_running;
+  m_cond.broadcast();
+}
+
+//-----------------------------------------------------
+// @brief the newest ready stage of the worker, else the oldest one
+// of another worker
+// @return NULL when the pipeline threads stop
+//-----------------------------------------------------
+FramePipeline::_Job* FramePipeline::_take(int worker)
+{
+  long long nb_pushed;
+  {
+    AutoMutex lock(m_cond.mutex());
+    while(!m_nb_tasks && !m_quit)
+      m_cond.wait();
+    if(!m_nb_tasks)
+      return NULL;
+    // a ready job is now reserved, it is in one of the queues
+    --m_nb_tasks;
+    nb_pushed = m_nb_pushed;
+  }
+
+  int nb_queues = int(m_queues.size());
+  while(true)
+    {
+      for(int n = 0;n < nb_queues;++n)
+	{
+	  _Queue& queue = *m_queues[(worker + n) % nb_queues];
+	  AutoMutex lock(queue.lock);
+	  if(queue.jobs.empty())
+	    continue;
+	  _Job* job;
+	  if(!n)
+	    {
+	      job = queue.jobs.front();
+	      queue.jobs.pop_front();
+	    }
+	  else
+	    {
+	      job = queue.jobs.back();
+	      queue.jobs.pop_back();
+	    }
+	  return job;
+	}
+
+      // the job was taken by another worker while this one scanned
+      // the queues, the one due is pushed after: wait for it
+      AutoMutex lock(m_cond.mutex());
+      while(m_nb_pushed == nb_pushed && !m_quit)
+	m_cond.wait();
+      if(m_nb_pushed == nb_pushed)
+	return NULL;
+      nb_pushed = m_nb_pushed;
+    }
+}
+
+void FramePipeline::_runStage(_Job* job)
+{
+  DEB_MEMBER_FUNCT();
+
+  _Stage& stage = m_stages[job->stage];
+  double start = Timestamp::now();
+  if(job->stage == int(m_stages.size()) - 1)
+    {
+      try
+	{
+	  job->delivery(job->frame);
+	}
+      catch(Exception& e)
+	{
+	  DEB_ERROR() << "Frame delivery failed: " << e.getErrMsg();
+	}
+    }
+  else
+    for(std::vector<FrameProcessor*>::iterator i = stage.processors.begin();
+	i != stage.processors.end();++i)
+      {
+	try
+	  {
+	    (*i)->process(job->frame);
+	  }
+	catch(Exception& e)
+	  {
+	    DEB_ERROR() << "Frame processing failed: " << e.getErrMsg();
+	  }
+      }
+  double duration = double(Timestamp::now()) - start;
+
+  AutoMutex lock(m_stage_lock);
+  PipelineStageStatus& status = stage.status;
+  ++status.nb_frames;
+  status.last_duration = duration;
+  status.mean_duration += (duration - status.mean_duration) / status.nb_frames;
+  status.max_duration = std::max(status.max_duration,duration);
+}
+
+//-----------------------------------------------------
+// @brief a serial stage takes the frames in submit order
+//-----------------------------------------------------
+void FramePipeline::_enter(_Job* job,int worker)
+{
+  AutoMutex lock(m_stage_lock);
+  _Stage& stage = m_stages[job->stage];
+  if(!stage.parallel && job->seq != stage.next_seq)
+    {
+      stage.waiting[job->seq] = job;
+      return;
+    }
+  lock.unlock();
+  _push(job,worker);
+}
+
+void FramePipeline::_push(_Job* job,int worker)
+{
+  {
+    _Queue& queue = *m_queues[worker];
+    AutoMutex lock(queue.lock);
+    queue.jobs.push_front(job);
+  }
+  AutoMutex lock(m_cond.mutex());
+  ++m_nb_tasks;
+  ++m_nb_pushed;
+  m_cond.broadcast();
+}
+
+void FramePipeline::_deliver(_Job* job)
+{
+  double latency = double(Timestamp::now()) - job->submit_time;
+  delete job;
+
+  AutoMutex lock(m_cond.mutex());
+  --m_in_flight;
+  ++m_status.nb_frames;
+  m_status.last_latency = latency;
+  m_status.mean_latency += (latency - m_status.mean_latency) / m_status.nb_frames;
+  m_status.max_latency = std::max(m_status.max_latency,latency);
+  m_cond.broadcast();
+}
+
+void FramePipeline::getStatus(PipelineStatus& status)
+{
+  AutoMutex lock(m_cond.mutex());
+  status = m_status;
+  status.in_flight = m_in_flight;
+}
+
+void FramePipeline::getStageStatus(std::vector<PipelineStageStatus>& status)
+{
+  AutoMutex lock(m_stage_lock);
+  status.clear();
+  for(std::vector<_Stage>::iterator i = m_stages.begin();i != m_stages.end();++i)
+    status.push_back(i->status);
+}
+
+void FramePipeline::resetStatus()
+{
+  DEB_MEMBER_FUNCT();
+
+  {
+    AutoMutex lock(m_cond.mutex());
+    m_status = PipelineStatus();
+  }
+  AutoMutex lock(m_stage_lock);
+  for(std::vector<_Stage>::iterator i = m_stages.begin();i != m_stages.end();++i)
+    {
+      i->status = PipelineStageStatus();
+      i->status.name = i->name;
+      i->status.parallel = i->parallel;
+    }
+}
@@ -0,0 +1,141 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaFrameProcessor.h"
+#include "ProsilicaFramePipeline.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+static bool _stageLess(const std::pair<FrameProcessor::Stage,FrameProcessor*>& a,
+		       const std::pair<FrameProcessor::Stage,FrameProcessor*>& b)
+{
+  return a.first < b.first;
+}
+
+FrameProcessorChain::FrameProcessorChain() :
+  m_pipeline(NULL),
+  m_empty(true)
+{
+  DEB_CONSTRUCTOR();
+}
+
+void FrameProcessorChain::setPipeline(FramePipeline* pipeline)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  m_pipeline = pipeline;
+  if(m_pipeline)
+    m_pipeline->setProcessors(m_processors);
+}
+
+void FrameProcessorChain::add(FrameProcessor* processor,FrameProcessor::Stage stage)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(stage);
+
+  AutoMutex lock(m_lock);
+  StageProcessor stage_processor(stage,processor);
+  // after the processors of the same stage
+  m_processors.insert(std::upper_bound(m_processors.begin(),m_processors.end(),
+				       stage_processor,_stageLess),
+		      stage_processor);
+  m_empty = false;
+  // waits for the frames in flight
+  if(m_pipeline)
+    m_pipeline->setProcessors(m_processors);
+}
+
+void FrameProcessorChain::remove(FrameProcessor* processor)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  for(std::vector<StageProcessor>::iterator i = m_processors.begin();
+      i != m_processors.end();++i)
+    if(i->second == processor)
+      {
+	m_processors.erase(i);
+	break;
+      }
+  m_empty = m_processors.empty();
+  if(m_pipeline)
+    m_pipeline->setProcessors(m_processors);
+}
+
+void FrameProcessorChain::prepare()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  for(std::vector<StageProcessor>::iterator i = m_processors.begin();
+      i != m_processors.end();++i)
+    i->second->prepare();
+}
+
+void FrameProcessorChain::finish()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_pipeline)
+    m_pipeline->drain();
+  AutoMutex lock(m_lock);
+  for(std::vector<StageProcessor>::iterator i = m_processors.begin();
+      i != m_processors.end();++i)
+    {
+      try
+	{
+	  i->second->finish();
+	}
+      catch(Exception& e)
+	{
+	  DEB_ERROR() << "Frame processor finish failed: " << e.getErrMsg();
+	}
+    }
+}
+
+void FrameProcessorChain::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  for(std::vector<StageProcessor>::iterator i = m_processors.begin();
+      i != m_processors.end();++i)
+    {
+      try
+	{
+	  i->second->process(frame);
+	}
+      catch(Exception& e)
+	{
+	  DEB_ERROR() << "Frame processing failed: " << e.getErrMsg();
+	}
+    }
+}
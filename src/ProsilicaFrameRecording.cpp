@@ -0,0 +1,466 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
+
+#include "ProsilicaFrameRecording.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+static inline size_t _recordSize(size_t image_size)
+{
+  return (sizeof(Recording::FrameHeader) + image_size + 7) & ~size_t(7);
+}
+
+FrameRecorder::FrameRecorder() :
+  m_active(false),
+  m_fd(-1),
+  m_map(NULL),
+  m_map_size(0),
+  m_offset(0),
+  m_start_time(-1.),
+  m_nb_recorded(0),
+  m_nb_dropped(0)
+{
+  DEB_CONSTRUCTOR();
+}
+
+FrameRecorder::~FrameRecorder()
+{
+  DEB_DESTRUCTOR();
+
+  stop();
+}
+
+//-----------------------------------------------------
+// @brief create the file, max_size bytes are mapped at once
+//-----------------------------------------------------
+void FrameRecorder::start(const std::string& path,long long max_size)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(path,max_size);
+
+  if(max_size <= Recording::HEADER_SIZE)
+    throw LIMA_HW_EXC(InvalidValue,"Recording max size too small");
+  stop();
+
+  int fd = ::open(path.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+  if(fd < 0)
+    {
+      DEB_ERROR() << "Can't create " << DEB_VAR2(path,strerror(errno));
+      throw LIMA_HW_EXC(Error,"Can't create the recording file");
+    }
+  void* map = MAP_FAILED;
+  if(!ftruncate(fd,max_size))
+    map = mmap(NULL,max_size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+  if(map == MAP_FAILED)
+    {
+      DEB_ERROR() << "Can't map " << DEB_VAR2(path,strerror(errno));
+      ::close(fd);
+      unlink(path.c_str());
+      throw LIMA_HW_EXC(Error,"Can't map the recording file");
+    }
+
+  Recording::FileHeader* header = (Recording::FileHeader*)map;
+  memset(header,0,sizeof(Recording::FileHeader));
+  header->magic = Recording::MAGIC;
+  header->version = Recording::VERSION;
+
+  AutoMutex lock(m_lock);
+  m_path = path;
+  m_fd = fd;
+  m_map = (char*)map;
+  m_map_size = max_size;
+  m_offset = Recording::HEADER_SIZE;
+  m_start_time = -1.;
+  m_nb_recorded = 0;
+  m_nb_dropped = 0;
+  m_active = true;
+}
+
+//-----------------------------------------------------
+// @brief unmap and trim the file to the recorded frames
+//-----------------------------------------------------
+void FrameRecorder::stop()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  if(!m_active)
+    return;
+  m_active = false;
+  msync(m_map,m_offset,MS_SYNC);
+  munmap(m_map,m_map_size);
+  if(ftruncate(m_fd,m_offset))
+    DEB_WARNING() << "Can't trim " << DEB_VAR1(m_path);
+  ::close(m_fd);
+  m_map = NULL;
+  m_fd = -1;
+
+  DEB_TRACE() << DEB_VAR3(m_path,m_nb_recorded,m_nb_dropped);
+}
+
+long long FrameRecorder::getNbRecorded()
+{
+  AutoMutex lock(m_lock);
+  return m_nb_recorded;
+}
+
+long long FrameRecorder::getNbDropped()
+{
+  AutoMutex lock(m_lock);
+  return m_nb_dropped;
+}
+
+void FrameRecorder::record(const tPvFrame* frame)
+{
+  if(!m_active || frame->Status == ePvErrCancelled)
+    return;
+
+  double now = Timestamp::now();
+  size_t image_size = frame->Status == ePvErrSuccess ? frame->ImageSize : 0;
+  size_t size = _recordSize(image_size);
+
+  AutoMutex lock(m_lock);
+  if(!m_active)
+    return;
+  if(m_offset + size > m_map_size)
+    {
+      ++m_nb_dropped;
+      return;
+    }
+  if(m_start_time < 0.)
+    m_start_time = now;
+
+  Recording::FrameHeader* header = (Recording::FrameHeader*)(m_map + m_offset);
+  header->size = uint32_t(size);
+  header->status = frame->Status;
+  header->format = frame->Format;
+  header->width = frame->Width;
+  header->height = frame->Height;
+  header->region_x = frame->RegionX;
+  header->region_y = frame->RegionY;
+  header->bit_depth = frame->BitDepth;
+  header->bayer_pattern = frame->BayerPattern;
+  header->frame_count = frame->FrameCount;
+  header->timestamp_lo = frame->TimestampLo;
+  header->timestamp_hi = frame->TimestampHi;
+  header->image_size = uint32_t(image_size);
+  header->reserved = 0;
+  header->arrival = now - m_start_time;
+  memcpy(header + 1,frame->ImageBuffer,image_size);
+  m_offset += size;
+
+  Recording::FileHeader* file_header = (Recording::FileHeader*)m_map;
+  file_header->nb_frames = ++m_nb_recorded;
+  file_header->data_size = m_offset - Recording::HEADER_SIZE;
+  file_header->start_time = m_start_time;
+}
+
+class FrameReplayer::_ReplayThread : public Thread
+{
+public:
+  _ReplayThread(FrameReplayer& replayer) : m_replayer(replayer) {}
+protected:
+  virtual void threadFunction() {m_replayer._run();}
+private:
+  FrameReplayer&	m_replayer;
+};
+
+FrameReplayer::FrameReplayer() :
+  m_active(false),
+  m_fd(-1),
+  m_map(NULL),
+  m_map_size(0),
+  m_thread(NULL),
+  m_quit(false),
+  m_running(false),
+  m_in_callback(false),
+  m_speed(1.),
+  m_loop(false),
+  m_next(0),
+  m_time_base(-1.),
+  m_nb_replayed(0)
+{
+  DEB_CONSTRUCTOR();
+}
+
+FrameReplayer::~FrameReplayer()
+{
+  DEB_DESTRUCTOR();
+
+  close();
+}
+
+void FrameReplayer::open(const std::string& path)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(path);
+
+  close();
+
+  int fd = ::open(path.c_str(),O_RDONLY);
+  if(fd < 0)
+    {
+      DEB_ERROR() << "Can't open " << DEB_VAR2(path,strerror(errno));
+      throw LIMA_HW_EXC(Error,"Can't open the recording file");
+    }
+  struct stat st;
+  void* map = MAP_FAILED;
+  if(!fstat(fd,&st) && st.st_size >= Recording::HEADER_SIZE)
+    map = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+  if(map == MAP_FAILED)
+    {
+      ::close(fd);
+      throw LIMA_HW_EXC(Error,"Can't map the recording file");
+    }
+
+  // the records are checked once, the replay trusts them
+  const Recording::FileHeader* header = (const Recording::FileHeader*)map;
+  std::vector<size_t> offsets;
+  bool ok = header->magic == Recording::MAGIC && header->version == Recording::VERSION &&
+    header->data_size <= uint64_t(st.st_size - Recording::HEADER_SIZE);
+  size_t end = Recording::HEADER_SIZE + (ok ? header->data_size : 0);
+  for(size_t offset = Recording::HEADER_SIZE;ok && offset < end;)
+    {
+      const Recording::FrameHeader* frame =
+	(const Recording::FrameHeader*)((const char*)map + offset);
+      ok = offset + sizeof(Recording::FrameHeader) <= end &&
+	frame->size == _recordSize(frame->image_size) && offset + frame->size <= end;
+      if(ok)
+	{
+	  offsets.push_back(offset);
+	  offset += frame->size;
+	}
+    }
+  if(!ok || offsets.empty() || offsets.size() != header->nb_frames)
+    {
+      munmap(map,st.st_size);
+      ::close(fd);
+      throw LIMA_HW_EXC(InvalidValue,"Not a valid recording file");
+    }
+
+  AutoMutex lock(m_cond.mutex());
+  m_fd = fd;
+  m_map = (char*)map;
+  m_map_size = st.st_size;
+  m_offsets.swap(offsets);
+  m_queue.clear();
+  m_next = 0;
+  m_time_base = -1.;
+  m_nb_replayed = 0;
+  m_quit = false;
+  m_running = true;
+  m_thread = new _ReplayThread(*this);
+  m_thread->start();
+  m_active = true;
+
+  DEB_TRACE() << DEB_VAR1(m_offsets.size());
+}
+
+void FrameReplayer::close()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active)
+    return;
+  clear();
+
+  AutoMutex lock(m_cond.mutex());
+  m_active = false;
+  m_quit = true;
+  m_cond.broadcast();
+  while(m_running)
+    m_cond.wait();
+  lock.unlock();
+
+  delete m_thread;
+  m_thread = NULL;
+  munmap(m_map,m_map_size);
+  ::close(m_fd);
+  m_map = NULL;
+  m_fd = -1;
+  m_offsets.clear();
+}
+
+void FrameReplayer::setSpeed(double speed)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(speed);
+
+  if(speed < 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Replay speed can't be negative");
+  AutoMutex lock(m_cond.mutex());
+  m_speed = speed;
+  m_time_base = -1.;
+  m_cond.broadcast();
+}
+
+void FrameReplayer::setLoop(bool loop)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(loop);
+
+  AutoMutex lock(m_cond.mutex());
+  m_loop = loop;
+  m_cond.broadcast();
+}
+
+long long FrameReplayer::getNbReplayed()
+{
+  AutoMutex lock(m_cond.mutex());
+  return m_nb_replayed;
+}
+
+tPvErr FrameReplayer::queueFrame(tPvFrame* frame,tPvFrameCallback callback)
+{
+  AutoMutex lock(m_cond.mutex());
+  if(!m_active)
+    return ePvErrBadSequence;
+  Queued queued = {frame,callback};
+  m_queue.push_back(queued);
+  m_cond.broadcast();
+  return ePvErrSuccess;
+}
+
+//-----------------------------------------------------
+// @brief the queued frames are given back cancelled, as PvAPI does.
+// A frame being replayed completes first, unless called from its callback
+//-----------------------------------------------------
+void FrameReplayer::clear()
+{
+  DEB_MEMBER_FUNCT();
+
+  std::deque<Queued> queue;
+  AutoMutex lock(m_cond.mutex());
+  queue.swap(m_queue);
+  // the replay goes on with the frames queued meanwhile, wait for this one only
+  long long nb_replayed = m_nb_replayed;
+  while(m_in_callback && m_nb_replayed == nb_replayed &&
+	!pthread_equal(pthread_self(),m_callback_thread))
+    m_cond.wait();
+  lock.unlock();
+
+  for(std::deque<Queued>::iterator i = queue.begin();i != queue.end();++i)
+    {
+      i->frame->Status = ePvErrCancelled;
+      if(i->callback)
+	i->callback(i->frame);
+    }
+}
+
+void FrameReplayer::rewind()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  m_next = 0;
+  m_time_base = -1.;
+}
+
+void FrameReplayer::_run()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  while(!m_quit)
+    {
+      if(m_next == m_offsets.size() && m_loop)
+	{
+	  m_next = 0;
+	  m_time_base = -1.;
+	}
+      if(m_queue.empty() || m_next == m_offsets.size())
+	{
+	  m_cond.wait();
+	  continue;
+	}
+
+      const Recording::FrameHeader* header =
+	(const Recording::FrameHeader*)(m_map + m_offsets[m_next]);
+      if(m_speed > 0.)
+	{
+	  double now = Timestamp::now();
+	  if(m_time_base < 0.)
+	    m_time_base = now - header->arrival / m_speed;
+	  double due = m_time_base + header->arrival / m_speed;
+	  if(due > now)
+	    {
+	      m_cond.wait(due - now);
+	      continue;
+	    }
+	}
+      Queued queued = m_queue.front();
+      m_queue.pop_front();
+      ++m_next;
+      m_in_callback = true;
+      m_callback_thread = pthread_self();
+      lock.unlock();
+
+      _fill(queued.frame,header);
+      if(queued.callback)
+	queued.callback(queued.frame);
+
+      lock.lock();
+      m_in_callback = false;
+      ++m_nb_replayed;
+      m_cond.broadcast();
+    }
+  m_running = false;
+  m_cond.broadcast();
+}
+
+void FrameReplayer::_fill(tPvFrame* frame,const Recording::FrameHeader* header)
+{
+  frame->Status = tPvErr(header->status);
+  frame->Format = tPvImageFormat(header->format);
+  frame->Width = header->width;
+  frame->Height = header->height;
+  frame->RegionX = header->region_x;
+  frame->RegionY = header->region_y;
+  frame->BitDepth = header->bit_depth;
+  frame->BayerPattern = tPvBayerPattern(header->bayer_pattern);
+  frame->FrameCount = header->frame_count;
+  frame->TimestampLo = header->timestamp_lo;
+  frame->TimestampHi = header->timestamp_hi;
+  frame->AncillarySize = 0;
+  if(header->image_size > frame->ImageBufferSize)
+    {
+      frame->Status = ePvErrBufferTooSmall;
+      frame->ImageSize = 0;
+      return;
+    }
+  memcpy(frame->ImageBuffer,header + 1,header->image_size);
+  frame->ImageSize = header->image_size;
+}
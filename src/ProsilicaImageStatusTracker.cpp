@@ -0,0 +1,62 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <algorithm>
+
+#include "ProsilicaImageStatusTracker.h"
+#include "ProsilicaCamera.h"
+#include "ProsilicaBufferCtrlObj.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+ImageStatusTracker::ImageStatusTracker(Camera* cam,bool track_saving) :
+  m_cam(cam),
+  m_track_saving(track_saving)
+{
+  DEB_CONSTRUCTOR();
+  // no overrun detection in video mode, Lima buffers are not used
+  BufferCtrlObj* buffer = m_cam->getBufferCtrlObj();
+  if(buffer)
+    buffer->setConsumerTracking(true);
+}
+
+ImageStatusTracker::~ImageStatusTracker()
+{
+  DEB_DESTRUCTOR();
+  BufferCtrlObj* buffer = m_cam->getBufferCtrlObj();
+  if(buffer)
+    buffer->setConsumerTracking(false);
+}
+
+void ImageStatusTracker::imageStatusChanged(const CtControl::ImageStatus& status)
+{
+  long last_consumed = status.LastImageReady;
+  if(m_track_saving)
+    last_consumed = std::min(last_consumed,status.LastImageSaved);
+  BufferCtrlObj* buffer = m_cam->getBufferCtrlObj();
+  if(buffer)
+    buffer->setLastConsumedFrame(int(last_consumed));
+}
@@ -59,7 +59,10 @@ Interface::Interface(Camera *cam) :
   m_roi = new RoiCtrlObj(cam, m_sync);
 
   if(m_buffer)
-    m_buffer->m_sync = m_sync;
+    {
+      m_buffer->m_sync = m_sync;
+      cam->m_buffer = m_buffer;
+    }
   if(m_video)
     m_video->m_sync = m_sync;
 }
@@ -67,6 +70,7 @@ Interface::Interface(Camera *cam) :
 Interface::~Interface()
 {
   DEB_DESTRUCTOR();
+  m_cam->m_buffer = NULL;
   if(m_video)
     {
       delete m_video;
@@ -105,6 +109,8 @@ void Interface::reset(ResetLevel reset_level)
 void Interface::prepareAcq()
 {
   DEB_MEMBER_FUNCT();
+  m_sync->checkAcqPlan();
+  m_cam->getFrameProcessors().prepare();
   if(m_buffer)
     m_buffer->prepareAcq();
 }
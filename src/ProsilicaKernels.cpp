@@ -0,0 +1,508 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ProsilicaKernels.h"
+
+using namespace lima::Prosilica;
+
+// 2048 column sums take 8 kB
+static const int COLUMN_BLOCK = 2048;
+
+#ifdef __SSE2__
+static inline void _addColumns(uint32_t* col,__m128i v)
+{
+  __m128i sums = _mm_loadu_si128((const __m128i*)col);
+  _mm_storeu_si128((__m128i*)col,_mm_add_epi32(sums,v));
+}
+
+static inline uint32_t _hsum32(__m128i v)
+{
+  v = _mm_add_epi32(v,_mm_srli_si128(v,8));
+  v = _mm_add_epi32(v,_mm_srli_si128(v,4));
+  return _mm_cvtsi128_si32(v);
+}
+#endif
+
+uint32_t Kernels::project8(const uint8_t* data,int stride,int width,int height,
+			   uint32_t* col_sums,uint32_t* row_sums)
+{
+  memset(col_sums,0,width * sizeof(uint32_t));
+  memset(row_sums,0,height * sizeof(uint32_t));
+
+  uint32_t max_value = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  __m128i vmax = zero;
+#endif
+  for(int c0 = 0;c0 < width;c0 += COLUMN_BLOCK)
+    {
+      int nb = std::min(COLUMN_BLOCK,width - c0);
+      uint32_t* col = col_sums + c0;
+      for(int y = 0;y < height;++y)
+	{
+	  const uint8_t* p = data + size_t(y) * stride + c0;
+	  uint32_t row = 0;
+	  int x = 0;
+#ifdef __SSE2__
+	  __m128i vrow = zero;
+	  for(;x + 16 <= nb;x += 16)
+	    {
+	      __m128i v = _mm_loadu_si128((const __m128i*)(p + x));
+	      vmax = _mm_max_epu8(vmax,v);
+	      vrow = _mm_add_epi64(vrow,_mm_sad_epu8(v,zero));
+	      __m128i lo = _mm_unpacklo_epi8(v,zero);
+	      __m128i hi = _mm_unpackhi_epi8(v,zero);
+	      _addColumns(col + x,_mm_unpacklo_epi16(lo,zero));
+	      _addColumns(col + x + 4,_mm_unpackhi_epi16(lo,zero));
+	      _addColumns(col + x + 8,_mm_unpacklo_epi16(hi,zero));
+	      _addColumns(col + x + 12,_mm_unpackhi_epi16(hi,zero));
+	    }
+	  row = _mm_cvtsi128_si32(vrow) + _mm_cvtsi128_si32(_mm_srli_si128(vrow,8));
+#endif
+	  for(;x < nb;++x)
+	    {
+	      uint32_t v = p[x];
+	      col[x] += v;
+	      row += v;
+	      max_value = std::max(max_value,v);
+	    }
+	  row_sums[y] += row;
+	}
+    }
+#ifdef __SSE2__
+  uint8_t lanes[16];
+  _mm_storeu_si128((__m128i*)lanes,vmax);
+  for(int i = 0;i < 16;++i)
+    max_value = std::max(max_value,uint32_t(lanes[i]));
+#endif
+  return max_value;
+}
+
+uint32_t Kernels::project16(const uint16_t* data,int stride,int width,int height,
+			    uint32_t* col_sums,uint32_t* row_sums)
+{
+  memset(col_sums,0,width * sizeof(uint32_t));
+  memset(row_sums,0,height * sizeof(uint32_t));
+
+  uint32_t max_value = 0;
+#ifdef __SSE2__
+  // no unsigned 16-bit max in SSE2: compare with the sign bit flipped
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi16(short(0x8000));
+  __m128i vmax = bias;
+#endif
+  for(int c0 = 0;c0 < width;c0 += COLUMN_BLOCK)
+    {
+      int nb = std::min(COLUMN_BLOCK,width - c0);
+      uint32_t* col = col_sums + c0;
+      for(int y = 0;y < height;++y)
+	{
+	  const uint16_t* p = data + size_t(y) * stride + c0;
+	  uint32_t row = 0;
+	  int x = 0;
+#ifdef __SSE2__
+	  __m128i vrow = zero;
+	  for(;x + 8 <= nb;x += 8)
+	    {
+	      __m128i v = _mm_loadu_si128((const __m128i*)(p + x));
+	      vmax = _mm_max_epi16(vmax,_mm_xor_si128(v,bias));
+	      __m128i lo = _mm_unpacklo_epi16(v,zero);
+	      __m128i hi = _mm_unpackhi_epi16(v,zero);
+	      vrow = _mm_add_epi32(vrow,_mm_add_epi32(lo,hi));
+	      _addColumns(col + x,lo);
+	      _addColumns(col + x + 4,hi);
+	    }
+	  row = _hsum32(vrow);
+#endif
+	  for(;x < nb;++x)
+	    {
+	      uint32_t v = p[x];
+	      col[x] += v;
+	      row += v;
+	      max_value = std::max(max_value,v);
+	    }
+	  row_sums[y] += row;
+	}
+    }
+#ifdef __SSE2__
+  uint16_t lanes[8];
+  _mm_storeu_si128((__m128i*)lanes,_mm_xor_si128(vmax,bias));
+  for(int i = 0;i < 8;++i)
+    max_value = std::max(max_value,uint32_t(lanes[i]));
+#endif
+  return max_value;
+}
+
+void Kernels::subtract8(uint8_t* data,const uint8_t* offset,int nb)
+{
+  int i = 0;
+#ifdef __SSE2__
+  for(;i + 16 <= nb;i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+      __m128i o = _mm_loadu_si128((const __m128i*)(offset + i));
+      _mm_storeu_si128((__m128i*)(data + i),_mm_subs_epu8(v,o));
+    }
+#endif
+  for(;i < nb;++i)
+    data[i] = data[i] > offset[i] ? data[i] - offset[i] : 0;
+}
+
+void Kernels::subtract16(uint16_t* data,const uint16_t* offset,int nb)
+{
+  int i = 0;
+#ifdef __SSE2__
+  for(;i + 8 <= nb;i += 8)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+      __m128i o = _mm_loadu_si128((const __m128i*)(offset + i));
+      _mm_storeu_si128((__m128i*)(data + i),_mm_subs_epu16(v,o));
+    }
+#endif
+  for(;i < nb;++i)
+    data[i] = data[i] > offset[i] ? data[i] - offset[i] : 0;
+}
+
+template<class T>
+static inline T _correct(T v,float offset,float gain,float max_value)
+{
+  float corrected = (v - offset) * gain + 0.5f;
+  return T(std::min(std::max(corrected,0.f),max_value));
+}
+
+#ifdef __SSE2__
+static inline __m128i _correct4(__m128i v,const float* offset,const float* gain)
+{
+  __m128 f = _mm_cvtepi32_ps(v);
+  f = _mm_mul_ps(_mm_sub_ps(f,_mm_loadu_ps(offset)),_mm_loadu_ps(gain));
+  return _mm_cvtps_epi32(_mm_max_ps(f,_mm_setzero_ps()));
+}
+#endif
+
+void Kernels::correct8(uint8_t* data,const float* offset,const float* gain,int nb)
+{
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for(;i + 16 <= nb;i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+      __m128i lo = _mm_unpacklo_epi8(v,zero);
+      __m128i hi = _mm_unpackhi_epi8(v,zero);
+      __m128i c0 = _correct4(_mm_unpacklo_epi16(lo,zero),offset + i,gain + i);
+      __m128i c1 = _correct4(_mm_unpackhi_epi16(lo,zero),offset + i + 4,gain + i + 4);
+      __m128i c2 = _correct4(_mm_unpacklo_epi16(hi,zero),offset + i + 8,gain + i + 8);
+      __m128i c3 = _correct4(_mm_unpackhi_epi16(hi,zero),offset + i + 12,gain + i + 12);
+      // saturating packs: 32 -> 16 signed -> 8 unsigned
+      __m128i p = _mm_packus_epi16(_mm_packs_epi32(c0,c1),_mm_packs_epi32(c2,c3));
+      _mm_storeu_si128((__m128i*)(data + i),p);
+    }
+#endif
+  for(;i < nb;++i)
+    data[i] = _correct(data[i],offset[i],gain[i],255.f);
+}
+
+void Kernels::correct16(uint16_t* data,const float* offset,const float* gain,int nb)
+{
+  int i = 0;
+#ifdef __SSE2__
+  // no unsigned 32 -> 16 saturating pack in SSE2: shift to signed range
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i shift32 = _mm_set1_epi32(0x8000);
+  const __m128i shift16 = _mm_set1_epi16(short(0x8000));
+  for(;i + 8 <= nb;i += 8)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+      __m128i c0 = _correct4(_mm_unpacklo_epi16(v,zero),offset + i,gain + i);
+      __m128i c1 = _correct4(_mm_unpackhi_epi16(v,zero),offset + i + 4,gain + i + 4);
+      __m128i p = _mm_packs_epi32(_mm_sub_epi32(c0,shift32),_mm_sub_epi32(c1,shift32));
+      _mm_storeu_si128((__m128i*)(data + i),_mm_xor_si128(p,shift16));
+    }
+#endif
+  for(;i < nb;++i)
+    data[i] = _correct(data[i],offset[i],gain[i],65535.f);
+}
+
+void Kernels::add8(uint32_t* acc,const uint8_t* data,int nb)
+{
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for(;i + 16 <= nb;i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+      __m128i lo = _mm_unpacklo_epi8(v,zero);
+      __m128i hi = _mm_unpackhi_epi8(v,zero);
+      _addColumns(acc + i,_mm_unpacklo_epi16(lo,zero));
+      _addColumns(acc + i + 4,_mm_unpackhi_epi16(lo,zero));
+      _addColumns(acc + i + 8,_mm_unpacklo_epi16(hi,zero));
+      _addColumns(acc + i + 12,_mm_unpackhi_epi16(hi,zero));
+    }
+#endif
+  for(;i < nb;++i)
+    acc[i] += data[i];
+}
+
+void Kernels::add16(uint32_t* acc,const uint16_t* data,int nb)
+{
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for(;i + 8 <= nb;i += 8)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+      _addColumns(acc + i,_mm_unpacklo_epi16(v,zero));
+      _addColumns(acc + i + 4,_mm_unpackhi_epi16(v,zero));
+    }
+#endif
+  for(;i < nb;++i)
+    acc[i] += data[i];
+}
+
+void Kernels::add32(uint32_t* acc,const uint32_t* data,int nb)
+{
+  int i = 0;
+#ifdef __SSE2__
+  for(;i + 4 <= nb;i += 4)
+    _addColumns(acc + i,_mm_loadu_si128((const __m128i*)(data + i)));
+#endif
+  for(;i < nb;++i)
+    acc[i] += data[i];
+}
+
+int Kernels::countSaturated8(const uint8_t* data,int nb,uint8_t level)
+{
+  int count = 0;
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i l = _mm_set1_epi8(char(level));
+  for(;i + 16 <= nb;i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+      // v >= level <=> max(v,level) == v
+      __m128i saturated = _mm_cmpeq_epi8(_mm_max_epu8(v,l),v);
+      count += __builtin_popcount(_mm_movemask_epi8(saturated));
+    }
+#endif
+  for(;i < nb;++i)
+    count += data[i] >= level;
+  return count;
+}
+
+int Kernels::countSaturated16(const uint16_t* data,int nb,uint16_t level)
+{
+  int count = 0;
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i l = _mm_set1_epi16(short(level));
+  const __m128i zero = _mm_setzero_si128();
+  for(;i + 8 <= nb;i += 8)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+      // v >= level <=> level -sat v == 0, two mask bits per pixel
+      __m128i saturated = _mm_cmpeq_epi16(_mm_subs_epu16(l,v),zero);
+      count += __builtin_popcount(_mm_movemask_epi8(saturated)) / 2;
+    }
+#endif
+  for(;i < nb;++i)
+    count += data[i] >= level;
+  return count;
+}
+
+template<class T>
+static inline void _storeSums(const uint32_t* sums,int nb,uint32_t divisor,
+			      uint32_t max_value,T* dst)
+{
+  if(divisor > 1)
+    for(int i = 0;i < nb;++i)
+      dst[i] = T(std::min((sums[i] + divisor / 2) / divisor,max_value));
+  else
+    for(int i = 0;i < nb;++i)
+      dst[i] = T(std::min(sums[i],max_value));
+}
+
+void Kernels::bin(const void* src,int src_depth,int width,int bin_x,int bin_y,
+		  bool mean,void* dst,int dst_depth,int first_row,int last_row,
+		  uint32_t* row)
+{
+  int out_width = width / bin_x;
+  uint32_t divisor = mean ? uint32_t(bin_x * bin_y) : 1;
+  for(int y = first_row;y < last_row;++y)
+    {
+      // vertical sums over the bin_y rows, then horizontal ones in place
+      memset(row,0,width * sizeof(uint32_t));
+      for(int dy = 0;dy < bin_y;++dy)
+	{
+	  size_t offset = (size_t(y) * bin_y + dy) * width;
+	  if(src_depth == 1)
+	    add8(row,(const uint8_t*)src + offset,width);
+	  else
+	    add16(row,(const uint16_t*)src + offset,width);
+	}
+      if(bin_x > 1)
+	for(int x = 0;x < out_width;++x)
+	  {
+	    const uint32_t* p = row + x * bin_x;
+	    uint32_t sum = 0;
+	    for(int dx = 0;dx < bin_x;++dx)
+	      sum += p[dx];
+	    row[x] = sum;
+	  }
+
+      size_t out_offset = size_t(y) * out_width;
+      switch(dst_depth)
+	{
+	case 1:
+	  _storeSums(row,out_width,divisor,0xffu,(uint8_t*)dst + out_offset);
+	  break;
+	case 2:
+	  _storeSums(row,out_width,divisor,0xffffu,(uint16_t*)dst + out_offset);
+	  break;
+	default:
+	  _storeSums(row,out_width,divisor,0xffffffffu,(uint32_t*)dst + out_offset);
+	  break;
+	}
+    }
+}
+
+void Kernels::toneMap16(const uint16_t* src,const uint8_t* lut,uint8_t* dst,int nb)
+{
+  // a table lookup does not vectorize, unrolling keeps the loads in flight
+  int i = 0;
+  for(;i + 4 <= nb;i += 4)
+    {
+      uint8_t a = lut[src[i]],b = lut[src[i + 1]];
+      uint8_t c = lut[src[i + 2]],d = lut[src[i + 3]];
+      dst[i] = a,dst[i + 1] = b,dst[i + 2] = c,dst[i + 3] = d;
+    }
+  for(;i < nb;++i)
+    dst[i] = lut[src[i]];
+}
+
+// 8x8 bit matrix transpose, byte k bit j <-> byte j bit k
+static inline uint64_t _transpose8(uint64_t x)
+{
+  uint64_t t;
+  t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+void Kernels::bitshuffle(const void* src,void* dst,int nb,int depth)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  uint8_t* d = (uint8_t*)dst;
+  int plane_size = nb / 8;
+  int g = 0;
+#ifdef __SSE2__
+  // 16 pixels at a time, movemask takes the top bit of each byte
+  if(depth == 2)
+    {
+      const __m128i low_mask = _mm_set1_epi16(0xff);
+      for(;g + 2 <= plane_size;g += 2)
+	{
+	  __m128i a = _mm_loadu_si128((const __m128i*)(s + g * 16));
+	  __m128i b = _mm_loadu_si128((const __m128i*)(s + g * 16 + 16));
+	  __m128i bytes[2];
+	  bytes[0] = _mm_packus_epi16(_mm_and_si128(a,low_mask),_mm_and_si128(b,low_mask));
+	  bytes[1] = _mm_packus_epi16(_mm_srli_epi16(a,8),_mm_srli_epi16(b,8));
+	  for(int byte = 0;byte < 2;++byte)
+	    {
+	      __m128i v = bytes[byte];
+	      for(int bit = 7;bit >= 0;--bit)
+		{
+		  uint16_t mask = uint16_t(_mm_movemask_epi8(v));
+		  memcpy(d + (byte * 8 + bit) * plane_size + g,&mask,2);
+		  v = _mm_slli_epi16(v,1);
+		}
+	    }
+	}
+    }
+#endif
+  for(;g < plane_size;++g)
+    for(int byte = 0;byte < depth;++byte)
+      {
+	uint64_t x = 0;
+	for(int k = 0;k < 8;++k)
+	  x |= uint64_t(s[(g * 8 + k) * depth + byte]) << (8 * k);
+	x = _transpose8(x);
+	for(int bit = 0;bit < 8;++bit)
+	  d[(byte * 8 + bit) * plane_size + g] = uint8_t(x >> (8 * bit));
+      }
+  size_t done = size_t(plane_size) * 8 * depth;
+  memcpy(d + done,s + done,size_t(nb) * depth - done);
+}
+
+void Kernels::bitunshuffle(const void* src,void* dst,int nb,int depth)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  uint8_t* d = (uint8_t*)dst;
+  int plane_size = nb / 8;
+  for(int g = 0;g < plane_size;++g)
+    for(int byte = 0;byte < depth;++byte)
+      {
+	uint64_t x = 0;
+	for(int bit = 0;bit < 8;++bit)
+	  x |= uint64_t(s[(byte * 8 + bit) * plane_size + g]) << (8 * bit);
+	x = _transpose8(x);
+	for(int k = 0;k < 8;++k)
+	  d[(g * 8 + k) * depth + byte] = uint8_t(x >> (8 * k));
+      }
+  size_t done = size_t(plane_size) * 8 * depth;
+  memcpy(d + done,s + done,size_t(nb) * depth - done);
+}
+
+void Kernels::moments(const uint32_t* sums,int nb,double& total,
+		      double& mean,double& rms)
+{
+  double s0 = 0.,s1 = 0.,s2 = 0.;
+  for(int i = 0;i < nb;++i)
+    {
+      double v = sums[i];
+      s0 += v;
+      s1 += v * i;
+      s2 += v * i * i;
+    }
+  total = s0;
+  if(s0 > 0.)
+    {
+      mean = s1 / s0;
+      rms = sqrt(std::max(0.,s2 / s0 - mean * mean));
+    }
+  else
+    mean = rms = 0.;
+}
@@ -0,0 +1,151 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <string.h>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaLivePreview.h"
+#include "ProsilicaPixelFormat.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+PreviewFrame::PreviewFrame() :
+  index(-1),
+  frame_nb(-1),
+  timestamp(0.),
+  width(0),
+  height(0),
+  depth(0),
+  mode(Y8)
+{
+}
+
+LivePreview::LivePreview() :
+  m_active(false),
+  m_max_rate(10.),
+  m_downscale(1),
+  m_last_publish(-1.),
+  m_nb_published(0),
+  m_bin(NULL),
+  m_bin_depth(0),
+  m_bin_factor(0)
+{
+  DEB_CONSTRUCTOR();
+}
+
+void LivePreview::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  m_active = active;
+}
+
+void LivePreview::setMaxRate(double rate)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(rate);
+
+  if(rate < 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Preview rate can't be negative");
+  m_max_rate = rate;
+}
+
+void LivePreview::setDownscale(int factor)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(factor);
+
+  if(factor != 1 && factor != 2 && factor != 4 && factor != 8)
+    throw LIMA_HW_EXC(InvalidValue,"Preview downscale must be 1, 2, 4 or 8");
+  m_downscale = factor;
+}
+
+bool LivePreview::getLatest(PreviewFrame& frame,long long after_index)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_read_lock);
+  m_frames.update();
+  const PreviewFrame& latest = m_frames.front();
+  if(latest.index < 0 || latest.index <= after_index)
+    return false;
+  frame = latest;
+  return true;
+}
+
+void LivePreview::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active)
+    return;
+  double max_rate = m_max_rate;
+  if(max_rate > 0. && m_last_publish >= 0. &&
+     frame.timestamp - m_last_publish < 1. / max_rate)
+    return;
+  m_last_publish = frame.timestamp;
+
+  int factor = m_downscale;
+  bool scalable = (frame.depth == 1 || frame.depth == 2) &&
+    frame.mode != RGB24 && frame.mode != BGR24 &&
+    frame.width >= factor && frame.height >= factor;
+  if(!scalable)
+    factor = 1;
+
+  PreviewFrame& preview = m_frames.back();
+  preview.index = m_nb_published;
+  preview.frame_nb = frame.frame_nb;
+  preview.timestamp = frame.timestamp;
+  preview.width = frame.width / factor;
+  preview.height = frame.height / factor;
+  preview.depth = frame.depth;
+  preview.mode = frame.mode;
+  preview.data.resize(size_t(preview.width) * preview.height * frame.depth);
+
+  if(factor > 1)
+    {
+      // a binned Bayer frame is no longer a colour mosaic
+      if(frame.mode == BAYER_RG8)
+	preview.mode = Y8;
+      else if(frame.mode == BAYER_RG16)
+	preview.mode = Y16;
+      m_row.resize(frame.width);
+      if(!m_bin || frame.depth != m_bin_depth || factor != m_bin_factor)
+	{
+	  m_bin = Kernels::selectBin(frame.depth,frame.depth,factor,factor,true);
+	  m_bin_depth = frame.depth,m_bin_factor = factor;
+	}
+      m_bin(frame.data,frame.width,factor,factor,
+	    &preview.data[0],0,preview.height,&m_row[0]);
+    }
+  else if(!preview.data.empty())
+    memcpy(&preview.data[0],frame.data,preview.data.size());
+
+  m_frames.publish();
+  ++m_nb_published;
+}
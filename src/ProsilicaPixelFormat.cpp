@@ -0,0 +1,413 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <string.h>
+#include <sstream>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
+
+#include "ProsilicaPixelFormat.h"
+#include "ProsilicaKernels.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+template<class T> struct _MaxValue;
+template<> struct _MaxValue<uint8_t> {static const uint32_t value = 0xffu;};
+template<> struct _MaxValue<uint16_t> {static const uint32_t value = 0xffffu;};
+template<> struct _MaxValue<uint32_t> {static const uint32_t value = 0xffffffffu;};
+
+//-----------------------------------------------------
+// bin with the factors as constants: the bin_x x bin_y window is summed
+// in registers and the mean divides by a constant. Same rounding and
+// saturation as Kernels::bin.
+//-----------------------------------------------------
+template<class S,class D,int BX,int BY,bool MEAN>
+static void _bin(const void* src,int width,int,int,void* dst,
+		 int first_row,int last_row,uint32_t*)
+{
+  const uint32_t divisor = MEAN ? BX * BY : 1;
+  const uint32_t max_value = _MaxValue<D>::value;
+  int out_width = width / BX;
+  for(int y = first_row;y < last_row;++y)
+    {
+      const S* p = (const S*)src + size_t(y) * BY * width;
+      D* out = (D*)dst + size_t(y) * out_width;
+      for(int x = 0;x < out_width;++x,p += BX)
+	{
+	  uint32_t sum = 0;
+	  for(int dy = 0;dy < BY;++dy)
+	    for(int dx = 0;dx < BX;++dx)
+	      sum += p[dy * width + dx];
+	  if(divisor > 1)
+	    sum = (sum + divisor / 2) / divisor;
+	  out[x] = D(std::min(sum,max_value));
+	}
+    }
+}
+
+template<int SD,int DD,bool MEAN>
+static void _genericBin(const void* src,int width,int bin_x,int bin_y,void* dst,
+			int first_row,int last_row,uint32_t* row)
+{
+  Kernels::bin(src,SD,width,bin_x,bin_y,MEAN,dst,DD,first_row,last_row,row);
+}
+
+template<class S,class D,bool MEAN>
+static Kernels::BinFunction _selectBin(int bin_x,int bin_y)
+{
+  switch(bin_x * 8 + bin_y)
+    {
+    case 1 * 8 + 1: return _bin<S,D,1,1,MEAN>;
+    case 1 * 8 + 2: return _bin<S,D,1,2,MEAN>;
+    case 1 * 8 + 4: return _bin<S,D,1,4,MEAN>;
+    case 2 * 8 + 1: return _bin<S,D,2,1,MEAN>;
+    case 2 * 8 + 2: return _bin<S,D,2,2,MEAN>;
+    case 2 * 8 + 4: return _bin<S,D,2,4,MEAN>;
+    case 4 * 8 + 1: return _bin<S,D,4,1,MEAN>;
+    case 4 * 8 + 2: return _bin<S,D,4,2,MEAN>;
+    case 4 * 8 + 4: return _bin<S,D,4,4,MEAN>;
+    default:
+      return NULL;
+    }
+}
+
+template<class S,class D,int SD,int DD>
+static Kernels::BinFunction _selectBin(int bin_x,int bin_y,bool mean,bool generic)
+{
+  Kernels::BinFunction function = NULL;
+  if(!generic && bin_x <= 4 && bin_y <= 4)
+    function = mean ? _selectBin<S,D,true>(bin_x,bin_y) :
+      _selectBin<S,D,false>(bin_x,bin_y);
+  if(!function)
+    function = mean ? _genericBin<SD,DD,true> : _genericBin<SD,DD,false>;
+  return function;
+}
+
+template<class S>
+static Kernels::BinFunction _selectBin(int dst_depth,int bin_x,int bin_y,
+				       bool mean,bool generic)
+{
+  switch(dst_depth)
+    {
+    case 1: return _selectBin<S,uint8_t,sizeof(S),1>(bin_x,bin_y,mean,generic);
+    case 2: return _selectBin<S,uint16_t,sizeof(S),2>(bin_x,bin_y,mean,generic);
+    default: return _selectBin<S,uint32_t,sizeof(S),4>(bin_x,bin_y,mean,generic);
+    }
+}
+
+Kernels::BinFunction Kernels::selectBin(int src_depth,int dst_depth,int bin_x,int bin_y,
+					bool mean,bool generic)
+{
+  if(src_depth == 1)
+    return _selectBin<uint8_t>(dst_depth,bin_x,bin_y,mean,generic);
+  else
+    return _selectBin<uint16_t>(dst_depth,bin_x,bin_y,mean,generic);
+}
+
+//-----------------------------------------------------
+// luminance, Y = (77 R + 150 G + 29 B) / 256 in the source value range
+//-----------------------------------------------------
+template<class S>
+static void _monoLuminance(const void* src,int width,int first_row,int last_row,
+			   uint16_t* dst)
+{
+  size_t begin = size_t(first_row) * width,end = size_t(last_row) * width;
+  const S* p = (const S*)src;
+  for(size_t i = begin;i < end;++i)
+    dst[i] = p[i];
+}
+
+// R at (RX,RY) of the 2x2 cell, B on the opposite corner
+template<class S,int RX,int RY>
+static void _bayerLuminance(const void* src,int width,int first_row,int last_row,
+			    uint16_t* dst)
+{
+  int out_width = width / 2;
+  for(int y = first_row;y < last_row;++y)
+    {
+      const S* row0 = (const S*)src + size_t(y) * 2 * width;
+      const S* row1 = row0 + width;
+      const S* r = (RY ? row1 : row0) + RX;
+      const S* b = (RY ? row0 : row1) + 1 - RX;
+      const S* g0 = row0 + (RY ? RX : 1 - RX);
+      const S* g1 = row1 + (RY ? 1 - RX : RX);
+      uint16_t* out = dst + size_t(y) * out_width;
+      for(int x = 0;x < out_width;++x)
+	{
+	  int i = 2 * x;
+	  uint32_t l = 77 * r[i] + 75 * (g0[i] + g1[i]) + 29 * b[i] + 128;
+	  out[x] = uint16_t(l >> 8);
+	}
+    }
+}
+
+// R at byte RO of the pixel, B at 2 - RO
+template<int RO>
+static void _rgbLuminance(const void* src,int width,int first_row,int last_row,
+			  uint16_t* dst)
+{
+  size_t begin = size_t(first_row) * width,end = size_t(last_row) * width;
+  const uint8_t* p = (const uint8_t*)src;
+  for(size_t i = begin;i < end;++i)
+    {
+      const uint8_t* rgb = p + i * 3;
+      dst[i] = uint16_t((77 * rgb[RO] + 150 * rgb[1] + 29 * rgb[2 - RO] + 128) >> 8);
+    }
+}
+
+template<class S>
+static Kernels::LuminanceFunction _selectLuminance(PixelLayout layout)
+{
+  switch(layout)
+    {
+    case LayoutMono:		return _monoLuminance<S>;
+    case LayoutBayerRGGB:	return _bayerLuminance<S,0,0>;
+    case LayoutBayerGBRG:	return _bayerLuminance<S,0,1>;
+    case LayoutBayerGRBG:	return _bayerLuminance<S,1,0>;
+    case LayoutBayerBGGR:	return _bayerLuminance<S,1,1>;
+    default:			return NULL;
+    }
+}
+
+Kernels::LuminanceFunction Kernels::selectLuminance(PixelLayout layout,int depth)
+{
+  switch(layout)
+    {
+    case LayoutRgb:
+      return depth == 3 ? _rgbLuminance<0> : NULL;
+    case LayoutBgr:
+      return depth == 3 ? _rgbLuminance<2> : NULL;
+    default:
+      if(depth == 1)
+	return _selectLuminance<uint8_t>(layout);
+      else if(depth == 2)
+	return _selectLuminance<uint16_t>(layout);
+      return NULL;
+    }
+}
+
+static inline uint32_t _pixel(const void* src,int depth,size_t i)
+{
+  return depth == 1 ? ((const uint8_t*)src)[i] : ((const uint16_t*)src)[i];
+}
+
+void Kernels::luminance(PixelLayout layout,int depth,const void* src,int width,
+			int first_row,int last_row,uint16_t* dst)
+{
+  bool bayer = isBayer(layout);
+  int out_width = bayer ? width / 2 : width;
+  for(int y = first_row;y < last_row;++y)
+    for(int x = 0;x < out_width;++x)
+      {
+	size_t out = size_t(y) * out_width + x;
+	uint32_t r,g,b;
+	switch(layout)
+	  {
+	  case LayoutMono:
+	    dst[out] = _pixel(src,depth,out);
+	    continue;
+	  case LayoutRgb:
+	  case LayoutBgr:
+	    {
+	      int ro = layout == LayoutRgb ? 0 : 2;
+	      r = _pixel(src,1,out * 3 + ro);
+	      g = _pixel(src,1,out * 3 + 1) * 2;
+	      b = _pixel(src,1,out * 3 + 2 - ro);
+	      dst[out] = uint16_t((77 * r + 75 * g + 29 * b + 128) >> 8);
+	    }
+	    continue;
+	  default:
+	    break;
+	  }
+	size_t p00 = size_t(y) * 2 * width + 2 * x,p01 = p00 + 1;
+	size_t p10 = p00 + width,p11 = p10 + 1;
+	switch(layout)
+	  {
+	  case LayoutBayerRGGB:
+	    r = _pixel(src,depth,p00),b = _pixel(src,depth,p11);
+	    g = _pixel(src,depth,p01) + _pixel(src,depth,p10);
+	    break;
+	  case LayoutBayerGBRG:
+	    r = _pixel(src,depth,p10),b = _pixel(src,depth,p01);
+	    g = _pixel(src,depth,p00) + _pixel(src,depth,p11);
+	    break;
+	  case LayoutBayerGRBG:
+	    r = _pixel(src,depth,p01),b = _pixel(src,depth,p10);
+	    g = _pixel(src,depth,p00) + _pixel(src,depth,p11);
+	    break;
+	  default:
+	    r = _pixel(src,depth,p11),b = _pixel(src,depth,p00);
+	    g = _pixel(src,depth,p01) + _pixel(src,depth,p10);
+	    break;
+	  }
+	dst[out] = uint16_t((77 * r + 75 * g + 29 * b + 128) >> 8);
+      }
+}
+
+//-----------------------------------------------------
+// FormatKernels
+//-----------------------------------------------------
+static FormatKernels _formatKernels(tPvImageFormat format,tPvBayerPattern pattern)
+{
+  FormatKernels kernels;
+  kernels.format = format;
+  kernels.pattern = pattern;
+  kernels.supported = true;
+  kernels.mode = Y8;
+  kernels.layout = LayoutMono;
+  kernels.depth = 1;
+  PixelLayout bayer = PixelLayout(LayoutBayerRGGB + pattern);
+  switch(format)
+    {
+    case ePvFmtMono8:	break;
+    case ePvFmtMono16:	kernels.mode = Y16,kernels.depth = 2;			break;
+    case ePvFmtBayer8:	kernels.mode = BAYER_RG8,kernels.layout = bayer;	break;
+    case ePvFmtBayer16:
+      kernels.mode = BAYER_RG16,kernels.layout = bayer,kernels.depth = 2;
+      break;
+    case ePvFmtRgb24:	kernels.mode = RGB24,kernels.layout = LayoutRgb,kernels.depth = 3;	break;
+    case ePvFmtBgr24:	kernels.mode = BGR24,kernels.layout = LayoutBgr,kernels.depth = 3;	break;
+    default:
+      kernels.supported = false;
+      break;
+    }
+  kernels.luminance = kernels.supported ?
+    Kernels::selectLuminance(kernels.layout,kernels.depth) : NULL;
+  return kernels;
+}
+
+const FormatKernels& FormatKernels::get(tPvImageFormat format,tPvBayerPattern pattern)
+{
+  enum {NB_FORMATS = ePvFmtBayer12Packed + 1,NB_PATTERNS = ePvBayerBGGR + 1};
+  struct Table
+  {
+    Table()
+    {
+      for(int f = 0;f < NB_FORMATS;++f)
+	for(int p = 0;p < NB_PATTERNS;++p)
+	  kernels[f][p] = _formatKernels(tPvImageFormat(f),tPvBayerPattern(p));
+      unknown = _formatKernels(tPvImageFormat(NB_FORMATS),ePvBayerRGGB);
+    }
+    FormatKernels kernels[NB_FORMATS][NB_PATTERNS];
+    FormatKernels unknown;
+  };
+  static const Table table;
+
+  if(unsigned(format) >= NB_FORMATS)
+    return table.unknown;
+  return table.kernels[format][unsigned(pattern) < NB_PATTERNS ? pattern : 0];
+}
+
+//-----------------------------------------------------
+// benchmark
+//-----------------------------------------------------
+KernelBenchmark::KernelBenchmark() :
+  generic_time(0.),
+  specialised_time(0.)
+{
+}
+
+template<class F>
+static double _time(int nb_iterations,F function)
+{
+  function();			// warm-up
+  Timestamp start = Timestamp::now();
+  for(int i = 0;i < nb_iterations;++i)
+    function();
+  return (Timestamp::now() - start) / nb_iterations;
+}
+
+//-----------------------------------------------------
+// @brief time the specialised kernels against the runtime-switched ones
+// on a synthetic width x height frame
+//-----------------------------------------------------
+void lima::Prosilica::benchmarkKernels(int width,int height,int nb_iterations,
+				       std::vector<KernelBenchmark>& results)
+{
+  width &= ~7,height &= ~7;
+  if(width <= 0 || height <= 0 || nb_iterations <= 0)
+    throw LIMA_HW_EXC(InvalidValue,"Invalid benchmark size");
+
+  size_t nb_pixels = size_t(width) * height;
+  std::vector<uint16_t> src(nb_pixels * 3 / 2 + 1);
+  uint32_t seed = 12345;
+  for(size_t i = 0;i < src.size();++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      src[i] = uint16_t(seed >> 16);
+    }
+  std::vector<uint32_t> dst(nb_pixels);
+  std::vector<uint32_t> row(width);
+  std::vector<uint16_t> luminance(nb_pixels);
+
+  results.clear();
+  static const struct {int src_depth,dst_depth,bin; bool mean;} bins[] =
+    {
+      {1,1,2,true},{2,2,2,true},{1,4,1,false},{2,4,2,false},{2,2,4,true},
+    };
+  for(size_t i = 0;i < sizeof(bins) / sizeof(bins[0]);++i)
+    {
+      int src_depth = bins[i].src_depth,dst_depth = bins[i].dst_depth;
+      int b = bins[i].bin;
+      bool mean = bins[i].mean;
+      KernelBenchmark result;
+      std::ostringstream name;
+      name << "bin" << b << "x" << b << (mean ? " mean " : " sum ")
+	   << src_depth * 8 << "->" << dst_depth * 8;
+      result.name = name.str();
+      Kernels::BinFunction generic = Kernels::selectBin(src_depth,dst_depth,b,b,mean,true);
+      Kernels::BinFunction specialised = Kernels::selectBin(src_depth,dst_depth,b,b,mean);
+      result.generic_time = _time(nb_iterations,[&] {
+	  generic(&src[0],width,b,b,&dst[0],0,height / b,&row[0]);});
+      result.specialised_time = _time(nb_iterations,[&] {
+	  specialised(&src[0],width,b,b,&dst[0],0,height / b,&row[0]);});
+      results.push_back(result);
+    }
+
+  static const struct {const char* name; PixelLayout layout; int depth;} formats[] =
+    {
+      {"luminance Mono16",LayoutMono,2},
+      {"luminance Bayer8 GBRG",LayoutBayerGBRG,1},
+      {"luminance Bayer16 BGGR",LayoutBayerBGGR,2},
+      {"luminance Rgb24",LayoutRgb,3},
+    };
+  for(size_t i = 0;i < sizeof(formats) / sizeof(formats[0]);++i)
+    {
+      PixelLayout layout = formats[i].layout;
+      int depth = formats[i].depth;
+      int nb_rows = isBayer(layout) ? height / 2 : height;
+      KernelBenchmark result;
+      result.name = formats[i].name;
+      Kernels::LuminanceFunction specialised = Kernels::selectLuminance(layout,depth);
+      result.generic_time = _time(nb_iterations,[&] {
+	  Kernels::luminance(layout,depth,&src[0],width,0,nb_rows,&luminance[0]);});
+      result.specialised_time = _time(nb_iterations,[&] {
+	  specialised(&src[0],width,0,nb_rows,&luminance[0]);});
+      results.push_back(result);
+    }
+}
@@ -0,0 +1,218 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaPreviewPyramid.h"
+#include "ProsilicaKernels.h"
+#include "ProsilicaPixelFormat.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+PreviewPyramid::PreviewPyramid() :
+  m_active(false),
+  m_max_rate(0.),
+  m_last_publish(-1.),
+  m_nb_published(0),
+  m_black(0),
+  m_white(0),
+  m_gamma(1.),
+  m_lut_dirty(true),
+  m_lut_depth(0),
+  m_lut_white(0),
+  m_mean8(Kernels::selectBin(1,2,2,2,true)),
+  m_mean16(Kernels::selectBin(2,2,2,2,true))
+{
+  DEB_CONSTRUCTOR();
+}
+
+void PreviewPyramid::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  m_active = active;
+}
+
+void PreviewPyramid::setMaxRate(double rate)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(rate);
+
+  if(rate < 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Preview rate can't be negative");
+  m_max_rate = rate;
+}
+
+void PreviewPyramid::setToneMapping(int black,int white,double gamma)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR3(black,white,gamma);
+
+  if(black < 0 || white < 0 || (white && white <= black))
+    throw LIMA_HW_EXC(InvalidValue,"Invalid black and white levels");
+  if(gamma <= 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Gamma must be positive");
+
+  AutoMutex lock(m_lock);
+  m_black = black;
+  m_white = white;
+  m_gamma = gamma;
+  m_lut_dirty = true;
+}
+
+void PreviewPyramid::getToneMapping(int& black,int& white,double& gamma)
+{
+  AutoMutex lock(m_lock);
+  black = m_black;
+  white = m_white;
+  gamma = m_gamma;
+}
+
+bool PreviewPyramid::getLevel(int level,PreviewFrame& frame,long long after_index)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(level,after_index);
+
+  if(level < 1 || level > NB_LEVELS)
+    throw LIMA_HW_EXC(InvalidValue,"Preview level must be 1, 2 or 3");
+
+  AutoMutex lock(m_read_lock);
+  TripleBuffer<PreviewFrame>& frames = m_levels[level - 1];
+  frames.update();
+  const PreviewFrame& latest = frames.front();
+  if(latest.index < 0 || latest.index <= after_index)
+    return false;
+  frame = latest;
+  return true;
+}
+
+//-----------------------------------------------------
+// @brief rebuild the lookup table when the settings change or,
+// in auto mode, when the brightest pixel moved by more than 1/16
+//-----------------------------------------------------
+void PreviewPyramid::_updateLut(int depth,int max_value)
+{
+  AutoMutex lock(m_lock);
+  int white = m_white;
+  if(!white)
+    {
+      white = std::max(max_value,m_black + 1);
+      if(!m_lut_dirty && depth == m_lut_depth &&
+	 std::abs(white - m_lut_white) <= m_lut_white / 16)
+	return;
+    }
+  else if(!m_lut_dirty && depth == m_lut_depth)
+    return;
+
+  int nb_values = depth == 1 ? 0x100 : 0x10000;
+  double range = white - m_black;
+  double exponent = 1. / m_gamma;
+  m_lut.resize(nb_values);
+  for(int v = 0;v < nb_values;++v)
+    {
+      double x = std::min(std::max((v - m_black) / range,0.),1.);
+      m_lut[v] = uint8_t(255. * pow(x,exponent) + .5);
+    }
+  m_lut_depth = depth;
+  m_lut_white = white;
+  m_lut_dirty = false;
+}
+
+void PreviewPyramid::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active)
+    return;
+  Kernels::LuminanceFunction luminance =
+    Kernels::selectLuminance(frame.layout,frame.depth);
+  if(!luminance)
+    return;
+  double max_rate = m_max_rate;
+  if(max_rate > 0. && m_last_publish >= 0. &&
+     frame.timestamp - m_last_publish < 1. / max_rate)
+    return;
+  m_last_publish = frame.timestamp;
+
+  // the first level is the luminance of the Bayer cells or the 2x2 mean
+  // of the pixels, the next ones the 2x2 mean of the previous level
+  int width = frame.width,height = frame.height;
+  int nb_levels = 0;
+  m_row.resize(width);
+  for(;nb_levels < NB_LEVELS;++nb_levels)
+    {
+      int level_width = width / 2,level_height = height / 2;
+      if(!level_width || !level_height)
+	break;
+      std::vector<uint16_t>& level = m_levels16[nb_levels];
+      level.resize(size_t(level_width) * level_height);
+      if(nb_levels)
+	m_mean16(&m_levels16[nb_levels - 1][0],width,2,2,&level[0],
+		 0,level_height,&m_row[0]);
+      else if(isBayer(frame.layout))
+	luminance(frame.data,width,0,level_height,&level[0]);
+      else if(frame.layout == LayoutMono)
+	(frame.depth == 1 ? m_mean8 : m_mean16)(frame.data,width,2,2,&level[0],
+						0,level_height,&m_row[0]);
+      else
+	{
+	  m_luminance.resize(size_t(width) * height);
+	  luminance(frame.data,width,0,height,&m_luminance[0]);
+	  m_mean16(&m_luminance[0],width,2,2,&level[0],0,level_height,&m_row[0]);
+	}
+      width = level_width,height = level_height;
+    }
+  if(!nb_levels)
+    return;
+
+  const std::vector<uint16_t>& smallest = m_levels16[nb_levels - 1];
+  int value_depth = frame.layout == LayoutRgb || frame.layout == LayoutBgr ? 1 : frame.depth;
+  _updateLut(value_depth,*std::max_element(smallest.begin(),smallest.end()));
+
+  width = frame.width,height = frame.height;
+  for(int i = 0;i < nb_levels;++i)
+    {
+      width /= 2,height /= 2;
+      PreviewFrame& preview = m_levels[i].back();
+      preview.index = m_nb_published;
+      preview.frame_nb = frame.frame_nb;
+      preview.timestamp = frame.timestamp;
+      preview.width = width;
+      preview.height = height;
+      preview.depth = 1;
+      preview.mode = Y8;
+      preview.data.resize(size_t(width) * height);
+      Kernels::toneMap16(&m_levels16[i][0],&m_lut[0],
+			 (uint8_t*)&preview.data[0],int(preview.data.size()));
+      m_levels[i].publish();
+    }
+  ++m_nb_published;
+}
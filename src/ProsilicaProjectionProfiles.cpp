@@ -0,0 +1,150 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <string.h>
+#include <algorithm>
+
+#include "ProsilicaProjectionProfiles.h"
+#include "ProsilicaKernels.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+ProfileRecord::ProfileRecord() :
+  index(-1),
+  frame_nb(-1),
+  timestamp(0.)
+{
+}
+
+ProjectionProfiles::ProjectionProfiles(int max_width,int max_height,int ring_size) :
+  m_active(false),
+  m_max_width(max_width),
+  m_max_height(max_height),
+  m_ring(ring_size,max_width + max_height),
+  m_cols(max_width),
+  m_rows(max_height)
+{
+  DEB_CONSTRUCTOR();
+  DEB_PARAM() << DEB_VAR3(max_width,max_height,ring_size);
+}
+
+ProjectionProfiles::~ProjectionProfiles()
+{
+  DEB_DESTRUCTOR();
+}
+
+void ProjectionProfiles::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  m_active = active;
+}
+
+void ProjectionProfiles::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active || frame.width > m_max_width || frame.height > m_max_height)
+    return;
+
+  uint32_t* cols = &m_cols[0];
+  uint32_t* rows = &m_rows[0];
+  switch(frame.mode)
+    {
+    case Y8:
+    case BAYER_RG8:
+      Kernels::project8((const uint8_t*)frame.data,frame.width,
+			frame.width,frame.height,cols,rows);
+      break;
+    case Y16:
+    case BAYER_RG16:
+      Kernels::project16((const uint16_t*)frame.data,frame.width,
+			 frame.width,frame.height,cols,rows);
+      break;
+    default:
+      return;
+    }
+
+  Header header;
+  header.frame_nb = frame.frame_nb;
+  header.timestamp = frame.timestamp;
+  header.width = frame.width;
+  header.height = frame.height;
+  m_ring.push(header,[&](uint32_t* data)
+    {
+      memcpy(data,cols,frame.width * sizeof(uint32_t));
+      memcpy(data + frame.width,rows,frame.height * sizeof(uint32_t));
+    });
+}
+
+bool ProjectionProfiles::_read(long long index,ProfileRecord& record) const
+{
+  Header header;
+  if(!m_ring.read(index,header,[&](const Header& h,const uint32_t* data)
+    {
+      int width = std::max(0,std::min(h.width,m_max_width));
+      int height = std::max(0,std::min(h.height,m_max_height));
+      record.cols.assign(data,data + width);
+      record.rows.assign(data + width,data + width + height);
+    }))
+    return false;
+  record.index = index;
+  record.frame_nb = header.frame_nb;
+  record.timestamp = header.timestamp;
+  return true;
+}
+
+bool ProjectionProfiles::getLastProfile(ProfileRecord& record) const
+{
+  long long index = getNextIndex() - 1;
+  return index >= 0 && _read(index,record);
+}
+
+long long ProjectionProfiles::readProfiles(long long& next_index,int max_nb,
+					   std::vector<ProfileRecord>& records) const
+{
+  records.clear();
+  long long count = getNextIndex();
+  long long oldest = std::max(0LL,count - m_ring.size());
+  long long lost = 0;
+  if(next_index < oldest)
+    {
+      lost = oldest - next_index;
+      next_index = oldest;
+    }
+
+  ProfileRecord record;
+  while(next_index < count && int(records.size()) < max_nb)
+    {
+      if(_read(next_index,record))
+	records.push_back(record);
+      else
+	++lost;			// overwritten meanwhile
+      ++next_index;
+    }
+  return lost;
+}
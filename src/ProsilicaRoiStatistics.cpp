@@ -0,0 +1,202 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaRoiStatistics.h"
+#include "ProsilicaKernels.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+RoiStatisticsResult::RoiStatisticsResult() :
+  roi_id(-1),
+  frame_nb(-1),
+  timestamp(0.),
+  sum(0.),
+  max(0.),
+  centroid_x(0.),
+  centroid_y(0.),
+  rms_x(0.),
+  rms_y(0.)
+{
+}
+
+RoiStatistics::RoiStatistics(int history_size) :
+  m_active(false),
+  m_history_size(history_size)
+{
+  DEB_CONSTRUCTOR();
+  for(int i = 0;i < MAX_ROIS;++i)
+    {
+      m_rings[i] = NULL;
+      m_first_index[i] = 0;
+    }
+}
+
+RoiStatistics::~RoiStatistics()
+{
+  DEB_DESTRUCTOR();
+  for(int i = 0;i < MAX_ROIS;++i)
+    delete m_rings[i];
+}
+
+void RoiStatistics::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  m_active = active;
+}
+
+int RoiStatistics::addRoi(const Roi& roi)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(roi);
+
+  AutoMutex lock(m_lock);
+  int roi_id = int(m_rois.size());
+  if(roi_id >= MAX_ROIS)
+    throw LIMA_HW_EXC(InvalidValue,"Too many statistics rois");
+  // rings are kept for the lock-free readers, older results of the id
+  // are hidden instead
+  if(!m_rings[roi_id])
+    m_rings[roi_id] = new ResultRing(m_history_size);
+  m_first_index[roi_id] = m_rings[roi_id]->count();
+  m_rois.push_back(roi);
+
+  DEB_RETURN() << DEB_VAR1(roi_id);
+  return roi_id;
+}
+
+void RoiStatistics::clearRois()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  m_rois.clear();
+}
+
+int RoiStatistics::getNbRois()
+{
+  AutoMutex lock(m_lock);
+  return int(m_rois.size());
+}
+
+void RoiStatistics::getRoi(int roi_id,Roi& roi)
+{
+  AutoMutex lock(m_lock);
+  if(roi_id < 0 || roi_id >= int(m_rois.size()))
+    throw LIMA_HW_EXC(InvalidValue,"Invalid statistics roi id");
+  roi = m_rois[roi_id];
+}
+
+void RoiStatistics::_checkRoiId(int roi_id) const
+{
+  if(roi_id < 0 || roi_id >= MAX_ROIS)
+    throw LIMA_HW_EXC(InvalidValue,"Invalid statistics roi id");
+}
+
+bool RoiStatistics::getLastResult(int roi_id,RoiStatisticsResult& result) const
+{
+  _checkRoiId(roi_id);
+  const ResultRing* ring = m_rings[roi_id];
+  if(!ring)
+    return false;
+  long long index = ring->count() - 1;
+  return index >= m_first_index[roi_id] && ring->read(index,result);
+}
+
+void RoiStatistics::getHistory(int roi_id,int nb,
+			       std::vector<RoiStatisticsResult>& results) const
+{
+  _checkRoiId(roi_id);
+  results.clear();
+  const ResultRing* ring = m_rings[roi_id];
+  if(!ring || nb <= 0)
+    return;
+
+  long long last = ring->count();
+  long long first = std::max(last - std::min(nb,ring->size()),
+			     (long long)m_first_index[roi_id]);
+  results.reserve(last - first);
+  RoiStatisticsResult result;
+  for(long long index = first;index < last;++index)
+    if(ring->read(index,result))
+      results.push_back(result);
+}
+
+void RoiStatistics::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active || (frame.mode != Y8 && frame.mode != Y16))
+    return;
+
+  AutoMutex lock(m_lock);
+  for(unsigned int roi_id = 0;roi_id < m_rois.size();++roi_id)
+    {
+      // clip the roi to the frame
+      Point top_left(0,0),bottom_right(frame.width,frame.height);
+      if(!m_rois[roi_id].isEmpty())
+	{
+	  Point roi_top_left = m_rois[roi_id].getTopLeft();
+	  Point roi_bottom_right = m_rois[roi_id].getBottomRight();
+	  top_left.x = std::max(roi_top_left.x,0);
+	  top_left.y = std::max(roi_top_left.y,0);
+	  bottom_right.x = std::min(roi_bottom_right.x + 1,frame.width);
+	  bottom_right.y = std::min(roi_bottom_right.y + 1,frame.height);
+	}
+      int width = bottom_right.x - top_left.x;
+      int height = bottom_right.y - top_left.y;
+      if(width <= 0 || height <= 0)
+	continue;
+      m_col_sums.resize(width);
+      m_row_sums.resize(height);
+
+      uint32_t max_value;
+      size_t offset = size_t(top_left.y) * frame.width + top_left.x;
+      if(frame.mode == Y8)
+	max_value = Kernels::project8((const uint8_t*)frame.data + offset,frame.width,
+				      width,height,&m_col_sums[0],&m_row_sums[0]);
+      else
+	max_value = Kernels::project16((const uint16_t*)frame.data + offset,frame.width,
+				       width,height,&m_col_sums[0],&m_row_sums[0]);
+
+      RoiStatisticsResult result;
+      result.roi_id = roi_id;
+      result.frame_nb = frame.frame_nb;
+      result.timestamp = frame.timestamp;
+      result.max = max_value;
+      double total;
+      Kernels::moments(&m_col_sums[0],width,result.sum,result.centroid_x,result.rms_x);
+      Kernels::moments(&m_row_sums[0],height,total,result.centroid_y,result.rms_y);
+      result.centroid_x += top_left.x;
+      result.centroid_y += top_left.y;
+      m_rings[roi_id]->push(result);
+    }
+}
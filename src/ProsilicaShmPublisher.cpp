@@ -0,0 +1,286 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <sstream>
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaShmPublisher.h"
+#include "ProsilicaCamera.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+static const int DEFAULT_NB_SLOTS = 8;
+static const size_t PAGE_SIZE = 4096;
+
+ShmPublisher::ShmPublisher(Camera* cam) :
+  m_cam(cam),
+  m_handle(cam->getHandle()),
+  m_active(false),
+  m_nb_slots(DEFAULT_NB_SLOTS),
+  m_fd(-1),
+  m_base(NULL),
+  m_map_size(0),
+  m_header(NULL),
+  m_nb_published(0),
+  m_nb_dropped(0)
+{
+  DEB_CONSTRUCTOR();
+
+  tPvUint32 uid = 0;
+  PvAttrUint32Get(m_handle,"UniqueId",&uid);
+  std::ostringstream name;
+  name << "/lima_prosilica_" << uid;
+  m_name = name.str();
+}
+
+ShmPublisher::~ShmPublisher()
+{
+  DEB_DESTRUCTOR();
+  AutoMutex lock(m_lock);
+  _close();
+}
+
+void ShmPublisher::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  AutoMutex lock(m_lock);
+  if(active && !m_header)
+    _open(_expectedFrameSize());
+  else if(!active)
+    _close();
+  m_active = active;
+}
+
+void ShmPublisher::setName(const std::string& name)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(name);
+
+  if(name.size() < 2 || name[0] != '/' || name.find('/',1) != std::string::npos)
+    throw LIMA_HW_EXC(InvalidValue,"Shm name must be /name");
+
+  AutoMutex lock(m_lock);
+  if(name == m_name)
+    return;
+  size_t max_data_size = m_header ? m_header->max_data_size : 0;
+  _close();
+  m_name = name;
+  if(m_active)
+    _open(max_data_size);
+}
+
+void ShmPublisher::getName(std::string& name)
+{
+  AutoMutex lock(m_lock);
+  name = m_name;
+}
+
+void ShmPublisher::setNbSlots(int nb_slots)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_slots);
+
+  if(nb_slots < 2)
+    throw LIMA_HW_EXC(InvalidValue,"Shm ring needs at least 2 slots");
+
+  AutoMutex lock(m_lock);
+  if(nb_slots == m_nb_slots)
+    return;
+  size_t max_data_size = m_header ? m_header->max_data_size : 0;
+  _close();
+  m_nb_slots = nb_slots;
+  if(m_active)
+    _open(max_data_size);
+}
+
+long long ShmPublisher::getNbPublished()
+{
+  AutoMutex lock(m_lock);
+  return m_nb_published;
+}
+
+//-----------------------------------------------------
+// @brief largest of the camera and Lima frames of the current settings
+//-----------------------------------------------------
+size_t ShmPublisher::_expectedFrameSize()
+{
+  DEB_MEMBER_FUNCT();
+
+  tPvUint32 width,height,frame_size;
+  if(PvAttrUint32Get(m_handle,"Width",&width) ||
+     PvAttrUint32Get(m_handle,"Height",&height) ||
+     PvAttrUint32Get(m_handle,"TotalBytesPerFrame",&frame_size) ||
+     !width || !height)
+    return 0;
+
+  int bits;
+  m_cam->getOutputDepth(bits);
+  Bin sw_bin;
+  m_cam->getSoftwareBin(sw_bin);
+  size_t depth = bits ? bits / 8 : frame_size / (width * height);
+  size_t lima_size = size_t(width / sw_bin.getX()) * (height / sw_bin.getY()) * depth;
+  return std::max(size_t(frame_size),lima_size);
+}
+
+//-----------------------------------------------------
+// @brief (re)create the segment, a stale one of the same name is removed
+//-----------------------------------------------------
+void ShmPublisher::_open(size_t max_data_size)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(m_name,max_data_size);
+
+  _close();
+
+  size_t slot_size = (Shm::SLOT_DATA_OFFSET + max_data_size + PAGE_SIZE - 1) /
+    PAGE_SIZE * PAGE_SIZE;
+  size_t map_size = Shm::HEADER_SIZE + slot_size * m_nb_slots;
+
+  shm_unlink(m_name.c_str());
+  int fd = shm_open(m_name.c_str(),O_RDWR | O_CREAT | O_EXCL,0644);
+  if(fd < 0)
+    {
+      DEB_ERROR() << "Can't create shm " << DEB_VAR1(m_name);
+      throw LIMA_HW_EXC(Error,"Can't create shm segment");
+    }
+  void* base = MAP_FAILED;
+  if(!ftruncate(fd,map_size))
+    base = mmap(NULL,map_size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+  if(base == MAP_FAILED)
+    {
+      close(fd);
+      shm_unlink(m_name.c_str());
+      DEB_ERROR() << "Can't map shm " << DEB_VAR2(m_name,map_size);
+      throw LIMA_HW_EXC(Error,"Can't map shm segment");
+    }
+
+  m_fd = fd;
+  m_base = (char*)base;
+  m_map_size = map_size;
+  m_header = (Shm::RingHeader*)base;
+  m_header->version = Shm::VERSION;
+  m_header->nb_slots = m_nb_slots;
+  m_header->closed = 0;
+  m_header->slot_size = slot_size;
+  m_header->max_data_size = slot_size - Shm::SLOT_DATA_OFFSET;
+  tPvUint32 frequency = 0;
+  PvAttrUint32Get(m_handle,"TimeStampFrequency",&frequency);
+  m_header->timestamp_frequency = frequency;
+  m_nb_published = 0;
+  Shm::store(&m_header->nb_published,0);
+  // readers attach once the header is complete
+  __atomic_store_n(&m_header->magic,uint32_t(Shm::MAGIC),__ATOMIC_RELEASE);
+}
+
+void ShmPublisher::_close()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_header)
+    return;
+  // attached readers see it and re-open the new segment
+  __atomic_store_n(&m_header->closed,uint32_t(1),__ATOMIC_RELEASE);
+  munmap(m_base,m_map_size);
+  close(m_fd);
+  shm_unlink(m_name.c_str());
+  m_header = NULL;
+  m_base = NULL;
+  m_fd = -1;
+}
+
+void ShmPublisher::prepare()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_lock);
+  if(!m_active)
+    return;
+  size_t max_data_size = _expectedFrameSize();
+  if(!m_header || m_header->max_data_size < max_data_size)
+    _open(max_data_size);
+  else
+    {
+      tPvUint32 frequency = 0;
+      PvAttrUint32Get(m_handle,"TimeStampFrequency",&frequency);
+      m_header->timestamp_frequency = frequency;
+    }
+}
+
+void ShmPublisher::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active)
+    return;
+
+  AutoMutex lock(m_lock);
+  size_t data_size = size_t(frame.width) * frame.height * frame.depth;
+  if(!m_header || data_size > m_header->max_data_size)
+    {
+      // geometry changed without prepare (live video)
+      DEB_WARNING() << "Shm slots resized to " << DEB_VAR1(data_size);
+      try
+	{
+	  _open(data_size);
+	}
+      catch(Exception&)
+	{
+	  ++m_nb_dropped;
+	  return;
+	}
+    }
+
+  unsigned long long index = m_nb_published;
+  char* slot = m_base + Shm::HEADER_SIZE +
+    (index % m_header->nb_slots) * m_header->slot_size;
+  Shm::SlotHeader* slot_header = (Shm::SlotHeader*)slot;
+
+  uint64_t seq = slot_header->seq;
+  __atomic_store_n(&slot_header->seq,seq + 1,__ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot_header->index = index;
+  slot_header->frame_nb = frame.frame_nb;
+  slot_header->width = frame.width;
+  slot_header->height = frame.height;
+  slot_header->depth = frame.depth;
+  slot_header->mode = frame.mode;
+  slot_header->data_size = uint32_t(data_size);
+  slot_header->camera_timestamp = frame.camera_timestamp;
+  slot_header->timestamp = frame.timestamp;
+  memcpy(slot + Shm::SLOT_DATA_OFFSET,frame.data,data_size);
+  Shm::store(&slot_header->seq,seq + 2);
+
+  m_nb_published = index + 1;
+  Shm::store(&m_header->nb_published,m_nb_published);
+}
@@ -0,0 +1,463 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
+
+#include "ProsilicaStreamTuning.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+static const int TEST_NB_BUFFERS = 4;
+static const unsigned long TEST_FRAME_TIMEOUT = 2000; // ms
+static const unsigned long PACKET_SIZES[] = {1500,4000,8228,9000};
+
+static bool _isAvailable(tPvHandle& handle,const char* name)
+{
+  return PvAttrIsAvailable(handle,name) == ePvErrSuccess;
+}
+
+static unsigned long _getStat(tPvHandle& handle,const char* name)
+{
+  tPvUint32 value = 0;
+  PvAttrUint32Get(handle,name,&value);
+  return value;
+}
+
+static void _makeDirectory(const std::string& path)
+{
+  std::string::size_type pos = 0;
+  while(pos != std::string::npos)
+    {
+      pos = path.find('/',pos + 1);
+      std::string sub_path = path.substr(0,pos);
+      if(mkdir(sub_path.c_str(),0755) && errno != EEXIST)
+	throw LIMA_HW_EXC(Error,"Can't create directory: " + sub_path);
+    }
+}
+
+StreamParameters::StreamParameters() :
+  packet_size(0),
+  stream_hold(false),
+  resend_percent(-1.),
+  lookback_window(0),
+  retries(0),
+  timeout(0)
+{
+}
+
+StreamTestResult::StreamTestResult() :
+  nb_frames(0),
+  nb_completed(0),
+  nb_dropped(0),
+  packets_received(0),
+  packets_missed(0),
+  packets_resent(0),
+  frame_rate(0.),
+  throughput(0.),
+  loss_ratio(1.)
+{
+}
+
+StreamTuning::StreamTuning(tPvHandle& handle,tPvUint32 uid) :
+  m_handle(handle),
+  m_uid(uid)
+{
+  DEB_CONSTRUCTOR();
+}
+
+//-----------------------------------------------------
+// @brief name of the host interface the camera is reached through
+//-----------------------------------------------------
+void StreamTuning::getHostInterface(std::string& iface) const
+{
+  DEB_MEMBER_FUNCT();
+
+  char address[64];
+  unsigned long psize;
+  if(PvAttrStringGet(m_handle,"HostIPAddress",address,
+		     sizeof(address),&psize) == ePvErrSuccess && address[0])
+    iface = address;
+  else
+    iface = "default";
+
+  DEB_RETURN() << DEB_VAR1(iface);
+}
+
+void StreamTuning::apply(const StreamParameters& params)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR4(params.packet_size,params.stream_hold,
+			  params.lookback_window,params.retries);
+
+  tPvErr error;
+  if(params.packet_size)
+    {
+      error = PvAttrUint32Set(m_handle,"PacketSize",params.packet_size);
+      if(error)
+	throw LIMA_HW_EXC(Error,"Can't set PacketSize");
+    }
+  if(_isAvailable(m_handle,"StreamHoldEnable"))
+    {
+      error = PvAttrEnumSet(m_handle,"StreamHoldEnable",
+			    params.stream_hold ? "On" : "Off");
+      if(error)
+	throw LIMA_HW_EXC(Error,"Can't set StreamHoldEnable");
+    }
+  if(params.resend_percent >= 0. && _isAvailable(m_handle,"GvspResendPercent"))
+    PvAttrFloat32Set(m_handle,"GvspResendPercent",params.resend_percent);
+  if(params.lookback_window && _isAvailable(m_handle,"GvspLookbackWindow"))
+    PvAttrUint32Set(m_handle,"GvspLookbackWindow",params.lookback_window);
+  if(params.retries && _isAvailable(m_handle,"GvspRetries"))
+    PvAttrUint32Set(m_handle,"GvspRetries",params.retries);
+  if(params.timeout && _isAvailable(m_handle,"GvspTimeout"))
+    PvAttrUint32Set(m_handle,"GvspTimeout",params.timeout);
+}
+
+void StreamTuning::read(StreamParameters& params) const
+{
+  DEB_MEMBER_FUNCT();
+
+  tPvUint32 value;
+  if(PvAttrUint32Get(m_handle,"PacketSize",&value) == ePvErrSuccess)
+    params.packet_size = value;
+
+  char hold[16];
+  unsigned long psize;
+  if(PvAttrEnumGet(m_handle,"StreamHoldEnable",hold,sizeof(hold),&psize) == ePvErrSuccess)
+    params.stream_hold = !strcmp(hold,"On");
+
+  tPvFloat32 percent;
+  if(PvAttrFloat32Get(m_handle,"GvspResendPercent",&percent) == ePvErrSuccess)
+    params.resend_percent = percent;
+  if(PvAttrUint32Get(m_handle,"GvspLookbackWindow",&value) == ePvErrSuccess)
+    params.lookback_window = value;
+  if(PvAttrUint32Get(m_handle,"GvspRetries",&value) == ePvErrSuccess)
+    params.retries = value;
+  if(PvAttrUint32Get(m_handle,"GvspTimeout",&value) == ePvErrSuccess)
+    params.timeout = value;
+
+  DEB_RETURN() << DEB_VAR4(params.packet_size,params.stream_hold,
+			   params.lookback_window,params.retries);
+}
+
+std::string StreamTuning::_storePath() const
+{
+  std::string directory;
+  const char* env = getenv("LIMA_PROSILICA_TUNING_DIR");
+  if(env && *env)
+    directory = env;
+  else
+    {
+      const char* home = getenv("HOME");
+      directory = std::string(home ? home : ".") + "/.lima/prosilica";
+    }
+
+  std::string iface;
+  getHostInterface(iface);
+
+  std::ostringstream path;
+  path << directory << "/" << m_uid << "_" << iface << ".cfg";
+  return path.str();
+}
+
+//-----------------------------------------------------
+// @brief read the stored set for this camera and interface
+// @return false if nothing was stored yet
+//-----------------------------------------------------
+bool StreamTuning::load(StreamParameters& params) const
+{
+  DEB_MEMBER_FUNCT();
+
+  std::string path = _storePath();
+  std::ifstream file(path.c_str());
+  if(!file)
+    return false;
+
+  DEB_TRACE() << "Loading stream tuning from " << path;
+  std::string line;
+  while(std::getline(file,line))
+    {
+      std::istringstream tokens(line);
+      std::string key,equal;
+      if(!(tokens >> key >> equal) || key[0] == '#' || equal != "=")
+	continue;
+
+      if(key == "packet_size")		tokens >> params.packet_size;
+      else if(key == "stream_hold")	tokens >> params.stream_hold;
+      else if(key == "resend_percent")	tokens >> params.resend_percent;
+      else if(key == "lookback_window")	tokens >> params.lookback_window;
+      else if(key == "retries")		tokens >> params.retries;
+      else if(key == "timeout")		tokens >> params.timeout;
+      else
+	DEB_WARNING() << "Unknown stream tuning key: " << key;
+    }
+  return true;
+}
+
+void StreamTuning::save(const StreamParameters& params) const
+{
+  DEB_MEMBER_FUNCT();
+
+  std::string path = _storePath();
+  _makeDirectory(path.substr(0,path.rfind('/')));
+
+  std::ofstream file(path.c_str());
+  if(!file)
+    throw LIMA_HW_EXC(Error,"Can't write stream tuning file: " + path);
+
+  file << "# Prosilica stream tuning, camera " << m_uid << std::endl
+       << "packet_size = " << params.packet_size << std::endl
+       << "stream_hold = " << params.stream_hold << std::endl
+       << "resend_percent = " << params.resend_percent << std::endl
+       << "lookback_window = " << params.lookback_window << std::endl
+       << "retries = " << params.retries << std::endl
+       << "timeout = " << params.timeout << std::endl;
+
+  DEB_TRACE() << "Stream tuning saved in " << path;
+}
+
+//-----------------------------------------------------
+// @brief run a short free-running acquisition with the given parameters
+//-----------------------------------------------------
+void StreamTuning::test(const StreamParameters& params,int nb_frames,
+			StreamTestResult& result)
+{
+  DEB_MEMBER_FUNCT();
+
+  apply(params);
+  result = StreamTestResult();
+  read(result.params);
+  result.nb_frames = nb_frames;
+  _grab(nb_frames,result);
+
+  DEB_RETURN() << DEB_VAR4(result.params.packet_size,result.frame_rate,
+			   result.throughput,result.loss_ratio);
+}
+
+void StreamTuning::_grab(int nb_frames,StreamTestResult& result)
+{
+  DEB_MEMBER_FUNCT();
+
+  tPvUint32 frame_size;
+  tPvErr error = PvAttrUint32Get(m_handle,"TotalBytesPerFrame",&frame_size);
+  if(error)
+    throw LIMA_HW_EXC(Error,"Can't get camera image size");
+
+  std::vector<char> memory(TEST_NB_BUFFERS * frame_size);
+  tPvFrame frames[TEST_NB_BUFFERS];
+  memset(frames,0,sizeof(frames));
+  for(int i = 0;i < TEST_NB_BUFFERS;++i)
+    {
+      frames[i].ImageBuffer = &memory[i * frame_size];
+      frames[i].ImageBufferSize = frame_size;
+    }
+
+  char trigger_mode[32];
+  unsigned long psize;
+  PvAttrEnumGet(m_handle,"FrameStartTriggerMode",trigger_mode,
+		sizeof(trigger_mode),&psize);
+  PvAttrEnumSet(m_handle,"FrameStartTriggerMode","Freerun");
+
+  error = PvCaptureStart(m_handle);
+  if(error)
+    {
+      PvAttrEnumSet(m_handle,"FrameStartTriggerMode",trigger_mode);
+      throw LIMA_HW_EXC(Error,"Can't start test capture");
+    }
+
+  unsigned long received0 = _getStat(m_handle,"StatPacketsReceived");
+  unsigned long missed0 = _getStat(m_handle,"StatPacketsMissed");
+  unsigned long resent0 = _getStat(m_handle,"StatPacketsResent");
+
+  for(int i = 0;i < TEST_NB_BUFFERS && i < nb_frames;++i)
+    PvCaptureQueueFrame(m_handle,&frames[i],NULL);
+
+  Timestamp start = Timestamp::now();
+  error = PvCommandRun(m_handle,"AcquisitionStart");
+  for(int i = 0;!error && i < nb_frames;++i)
+    {
+      tPvFrame& frame = frames[i % TEST_NB_BUFFERS];
+      if(PvCaptureWaitForFrameDone(m_handle,&frame,TEST_FRAME_TIMEOUT))
+	{
+	  DEB_WARNING() << "Test acquisition timeout at frame " << i;
+	  break;
+	}
+      if(frame.Status == ePvErrSuccess)
+	++result.nb_completed;
+      if(i + TEST_NB_BUFFERS < nb_frames)
+	PvCaptureQueueFrame(m_handle,&frame,NULL);
+    }
+  double elapsed = Timestamp::now() - start;
+
+  PvCommandRun(m_handle,"AcquisitionStop");
+  PvCaptureQueueClear(m_handle);
+
+  // each test frame not completed (error, timeout) is lost once
+  result.nb_dropped = nb_frames - result.nb_completed;
+  result.packets_received = _getStat(m_handle,"StatPacketsReceived") - received0;
+  result.packets_missed = _getStat(m_handle,"StatPacketsMissed") - missed0;
+  result.packets_resent = _getStat(m_handle,"StatPacketsResent") - resent0;
+
+  PvCaptureEnd(m_handle);
+  PvAttrEnumSet(m_handle,"FrameStartTriggerMode",trigger_mode);
+
+  if(error)
+    throw LIMA_HW_EXC(Error,"Can't start test acquisition");
+
+  if(elapsed > 0.)
+    {
+      result.frame_rate = result.nb_completed / elapsed;
+      result.throughput = result.frame_rate * frame_size;
+    }
+  double frame_loss = nb_frames ? double(result.nb_dropped) / nb_frames : 1.;
+  unsigned long nb_packets = result.packets_received + result.packets_missed;
+  double packet_loss = nb_packets ? double(result.packets_missed) / nb_packets : 0.;
+  result.loss_ratio = std::min(1.,std::max(frame_loss,packet_loss));
+}
+
+//-----------------------------------------------------
+// @brief true if a is a better stream set than b.
+// lower loss first, then higher throughput
+//-----------------------------------------------------
+bool StreamTuning::_better(const StreamTestResult& a,const StreamTestResult& b)
+{
+  if(!a.nb_completed)
+    return false;
+  if(!b.nb_completed)
+    return true;
+
+  const double loss_tolerance = 1e-4;
+  if(a.loss_ratio + loss_tolerance < b.loss_ratio)
+    return true;
+  if(b.loss_ratio + loss_tolerance < a.loss_ratio)
+    return false;
+  return a.throughput > b.throughput;
+}
+
+//-----------------------------------------------------
+// @brief test candidate packet sizes, stream hold and resend windows.
+// the best set is applied, the caller decides whether to save it.
+//-----------------------------------------------------
+void StreamTuning::autoTune(int nb_frames,StreamParameters& best,
+			    std::vector<StreamTestResult>* results)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  StreamParameters current;
+  read(current);
+
+  tPvUint32 min_size = 0,max_size = 0;
+  PvAttrRangeUint32(m_handle,"PacketSize",&min_size,&max_size);
+
+  std::vector<unsigned long> sizes;
+  for(unsigned int i = 0;i < sizeof(PACKET_SIZES) / sizeof(PACKET_SIZES[0]);++i)
+    if(PACKET_SIZES[i] >= min_size && PACKET_SIZES[i] <= max_size)
+      sizes.push_back(PACKET_SIZES[i]);
+  if(max_size && std::find(sizes.begin(),sizes.end(),max_size) == sizes.end())
+    sizes.push_back(max_size);
+
+  std::vector<bool> holds(1,current.stream_hold);
+  if(_isAvailable(m_handle,"StreamHoldEnable"))
+    holds.push_back(!current.stream_hold);
+
+  StreamTestResult best_result;
+  std::vector<unsigned long> tested;
+  try
+    {
+      for(unsigned int i = 0;i < sizes.size();++i)
+	{
+	  // keep the largest size the network path really accepts
+	  if(PvCaptureAdjustPacketSize(m_handle,sizes[i]) != ePvErrSuccess)
+	    continue;
+	  tPvUint32 negotiated;
+	  PvAttrUint32Get(m_handle,"PacketSize",&negotiated);
+	  if(std::find(tested.begin(),tested.end(),negotiated) != tested.end())
+	    continue;
+	  tested.push_back(negotiated);
+
+	  for(unsigned int j = 0;j < holds.size();++j)
+	    {
+	      StreamParameters params = current;
+	      params.packet_size = negotiated;
+	      params.stream_hold = holds[j];
+
+	      StreamTestResult result;
+	      test(params,nb_frames,result);
+	      if(results)
+		results->push_back(result);
+	      if(_better(result,best_result))
+		best_result = result;
+	    }
+	}
+
+      // then widen the resend windows around the best packet setting
+      if(best_result.nb_completed && current.lookback_window && current.retries)
+	{
+	  StreamParameters base = best_result.params;
+	  for(unsigned long scale = 2;scale <= 4;scale *= 2)
+	    {
+	      StreamParameters params = base;
+	      params.lookback_window = current.lookback_window * scale;
+	      params.retries = current.retries + scale;
+	      if(current.timeout)
+		params.timeout = current.timeout * scale;
+
+	      StreamTestResult result;
+	      test(params,nb_frames,result);
+	      if(results)
+		results->push_back(result);
+	      if(_better(result,best_result))
+		best_result = result;
+	    }
+	}
+    }
+  catch(Exception&)
+    {
+      apply(current);
+      throw;
+    }
+
+  if(!best_result.nb_completed)
+    {
+      apply(current);
+      throw LIMA_HW_EXC(Error,"Stream auto-tune failed, no frame received");
+    }
+
+  best = best_result.params;
+  apply(best);
+
+  DEB_RETURN() << DEB_VAR4(best.packet_size,best.stream_hold,
+			   best_result.throughput,best_result.loss_ratio);
+}
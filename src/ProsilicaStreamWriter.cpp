@@ -0,0 +1,728 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#ifdef PROSILICA_WITH_IO_URING
+#include <liburing.h>
+#endif
+
+#include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
+
+#include "ProsilicaStreamWriter.h"
+#include "ProsilicaCamera.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+static const int DEFAULT_FRAMES_PER_FILE = 1000;
+static const int DEFAULT_NB_BUFFERS = 32;
+static const int DEFAULT_NB_THREADS = 2;
+
+static inline size_t _blockAligned(size_t size)
+{
+  return (size + Stream::BLOCK_SIZE - 1) / Stream::BLOCK_SIZE * Stream::BLOCK_SIZE;
+}
+
+class StreamWriter::_IoThread : public Thread
+{
+public:
+  _IoThread(StreamWriter& writer) : m_writer(writer) {}
+protected:
+  virtual void threadFunction() {m_writer._run();}
+private:
+  StreamWriter&	m_writer;
+};
+
+StreamWriterStatus::StreamWriterStatus() :
+  nb_written(0),
+  nb_bytes(0),
+  nb_dropped(0),
+  nb_errors(0),
+  nb_files(0),
+  queue_depth(0),
+  max_queue_depth(0),
+  last_latency(0.),
+  mean_latency(0.),
+  max_latency(0.)
+{
+}
+
+StreamWriter::StreamWriter(Camera* cam) :
+  m_cam(cam),
+  m_active(false),
+  m_directory("."),
+  m_prefix("stream_"),
+  m_frames_per_file(DEFAULT_FRAMES_PER_FILE),
+  m_nb_buffers(DEFAULT_NB_BUFFERS),
+  m_nb_threads(DEFAULT_NB_THREADS),
+  m_next_file_nb(0),
+  m_timestamp_frequency(0),
+  m_running(false),
+  m_quit(false),
+  m_nb_io_threads(0),
+  m_file(NULL),
+  m_nb_latencies(0)
+{
+  DEB_CONSTRUCTOR();
+}
+
+StreamWriter::~StreamWriter()
+{
+  DEB_DESTRUCTOR();
+
+  finish();
+  for(std::vector<char*>::iterator i = m_buffers.begin();i != m_buffers.end();++i)
+    free(*i);
+}
+
+bool StreamWriter::hasIoUring()
+{
+#ifdef PROSILICA_WITH_IO_URING
+  return true;
+#else
+  return false;
+#endif
+}
+
+void StreamWriter::_checkIdle()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_running)
+    throw LIMA_HW_EXC(Error,"Can't change the stream writer while streaming");
+}
+
+void StreamWriter::setActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  m_active = active;
+  if(!active)
+    finish();
+}
+
+void StreamWriter::setDirectory(const std::string& directory)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(directory);
+
+  AutoMutex lock(m_cond.mutex());
+  _checkIdle();
+  if(directory != m_directory)
+    m_next_file_nb = 0;
+  m_directory = directory;
+}
+
+void StreamWriter::getDirectory(std::string& directory) const
+{
+  directory = m_directory;
+}
+
+void StreamWriter::setPrefix(const std::string& prefix)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(prefix);
+
+  if(prefix.find('/') != std::string::npos)
+    throw LIMA_HW_EXC(InvalidValue,"Stream prefix can't hold a /");
+  AutoMutex lock(m_cond.mutex());
+  _checkIdle();
+  if(prefix != m_prefix)
+    m_next_file_nb = 0;
+  m_prefix = prefix;
+}
+
+void StreamWriter::getPrefix(std::string& prefix) const
+{
+  prefix = m_prefix;
+}
+
+void StreamWriter::setFramesPerFile(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if(nb_frames < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Frames per file must be at least 1");
+  AutoMutex lock(m_cond.mutex());
+  _checkIdle();
+  m_frames_per_file = nb_frames;
+}
+
+void StreamWriter::setNbBuffers(int nb_buffers)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_buffers);
+
+  if(nb_buffers < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Stream writer needs at least 1 buffer");
+  AutoMutex lock(m_cond.mutex());
+  _checkIdle();
+  m_nb_buffers = nb_buffers;
+}
+
+void StreamWriter::setNbThreads(int nb_threads)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_threads);
+
+  if(nb_threads < 1)
+    throw LIMA_HW_EXC(InvalidValue,"Stream writer needs at least 1 thread");
+  AutoMutex lock(m_cond.mutex());
+  _checkIdle();
+  m_nb_threads = nb_threads;
+}
+
+void StreamWriter::getStatus(StreamWriterStatus& status)
+{
+  AutoMutex lock(m_cond.mutex());
+  status = m_status;
+}
+
+void StreamWriter::prepare()
+{
+  DEB_MEMBER_FUNCT();
+
+  // the previous acquisition was not stopped
+  finish();
+  if(!m_active)
+    return;
+
+  struct stat st;
+  if(stat(m_directory.c_str(),&st) || !S_ISDIR(st.st_mode))
+    throw LIMA_HW_EXC(InvalidValue,"Stream directory doesn't exist");
+  tPvUint32 frequency = 0;
+  PvAttrUint32Get(m_cam->getHandle(),"TimeStampFrequency",&frequency);
+
+  AutoMutex lock(m_cond.mutex());
+  m_timestamp_frequency = frequency;
+  m_status = StreamWriterStatus();
+  m_nb_latencies = 0;
+  // the buffers are (re)allocated to the frame size on first use
+  for(size_t i = m_nb_buffers;i < m_buffers.size();++i)
+    free(m_buffers[i]);
+  m_buffers.resize(m_nb_buffers,NULL);
+  m_buffer_sizes.resize(m_nb_buffers,0);
+  m_free_buffers.clear();
+  for(int i = m_nb_buffers - 1;i >= 0;--i)
+    m_free_buffers.push_back(i);
+  m_queue.clear();
+  m_file = NULL;
+  m_quit = false;
+  m_running = true;
+  _start();
+}
+
+void StreamWriter::_start()
+{
+  DEB_MEMBER_FUNCT();
+
+  int nb_threads = hasIoUring() ? 1 : m_nb_threads;
+  for(int i = 0;i < nb_threads;++i)
+    {
+      _IoThread* thread = new _IoThread(*this);
+      m_io_threads.push_back(thread);
+      ++m_nb_io_threads;
+      thread->start();
+    }
+}
+
+//-----------------------------------------------------
+// @brief write the frames still queued and close the files
+//-----------------------------------------------------
+void StreamWriter::finish()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_cond.mutex());
+  if(!m_running)
+    return;
+  m_running = false;
+  if(m_file)
+    {
+      m_file->full = true;
+      if(!m_file->nb_pending)
+	_push(Request{-1,m_file,0,0,0,0,0,0.,0.});
+      m_file = NULL;
+    }
+  m_quit = true;
+  m_cond.broadcast();
+  while(m_nb_io_threads)
+    m_cond.wait();
+  std::vector<_IoThread*> threads;
+  threads.swap(m_io_threads);
+  std::vector<File*> files(m_files.begin(),m_files.end());
+  lock.unlock();
+
+  for(std::vector<_IoThread*>::iterator i = threads.begin();i != threads.end();++i)
+    delete *i;
+  // should not happen, all the files are closed by the io threads
+  for(std::vector<File*>::iterator i = files.begin();i != files.end();++i)
+    _close(*i);
+
+  DEB_TRACE() << DEB_VAR4(m_status.nb_written,m_status.nb_dropped,
+			  m_status.nb_errors,m_status.max_queue_depth);
+}
+
+void StreamWriter::process(FrameData& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_active)
+    return;
+
+  size_t raw_size = size_t(frame.width) * frame.height * frame.depth;
+  const void* data = frame.data;
+  size_t data_size = raw_size;
+  int codec = 0;
+  size_t record_size = _blockAligned(Stream::RECORD_DATA_OFFSET + raw_size);
+  if(frame.compressed)
+    {
+      data = &frame.compressed->data[0];
+      data_size = frame.compressed->size;
+      codec = frame.compressed->codec + 1;
+      // the chunk table, each chunk is at most its raw size
+      record_size = _blockAligned(Stream::RECORD_DATA_OFFSET + raw_size +
+				  (2 + frame.height) * sizeof(uint32_t));
+    }
+  size_t size = _blockAligned(Stream::RECORD_DATA_OFFSET + data_size);
+
+  AutoMutex lock(m_cond.mutex());
+  if(!m_running)
+    return;
+  if(m_free_buffers.empty())
+    {
+      ++m_status.nb_dropped;
+      return;
+    }
+  int buffer = m_free_buffers.back();
+  m_free_buffers.pop_back();
+  lock.unlock();
+
+  // the copy is done out of the lock, the buffer is ours
+  if(m_buffer_sizes[buffer] < size)
+    {
+      void* memory;
+      free(m_buffers[buffer]);
+      m_buffers[buffer] = NULL;
+      m_buffer_sizes[buffer] = 0;
+      if(posix_memalign(&memory,Stream::BLOCK_SIZE,size))
+	{
+	  DEB_ERROR() << "Can't allocate stream buffer of " << DEB_VAR1(size);
+	  lock.lock();
+	  m_free_buffers.push_back(buffer);
+	  ++m_status.nb_dropped;
+	  return;
+	}
+      m_buffers[buffer] = (char*)memory;
+      m_buffer_sizes[buffer] = size;
+    }
+  char* record = m_buffers[buffer];
+  memset(record,0,Stream::RECORD_DATA_OFFSET);
+  Stream::RecordHeader* header = (Stream::RecordHeader*)record;
+  header->magic = Stream::RECORD_MAGIC;
+  header->frame_nb = frame.frame_nb;
+  header->width = frame.width;
+  header->height = frame.height;
+  header->depth = frame.depth;
+  header->mode = frame.mode;
+  header->data_size = uint32_t(data_size);
+  header->codec = codec;
+  header->camera_timestamp = frame.camera_timestamp;
+  header->timestamp = frame.timestamp;
+  memcpy(record + Stream::RECORD_DATA_OFFSET,data,data_size);
+  memset(record + Stream::RECORD_DATA_OFFSET + data_size,0,
+	 size - Stream::RECORD_DATA_OFFSET - data_size);
+
+  lock.lock();
+  if(!m_running)
+    {
+      m_free_buffers.push_back(buffer);
+      return;
+    }
+  // a new geometry starts a new file
+  if(m_file && (m_file->record_size != record_size ||
+		m_file->width != frame.width || m_file->height != frame.height ||
+		m_file->depth != frame.depth || m_file->mode != frame.mode))
+    {
+      m_file->full = true;
+      if(!m_file->nb_pending)
+	_push(Request{-1,m_file,0,0,0,0,0,0.,0.});
+      m_file = NULL;
+    }
+  if(!m_file)
+    {
+      m_file = new File;
+      m_file->nb = m_next_file_nb++;
+      m_file->fd = -1;
+      m_file->record_size = record_size;
+      m_file->next_offset = Stream::HEADER_SIZE;
+      m_file->width = frame.width;
+      m_file->height = frame.height;
+      m_file->depth = frame.depth;
+      m_file->mode = frame.mode;
+      m_file->nb_records = 0;
+      m_file->nb_pending = 0;
+      m_file->full = false;
+      Stream::IndexEntry missing = {-1,0,0,0.};
+      m_file->index.assign(m_frames_per_file,missing);
+      m_files.insert(m_file);
+      ++m_status.nb_files;
+    }
+  File* file = m_file;
+  int record_nb = file->nb_records++;
+  uint64_t offset = file->next_offset;
+  file->next_offset += size;
+  ++file->nb_pending;
+  if(file->nb_records == int(file->index.size()))
+    {
+      file->full = true;
+      m_file = NULL;
+    }
+  _push(Request{buffer,file,record_nb,offset,size,frame.frame_nb,frame.camera_timestamp,
+		frame.timestamp,double(Timestamp::now())});
+}
+
+void StreamWriter::_push(const Request& request)
+{
+  m_queue.push_back(request);
+  if(request.buffer >= 0)
+    {
+      ++m_status.queue_depth;
+      m_status.max_queue_depth = std::max(m_status.max_queue_depth,
+					  m_status.queue_depth);
+    }
+  m_cond.broadcast();
+}
+
+void StreamWriter::_run()
+{
+  DEB_MEMBER_FUNCT();
+
+  int policy_generation = -1;
+  m_cam->getWorkerThreadControl().update(policy_generation);
+
+  AutoMutex lock(m_cond.mutex());
+#ifdef PROSILICA_WITH_IO_URING
+  _runIoUring(lock);
+#else
+  _runThreads(lock);
+#endif
+  lock.unlock();
+  m_cam->getWorkerThreadControl().release();
+  lock.lock();
+  --m_nb_io_threads;
+  m_cond.broadcast();
+}
+
+void StreamWriter::_runThreads(AutoMutex& lock)
+{
+  while(true)
+    {
+      while(m_queue.empty() && !m_quit)
+	m_cond.wait();
+      if(m_queue.empty())
+	break;
+      Request request = m_queue.front();
+      m_queue.pop_front();
+      lock.unlock();
+
+      File* file = request.file;
+      if(request.buffer >= 0)
+	{
+	  bool ok = _write(request);
+	  lock.lock();
+	  file = _complete(request,ok);
+	  lock.unlock();
+	}
+      if(file)
+	_close(file);
+      lock.lock();
+    }
+}
+
+#ifdef PROSILICA_WITH_IO_URING
+//-----------------------------------------------------
+// @brief the queued frames are submitted by batches, a single thread
+// keeps up to nb_buffers writes in flight
+//-----------------------------------------------------
+void StreamWriter::_runIoUring(AutoMutex& lock)
+{
+  DEB_MEMBER_FUNCT();
+
+  struct io_uring ring;
+  int error = io_uring_queue_init(m_nb_buffers,&ring,0);
+  if(error < 0)
+    {
+      DEB_WARNING() << "io_uring not available, writing with pwrite: " << strerror(-error);
+      _runThreads(lock);
+      return;
+    }
+
+  std::vector<Request> in_flight(m_nb_buffers);
+  int nb_in_flight = 0;
+  std::vector<Request> batch;
+  std::vector<File*> to_close;
+  while(true)
+    {
+      while(m_queue.empty() && !nb_in_flight && !m_quit)
+	m_cond.wait();
+      if(m_queue.empty() && !nb_in_flight)
+	break;
+      batch.assign(m_queue.begin(),m_queue.end());
+      m_queue.clear();
+      lock.unlock();
+
+      int nb_submitted = 0;
+      for(std::vector<Request>::iterator i = batch.begin();i != batch.end();++i)
+	{
+	  if(i->buffer < 0)
+	    {
+	      to_close.push_back(i->file);
+	      continue;
+	    }
+	  int fd = _fileFd(i->file);
+	  if(fd < 0)
+	    {
+	      lock.lock();
+	      File* file = _complete(*i,false);
+	      lock.unlock();
+	      if(file)
+		to_close.push_back(file);
+	      continue;
+	    }
+	  struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+	  io_uring_prep_write(sqe,fd,m_buffers[i->buffer],i->size,i->offset);
+	  io_uring_sqe_set_data(sqe,(void*)(intptr_t)i->buffer);
+	  in_flight[i->buffer] = *i;
+	  ++nb_in_flight;
+	  ++nb_submitted;
+	}
+      if(nb_submitted)
+	io_uring_submit(&ring);
+
+      // a short wait lets the next frames join the following batch
+      struct io_uring_cqe* cqe;
+      struct __kernel_timespec timeout = {0,1000000};
+      if(nb_in_flight && !io_uring_wait_cqe_timeout(&ring,&cqe,&timeout))
+	{
+	  unsigned head;
+	  int nb_completed = 0;
+	  lock.lock();
+	  io_uring_for_each_cqe(&ring,head,cqe)
+	    {
+	      const Request& request = in_flight[(intptr_t)io_uring_cqe_get_data(cqe)];
+	      File* file = _complete(request,cqe->res == int(request.size));
+	      if(file)
+		to_close.push_back(file);
+	      ++nb_completed;
+	    }
+	  io_uring_cq_advance(&ring,nb_completed);
+	  nb_in_flight -= nb_completed;
+	  lock.unlock();
+	}
+      for(std::vector<File*>::iterator i = to_close.begin();i != to_close.end();++i)
+	_close(*i);
+      to_close.clear();
+      lock.lock();
+    }
+  io_uring_queue_exit(&ring);
+}
+#endif
+
+//-----------------------------------------------------
+// @brief open and preallocate the file on its first record
+//-----------------------------------------------------
+int StreamWriter::_fileFd(File* file)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_file_lock);
+  if(file->fd != -1)
+    return file->fd < 0 ? -1 : file->fd;
+
+  char name[32];
+  snprintf(name,sizeof(name),"%05d.lpsf",file->nb);
+  std::string path = m_directory + "/" + m_prefix + name;
+  // never overwrite a stream file. O_DIRECT is set once created: an
+  // open with it fails after creating the file where it's not supported
+  int fd = open(path.c_str(),O_WRONLY | O_CREAT | O_EXCL,0644);
+  if(fd < 0)
+    {
+      DEB_ERROR() << "Can't create " << DEB_VAR2(path,strerror(errno));
+      file->fd = -2;
+      return -1;
+    }
+  if(fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) | O_DIRECT))
+    DEB_WARNING() << "No O_DIRECT on " << DEB_VAR2(path,strerror(errno));
+
+  off_t size = Stream::HEADER_SIZE + off_t(file->index.size()) * file->record_size;
+  int error = posix_fallocate(fd,0,size);
+  if(error)
+    DEB_WARNING() << "Can't preallocate " << DEB_VAR2(path,strerror(error));
+
+  // nb_records stays 0 until the file is closed
+  void* block;
+  if(!posix_memalign(&block,Stream::BLOCK_SIZE,Stream::HEADER_SIZE))
+    {
+      memset(block,0,Stream::HEADER_SIZE);
+      Stream::FileHeader* header = (Stream::FileHeader*)block;
+      header->magic = Stream::MAGIC;
+      header->version = Stream::VERSION;
+      header->file_nb = file->nb;
+      header->max_records = uint32_t(file->index.size());
+      header->record_size = file->record_size;
+      header->timestamp_frequency = m_timestamp_frequency;
+      header->width = file->width;
+      header->height = file->height;
+      header->depth = file->depth;
+      header->mode = file->mode;
+      if(pwrite(fd,block,Stream::HEADER_SIZE,0) != Stream::HEADER_SIZE)
+	DEB_ERROR() << "Can't write header of " << DEB_VAR1(path);
+      free(block);
+    }
+  file->fd = fd;
+  return fd;
+}
+
+bool StreamWriter::_write(const Request& request)
+{
+  DEB_MEMBER_FUNCT();
+
+  int fd = _fileFd(request.file);
+  if(fd < 0)
+    return false;
+  size_t size = request.size;
+  off_t offset = request.offset;
+  const char* data = m_buffers[request.buffer];
+  while(size)
+    {
+      ssize_t written = pwrite(fd,data,size,offset);
+      if(written <= 0)
+	{
+	  if(written < 0 && errno == EINTR)
+	    continue;
+	  DEB_ERROR() << "Stream write failed: " << strerror(errno);
+	  return false;
+	}
+      data += written,offset += written,size -= written;
+    }
+  return true;
+}
+
+//-----------------------------------------------------
+// @brief account a finished write, m_cond locked
+// @return the file to close, full and without pending write
+//-----------------------------------------------------
+StreamWriter::File* StreamWriter::_complete(const Request& request,bool ok)
+{
+  File* file = request.file;
+  if(ok)
+    {
+      Stream::IndexEntry& entry = file->index[request.record];
+      entry.frame_nb = request.frame_nb;
+      entry.offset = request.offset;
+      entry.camera_timestamp = request.camera_timestamp;
+      entry.timestamp = request.timestamp;
+      ++m_status.nb_written;
+      m_status.nb_bytes += request.size;
+    }
+  else
+    ++m_status.nb_errors;
+
+  double latency = double(Timestamp::now()) - request.submit_time;
+  m_status.last_latency = latency;
+  m_status.max_latency = std::max(m_status.max_latency,latency);
+  ++m_nb_latencies;
+  m_status.mean_latency += (latency - m_status.mean_latency) / m_nb_latencies;
+  --m_status.queue_depth;
+  m_free_buffers.push_back(request.buffer);
+
+  return !--file->nb_pending && file->full ? file : NULL;
+}
+
+//-----------------------------------------------------
+// @brief write the index and the final header, trim the preallocation
+//-----------------------------------------------------
+void StreamWriter::_close(File* file)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(file->fd >= 0)
+    {
+      int fd = file->fd;
+      uint64_t index_offset = file->next_offset;
+      size_t index_size = file->nb_records * sizeof(Stream::IndexEntry);
+      size_t block_size = _blockAligned(std::max(index_size,sizeof(Stream::FileHeader)));
+      void* block;
+      if(posix_memalign(&block,Stream::BLOCK_SIZE,block_size))
+	DEB_ERROR() << "Can't allocate the index of file " << file->nb;
+      else
+	{
+	  memset(block,0,block_size);
+	  memcpy(block,&file->index[0],index_size);
+	  bool ok = pwrite(fd,block,_blockAligned(index_size),index_offset) ==
+	    ssize_t(_blockAligned(index_size));
+
+	  memset(block,0,Stream::HEADER_SIZE);
+	  Stream::FileHeader* header = (Stream::FileHeader*)block;
+	  header->magic = Stream::MAGIC;
+	  header->version = Stream::VERSION;
+	  header->file_nb = file->nb;
+	  header->max_records = uint32_t(file->index.size());
+	  header->record_size = file->record_size;
+	  header->nb_records = file->nb_records;
+	  header->index_offset = index_offset;
+	  header->timestamp_frequency = m_timestamp_frequency;
+	  header->width = file->width;
+	  header->height = file->height;
+	  header->depth = file->depth;
+	  header->mode = file->mode;
+	  ok = ok && pwrite(fd,block,Stream::HEADER_SIZE,0) == Stream::HEADER_SIZE;
+	  free(block);
+	  if(!ok)
+	    DEB_ERROR() << "Can't write the index of file " << file->nb;
+	}
+      if(ftruncate(fd,index_offset + _blockAligned(index_size)))
+	DEB_WARNING() << "Can't trim file " << file->nb;
+      fdatasync(fd);
+      close(fd);
+    }
+
+  AutoMutex lock(m_cond.mutex());
+  m_files.erase(file);
+  delete file;
+}
@@ -23,6 +23,8 @@
 //###########################################################################
 
 #include <sstream>
+#include <algorithm>
+#include "lima/Timestamp.h"
 #include "ProsilicaSyncCtrlObj.h"
 #include "ProsilicaBufferCtrlObj.h"
 #include "ProsilicaCamera.h"
@@ -30,13 +32,138 @@
 using namespace lima;
 using namespace lima::Prosilica;
 
+// GigE bandwidth model: PacketSize includes the IP, UDP and GVSP headers,
+// the Ethernet header, FCS, preamble and inter-frame gap come on top.
+static const double GIGE_LINK_SPEED = 125e6; // bytes per second
+static const int GVSP_HEADER_SIZE = 36;
+static const int ETHERNET_OVERHEAD = 38;
+static const int GVSP_LEADER_TRAILER_SIZE = 2 * (64 + ETHERNET_OVERHEAD);
+static const double RATE_TOLERANCE = 0.01;
+// the timing model is checked against the camera every n range updates
+static const int TIMING_CHECK_PERIOD = 32;
+
+static int _bytesPerPixel(VideoMode mode)
+{
+  switch(mode)
+    {
+    case Y16:
+    case BAYER_RG16:	return 2;
+    case RGB24:
+    case BGR24:		return 3;
+    default:		return 1;
+    }
+}
+
+static const char* _limitingFactorName(AcqPrediction::LimitingFactor factor)
+{
+  switch(factor)
+    {
+    case AcqPrediction::Exposure:	return "exposure";
+    case AcqPrediction::Readout:	return "sensor readout";
+    case AcqPrediction::Bandwidth:	return "stream bandwidth";
+    default:				return "requested rate";
+    }
+}
+
+AcqPlan::AcqPlan() :
+  bin(1,1),
+  video_mode(Y16),
+  exp_time(0.),
+  lat_time(0.),
+  nb_frames(1),
+  trig_mode(IntTrig),
+  accumulation(1)
+{
+}
+
+AcqPrediction::AcqPrediction() :
+  frame_rate(0.),
+  requested_frame_rate(0.),
+  camera_frame_rate(0.),
+  effective_exp_time(0.),
+  max_readout_rate(0.),
+  max_bandwidth_rate(0.),
+  link_utilisation(0.),
+  data_rate(0.),
+  frame_size(0),
+  buffer_memory(0),
+  limiting_factor(Requested)
+{
+}
+
+//-----------------------------------------------------
+// @brief ends the capture when the last frame is received, the PvAPI
+// callback thread must not run AcquisitionStop and PvCaptureEnd itself
+//-----------------------------------------------------
+class SyncCtrlObj::_StopThread : public Thread
+{
+  DEB_CLASS_NAMESPC(DebModCamera,"SyncCtrlObj","_StopThread");
+public:
+  _StopThread(SyncCtrlObj& sync) : m_sync(sync) {}
+protected:
+  virtual void threadFunction();
+private:
+  SyncCtrlObj&	m_sync;
+};
+
+void SyncCtrlObj::_StopThread::threadFunction()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex lock(m_sync.m_cond.mutex());
+  while(!m_sync.m_quit)
+    {
+      if(!m_sync.m_stop_requested)
+	{
+	  m_sync.m_cond.wait();
+	  continue;
+	}
+
+      bool clearQueue = m_sync.m_stop_clear_queue;
+      m_sync.m_stop_requested = false;
+      lock.unlock();
+      try
+	{
+	  m_sync._stopCapture(clearQueue);
+	}
+      catch(Exception& e)
+	{
+	  DEB_ERROR() << "Asynchronous stop failed: " << e.getErrMsg();
+	}
+      lock.lock();
+
+      double latency = double(Timestamp::now()) - m_sync.m_last_frame_time;
+      m_sync.m_stop_latency = latency;
+      m_sync.m_max_stop_latency = std::max(m_sync.m_max_stop_latency,latency);
+      DEB_TRACE() << DEB_VAR1(latency);
+
+      m_sync.m_started = m_sync.m_stopping = false;
+      m_sync.m_cond.broadcast();
+    }
+  m_sync.m_thread_running = false;
+  m_sync.m_cond.broadcast();
+}
+
 SyncCtrlObj::SyncCtrlObj(Camera *cam,BufferCtrlObj *buffer) :
   m_cam(cam),
   m_handle(cam->getHandle()),
   m_trig_mode(IntTrig),
   m_buffer(buffer),
   m_nb_frames(1),
-  m_started(false)
+  m_started(false),
+  m_strict_plan_check(false),
+  m_link_speed(GIGE_LINK_SPEED),
+  m_timing(cam),
+  m_nb_range_updates(0),
+  m_stop_thread(NULL),
+  m_stopping(false),
+  m_stop_requested(false),
+  m_stop_clear_queue(false),
+  m_quit(false),
+  m_thread_running(false),
+  m_last_frame_time(0.),
+  m_stop_latency(0.),
+  m_max_stop_latency(0.)
 {
   DEB_CONSTRUCTOR();
   m_access_mode = cam->m_as_master ? 
@@ -48,11 +175,23 @@ SyncCtrlObj::SyncCtrlObj(Camera *cam,BufferCtrlObj *buffer) :
   tPvErr error = PvAttrFloat32Set(m_handle, "FrameRate", m_maxframerate);
   if(error)
     throw LIMA_HW_EXC(Error,"Can't set FramRate to max");
+
+  m_stop_thread = new _StopThread(*this);
+  m_thread_running = true;
+  m_stop_thread->start();
 }
 
 SyncCtrlObj::~SyncCtrlObj()
 {
   DEB_DESTRUCTOR();
+
+  AutoMutex lock(m_cond.mutex());
+  m_quit = true;
+  m_cond.broadcast();
+  while(m_thread_running)
+    m_cond.wait();
+  lock.unlock();
+  delete m_stop_thread;
 }
 
 bool SyncCtrlObj::checkTrigMode(TrigMode trig_mode)
@@ -122,19 +261,44 @@ void SyncCtrlObj::getTrigMode(TrigMode &trig_mode)
 void SyncCtrlObj::updateValidRanges(bool force_init)
 {
   DEB_MEMBER_FUNCT();
-  // force rereading of the frame-rate range and adjust the timing ranges
-  tPvErr error = PvAttrRangeFloat32(m_handle, "FrameRate", &m_minframerate, &m_maxframerate);
-  if(error)
-    throw LIMA_HW_EXC(Error,"Can't get  FramRate range");
-  DEB_TRACE() << "Frame Rate Range :" << m_minframerate << " - " << m_maxframerate << " Hz";
-  
-  tPvUint32 min_exp, max_exp;
-  error = PvAttrRangeUint32(m_handle, "ExposureValue", &min_exp, &max_exp);
-  if(error)
-    throw LIMA_HW_EXC(Error,"Can't get  Exposure range");
-  DEB_TRACE() << "Exposure Range :" << min_exp << " - " << max_exp << " usec.";
-  m_minexposure = min_exp/1e6;
-  m_maxexposure = max_exp/1e6;
+  if(force_init && m_access_mode == HwSyncCtrlObj::Master)
+    m_timing.calibrate();
+
+  if(m_timing.isCalibrated())
+    {
+      // ranges from the local timing model, no camera round-trip
+      AcqPlan plan;
+      getAcqPlan(plan);
+      int width,height;
+      _getPlanImageSize(plan,width,height);
+      int bytes_per_pixel = _bytesPerPixel(plan.video_mode);
+      if(!(++m_nb_range_updates % TIMING_CHECK_PERIOD))
+	m_timing.check(width,height,plan.bin,bytes_per_pixel);
+
+      m_maxframerate = m_timing.maxFrameRate(width,height,plan.bin,bytes_per_pixel);
+      m_minframerate = m_timing.getMinFrameRate();
+      double min_exp,max_exp;
+      m_timing.getExposureRange(min_exp,max_exp);
+      m_minexposure = min_exp;
+      m_maxexposure = max_exp;
+      DEB_TRACE() << "Frame Rate Range :" << m_minframerate << " - " << m_maxframerate << " Hz (model)";
+    }
+  else
+    {
+      // force rereading of the frame-rate range and adjust the timing ranges
+      tPvErr error = PvAttrRangeFloat32(m_handle, "FrameRate", &m_minframerate, &m_maxframerate);
+      if(error)
+	throw LIMA_HW_EXC(Error,"Can't get  FramRate range");
+      DEB_TRACE() << "Frame Rate Range :" << m_minframerate << " - " << m_maxframerate << " Hz";
+
+      tPvUint32 min_exp, max_exp;
+      error = PvAttrRangeUint32(m_handle, "ExposureValue", &min_exp, &max_exp);
+      if(error)
+	throw LIMA_HW_EXC(Error,"Can't get  Exposure range");
+      DEB_TRACE() << "Exposure Range :" << min_exp << " - " << max_exp << " usec.";
+      m_minexposure = min_exp/1e6;
+      m_maxexposure = max_exp/1e6;
+    }
   
   if (force_init)
   {
@@ -249,67 +413,150 @@ void SyncCtrlObj::startAcq()
 {
   DEB_MEMBER_FUNCT();
   
+  bool started;
+  {
+    AutoMutex lock(m_cond.mutex());
+    _waitStopDone(lock);
+    started = m_started;
+    // before the capture starts, the last frame may come at once
+    m_started = true;
+  }
+
   tPvErr error;
-  if(!m_started)
+  try
     {
-      error = PvCaptureStart(m_handle);
-      if(error)
-	throw LIMA_HW_EXC(Error,"Can't start acquisition capture");
+      if(!started)
+	{
+	  error = PvCaptureStart(m_handle);
+	  if(error)
+	    throw LIMA_HW_EXC(Error,"Can't start acquisition capture");
+	  // each acquisition replays the recording from its start
+	  m_cam->getFrameReplayer().rewind();
+	  m_cam->resetCallbackStatus();
 
-      if(m_buffer)
-	m_buffer->startAcq();
-      else
-	m_cam->startAcq();
+	  if(m_buffer)
+	    m_buffer->startAcq();
+	  else
+	    m_cam->startAcq();
       
-      if(m_cam->m_as_master)
+	  if(m_cam->m_as_master)
+	    {
+	      error = PvCommandRun(m_handle, "AcquisitionStart");
+	      if(error)
+		throw LIMA_HW_EXC(Error,"Can't start acquisition");
+	    }  
+	}
+      if (m_trig_mode == IntTrigMult)
 	{
-	  error = PvCommandRun(m_handle, "AcquisitionStart");
+	  error = PvCommandRun(m_handle, "FrameStartTriggerSoftware");
 	  if(error)
-	    throw LIMA_HW_EXC(Error,"Can't start acquisition");
-	}  
+	    throw LIMA_HW_EXC(Error,"Can't start software trigger");
+	}
     }
-  if (m_trig_mode == IntTrigMult)
+  catch(Exception&)
     {
-      error = PvCommandRun(m_handle, "FrameStartTriggerSoftware");
-      if(error)
-	throw LIMA_HW_EXC(Error,"Can't start software trigger");
+      AutoMutex lock(m_cond.mutex());
+      m_started = started;
+      throw;
     }
-  m_started = true;
 }
 
 void SyncCtrlObj::stopAcq(bool clearQueue)
 {
   DEB_MEMBER_FUNCT();
-  if(m_started)
+
+  AutoMutex lock(m_cond.mutex());
+  _waitStopDone(lock);
+  if(!m_started)
     {
-      DEB_TRACE() << "Try to stop Acq";
-      tPvErr error = PvCommandRun(m_handle,"AcquisitionStop");
-      if(error)
-	{
-	  DEB_ERROR() << "Failed to stop acquisition";
-	  throw LIMA_HW_EXC(Error,"Failed to stop acquisition");
-	}
+      lock.unlock();
+      if(m_buffer)
+	m_buffer->flushFrames();
+      return;
+    }
+
+  // callbacks must not request an asynchronous stop meanwhile
+  m_stopping = true;
+  lock.unlock();
+  try
+    {
+      _stopCapture(clearQueue);
+    }
+  catch(Exception&)
+    {
+      lock.lock();
+      m_started = m_stopping = false;
+      m_cond.broadcast();
+      throw;
+    }
+  lock.lock();
+  m_started = m_stopping = false;
+  m_cond.broadcast();
+}
+
+void SyncCtrlObj::requestStop(bool clearQueue)
+{
+  DEB_MEMBER_FUNCT();
 
-      DEB_TRACE() << "Try to stop Capture";
-      error = PvCaptureEnd(m_handle);
+  AutoMutex lock(m_cond.mutex());
+  if(!m_started || m_stopping)
+    return;
+
+  m_last_frame_time = Timestamp::now();
+  m_stopping = m_stop_requested = true;
+  m_stop_clear_queue = clearQueue;
+  m_cond.broadcast();
+}
+
+void SyncCtrlObj::_waitStopDone(AutoMutex&)
+{
+  while(m_stopping)
+    m_cond.wait();
+}
+
+void SyncCtrlObj::getStopLatency(double& last,double& max)
+{
+  AutoMutex lock(m_cond.mutex());
+  last = m_stop_latency;
+  max = m_max_stop_latency;
+}
+
+void SyncCtrlObj::_stopCapture(bool clearQueue)
+{
+  DEB_MEMBER_FUNCT();
+  // the frames in the pipeline go to Lima before the last batch
+  m_cam->getFramePipeline().drain();
+  if(m_buffer)
+    m_buffer->flushFrames();
+
+  DEB_TRACE() << "Try to stop Acq";
+  tPvErr error = PvCommandRun(m_handle,"AcquisitionStop");
+  if(error)
+    {
+      DEB_ERROR() << "Failed to stop acquisition";
+      throw LIMA_HW_EXC(Error,"Failed to stop acquisition");
+    }
+
+  DEB_TRACE() << "Try to stop Capture";
+  error = PvCaptureEnd(m_handle);
+  if(error)
+    {
+      DEB_ERROR() << "Failed to stop acquisition";
+      throw LIMA_HW_EXC(Error,"Failed to stop acquisition");
+    }
+
+  if(clearQueue)
+    {
+      DEB_TRACE() << "Try to clear queue";
+      error = m_cam->clearFrameQueue();
       if(error)
 	{
 	  DEB_ERROR() << "Failed to stop acquisition";
 	  throw LIMA_HW_EXC(Error,"Failed to stop acquisition");
 	}
-
-      if(clearQueue)
-	{
-	  DEB_TRACE() << "Try to clear queue";
-	  error = PvCaptureQueueClear(m_handle);
-	  if(error)
-	    {
-	      DEB_ERROR() << "Failed to stop acquisition";
-	      throw LIMA_HW_EXC(Error,"Failed to stop acquisition");
-	    }
-	}
     }
-  m_started = false;
+
+  m_cam->getFrameProcessors().finish();
 }
 
 void SyncCtrlObj::getStatus(HwInterface::StatusType& status)
@@ -349,3 +596,198 @@ void SyncCtrlObj::getStatus(HwInterface::StatusType& status)
     }
   DEB_RETURN() << DEB_VAR1(status);
 }
+
+void SyncCtrlObj::setLinkSpeed(double bytes_per_second)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(bytes_per_second);
+
+  if(bytes_per_second <= 0.)
+    throw LIMA_HW_EXC(InvalidValue,"Link speed must be positive");
+  m_link_speed = bytes_per_second;
+}
+
+//-----------------------------------------------------
+// @brief the plan of the acquisition with the current settings
+//-----------------------------------------------------
+void SyncCtrlObj::getAcqPlan(AcqPlan& plan)
+{
+  DEB_MEMBER_FUNCT();
+
+  // camera side geometry, before any software binning
+  m_cam->getCameraRoi(plan.roi);
+  m_cam->getCameraBin(plan.bin);
+  plan.video_mode = m_cam->getVideoMode();
+  plan.exp_time = m_exposure;
+  plan.lat_time = m_latency;
+  plan.nb_frames = m_nb_frames;
+  plan.trig_mode = m_trig_mode;
+  plan.accumulation = m_buffer ? m_buffer->getAccumulation() : 1;
+}
+
+void SyncCtrlObj::_getPlanImageSize(const AcqPlan& plan,int& width,int& height)
+{
+  if(plan.roi.isActive())
+    {
+      width = plan.roi.getSize().getWidth();
+      height = plan.roi.getSize().getHeight();
+    }
+  else
+    {
+      tPvUint32 max_width,max_height;
+      m_cam->getMaxWidthHeight(max_width,max_height);
+      width = max_width / plan.bin.getX();
+      height = max_height / plan.bin.getY();
+    }
+}
+
+//-----------------------------------------------------
+// @brief readout-limited frame rate of a plan
+// without timing model, the camera reported maximum is scaled
+// with the number of rows read
+//-----------------------------------------------------
+double SyncCtrlObj::_maxReadoutRate(const AcqPlan& plan)
+{
+  int width,height;
+  _getPlanImageSize(plan,width,height);
+  if(m_timing.isCalibrated())
+    return m_timing.maxFrameRate(width,height,plan.bin,
+				 _bytesPerPixel(plan.video_mode));
+
+  AcqPlan current;
+  getAcqPlan(current);
+  int current_width,current_height;
+  _getPlanImageSize(current,current_width,current_height);
+
+  double rate = m_maxframerate;
+  if(height > 0 && height != current_height)
+    rate *= double(current_height) / height;
+  return rate;
+}
+
+//-----------------------------------------------------
+// @brief predict the sustained frame rate, link utilisation and
+// buffer memory of a planned acquisition
+//-----------------------------------------------------
+void SyncCtrlObj::predictAcq(const AcqPlan& plan,AcqPrediction& prediction)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR5(plan.roi,plan.bin,plan.video_mode,
+			  plan.exp_time,plan.lat_time);
+
+  prediction = AcqPrediction();
+
+  int width,height;
+  _getPlanImageSize(plan,width,height);
+  int accumulation = std::max(plan.accumulation,1);
+  prediction.frame_size = (long long)width * height * _bytesPerPixel(plan.video_mode);
+  // the camera frames of an accumulation are summed in 32 bits
+  long long lima_frame_size = accumulation > 1 ?
+    (long long)width * height * 4 : prediction.frame_size;
+  prediction.buffer_memory = lima_frame_size * plan.nb_frames;
+  prediction.effective_exp_time = plan.exp_time * accumulation;
+
+  tPvUint32 packet_size = 1500;
+  PvAttrUint32Get(m_handle,"PacketSize",&packet_size);
+  tPvUint32 stream_bandwidth = 0;
+  PvAttrUint32Get(m_handle,"StreamBytesPerSecond",&stream_bandwidth);
+
+  long long payload = std::max<long long>(packet_size - GVSP_HEADER_SIZE,1);
+  long long nb_packets = (prediction.frame_size + payload - 1) / payload;
+  double wire_size = double(nb_packets) * (packet_size + ETHERNET_OVERHEAD) +
+    GVSP_LEADER_TRAILER_SIZE;
+  double bandwidth = stream_bandwidth ? double(stream_bandwidth) : m_link_speed;
+
+  prediction.max_readout_rate = _maxReadoutRate(plan);
+  prediction.max_bandwidth_rate = bandwidth / wire_size;
+
+  double rate = prediction.max_readout_rate;
+  prediction.limiting_factor = AcqPrediction::Readout;
+  if(plan.exp_time > 0. && 1. / plan.exp_time < rate)
+    {
+      rate = 1. / plan.exp_time;
+      prediction.limiting_factor = AcqPrediction::Exposure;
+    }
+  if(plan.trig_mode == IntTrig && plan.exp_time + plan.lat_time > 0.)
+    {
+      prediction.requested_frame_rate = 1. / (plan.exp_time + plan.lat_time);
+      if(prediction.requested_frame_rate <= rate)
+	{
+	  rate = prediction.requested_frame_rate;
+	  prediction.limiting_factor = AcqPrediction::Requested;
+	}
+    }
+  // what the camera would send, before the stream throttles it
+  prediction.link_utilisation = rate * wire_size / m_link_speed;
+  if(prediction.max_bandwidth_rate < rate)
+    {
+      rate = prediction.max_bandwidth_rate;
+      prediction.limiting_factor = AcqPrediction::Bandwidth;
+    }
+
+  prediction.camera_frame_rate = rate;
+  prediction.frame_rate = rate / accumulation;
+  prediction.requested_frame_rate /= accumulation;
+  prediction.data_rate = rate * prediction.frame_size;
+
+  DEB_RETURN() << DEB_VAR4(prediction.frame_rate,prediction.link_utilisation,
+			   prediction.buffer_memory,
+			   _limitingFactorName(prediction.limiting_factor));
+}
+
+//-----------------------------------------------------
+// @brief fail at prepare time if the current plan would overload the
+// link. a readout or exposure limited rate below the requested one
+// only fails in strict mode
+//-----------------------------------------------------
+void SyncCtrlObj::checkAcqPlan()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_access_mode != HwSyncCtrlObj::Master)
+    return;
+
+  AcqPlan plan;
+  getAcqPlan(plan);
+
+  // once per acquisition, make sure the timing model still matches
+  if(m_timing.isCalibrated())
+    {
+      int width,height;
+      _getPlanImageSize(plan,width,height);
+      if(!m_timing.check(width,height,plan.bin,_bytesPerPixel(plan.video_mode)))
+	updateValidRanges();
+    }
+
+  AcqPrediction prediction;
+  predictAcq(plan,prediction);
+
+  // the stream can't take the requested rate: frames would be lost
+  if(prediction.requested_frame_rate > 0. &&
+     (prediction.link_utilisation > 1. ||
+      prediction.requested_frame_rate * std::max(plan.accumulation,1) >
+      prediction.max_bandwidth_rate * (1. + RATE_TOLERANCE)))
+    {
+      std::ostringstream message;
+      message << "Acquisition needs " << int(prediction.link_utilisation * 100)
+	      << "% of the link bandwidth, the stream can only take "
+	      << prediction.max_bandwidth_rate << " Hz, frames would be lost";
+      throw LIMA_HW_EXC(InvalidValue,message.str());
+    }
+  if(prediction.link_utilisation > 1.)
+    DEB_WARNING() << "Triggers faster than " << prediction.max_bandwidth_rate
+		  << " Hz would overload the link";
+
+  if(prediction.requested_frame_rate > 0. &&
+     prediction.frame_rate < prediction.requested_frame_rate * (1. - RATE_TOLERANCE))
+    {
+      std::ostringstream message;
+      message << "Requested " << prediction.requested_frame_rate
+	      << " Hz but only " << prediction.frame_rate
+	      << " Hz can be sustained, limited by "
+	      << _limitingFactorName(prediction.limiting_factor);
+      if(m_strict_plan_check)
+	throw LIMA_HW_EXC(InvalidValue,message.str());
+      DEB_WARNING() << message.str();
+    }
+}
@@ -0,0 +1,250 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaThreadPolicy.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+ThreadPolicy::ThreadPolicy() :
+  priority(0)
+{
+}
+
+ThreadState::ThreadState() :
+  tid(0),
+  fifo(false),
+  priority(0),
+  degraded(false)
+{
+}
+
+CallbackStatus::CallbackStatus() :
+  nb_frames(0),
+  last_duration(0.),
+  mean_duration(0.),
+  max_duration(0.)
+{
+}
+
+void lima::Prosilica::parseCpuList(const std::string& list,std::vector<int>& cpus)
+{
+  DEB_STATIC_FUNCT();
+
+  cpus.clear();
+  std::istringstream is(list);
+  std::string item;
+  while(std::getline(is,item,','))
+    {
+      if(item.find_first_not_of(" \t") == std::string::npos)
+	continue;
+      char* end;
+      long first = strtol(item.c_str(),&end,10);
+      long last = first;
+      if(*end == '-')
+	last = strtol(end + 1,&end,10);
+      while(*end == ' ' || *end == '\t')
+	++end;
+      if(*end || first < 0 || last < first || last >= CPU_SETSIZE)
+	{
+	  DEB_ERROR() << "Bad cpu list: " << DEB_VAR1(list);
+	  throw LIMA_HW_EXC(InvalidValue,"Bad cpu list");
+	}
+      for(long cpu = first;cpu <= last;++cpu)
+	cpus.push_back(int(cpu));
+    }
+}
+
+std::string lima::Prosilica::formatCpuList(const std::vector<int>& cpus)
+{
+  std::ostringstream os;
+  for(size_t i = 0;i < cpus.size();)
+    {
+      size_t j = i;
+      while(j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+	++j;
+      if(i)
+	os << ',';
+      os << cpus[i];
+      if(j > i)
+	os << '-' << cpus[j];
+      i = j + 1;
+    }
+  return os.str();
+}
+
+ThreadPolicyControl::ThreadPolicyControl(const std::string& name) :
+  m_name(name),
+  m_generation(0)
+{
+  DEB_CONSTRUCTOR();
+}
+
+void ThreadPolicyControl::set(const ThreadPolicy& policy)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR3(m_name,formatCpuList(policy.cpus),policy.priority);
+
+  for(std::vector<int>::const_iterator i = policy.cpus.begin();
+      i != policy.cpus.end();++i)
+    if(*i < 0 || *i >= CPU_SETSIZE)
+      throw LIMA_HW_EXC(InvalidValue,"Bad cpu number");
+  if(policy.priority < 0 || policy.priority > sched_get_priority_max(SCHED_FIFO))
+    throw LIMA_HW_EXC(InvalidValue,"Bad SCHED_FIFO priority");
+
+  AutoMutex lock(m_lock);
+  m_policy = policy;
+  ++m_generation;
+}
+
+void ThreadPolicyControl::get(ThreadPolicy& policy) const
+{
+  AutoMutex lock(m_lock);
+  policy = m_policy;
+}
+
+//-----------------------------------------------------
+// @brief apply the policy to the calling thread if it changed,
+// a new thread (applied_generation -1) is registered in the states
+//-----------------------------------------------------
+void ThreadPolicyControl::update(int& applied_generation)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!changed(applied_generation))
+    return;
+
+  AutoMutex lock(m_lock);
+  ThreadPolicy policy = m_policy;
+  int generation = m_generation;
+  lock.unlock();
+
+  ThreadState state;
+  state.name = m_name;
+  state.tid = int(syscall(SYS_gettid));
+  // generation 0: no policy set, the thread is left as it is
+  if(generation)
+    _apply(policy,state);
+  _read(state);
+  if(generation)
+    {
+      // a cpuset may silently narrow the affinity
+      std::vector<int> cpus = policy.cpus;
+      std::sort(cpus.begin(),cpus.end());
+      cpus.erase(std::unique(cpus.begin(),cpus.end()),cpus.end());
+      if(!cpus.empty() && cpus != state.cpus)
+	state.degraded = true;
+      if(state.fifo != (policy.priority > 0))
+	state.degraded = true;
+    }
+  applied_generation = generation;
+
+  lock.lock();
+  m_states[state.tid] = state;
+}
+
+void ThreadPolicyControl::release()
+{
+  AutoMutex lock(m_lock);
+  m_states.erase(int(syscall(SYS_gettid)));
+}
+
+void ThreadPolicyControl::getStates(std::vector<ThreadState>& states) const
+{
+  AutoMutex lock(m_lock);
+  for(std::map<int,ThreadState>::const_iterator i = m_states.begin();
+      i != m_states.end();++i)
+    states.push_back(i->second);
+}
+
+void ThreadPolicyControl::_apply(const ThreadPolicy& policy,ThreadState& state)
+{
+  DEB_MEMBER_FUNCT();
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if(policy.cpus.empty())
+    {
+      long nb_cpus = sysconf(_SC_NPROCESSORS_CONF);
+      for(long cpu = 0;cpu < nb_cpus && cpu < CPU_SETSIZE;++cpu)
+	CPU_SET(cpu,&cpu_set);
+    }
+  else
+    for(std::vector<int>::const_iterator i = policy.cpus.begin();
+	i != policy.cpus.end();++i)
+      CPU_SET(*i,&cpu_set);
+  int error = pthread_setaffinity_np(pthread_self(),sizeof(cpu_set),&cpu_set);
+  if(error)
+    {
+      DEB_WARNING() << m_name << " thread " << state.tid << ": can't set cpu affinity "
+		    << formatCpuList(policy.cpus) << ": " << strerror(error);
+      state.degraded = true;
+    }
+
+  struct sched_param param;
+  memset(&param,0,sizeof(param));
+  param.sched_priority = policy.priority;
+  error = pthread_setschedparam(pthread_self(),
+				policy.priority ? SCHED_FIFO : SCHED_OTHER,&param);
+  if(error)
+    {
+      // EPERM without CAP_SYS_NICE, keep the normal scheduling
+      DEB_WARNING() << m_name << " thread " << state.tid
+		    << ": can't set SCHED_FIFO priority " << policy.priority
+		    << ": " << strerror(error);
+      state.degraded = true;
+    }
+}
+
+void ThreadPolicyControl::_read(ThreadState& state)
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  state.cpus.clear();
+  if(!pthread_getaffinity_np(pthread_self(),sizeof(cpu_set),&cpu_set))
+    for(int cpu = 0;cpu < CPU_SETSIZE;++cpu)
+      if(CPU_ISSET(cpu,&cpu_set))
+	state.cpus.push_back(cpu);
+
+  int sched_policy;
+  struct sched_param param;
+  if(!pthread_getschedparam(pthread_self(),&sched_policy,&param))
+    {
+      state.fifo = sched_policy == SCHED_FIFO;
+      state.priority = state.fifo ? param.sched_priority : 0;
+    }
+}
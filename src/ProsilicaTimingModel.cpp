@@ -0,0 +1,234 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#include <cmath>
+#include <algorithm>
+
+#include "lima/Exceptions.h"
+
+#include "ProsilicaTimingModel.h"
+#include "ProsilicaCamera.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+static const double MODEL_TOLERANCE = 0.02;
+
+TimingModel::TimingModel(Camera* cam) :
+  m_cam(cam),
+  m_handle(cam->getHandle()),
+  m_calibrated(false),
+  m_offset(0.),
+  m_row_time(0.),
+  m_shift_time(0.),
+  m_byte_time(0.),
+  m_min_frame_rate(0.),
+  m_min_exposure(0.),
+  m_max_exposure(0.)
+{
+  DEB_CONSTRUCTOR();
+}
+
+double TimingModel::_cameraPeriod()
+{
+  DEB_MEMBER_FUNCT();
+
+  tPvFloat32 min_framerate,max_framerate;
+  tPvErr error = PvAttrRangeFloat32(m_handle,"FrameRate",&min_framerate,&max_framerate);
+  if(error || max_framerate <= 0.)
+    throw LIMA_HW_EXC(Error,"Can't get  FramRate range");
+  m_min_frame_rate = min_framerate;
+  return 1. / max_framerate;
+}
+
+//-----------------------------------------------------
+// @brief fit the model from a few camera queries at the min exposure.
+// roi, binning, pixel format, exposure and stream bandwidth are
+// restored afterwards, also on error. Without a 16 bit format, or if
+// the 16 bit frame rate is bound by the stream bandwidth, the model has
+// no pixel format term
+//-----------------------------------------------------
+void TimingModel::calibrate()
+{
+  DEB_MEMBER_FUNCT();
+
+  tPvUint32 max_width,max_height;
+  m_cam->getMaxWidthHeight(max_width,max_height);
+
+  tPvUint32 region_x,region_y,width,height,bin_x,bin_y;
+  PvAttrUint32Get(m_handle,"RegionX",&region_x);
+  PvAttrUint32Get(m_handle,"RegionY",&region_y);
+  PvAttrUint32Get(m_handle,"Width",&width);
+  PvAttrUint32Get(m_handle,"Height",&height);
+  PvAttrUint32Get(m_handle,"BinningX",&bin_x);
+  PvAttrUint32Get(m_handle,"BinningY",&bin_y);
+  char format[32];
+  unsigned long psize;
+  PvAttrEnumGet(m_handle,"PixelFormat",format,sizeof(format),&psize);
+  tPvUint32 exposure,stream_bandwidth = 0;
+  PvAttrUint32Get(m_handle,"ExposureValue",&exposure);
+  PvAttrUint32Get(m_handle,"StreamBytesPerSecond",&stream_bandwidth);
+
+  tPvUint32 min_exp,max_exp;
+  tPvErr error = PvAttrRangeUint32(m_handle,"ExposureValue",&min_exp,&max_exp);
+  if(error)
+    throw LIMA_HW_EXC(Error,"Can't get  Exposure range");
+  m_min_exposure = min_exp / 1e6;
+  m_max_exposure = max_exp / 1e6;
+
+  int full_rows = max_height;
+  int half_rows = max_height / 2;
+  double full_period,half_period;
+  double binned_period = -1.;
+  double wide_period = -1.;
+  try
+    {
+      // a longer exposure than the readout would bound all the samples
+      PvAttrUint32Set(m_handle,"ExposureValue",min_exp);
+      // the smallest pixel format keeps the stream bandwidth out of the fit
+      PvAttrEnumSet(m_handle,"PixelFormat",m_cam->isMonochrome() ? "Mono8" : "Bayer8");
+      PvAttrUint32Set(m_handle,"BinningX",1);
+      PvAttrUint32Set(m_handle,"BinningY",1);
+      PvAttrUint32Set(m_handle,"RegionX",0);
+      PvAttrUint32Set(m_handle,"RegionY",0);
+      PvAttrUint32Set(m_handle,"Width",max_width);
+      PvAttrUint32Set(m_handle,"Height",max_height);
+
+      full_period = _cameraPeriod();
+      PvAttrUint32Set(m_handle,"Height",half_rows);
+      half_period = _cameraPeriod();
+
+      tPvUint32 min_bin,max_bin;
+      if(!PvAttrRangeUint32(m_handle,"BinningY",&min_bin,&max_bin) && max_bin >= 2 &&
+	 !PvAttrUint32Set(m_handle,"BinningY",2))
+	{
+	  binned_period = _cameraPeriod();
+	  PvAttrUint32Set(m_handle,"BinningY",1);
+	}
+
+      // the extra byte of a 16 bit pixel gives the pixel format term,
+      // with all the link bandwidth for the stream
+      tPvUint32 min_bandwidth,max_bandwidth;
+      if(!PvAttrRangeUint32(m_handle,"StreamBytesPerSecond",&min_bandwidth,&max_bandwidth))
+	PvAttrUint32Set(m_handle,"StreamBytesPerSecond",max_bandwidth);
+      else
+	max_bandwidth = 0;
+      tPvUint32 frame_size;
+      if(!PvAttrEnumSet(m_handle,"PixelFormat",m_cam->isMonochrome() ? "Mono16" : "Bayer16"))
+	{
+	  wide_period = _cameraPeriod();
+	  // at the stream bandwidth, the sample doesn't tell the readout
+	  if(max_bandwidth &&
+	     !PvAttrUint32Get(m_handle,"TotalBytesPerFrame",&frame_size) &&
+	     wide_period <= double(frame_size) / max_bandwidth * (1. + MODEL_TOLERANCE))
+	    {
+	      DEB_TRACE() << "16 bit frame rate bound by the stream: " << DEB_VAR1(wide_period);
+	      wide_period = -1.;
+	    }
+	}
+    }
+  catch(Exception&)
+    {
+      _restoreSettings(region_x,region_y,width,height,bin_x,bin_y,format,
+		       exposure,stream_bandwidth);
+      throw;
+    }
+  _restoreSettings(region_x,region_y,width,height,bin_x,bin_y,format,
+		   exposure,stream_bandwidth);
+
+  double sensor_row_time = 0.;
+  if(full_rows > half_rows)
+    sensor_row_time = std::max(0.,(full_period - half_period) / (full_rows - half_rows));
+  m_offset = std::max(0.,full_period - sensor_row_time * full_rows);
+  if(binned_period > 0. && half_rows)
+    m_shift_time = std::min(sensor_row_time,
+			    std::max(0.,(binned_period - half_period) / half_rows));
+  else
+    m_shift_time = 0.;
+  m_row_time = sensor_row_time - m_shift_time;
+  if(wide_period > 0. && half_rows)
+    m_byte_time = std::max(0.,(wide_period - half_period) /
+			   (double(max_width) * half_rows));
+  else
+    m_byte_time = 0.;
+  m_calibrated = true;
+
+  DEB_TRACE() << DEB_VAR4(full_period,half_period,binned_period,wide_period);
+  DEB_RETURN() << DEB_VAR4(m_offset,m_row_time,m_shift_time,m_byte_time);
+}
+
+void TimingModel::_restoreSettings(tPvUint32 region_x,tPvUint32 region_y,
+				   tPvUint32 width,tPvUint32 height,
+				   tPvUint32 bin_x,tPvUint32 bin_y,const char* format,
+				   tPvUint32 exposure,tPvUint32 stream_bandwidth)
+{
+  PvAttrUint32Set(m_handle,"BinningX",bin_x);
+  PvAttrUint32Set(m_handle,"BinningY",bin_y);
+  PvAttrUint32Set(m_handle,"RegionX",region_x);
+  PvAttrUint32Set(m_handle,"RegionY",region_y);
+  PvAttrUint32Set(m_handle,"Width",width);
+  PvAttrUint32Set(m_handle,"Height",height);
+  PvAttrEnumSet(m_handle,"PixelFormat",format);
+  PvAttrUint32Set(m_handle,"ExposureValue",exposure);
+  if(stream_bandwidth)
+    PvAttrUint32Set(m_handle,"StreamBytesPerSecond",stream_bandwidth);
+}
+
+double TimingModel::readoutTime(int width,int height,const Bin& bin,
+				int bytes_per_pixel) const
+{
+  return m_offset + m_row_time * height + m_shift_time * height * bin.getY() +
+    m_byte_time * double(width) * height * (bytes_per_pixel - 1);
+}
+
+//-----------------------------------------------------
+// @brief compare the model with the camera for the current settings,
+// the offset is corrected when they disagree
+// @return true if the model was within tolerance
+//-----------------------------------------------------
+bool TimingModel::check(int width,int height,const Bin& bin,int bytes_per_pixel)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR4(width,height,bin,bytes_per_pixel);
+
+  double camera_period = _cameraPeriod();
+  // a period bound by the exposure doesn't tell the readout
+  tPvUint32 exposure;
+  if(!PvAttrUint32Get(m_handle,"ExposureValue",&exposure) &&
+     exposure / 1e6 >= camera_period * (1. - MODEL_TOLERANCE))
+    {
+      DEB_TRACE() << "Period bound by the exposure: " << DEB_VAR1(camera_period);
+      return true;
+    }
+  double model_period = readoutTime(width,height,bin,bytes_per_pixel);
+  bool ok = fabs(model_period - camera_period) <= MODEL_TOLERANCE * camera_period;
+  if(!ok)
+    {
+      DEB_WARNING() << "Timing model off: " << DEB_VAR2(model_period,camera_period);
+      m_offset = std::max(0.,m_offset + camera_period - model_period);
+    }
+
+  DEB_RETURN() << DEB_VAR1(ok);
+  return ok;
+}
@@ -91,9 +91,22 @@ void VideoCtrlObj::getGain(double &aGain) const
   m_cam->getGain(aGain);
 }
 
+//-----------------------------------------------------
+// @brief the colour frames can't be binned, the Mono ones are by the
+// camera and in software like the BinCtrlObj does
+//-----------------------------------------------------
 void VideoCtrlObj::checkBin(Bin& bin)
 {
-  bin = Bin(1,1);		// Do not manage Hw Bin
+  VideoMode mode = m_cam->getVideoMode();
+  if(mode == Y8 || mode == Y16)
+    m_cam->checkBin(bin);
+  else
+    bin = Bin(1,1);
+}
+
+void VideoCtrlObj::setBin(const Bin& bin)
+{
+  m_cam->setBin(bin);
 }
 
 void VideoCtrlObj::checkRoi(const Roi&, Roi& hw_roi)
@@ -102,5 +115,7 @@ void VideoCtrlObj::checkRoi(const Roi&, Roi& hw_roi)
   tPvErr error = PvAttrUint32Get(m_handle,"Width",&width);
   error = PvAttrUint32Get(m_handle,"Height",&height);
 
-  hw_roi = Roi(0,0,width,height); // Do not manage Hw Roi
+  Bin sw_bin;
+  m_cam->getSoftwareBin(sw_bin);
+  hw_roi = Roi(0,0,width / sw_bin.getX(),height / sw_bin.getY()); // Do not manage Hw Roi
 }
@@ -0,0 +1,165 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2024
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// Contact: lima@esrf.fr
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+#include <unistd.h>
+#include <algorithm>
+
+#include "ProsilicaWorkerPool.h"
+
+using namespace lima;
+using namespace lima::Prosilica;
+
+class WorkerPool::_Worker : public Thread
+{
+public:
+  _Worker(WorkerPool& pool) : m_pool(pool) {}
+protected:
+  virtual void threadFunction() {m_pool._run();}
+private:
+  WorkerPool&	m_pool;
+};
+
+WorkerPool::WorkerPool(int nb_threads,ThreadPolicyControl* policy) :
+  m_policy(policy),
+  m_nb_threads(nb_threads),
+  m_func(NULL),
+  m_nb(0),
+  m_next(0),
+  m_nb_tickets(0),
+  m_nb_busy(0),
+  m_nb_running(0),
+  m_quit(false)
+{
+  DEB_CONSTRUCTOR();
+
+  if(m_nb_threads <= 0)
+    m_nb_threads = int(std::max(0L,sysconf(_SC_NPROCESSORS_ONLN) - 1));
+  DEB_PARAM() << DEB_VAR1(m_nb_threads);
+}
+
+WorkerPool::~WorkerPool()
+{
+  DEB_DESTRUCTOR();
+
+  AutoMutex lock(m_cond.mutex());
+  m_quit = true;
+  m_cond.broadcast();
+  while(m_nb_running)
+    m_cond.wait();
+  lock.unlock();
+
+  for(std::vector<_Worker*>::iterator i = m_workers.begin();
+      i != m_workers.end();++i)
+    delete *i;
+}
+
+void WorkerPool::parallelFor(int nb,const std::function<void(int)>& func)
+{
+  if(nb <= 0)
+    return;
+  // the calling thread takes one of the items
+  int nb_workers = std::min(nb - 1,m_nb_threads);
+  if(nb_workers <= 0)
+    {
+      for(int i = 0;i < nb;++i)
+	func(i);
+      return;
+    }
+
+  AutoMutex call_lock(m_call_lock);
+  AutoMutex lock(m_cond.mutex());
+  while(int(m_workers.size()) < nb_workers)
+    {
+      _Worker* worker = new _Worker(*this);
+      m_workers.push_back(worker);
+      ++m_nb_running;
+      worker->start();
+    }
+  m_func = &func;
+  m_nb = nb;
+  m_next = 0;
+  // each ticket is taken by one worker, the others keep sleeping
+  m_nb_tickets = m_nb_busy = nb_workers;
+  if(nb_workers == int(m_workers.size()))
+    m_cond.broadcast();
+  else
+    for(int i = 0;i < nb_workers;++i)
+      m_cond.signal();
+  lock.unlock();
+
+  _work();
+
+  lock.lock();
+  while(m_nb_busy)
+    m_cond.wait();
+  m_func = NULL;
+}
+
+void WorkerPool::applyThreadPolicy()
+{
+  AutoMutex lock(m_cond.mutex());
+  m_cond.broadcast();
+}
+
+void WorkerPool::_work()
+{
+  for(int i = m_next++;i < m_nb;i = m_next++)
+    (*m_func)(i);
+}
+
+void WorkerPool::_run()
+{
+  AutoMutex lock(m_cond.mutex());
+  int policy_generation = -1;
+  while(!m_quit)
+    {
+      if(m_policy && m_policy->changed(policy_generation))
+	{
+	  lock.unlock();
+	  m_policy->update(policy_generation);
+	  lock.lock();
+	  continue;
+	}
+      if(!m_nb_tickets)
+	{
+	  m_cond.wait();
+	  continue;
+	}
+      --m_nb_tickets;
+      lock.unlock();
+      _work();
+      lock.lock();
+      if(!--m_nb_busy)
+	m_cond.broadcast();
+    }
+  if(m_policy)
+    {
+      lock.unlock();
+      m_policy->release();
+      lock.lock();
+    }
+  --m_nb_running;
+  m_cond.broadcast();
+}
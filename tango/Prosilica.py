@@ -41,12 +41,34 @@
 #         (c) - Bliss - ESRF
 #=============================================================================
 #
+import numpy
 import PyTango
 from Lima import Core
 from Lima import Prosilica as ProsilicaAcq
 from Lima.Server import AttrHelper
 
 
+# "0,2-3" <-> [0, 2, 3]
+def _parse_cpus(cpus):
+    result = []
+    for item in cpus.split(','):
+        item = item.strip()
+        if not item:
+            continue
+        first, _, last = item.partition('-')
+        result.extend(range(int(first), int(last or first) + 1))
+    return result
+
+def _format_cpus(cpus):
+    ranges = []
+    for cpu in cpus:
+        if ranges and ranges[-1][1] == cpu - 1:
+            ranges[-1][1] = cpu
+        else:
+            ranges.append([cpu, cpu])
+    return ','.join(str(f) if f == l else '%d-%d' % (f, l) for f, l in ranges)
+
+
 class Prosilica(PyTango.Device_4Impl):
 
     Core.DEB_CLASS(Core.DebModApplication, 'LimaCCDs')
@@ -58,6 +80,19 @@ class Prosilica(PyTango.Device_4Impl):
     def __init__(self,*args) :
         PyTango.Device_4Impl.__init__(self,*args)
 
+        self.__OverrunPolicy = {'STOP': ProsilicaAcq.OverrunStop,
+                                'DROP': ProsilicaAcq.OverrunDrop,
+                                'DECIMATE': ProsilicaAcq.OverrunDecimate}
+        self.__HistoryTrigger = {'SOFTWARE': ProsilicaAcq.HistorySoftware,
+                                 'SYNCIN1': ProsilicaAcq.HistorySyncIn1,
+                                 'SYNCIN2': ProsilicaAcq.HistorySyncIn2}
+        self.__SoftwareBinMode = {'SUM': ProsilicaAcq.SoftwareBinSum,
+                                  'MEAN': ProsilicaAcq.SoftwareBinMean}
+        self.__CompressionCodec = {
+            'BSHUF_RLE': ProsilicaAcq.FrameCompressor.BitshuffleRle,
+            'BSHUF_LZ4': ProsilicaAcq.FrameCompressor.BitshuffleLz4,
+            'BSHUF_ZSTD': ProsilicaAcq.FrameCompressor.BitshuffleZstd}
+
         self.init_device()
 
 #------------------------------------------------------------------
@@ -78,6 +113,537 @@ class Prosilica(PyTango.Device_4Impl):
     def getAttrStringValueList(self, attr_name):
         return AttrHelper.get_attr_string_value_list(self, attr_name)
 
+    @Core.DEB_MEMBER_FUNCT
+    def autoTuneStream(self, nb_frames):
+        best = _ProsilicaCam.autoTuneStream(nb_frames)
+        return best.packet_size
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_acq_prediction(self, attr):
+        plan = _ProsilicaCam.getAcqPlan()
+        prediction = _ProsilicaCam.predictAcq(plan)
+        attr.set_value([prediction.frame_rate,
+                        prediction.requested_frame_rate,
+                        prediction.link_utilisation,
+                        prediction.data_rate,
+                        prediction.buffer_memory])
+
+    @Core.DEB_MEMBER_FUNCT
+    def triggerHistory(self):
+        _ProsilicaCam.triggerHistory()
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_history(self, attr):
+        attr.set_value(list(_ProsilicaCam.getHistory()))
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_history(self, attr):
+        pre_frames, post_frames = attr.get_write_value()
+        _ProsilicaCam.setHistory(pre_frames, post_frames)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_statistics_active(self, attr):
+        attr.set_value(_ProsilicaCam.getRoiStatistics().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_statistics_active(self, attr):
+        _ProsilicaCam.getRoiStatistics().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_statistics_rois(self, attr):
+        statistics = _ProsilicaCam.getRoiStatistics()
+        rois = []
+        for roi_id in range(statistics.getNbRois()):
+            roi = statistics.getRoi(roi_id)
+            top_left = roi.getTopLeft()
+            size = roi.getSize()
+            rois += [top_left.x, top_left.y, size.getWidth(), size.getHeight()]
+        attr.set_value(rois)
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_statistics_rois(self, attr):
+        values = attr.get_write_value()
+        statistics = _ProsilicaCam.getRoiStatistics()
+        statistics.clearRois()
+        for i in range(0, len(values) - 3, 4):
+            statistics.addRoi(Core.Roi(*values[i:i + 4]))
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_statistics(self, attr):
+        statistics = _ProsilicaCam.getRoiStatistics()
+        values = []
+        for roi_id in range(statistics.getNbRois()):
+            found, result = statistics.getLastResult(roi_id)
+            values.append(self.__statisticsValues(result))
+        attr.set_value(values)
+
+    @Core.DEB_MEMBER_FUNCT
+    def getStatisticsHistory(self, argin):
+        roi_id, nb = argin
+        values = []
+        for result in _ProsilicaCam.getRoiStatistics().getHistory(roi_id, nb):
+            values += self.__statisticsValues(result)
+        return values
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_profiles_active(self, attr):
+        attr.set_value(_ProsilicaCam.getProjectionProfiles().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_profiles_active(self, attr):
+        _ProsilicaCam.getProjectionProfiles().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_profile_cols(self, attr):
+        found, record = _ProsilicaCam.getProjectionProfiles().getLastProfile()
+        attr.set_value(record.cols)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_profile_rows(self, attr):
+        found, record = _ProsilicaCam.getProjectionProfiles().getLastProfile()
+        attr.set_value(record.rows)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_flat_field_active(self, attr):
+        attr.set_value(_ProsilicaCam.getFlatFieldCorrection().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_flat_field_active(self, attr):
+        _ProsilicaCam.getFlatFieldCorrection().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def acquireDark(self, nb_frames):
+        _ProsilicaCam.getFlatFieldCorrection().acquireDark(nb_frames)
+
+    @Core.DEB_MEMBER_FUNCT
+    def acquireFlat(self, nb_frames):
+        _ProsilicaCam.getFlatFieldCorrection().acquireFlat(nb_frames)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_bad_pixels_active(self, attr):
+        attr.set_value(_ProsilicaCam.getBadPixelCorrection().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_bad_pixels_active(self, attr):
+        _ProsilicaCam.getBadPixelCorrection().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_nb_bad_pixels(self, attr):
+        attr.set_value(_ProsilicaCam.getBadPixelCorrection().getNbDefects())
+
+    @Core.DEB_MEMBER_FUNCT
+    def addBadPixels(self, argin):
+        bad_pixels = _ProsilicaCam.getBadPixelCorrection()
+        for i in range(0, len(argin) - 1, 2):
+            bad_pixels.addDefect(argin[i], argin[i + 1])
+
+    @Core.DEB_MEMBER_FUNCT
+    def clearBadPixels(self):
+        _ProsilicaCam.getBadPixelCorrection().clearDefects()
+
+    @Core.DEB_MEMBER_FUNCT
+    def detectBadPixels(self, argin):
+        hot_sigma, dead_ratio = argin
+        return _ProsilicaCam.getBadPixelCorrection().detect(
+            _ProsilicaCam.getFlatFieldCorrection(), hot_sigma, dead_ratio)
+
+    @staticmethod
+    def __statisticsValues(result):
+        return [result.frame_nb, result.timestamp, result.sum, result.max,
+                result.centroid_x, result.centroid_y, result.rms_x, result.rms_y]
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_shm_active(self, attr):
+        attr.set_value(_ProsilicaCam.getShmPublisher().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_shm_active(self, attr):
+        _ProsilicaCam.getShmPublisher().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_shm_name(self, attr):
+        attr.set_value(_ProsilicaCam.getShmPublisher().getName())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_shm_name(self, attr):
+        _ProsilicaCam.getShmPublisher().setName(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_shm_nb_slots(self, attr):
+        attr.set_value(_ProsilicaCam.getShmPublisher().getNbSlots())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_shm_nb_slots(self, attr):
+        _ProsilicaCam.getShmPublisher().setNbSlots(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_shm_nb_published(self, attr):
+        attr.set_value(_ProsilicaCam.getShmPublisher().getNbPublished())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_compression_active(self, attr):
+        attr.set_value(_ProsilicaCam.getFrameCompressor().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_compression_active(self, attr):
+        _ProsilicaCam.getFrameCompressor().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_compression_codec(self, attr):
+        codec = _ProsilicaCam.getFrameCompressor().getCodec()
+        for name, value in self.__CompressionCodec.items():
+            if value == codec:
+                attr.set_value(name)
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_compression_codec(self, attr):
+        codec = self.__CompressionCodec[attr.get_write_value().upper()]
+        _ProsilicaCam.getFrameCompressor().setCodec(codec)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_compression_level(self, attr):
+        attr.set_value(_ProsilicaCam.getFrameCompressor().getLevel())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_compression_level(self, attr):
+        _ProsilicaCam.getFrameCompressor().setLevel(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_compression_status(self, attr):
+        status = _ProsilicaCam.getFrameCompressor().getStatus()
+        attr.set_value([status.nb_frames, status.ratio, status.last_ratio,
+                        status.throughput_per_core, status.last_duration])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_pipeline_active(self, attr):
+        attr.set_value(_ProsilicaCam.getFramePipeline().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_pipeline_active(self, attr):
+        _ProsilicaCam.getFramePipeline().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_pipeline_threads(self, attr):
+        attr.set_value(_ProsilicaCam.getFramePipeline().getNbThreads())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_pipeline_threads(self, attr):
+        _ProsilicaCam.getFramePipeline().setNbThreads(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_pipeline_depth(self, attr):
+        attr.set_value(_ProsilicaCam.getFramePipeline().getDepth())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_pipeline_depth(self, attr):
+        _ProsilicaCam.getFramePipeline().setDepth(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_pipeline_status(self, attr):
+        status = _ProsilicaCam.getFramePipeline().getStatus()
+        attr.set_value([status.nb_frames, status.in_flight, status.max_in_flight,
+                        status.nb_stalls, status.stall_time,
+                        status.last_latency, status.mean_latency, status.max_latency])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_pipeline_stages(self, attr):
+        stages = []
+        for status in _ProsilicaCam.getFramePipeline().getStageStatus():
+            stages.append('%s %s frames %d mean %g s max %g s' %
+                          (status.name, 'parallel' if status.parallel else 'serial',
+                           status.nb_frames, status.mean_duration, status.max_duration))
+        attr.set_value(stages)
+
+    @Core.DEB_MEMBER_FUNCT
+    def startRecording(self, path):
+        _ProsilicaCam.getFrameRecorder().start(path)
+
+    @Core.DEB_MEMBER_FUNCT
+    def stopRecording(self):
+        _ProsilicaCam.getFrameRecorder().stop()
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_recording_status(self, attr):
+        recorder = _ProsilicaCam.getFrameRecorder()
+        attr.set_value([recorder.getNbRecorded(), recorder.getNbDropped()])
+
+    @Core.DEB_MEMBER_FUNCT
+    def startReplay(self, path):
+        _ProsilicaCam.getFrameReplayer().open(path)
+
+    @Core.DEB_MEMBER_FUNCT
+    def stopReplay(self):
+        _ProsilicaCam.getFrameReplayer().close()
+
+    @Core.DEB_MEMBER_FUNCT
+    def benchmarkKernels(self, argin):
+        width, height, nb_iterations = argin
+        results = []
+        for result in ProsilicaAcq.benchmarkKernels(width, height, nb_iterations):
+            results.append('%s generic %g s specialised %g s' %
+                           (result.name, result.generic_time, result.specialised_time))
+        return results
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_replay_speed(self, attr):
+        attr.set_value(_ProsilicaCam.getFrameReplayer().getSpeed())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_replay_speed(self, attr):
+        _ProsilicaCam.getFrameReplayer().setSpeed(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_replay_loop(self, attr):
+        attr.set_value(_ProsilicaCam.getFrameReplayer().getLoop())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_replay_loop(self, attr):
+        _ProsilicaCam.getFrameReplayer().setLoop(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_replay_status(self, attr):
+        replayer = _ProsilicaCam.getFrameReplayer()
+        attr.set_value([replayer.getNbFrames(), replayer.getNbReplayed()])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_clock_sync(self, attr):
+        attr.set_value(_ProsilicaCam.getClockSync().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_clock_sync(self, attr):
+        _ProsilicaCam.getClockSync().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_clock_sync_period(self, attr):
+        attr.set_value(_ProsilicaCam.getClockSync().getPeriod())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_clock_sync_period(self, attr):
+        _ProsilicaCam.getClockSync().setPeriod(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_clock_sync_window(self, attr):
+        attr.set_value(_ProsilicaCam.getClockSync().getWindow())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_clock_sync_window(self, attr):
+        _ProsilicaCam.getClockSync().setWindow(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_clock_sync_status(self, attr):
+        status = _ProsilicaCam.getClockSync().getStatus()
+        attr.set_value([status.nb_samples, status.nb_rejected, status.frequency,
+                        status.drift, status.rms_residual, status.max_residual,
+                        status.prediction_error, status.round_trip])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_callback_cpus(self, attr):
+        attr.set_value(_format_cpus(_ProsilicaCam.getCallbackThreadPolicy().cpus))
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_callback_cpus(self, attr):
+        policy = _ProsilicaCam.getCallbackThreadPolicy()
+        policy.cpus = _parse_cpus(attr.get_write_value())
+        _ProsilicaCam.setCallbackThreadPolicy(policy)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_callback_priority(self, attr):
+        attr.set_value(_ProsilicaCam.getCallbackThreadPolicy().priority)
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_callback_priority(self, attr):
+        policy = _ProsilicaCam.getCallbackThreadPolicy()
+        policy.priority = attr.get_write_value()
+        _ProsilicaCam.setCallbackThreadPolicy(policy)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_worker_cpus(self, attr):
+        attr.set_value(_format_cpus(_ProsilicaCam.getWorkerThreadPolicy().cpus))
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_worker_cpus(self, attr):
+        policy = _ProsilicaCam.getWorkerThreadPolicy()
+        policy.cpus = _parse_cpus(attr.get_write_value())
+        _ProsilicaCam.setWorkerThreadPolicy(policy)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_worker_priority(self, attr):
+        attr.set_value(_ProsilicaCam.getWorkerThreadPolicy().priority)
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_worker_priority(self, attr):
+        policy = _ProsilicaCam.getWorkerThreadPolicy()
+        policy.priority = attr.get_write_value()
+        _ProsilicaCam.setWorkerThreadPolicy(policy)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_thread_status(self, attr):
+        status = []
+        for state in _ProsilicaCam.getThreadStates():
+            status.append('%s %d cpus %s %s%s' %
+                          (state.name, state.tid, _format_cpus(state.cpus),
+                           'SCHED_FIFO %d' % state.priority if state.fifo else 'SCHED_OTHER',
+                           ' (degraded)' if state.degraded else ''))
+        attr.set_value(status)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_callback_duration(self, attr):
+        status = _ProsilicaCam.getCallbackStatus()
+        attr.set_value([status.last_duration, status.mean_duration, status.max_duration])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_stream_active(self, attr):
+        attr.set_value(_ProsilicaCam.getStreamWriter().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_stream_active(self, attr):
+        _ProsilicaCam.getStreamWriter().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_stream_directory(self, attr):
+        attr.set_value(_ProsilicaCam.getStreamWriter().getDirectory())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_stream_directory(self, attr):
+        _ProsilicaCam.getStreamWriter().setDirectory(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_stream_prefix(self, attr):
+        attr.set_value(_ProsilicaCam.getStreamWriter().getPrefix())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_stream_prefix(self, attr):
+        _ProsilicaCam.getStreamWriter().setPrefix(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_stream_frames_per_file(self, attr):
+        attr.set_value(_ProsilicaCam.getStreamWriter().getFramesPerFile())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_stream_frames_per_file(self, attr):
+        _ProsilicaCam.getStreamWriter().setFramesPerFile(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_stream_nb_buffers(self, attr):
+        attr.set_value(_ProsilicaCam.getStreamWriter().getNbBuffers())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_stream_nb_buffers(self, attr):
+        _ProsilicaCam.getStreamWriter().setNbBuffers(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_stream_status(self, attr):
+        status = _ProsilicaCam.getStreamWriter().getStatus()
+        attr.set_value([status.nb_written, status.nb_dropped, status.nb_errors,
+                        status.queue_depth, status.max_queue_depth,
+                        status.last_latency, status.mean_latency, status.max_latency])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_preview_active(self, attr):
+        attr.set_value(_ProsilicaCam.getLivePreview().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_preview_active(self, attr):
+        _ProsilicaCam.getLivePreview().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_preview_max_rate(self, attr):
+        attr.set_value(_ProsilicaCam.getLivePreview().getMaxRate())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_preview_max_rate(self, attr):
+        _ProsilicaCam.getLivePreview().setMaxRate(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_preview_downscale(self, attr):
+        attr.set_value(_ProsilicaCam.getLivePreview().getDownscale())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_preview_downscale(self, attr):
+        _ProsilicaCam.getLivePreview().setDownscale(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_preview(self, attr):
+        found, frame = _ProsilicaCam.getLivePreview().getLatest()
+        if not found or frame.depth not in (1, 2, 4):
+            attr.set_value(numpy.zeros((0, 0), numpy.uint16))
+            return
+        dtype = {1: numpy.uint8, 2: numpy.uint16, 4: numpy.uint32}[frame.depth]
+        image = numpy.frombuffer(frame.data, dtype).reshape(frame.height, frame.width)
+        attr.set_value(numpy.minimum(image, 0xffff).astype(numpy.uint16))
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_pyramid_active(self, attr):
+        attr.set_value(_ProsilicaCam.getPreviewPyramid().isActive())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_pyramid_active(self, attr):
+        _ProsilicaCam.getPreviewPyramid().setActive(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_pyramid_max_rate(self, attr):
+        attr.set_value(_ProsilicaCam.getPreviewPyramid().getMaxRate())
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_pyramid_max_rate(self, attr):
+        _ProsilicaCam.getPreviewPyramid().setMaxRate(attr.get_write_value())
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_pyramid_tone_mapping(self, attr):
+        attr.set_value(list(_ProsilicaCam.getPreviewPyramid().getToneMapping()))
+
+    @Core.DEB_MEMBER_FUNCT
+    def write_pyramid_tone_mapping(self, attr):
+        black, white, gamma = attr.get_write_value()
+        _ProsilicaCam.getPreviewPyramid().setToneMapping(int(black), int(white), gamma)
+
+    def __read_pyramid_level(self, attr, level):
+        found, frame = _ProsilicaCam.getPreviewPyramid().getLevel(level)
+        if not found:
+            attr.set_value(numpy.zeros((0, 0), numpy.uint8))
+            return
+        attr.set_value(numpy.frombuffer(frame.data, numpy.uint8).reshape(frame.height, frame.width))
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_preview_half(self, attr):
+        self.__read_pyramid_level(attr, 1)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_preview_quarter(self, attr):
+        self.__read_pyramid_level(attr, 2)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_preview_eighth(self, attr):
+        self.__read_pyramid_level(attr, 3)
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_accumulation_status(self, attr):
+        status = _ProsilicaCam.getAccumulationStatus()
+        attr.set_value([status.nb_saturated_frames,
+                        status.nb_saturated_pixels,
+                        status.last_saturated_frame])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_software_bin(self, attr):
+        sw_bin = _ProsilicaCam.getSoftwareBin()
+        attr.set_value([sw_bin.getX(), sw_bin.getY()])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_stop_latency(self, attr):
+        last, max_latency = _ProsilicaCam.getStopLatency()
+        attr.set_value([last, max_latency])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_overrun_status(self, attr):
+        status = _ProsilicaCam.getOverrunStatus()
+        attr.set_value([status.capacity,
+                        status.high_water_mark,
+                        status.nb_overruns,
+                        status.nb_dropped,
+                        status.nb_decimated,
+                        status.first_overrun_time,
+                        status.last_overrun_time])
+
     def __getattr__(self,name) :
         return AttrHelper.get_attr_4u(self, name, _ProsilicaCam)
 
@@ -96,6 +662,45 @@ class ProsilicaClass(PyTango.DeviceClass):
         'getAttrStringValueList':
         [[PyTango.DevString, "Attribute name"],
          [PyTango.DevVarStringArray, "Authorized String value list"]],
+        'autoTuneStream':
+        [[PyTango.DevLong, "Number of frames per test acquisition"],
+         [PyTango.DevULong, "Selected packet size"]],
+        'triggerHistory':
+        [[PyTango.DevVoid, ""],
+         [PyTango.DevVoid, ""]],
+        'getStatisticsHistory':
+        [[PyTango.DevVarLongArray, "roi id, nb of results"],
+         [PyTango.DevVarDoubleArray, "8 values per result, older first"]],
+        'acquireDark':
+        [[PyTango.DevLong, "Number of frames averaged"],
+         [PyTango.DevVoid, ""]],
+        'acquireFlat':
+        [[PyTango.DevLong, "Number of frames averaged"],
+         [PyTango.DevVoid, ""]],
+        'addBadPixels':
+        [[PyTango.DevVarLongArray, "x, y sensor coordinates of each defect"],
+         [PyTango.DevVoid, ""]],
+        'clearBadPixels':
+        [[PyTango.DevVoid, ""],
+         [PyTango.DevVoid, ""]],
+        'detectBadPixels':
+        [[PyTango.DevVarDoubleArray, "hot sigma, dead ratio"],
+         [PyTango.DevLong, "Number of defects found"]],
+        'startRecording':
+        [[PyTango.DevString, "Recording file path"],
+         [PyTango.DevVoid, ""]],
+        'stopRecording':
+        [[PyTango.DevVoid, ""],
+         [PyTango.DevVoid, ""]],
+        'startReplay':
+        [[PyTango.DevString, "Recording file path"],
+         [PyTango.DevVoid, ""]],
+        'stopReplay':
+        [[PyTango.DevVoid, ""],
+         [PyTango.DevVoid, ""]],
+        'benchmarkKernels':
+        [[PyTango.DevVarLongArray, "width, height, nb of iterations"],
+         [PyTango.DevVarStringArray, "time per frame of each kernel"]],
         }
 
     attr_list = {
@@ -127,6 +732,678 @@ class ProsilicaClass(PyTango.DeviceClass):
              'format': '',
              'description': 'camera PvApi gain',
          }],
+        'packet_size':
+        [[PyTango.DevULong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'bytes',
+             'format': '',
+             'description': 'GigE stream packet size',
+         }],
+        'strict_plan_check':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'prepare fails if the requested rate cannot be sustained',
+         }],
+        'link_speed':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'bytes/s',
+             'format': '',
+             'description': 'host link speed used by the bandwidth model',
+         }],
+        'nb_queued_frames':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'number of frames queued ahead to the driver',
+         }],
+        'max_batch_size':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'max number of frames notified together',
+         }],
+        'max_batch_latency':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 's',
+             'format': '',
+             'description': 'max delay of a frame waiting in a batch',
+         }],
+        'history':
+        [[PyTango.DevLong,
+          PyTango.SPECTRUM,
+          PyTango.READ_WRITE,
+          2],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'pre and post-trigger frames, 0 0 disables the history mode',
+         }],
+        'history_trigger':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'SOFTWARE, SYNCIN1 or SYNCIN2',
+         }],
+        'shm_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames published in a shared memory ring',
+         }],
+        'shm_name':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'POSIX shm name of the frame ring',
+         }],
+        'shm_nb_slots':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames held by the shared memory ring',
+         }],
+        'shm_nb_published':
+        [[PyTango.DevLong64,
+          PyTango.SCALAR,
+          PyTango.READ],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames published since the ring was created',
+         }],
+        'compression_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'lossless compression of the frames',
+         }],
+        'compression_codec':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'BSHUF_RLE, BSHUF_LZ4 or BSHUF_ZSTD',
+         }],
+        'compression_level':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'zstd level or LZ4 acceleration',
+         }],
+        'compression_status':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          5],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames, ratio, last ratio, bytes/s per core, last duration',
+         }],
+        'pipeline_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frame processors run out of the callback thread',
+         }],
+        'pipeline_threads':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'pipeline threads, 0: half the cpus',
+         }],
+        'pipeline_depth':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'max frames in the pipeline',
+         }],
+        'pipeline_status':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          8],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'delivered, in flight, max in flight, stalls, stall time, last, mean and max latency',
+         }],
+        'pipeline_stages':
+        [[PyTango.DevString,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          8],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames and mean, max duration of each stage',
+         }],
+        'recording_status':
+        [[PyTango.DevLong64,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          2],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames recorded, frames not recorded (file full)',
+         }],
+        'replay_speed':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': '1: recorded pace, 0: as fast as possible',
+         }],
+        'replay_loop':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'replay again from the start at the end of the recording',
+         }],
+        'replay_status':
+        [[PyTango.DevLong64,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          2],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames in the recording, frames replayed',
+         }],
+        'clock_sync':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'camera clock sampled to time the frames on the host clock',
+         }],
+        'clock_sync_period':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 's',
+             'format': '',
+             'description': 'time between two camera clock samples',
+         }],
+        'clock_sync_window':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'samples of the clock drift fit',
+         }],
+        'clock_sync_status':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          8],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'samples, rejected, frequency, drift (ppm), rms and max residual, prediction error, round-trip',
+         }],
+        'callback_cpus':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'cpus of the frame callback thread, "0,2-3", empty: any',
+         }],
+        'callback_priority':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'SCHED_FIFO priority of the frame callback thread, 0: normal scheduling',
+         }],
+        'worker_cpus':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'cpus of the plugin threads, "0,2-3", empty: any',
+         }],
+        'worker_priority':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'SCHED_FIFO priority of the plugin threads, 0: normal scheduling',
+         }],
+        'thread_status':
+        [[PyTango.DevString,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          64],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'effective cpus and scheduling of each thread',
+         }],
+        'callback_duration':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          3],
+         {
+             'unit': 's',
+             'format': '',
+             'description': 'last, mean and max time spent in the frame callback',
+         }],
+        'stream_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'acquired frames streamed to disk',
+         }],
+        'stream_directory':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'directory of the stream files',
+         }],
+        'stream_prefix':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'prefix of the stream file names',
+         }],
+        'stream_frames_per_file':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames per stream file',
+         }],
+        'stream_nb_buffers':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'frames waiting for their write at most',
+         }],
+        'stream_status':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          8],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'written, dropped, errors, queue depth, max queue depth, last, mean and max latency',
+         }],
+        'preview_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'latest frame kept for the preview',
+         }],
+        'preview_max_rate':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'Hz',
+             'format': '',
+             'description': 'max preview frames per second, 0 for all',
+         }],
+        'preview_downscale':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'preview downscale factor: 1, 2, 4 or 8',
+         }],
+        'preview':
+        [[PyTango.DevUShort,
+          PyTango.IMAGE,
+          PyTango.READ,
+          4096, 4096],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'latest preview frame',
+         }],
+        'pyramid_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': '8-bit previews at 1/2, 1/4 and 1/8 scale',
+         }],
+        'pyramid_max_rate':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'Hz',
+             'format': '',
+             'description': 'max pyramid frames per second, 0 for all',
+         }],
+        'pyramid_tone_mapping':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ_WRITE,
+          3],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'black, white (0: auto), gamma',
+         }],
+        'preview_half':
+        [[PyTango.DevUChar,
+          PyTango.IMAGE,
+          PyTango.READ,
+          2048, 2048],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'latest 8-bit preview at 1/2 scale',
+         }],
+        'preview_quarter':
+        [[PyTango.DevUChar,
+          PyTango.IMAGE,
+          PyTango.READ,
+          1024, 1024],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'latest 8-bit preview at 1/4 scale',
+         }],
+        'preview_eighth':
+        [[PyTango.DevUChar,
+          PyTango.IMAGE,
+          PyTango.READ,
+          512, 512],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'latest 8-bit preview at 1/8 scale',
+         }],
+        'video_max_rate':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'Hz',
+             'format': '',
+             'description': 'max live video frames per second given to Lima, 0 for all',
+         }],
+        'accumulation':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'camera frames summed in each frame, 1 disables',
+         }],
+        'saturation_level':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'camera pixel value counted as saturated, 0 disables',
+         }],
+        'accumulation_status':
+        [[PyTango.DevLong64,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          3],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'saturated camera frames, saturated pixels, last saturated frame',
+         }],
+        'statistics_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'roi statistics computed on each frame',
+         }],
+        'statistics_rois':
+        [[PyTango.DevLong,
+          PyTango.SPECTRUM,
+          PyTango.READ_WRITE,
+          4 * 16],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'x, y, width, height of each statistics roi',
+         }],
+        'statistics':
+        [[PyTango.DevDouble,
+          PyTango.IMAGE,
+          PyTango.READ,
+          8, 16],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'per roi: frame nb, timestamp, sum, max, centroid x/y, rms x/y',
+         }],
+        'profiles_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'row and column profiles computed on each frame',
+         }],
+        'profile_cols':
+        [[PyTango.DevULong,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          16384],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'column sums of the last frame',
+         }],
+        'profile_rows':
+        [[PyTango.DevULong,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          16384],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'row sums of the last frame',
+         }],
+        'flat_field_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'dark and flat-field correction of the frames',
+         }],
+        'bad_pixels_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'replacement of the bad pixels by their neighbours',
+         }],
+        'nb_bad_pixels':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'number of bad pixels of the sensor',
+         }],
+        'stop_latency':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          2],
+         {
+             'unit': 's',
+             'format': '',
+             'description': 'last and max delay from the last frame to ready',
+         }],
+        'software_bin':
+        [[PyTango.DevLong,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          2],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'software part of the binning, x and y',
+         }],
+        'software_bin_mode':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'SUM or MEAN of the software binned pixels',
+         }],
+        'output_depth':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'bits',
+             'format': '',
+             'description': '8, 16 or 32 bit output, 0 for the camera depth',
+         }],
+        'overrun_policy':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'STOP, DROP or DECIMATE when no buffer is free',
+         }],
+        'overrun_decimation':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'one frame kept out of n in DECIMATE policy',
+         }],
+        'overrun_status':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          7],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'capacity, high-water mark, overruns, dropped, decimated, first and last overrun time (s)',
+         }],
+        'acq_prediction':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ,
+          5],
+         {
+             'unit': 'N/A',
+             'format': '',
+             'description': 'predicted fps, requested fps, link utilisation, data rate (bytes/s), buffer memory (bytes)',
+         }],
     }
 
     def __init__(self,name) :
@@ -138,15 +1415,23 @@ class ProsilicaClass(PyTango.DeviceClass):
 #----------------------------------------------------------------------------
 _ProsilicaCam = None
 _ProsilicaInterface = None
+_ProsilicaControl = None
+_ProsilicaTracker = None
 
 def get_control(cam_ip_address = "0",**keys) :
     print ("cam_ip_address",cam_ip_address)
     global _ProsilicaCam
     global _ProsilicaInterface
+    global _ProsilicaControl
+    global _ProsilicaTracker
     if _ProsilicaCam is None:
         _ProsilicaCam = ProsilicaAcq.Camera(cam_ip_address)
         _ProsilicaInterface = ProsilicaAcq.Interface(_ProsilicaCam)
-    return Core.CtControl(_ProsilicaInterface)
+    if _ProsilicaControl is None:
+        _ProsilicaControl = Core.CtControl(_ProsilicaInterface)
+        _ProsilicaTracker = ProsilicaAcq.ImageStatusTracker(_ProsilicaCam)
+        _ProsilicaControl.registerImageStatusCallback(_ProsilicaTracker)
+    return _ProsilicaControl
 
 def get_tango_specific_class_n_device():
     return ProsilicaClass,Prosilica